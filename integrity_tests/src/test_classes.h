@@ -2,7 +2,11 @@
 #include <render/renderer.h>
 #include <volume/gradient_volume.h>
 #include <volume/volume.h>
+#include <cstdint>
+#include <glm/vec3.hpp>
+#include <random>
 #include <utility>
+#include <vector>
 
 #define provide_member_function_access(func_name)      \
     template <typename... Args>                        \
@@ -36,6 +40,9 @@ public:
     provide_static_member_function_access(cubicInterpolate)
     provide_const_member_function_access(biCubicInterpolate)
     provide_const_member_function_access(getSampleTriCubicInterpolation)
+
+    const std::vector<float>& test_data() const { return m_data; }
+    const std::vector<int>& test_histogram() const { return m_histogram; }
 };
 
 class TestGradientVolume : public volume::GradientVolume {
@@ -44,6 +51,8 @@ public:
 
     provide_static_member_function_access(linearInterpolate)
     provide_const_member_function_access(getGradientLinearInterpolate)
+
+    const std::vector<volume::GradientVoxel>& test_data() const { return m_data; }
 };
 
 class TestRenderer : public render::Renderer {
@@ -57,5 +66,37 @@ public:
     provide_member_function_access(traceRayTF2D)
 
     provide_member_function_access(bisectionAccuracy)
+    provide_member_function_access(analyticIntersection)
     provide_member_function_access(computePhongShading)
-};
\ No newline at end of file
+};
+
+// Pseudo random numbers for the tests. Every test seeds its own generator with a seed that no other test uses, so the
+// tests do not share sequences and stay reproducible.
+class TestRandom {
+public:
+    explicit TestRandom(uint32_t seed)
+        : m_engine(seed)
+    {
+    }
+
+    // Uniform in [lower, upper).
+    float uniform(float lower = 0.0f, float upper = 1.0f)
+    {
+        return std::uniform_real_distribution<float>(lower, upper)(m_engine);
+    }
+    glm::vec3 uniform(const glm::vec3& lower, const glm::vec3& upper)
+    {
+        glm::vec3 value;
+        for (int axis = 0; axis < 3; axis++)
+            value[axis] = uniform(lower[axis], upper[axis]);
+        return value;
+    }
+    // Uniform in [lower, upper].
+    int uniformInt(int lower, int upper)
+    {
+        return std::uniform_int_distribution<int>(lower, upper)(m_engine);
+    }
+
+private:
+    std::mt19937 m_engine;
+};
@@ -1,9 +1,45 @@
 // Can access the header files from the viewer...
+#include "render/clipping.h"
+#include "render/iso_intersection.h"
+#include "render/marching_cubes.h"
+#include "render/opacity_range_index.h"
+#include "render/proxy_geometry.h"
+#include "render/resolution_controller.h"
+#include "render/span_space_index.h"
+#include "render/tile_coverage.h"
 #include "test_classes.h"
 #include "ui/window.h"
+#include "util/mapped_file.h"
+#include "util/trace.h"
+#include "volume/brick_atlas.h"
+#include "volume/gpu_volume.h"
+#include "volume/min_max_table.h"
+#include "volume/texture_format.h"
+#include "volume/time_series.h"
+#include "volume/volume_pyramid.h"
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include <catch2/catch.hpp>
+#include <glm/gtc/epsilon.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include <glm/vector_relational.hpp>
 
 /*
 GradientVolume:
@@ -46,3 +82,1322 @@ TEST_CASE("Gradient Volume Tests")
     const TestGradientVolume gradient { volume };
     REQUIRE_NOTHROW(gradient.test_getGradientLinearInterpolate(glm::vec3(100.f)));
 }
+
+TEST_CASE("Volume Span Tests")
+{
+    // The views alias the storage of the volumes instead of copying it, so every call returns the same span.
+    const TestVolume ramp { std::vector<float> { 0, 1, 4, 9, 16, 25, 36, 49, 64, 81, 100, 121, 144, 169, 196, 225, 256, 289, 324, 361, 400, 441, 484, 529, 576, 625, 676 }, glm::ivec3(3) };
+    const auto data = ramp.getData();
+    REQUIRE(data.data() == ramp.test_data().data());
+    REQUIRE(data.size() == ramp.test_data().size());
+    REQUIRE(ramp.getData().data() == data.data());
+    REQUIRE(ramp.getData().size() == data.size());
+    REQUIRE(data[13] == ramp.getVoxel(1, 1, 1));
+
+    const auto histogram = ramp.histogram();
+    REQUIRE(histogram.data() == ramp.test_histogram().data());
+    REQUIRE(histogram.size() == ramp.test_histogram().size());
+    REQUIRE(ramp.histogram().data() == histogram.data());
+
+    const TestGradientVolume rampGradient { ramp };
+    const auto vec4Data = rampGradient.getVec4Data();
+    REQUIRE(static_cast<const void*>(vec4Data.data()) == static_cast<const void*>(rampGradient.test_data().data()));
+    REQUIRE(vec4Data.size() == rampGradient.test_data().size());
+    REQUIRE(rampGradient.getVec4Data().data() == vec4Data.data());
+    REQUIRE(rampGradient.getVec4Data().size() == vec4Data.size());
+    REQUIRE(vec4Data[13] == rampGradient.gradientToVec4(rampGradient.getGradient(1, 1, 1)));
+}
+
+TEST_CASE("Trace Recorder Tests")
+{
+    util::TraceRecorder& recorder = util::TraceRecorder::instance();
+    recorder.clear();
+    // Nothing is recorded until recording is enabled.
+    REQUIRE_FALSE(recorder.enabled());
+    {
+        util::ScopedTimer timer("disabled", "test");
+    }
+    REQUIRE(recorder.events().empty());
+
+    recorder.setEnabled(true);
+    {
+        util::ScopedTimer outer("outer", "test");
+        util::ScopedTimer inner("inner", "test");
+    }
+    const auto events = recorder.events();
+    REQUIRE(events.size() == 2);
+    // Inner span finishes first and is nested inside the outer span.
+    REQUIRE(std::string_view(events[0].name) == "inner");
+    REQUIRE(events[0].depth == 1);
+    REQUIRE(events[1].depth == 0);
+    REQUIRE(events[0].startMicroseconds >= events[1].startMicroseconds);
+
+    // The ring buffer keeps only the newest events.
+    recorder.setCapacity(4);
+    for (int i = 0; i < 10; i++)
+        util::ScopedTimer timer("span", "test");
+    REQUIRE(recorder.events().size() == 4);
+
+    const auto tracePath = std::filesystem::temp_directory_path() / "volvis_trace_test.json";
+    REQUIRE(recorder.exportChromeTrace(tracePath));
+    REQUIRE(std::filesystem::file_size(tracePath) > 0);
+    std::filesystem::remove(tracePath);
+    recorder.setCapacity(1 << 16);
+    recorder.setEnabled(false);
+}
+
+TEST_CASE("Brick Cache Tests")
+{
+    // Write a small .dat volume whose dimensions are not a multiple of the brick size.
+    const glm::ivec3 dim { 5, 6, 7 };
+    const auto volumePath = std::filesystem::temp_directory_path() / "volvis_brick_test.dat";
+    {
+        std::ofstream ofs(volumePath, std::ios::binary);
+        const std::array<uint16_t, 3> header { uint16_t(dim.x), uint16_t(dim.y), uint16_t(dim.z) };
+        ofs.write(reinterpret_cast<const char*>(header.data()), sizeof(header));
+        for (int z = 0; z < dim.z; z++) {
+            for (int y = 0; y < dim.y; y++) {
+                for (int x = 0; x < dim.x; x++) {
+                    const uint16_t value = uint16_t(x + 10 * y + 100 * z);
+                    ofs.write(reinterpret_cast<const char*>(&value), sizeof(value));
+                }
+            }
+        }
+    }
+
+    const volume::Volume inCore { volumePath };
+    // A budget of 0 MB keeps only a single brick resident, so every brick is loaded and evicted at least once.
+    const volume::Volume outOfCore { volumePath, volume::OutOfCoreConfig { true, 4, 0 } };
+    REQUIRE(outOfCore.isOutOfCore());
+    REQUIRE(outOfCore.brickCache()->numBricks() == glm::ivec3(2, 2, 2));
+    REQUIRE(outOfCore.dims() == inCore.dims());
+    REQUIRE(outOfCore.minimum() == inCore.minimum());
+    REQUIRE(outOfCore.maximum() == inCore.maximum());
+    REQUIRE(std::equal(std::begin(outOfCore.histogram()), std::end(outOfCore.histogram()), std::begin(inCore.histogram()), std::end(inCore.histogram())));
+
+    const volume::GradientVolume inCoreGradient { inCore };
+    const volume::GradientVolume outOfCoreGradient { outOfCore };
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++) {
+                REQUIRE(outOfCore.getVoxel(x, y, z) == inCore.getVoxel(x, y, z));
+                REQUIRE(outOfCoreGradient.getGradient(x, y, z).dir == inCoreGradient.getGradient(x, y, z).dir);
+            }
+        }
+    }
+    REQUIRE(outOfCore.brickCache()->residentBytes() <= 4 * 4 * 4 * sizeof(float));
+
+    // Headers that do not describe a brick file of bytes or uint16_ts are rejected.
+    const auto brickPath = volume::BrickCache::brickFilePath(volumePath, 4);
+    const auto readHeaderWith = [&](std::streamoff offset, auto field) {
+        const auto corruptPath = std::filesystem::temp_directory_path() / "volvis_brick_test_corrupt.bricks";
+        std::filesystem::copy_file(brickPath, corruptPath, std::filesystem::copy_options::overwrite_existing);
+        {
+            std::fstream fs(corruptPath, std::ios::binary | std::ios::in | std::ios::out);
+            fs.seekp(offset);
+            fs.write(reinterpret_cast<const char*>(&field), sizeof(field));
+        }
+        std::ifstream ifs(corruptPath, std::ios::binary);
+        volume::BrickFileHeader header;
+        const bool valid = volume::BrickCache::readBrickFileHeader(ifs, header);
+        ifs.close();
+        std::filesystem::remove(corruptPath);
+        return valid;
+    };
+    // The magic is followed by the dimensions, the brick size and the element size as int32_ts, then the minimum and
+    // the maximum as floats.
+    REQUIRE(readHeaderWith(8, 5));
+    REQUIRE_FALSE(readHeaderWith(8, 0));
+    REQUIRE_FALSE(readHeaderWith(24, 3));
+    REQUIRE_FALSE(readHeaderWith(28, 1e6f));
+    REQUIRE_FALSE(readHeaderWith(32, -1.0f));
+    REQUIRE_FALSE(readHeaderWith(32, std::numeric_limits<float>::quiet_NaN()));
+
+    // A volume file that ends early leaves neither a brick file nor a partial one behind.
+    std::filesystem::resize_file(volumePath, std::filesystem::file_size(volumePath) - 2);
+    const auto truncatedBrickPath = volume::BrickCache::brickFilePath(volumePath, 3);
+    REQUIRE_FALSE(volume::BrickCache::buildBrickFile(volumePath, truncatedBrickPath, 3));
+    REQUIRE_FALSE(std::filesystem::exists(truncatedBrickPath));
+    REQUIRE_FALSE(std::filesystem::exists(truncatedBrickPath.string() + ".partial"));
+
+    std::filesystem::remove(volumePath);
+    std::filesystem::remove(brickPath);
+}
+
+TEST_CASE("Volume Pyramid Tests")
+{
+    // 6x5x4 volume with value x + 10y + 100z, odd dimensions exercise the partial blocks at the border.
+    const glm::ivec3 dim { 6, 5, 4 };
+    std::vector<float> data;
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++)
+                data.push_back(float(x + 10 * y + 100 * z));
+        }
+    }
+    const volume::Volume volume { data, dim };
+    const volume::GradientVolume gradientVolume { volume };
+    const volume::VolumePyramid pyramid { volume, gradientVolume, 1 };
+
+    REQUIRE(pyramid.numLevels() == 4);
+    REQUIRE(&pyramid.level(0) == &volume);
+    REQUIRE(pyramid.level(1).dims() == glm::ivec3(3, 3, 2));
+    REQUIRE(pyramid.level(2).dims() == glm::ivec3(2, 2, 1));
+    REQUIRE(pyramid.level(3).dims() == glm::ivec3(1, 1, 1));
+
+    // A voxel of level 1 is the average of 2x2x2 voxels, which for a linear function is the value at the block center.
+    REQUIRE(pyramid.level(1).getVoxel(1, 1, 1) == Approx(2.5f + 10.0f * 2.5f + 100.0f * 2.5f));
+    // Border blocks only average the voxels inside the volume (y = 4).
+    REQUIRE(pyramid.level(1).getVoxel(0, 2, 0) == Approx(0.5f + 10.0f * 4.0f + 100.0f * 0.5f));
+
+    // Coordinates map to the block centers of the coarser level.
+    REQUIRE(volume::VolumePyramid::toLevelCoordinate(glm::vec3(2.5f), 1) == glm::vec3(1.0f));
+    REQUIRE(volume::VolumePyramid::toLevelCoordinate(glm::vec3(1.5f), 2) == glm::vec3(0.0f));
+
+    // Pixels smaller than a voxel use the full resolution, every doubling of the pixel size goes one level coarser.
+    REQUIRE(pyramid.selectLevel(0.5f) == 0);
+    REQUIRE(pyramid.selectLevel(1.0f) == 0);
+    REQUIRE(pyramid.selectLevel(2.0f) == 1);
+    REQUIRE(pyramid.selectLevel(5.0f) == 2);
+    REQUIRE(pyramid.selectLevel(1.0f, 1.0f) == 1);
+    REQUIRE(pyramid.selectLevel(1000.0f) == 3);
+}
+
+TEST_CASE("MinMax Table Tests")
+{
+    // 13x9x11 volume with pseudo random values, none of the cell sizes divide the dimensions.
+    const glm::ivec3 dim { 13, 9, 11 };
+    std::vector<float> data;
+    TestRandom random { 12345 };
+    for (int i = 0; i < dim.x * dim.y * dim.z; i++)
+        data.push_back(float(random.uniformInt(0, 4095)));
+    const volume::Volume volume { data, dim };
+
+    const auto bruteForce = [&](const glm::ivec3& cell, int cellSize, int padding) {
+        const glm::ivec3 lower = glm::max(cell * cellSize - padding, glm::ivec3(0));
+        const glm::ivec3 upper = glm::min((cell + 1) * cellSize + padding, dim);
+        glm::vec2 range { std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() };
+        for (int z = lower.z; z < upper.z; z++) {
+            for (int y = lower.y; y < upper.y; y++) {
+                for (int x = lower.x; x < upper.x; x++) {
+                    range.x = std::min(range.x, volume.getVoxel(x, y, z));
+                    range.y = std::max(range.y, volume.getVoxel(x, y, z));
+                }
+            }
+        }
+        return range;
+    };
+    const auto requireEqual = [&](const volume::MinMaxTable& table) {
+        REQUIRE(table.size() == (dim + glm::ivec3(table.cellSize() - 1)) / table.cellSize());
+        for (int z = 0; z < table.size().z; z++) {
+            for (int y = 0; y < table.size().y; y++) {
+                for (int x = 0; x < table.size().x; x++)
+                    REQUIRE(table.minMax(glm::ivec3(x, y, z)) == bruteForce(glm::ivec3(x, y, z), table.cellSize(), table.padding()));
+            }
+        }
+    };
+
+    for (const auto& [cellSize, padding] : { std::pair { 1, 0 }, std::pair { 4, 0 }, std::pair { 4, 2 }, std::pair { 5, 1 }, std::pair { 16, 2 } })
+        requireEqual(volume::MinMaxTable(volume, cellSize, padding));
+
+    // Coarser tables derived from a finer one match a scan of the volume.
+    const volume::MinMaxTable fine { volume, 2, 1 };
+    REQUIRE(fine.canCoarsen(4, 1));
+    REQUIRE(fine.canCoarsen(6, 3));
+    REQUIRE_FALSE(fine.canCoarsen(5, 1));
+    REQUIRE_FALSE(fine.canCoarsen(4, 2));
+    REQUIRE_FALSE(fine.canCoarsen(4, 0));
+    requireEqual(fine.coarsen(4, 1));
+    requireEqual(fine.coarsen(6, 3));
+    requireEqual(fine.coarsen(16, 5));
+}
+
+TEST_CASE("Brick Atlas Tests")
+{
+    const auto capacity = [](const std::vector<glm::ivec3>& atlas) {
+        long long numSlots = 0;
+        for (const glm::ivec3& sizeInBricks : atlas)
+            numSlots += static_cast<long long>(sizeInBricks.x) * sizeInBricks.y * sizeInBricks.z;
+        return numSlots;
+    };
+
+    // The example from the assignment: 10 bricks fit into a permutation of 5x2x1 without waste.
+    const glm::ivec3 tenBricks = volume::fitBricksInCuboid(10, 16);
+    REQUIRE(tenBricks.x * tenBricks.y * tenBricks.z == 10);
+    REQUIRE(std::max(tenBricks.x, std::max(tenBricks.y, tenBricks.z)) == 5);
+    REQUIRE(volume::fitBricksInCuboid(16 * 16 * 16, 16) == glm::ivec3(16));
+    REQUIRE(volume::fitBricksInCuboid(16 * 16 * 16 + 1, 16) == glm::ivec3(0));
+
+    // All brick counts that need up to four textures of 16^3 bricks (like 2048^3 textures of 128^3 bricks).
+    const int maxExtent = 16;
+    const int cubeCapacity = maxExtent * maxExtent * maxExtent;
+    double minEfficiency = 1.0;
+    double sumEfficiency = 0.0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int N = 1; N <= volume::maxBrickAtlasTextures * cubeCapacity; N++) {
+        const std::vector<glm::ivec3> atlas = volume::packBrickAtlas(N, maxExtent);
+        REQUIRE(int(atlas.size()) == (N + cubeCapacity - 1) / cubeCapacity);
+        REQUIRE(capacity(atlas) >= N);
+        for (const glm::ivec3& sizeInBricks : atlas) {
+            REQUIRE(glm::all(glm::greaterThan(sizeInBricks, glm::ivec3(0))));
+            REQUIRE(glm::all(glm::lessThanEqual(sizeInBricks, glm::ivec3(maxExtent))));
+        }
+        const double efficiency = double(N) / double(capacity(atlas));
+        if (N >= 64)
+            minEfficiency = std::min(minEfficiency, efficiency);
+        sumEfficiency += efficiency;
+    }
+    const double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    REQUIRE(minEfficiency > 0.9);
+    REQUIRE(sumEfficiency / (volume::maxBrickAtlasTextures * cubeCapacity) > 0.99);
+    // 16384 packings, about a microsecond each in an optimized build.
+    REQUIRE(elapsedMs < 2000.0);
+
+    // Brick counts that do not fit get all textures at the maximum size.
+    const std::vector<glm::ivec3> overfull = volume::packBrickAtlas(volume::maxBrickAtlasTextures * cubeCapacity + 1, maxExtent);
+    REQUIRE(overfull.size() == size_t(volume::maxBrickAtlasTextures));
+    REQUIRE(capacity(overfull) == volume::maxBrickAtlasTextures * cubeCapacity);
+}
+
+TEST_CASE("Texture Format Tests")
+{
+    const auto toTexels = [](const std::vector<float>& values, volume::TextureFormat format, auto texel) {
+        std::vector<decltype(texel)> texels(values.size());
+        volume::convertToTexels(values.data(), values.size(), format, reinterpret_cast<std::byte*>(texels.data()));
+        return texels;
+    };
+
+    // Values are rounded and clamped to the integer range of the normalized formats.
+    REQUIRE(toTexels({ -3.0f, 0.0f, 0.4f, 0.6f, 127.5f, 254.6f, 255.0f, 300.0f }, volume::TextureFormat::R8, uint8_t())
+        == std::vector<uint8_t> { 0, 0, 0, 1, 128, 255, 255, 255 });
+    REQUIRE(toTexels({ -1.0f, 1000.4f, 65535.4f, 70000.0f }, volume::TextureFormat::R16, uint16_t())
+        == std::vector<uint16_t> { 0, 1000, 65535, 65535 });
+
+    // A sample of a normalized texture returns texel / 255 or texel / 65535, the value scale turns it back into the
+    // integer value that was uploaded.
+    std::vector<float> integers(65536);
+    for (size_t i = 0; i < integers.size(); i++)
+        integers[i] = float(i);
+    const std::vector<float> bytes(std::begin(integers), std::begin(integers) + 256);
+    const std::vector<uint8_t> r8 = toTexels(bytes, volume::TextureFormat::R8, uint8_t());
+    for (size_t i = 0; i < bytes.size(); i++)
+        REQUIRE(float(r8[i]) / 255.0f * volume::textureValueScale(volume::TextureFormat::R8) == Approx(bytes[i]).margin(1e-3f));
+    const std::vector<uint16_t> r16 = toTexels(integers, volume::TextureFormat::R16, uint16_t());
+    for (size_t i = 0; i < integers.size(); i++)
+        REQUIRE(float(r16[i]) / 65535.0f * volume::textureValueScale(volume::TextureFormat::R16) == Approx(integers[i]).margin(1e-2f));
+
+    // Half floats hold the integers up to 2048 exactly and other values with 10 bits of mantissa.
+    REQUIRE(volume::textureValueScale(volume::TextureFormat::R16F) == 1.0f);
+    const std::vector<float> smallIntegers(std::begin(integers), std::begin(integers) + 2049);
+    const std::vector<uint16_t> halfIntegers = toTexels(smallIntegers, volume::TextureFormat::R16F, uint16_t());
+    for (size_t i = 0; i < smallIntegers.size(); i++)
+        REQUIRE(glm::unpackHalf1x16(halfIntegers[i]) == smallIntegers[i]);
+    TestRandom random { 8642 };
+    std::vector<float> values(1000);
+    for (float& value : values)
+        value = random.uniform(-1000.0f, 1000.0f);
+    const std::vector<uint16_t> halfValues = toTexels(values, volume::TextureFormat::R16F, uint16_t());
+    for (size_t i = 0; i < values.size(); i++)
+        REQUIRE(std::abs(glm::unpackHalf1x16(halfValues[i]) - values[i]) <= std::abs(values[i]) / 1024.0f);
+
+    REQUIRE(toTexels(values, volume::TextureFormat::R32F, float()) == values);
+}
+
+// Needs an OpenGL 3.3 context and opens a window for it, run with: IntegrityTests "[.gl]"
+TEST_CASE("GPU Volume Texture Format Tests", "[.gl]")
+{
+    const ui::Window window { "Integrity Tests", glm::ivec2(64) };
+
+    // The volume texture read back as floats holds the samples of the shaders, which multiply them by the value scale.
+    const auto readBack = [](GLuint texId, float valueScale, size_t numVoxels) {
+        std::vector<float> samples(numVoxels);
+        glBindTexture(GL_TEXTURE_3D, texId);
+        glGetTexImage(GL_TEXTURE_3D, 0, GL_RED, GL_FLOAT, samples.data());
+        glBindTexture(GL_TEXTURE_3D, 0);
+        for (float& sample : samples)
+            sample *= valueScale;
+        return samples;
+    };
+    const glm::ivec3 dim { 8, 8, 4 };
+    const size_t numVoxels = size_t(dim.x * dim.y * dim.z);
+
+    // An 8 bit file is stored as R8.
+    const auto filePath = std::filesystem::temp_directory_path() / "volvis_texture_format_test.fld";
+    {
+        std::ofstream ofs(filePath, std::ios::binary);
+        ofs << "ndim=3\ndim1=" << dim.x << "\ndim2=" << dim.y << "\ndim3=" << dim.z << "\nnspace=3\nveclen=1\ndata=byte\nfield=uniform\n\f\f";
+        for (size_t i = 0; i < numVoxels; i++)
+            ofs.put(static_cast<char>(i));
+    }
+    {
+        const volume::Volume bytes { filePath };
+        const volume::GPUVolume gpuVolume { &bytes };
+        REQUIRE(gpuVolume.getValueScale() == volume::textureValueScale(volume::TextureFormat::R8));
+        const std::vector<float> samples = readBack(gpuVolume.getTexId(), gpuVolume.getValueScale(), numVoxels);
+        for (size_t i = 0; i < numVoxels; i++)
+            REQUIRE(samples[i] == Approx(bytes.getData()[i]).margin(1e-3f));
+    }
+    std::filesystem::remove(filePath);
+
+    // Volumes that are not loaded from a file count as 16 bit, integer values are stored as R16.
+    std::vector<float> shorts(numVoxels);
+    for (size_t i = 0; i < numVoxels; i++)
+        shorts[i] = float(i * 257);
+    {
+        const volume::Volume volume { shorts, dim };
+        const volume::GPUVolume gpuVolume { &volume };
+        REQUIRE(gpuVolume.getValueScale() == volume::textureValueScale(volume::TextureFormat::R16));
+        const std::vector<float> samples = readBack(gpuVolume.getTexId(), gpuVolume.getValueScale(), numVoxels);
+        for (size_t i = 0; i < numVoxels; i++)
+            REQUIRE(samples[i] == Approx(shorts[i]).margin(1e-2f));
+    }
+
+    // Volumes only get R16F for values outside of the 16 bit range, e.g. negative ones, which the histogram of a Volume
+    // does not support. The R16F storage is read back from a texture of its own.
+    TestRandom random { 9753 };
+    std::vector<float> values(numVoxels);
+    for (float& value : values)
+        value = random.uniform(-1000.0f, 1000.0f);
+    {
+        const volume::Texture texture { values, dim, volume::TextureFormat::R16F };
+        const std::vector<float> samples = readBack(texture.getTexId(), volume::textureValueScale(volume::TextureFormat::R16F), numVoxels);
+        for (size_t i = 0; i < numVoxels; i++)
+            REQUIRE(std::abs(samples[i] - values[i]) <= std::abs(values[i]) / 1024.0f);
+    }
+}
+
+// Needs an OpenGL 3.3 context and opens a window for it, run with: IntegrityTests "[.gl]"
+TEST_CASE("Texture Streaming Tests", "[.gl]")
+{
+    const ui::Window window { "Integrity Tests", glm::ivec2(64) };
+    const auto readBack = [](const volume::Texture& texture) {
+        const glm::ivec3 dims = texture.getDims();
+        std::vector<float> texels(size_t(dims.x * dims.y * dims.z));
+        glBindTexture(GL_TEXTURE_3D, texture.getTexId());
+        glGetTexImage(GL_TEXTURE_3D, 0, GL_RED, GL_FLOAT, texels.data());
+        glBindTexture(GL_TEXTURE_3D, 0);
+        return texels;
+    };
+    TestRandom random { 2469 };
+    const auto randomValues = [&](glm::ivec3 dims) {
+        std::vector<float> values(size_t(dims.x * dims.y * dims.z));
+        for (float& value : values)
+            value = random.uniform(0.0f, 1000.0f);
+        return values;
+    };
+
+    // 300 slices of 16 KB are uploaded in a chunk of 256 slices and one of 44 through both streaming buffers.
+    const glm::ivec3 dims { 64, 64, 300 };
+    const std::vector<float> first = randomValues(dims);
+    volume::Texture texture { first, dims };
+    REQUIRE(readBack(texture) == first);
+
+    // Copies share the texture and its streaming buffers, an update with the same dimensions keeps the storage.
+    volume::Texture copy { texture };
+    const std::vector<float> second = randomValues(dims);
+    copy.update(second, dims);
+    REQUIRE(copy.getTexId() == texture.getTexId());
+    REQUIRE(readBack(texture) == second);
+
+    // A box of the data replaces the same box of the texture.
+    const std::vector<float> third = randomValues(dims);
+    const glm::ivec3 offset { 3, 5, 250 };
+    const glm::ivec3 size { 20, 30, 40 };
+    texture.updateSubRegion(third, dims, offset, size);
+    const std::vector<float> updated = readBack(texture);
+    for (int z = 0; z < dims.z; z++) {
+        for (int y = 0; y < dims.y; y++) {
+            for (int x = 0; x < dims.x; x++) {
+                const glm::ivec3 voxel { x, y, z };
+                const size_t i = size_t((z * dims.y + y) * dims.x + x);
+                const bool inside = glm::all(glm::greaterThanEqual(voxel, offset)) && glm::all(glm::lessThan(voxel, offset + size));
+                REQUIRE(updated[i] == (inside ? third[i] : second[i]));
+            }
+        }
+    }
+
+    // Other dimensions need buffers of another size.
+    const glm::ivec3 smallDims { 16, 12, 8 };
+    const std::vector<float> small = randomValues(smallDims);
+    texture.update(small, smallDims);
+    REQUIRE(readBack(texture) == small);
+}
+
+TEST_CASE("Proxy Geometry Tests")
+{
+    // A fully active grid is a single box.
+    const glm::ivec3 gridSize { 7, 5, 6 };
+    const size_t numBlocks = size_t(gridSize.x * gridSize.y * gridSize.z);
+    render::ActiveMask allActive(numBlocks);
+    for (size_t i = 0; i < numBlocks; i++)
+        allActive.set(i, true);
+    const auto allBoxes = render::mergeActiveBlocks(allActive, gridSize);
+    REQUIRE(allBoxes.size() == 1);
+    REQUIRE(allBoxes[0].origin == glm::ivec3(0));
+    REQUIRE(allBoxes[0].size == gridSize);
+    REQUIRE(render::mergeActiveBlocks(render::ActiveMask(numBlocks), gridSize).empty());
+
+    // Random grids are covered exactly once by the boxes, active blocks only.
+    TestRandom random { 4321 };
+    for (int density : { 10, 50, 90 }) {
+        render::ActiveMask blockActive(numBlocks);
+        std::vector<int> expectedCount;
+        for (size_t i = 0; i < numBlocks; i++) {
+            blockActive.set(i, random.uniformInt(0, 99) < density);
+            expectedCount.push_back(blockActive[i]);
+        }
+        std::vector<int> coverCount(numBlocks, 0);
+        const auto boxes = render::mergeActiveBlocks(blockActive, gridSize);
+        for (const render::BlockBox& box : boxes) {
+            REQUIRE(glm::all(glm::greaterThan(box.size, glm::ivec3(0))));
+            REQUIRE(glm::all(glm::lessThanEqual(box.origin + box.size, gridSize)));
+            for (int z = box.origin.z; z < box.origin.z + box.size.z; z++) {
+                for (int y = box.origin.y; y < box.origin.y + box.size.y; y++) {
+                    for (int x = box.origin.x; x < box.origin.x + box.size.x; x++)
+                        coverCount[(size_t(z) * size_t(gridSize.y) + size_t(y)) * size_t(gridSize.x) + size_t(x)]++;
+                }
+            }
+        }
+        REQUIRE(coverCount == expectedCount);
+        REQUIRE(boxes.size() <= blockActive.count());
+    }
+}
+
+TEST_CASE("Opacity Range Index Tests")
+{
+    // Compare against scanning the entries of the range, for transfer functions of different resolutions.
+    TestRandom random { 8765 };
+    for (size_t tfSize : { size_t(1), size_t(100), size_t(256), size_t(1000) }) {
+        std::vector<glm::vec4> colorMap(tfSize, glm::vec4(1.0f));
+        for (glm::vec4& color : colorMap)
+            color.a = random.uniformInt(0, 3) == 0 ? 0.5f : 0.0f;
+        const float indexStart = -10.0f, indexRange = 50.0f;
+        const render::OpacityRangeIndex opacityIndex { colorMap, indexStart, indexRange };
+        REQUIRE(opacityIndex.size() == tfSize);
+
+        const auto entryIndex = [&](float value) {
+            const float range01 = (value - indexStart) / indexRange;
+            return std::clamp(int(range01 * float(tfSize)), 0, int(tfSize) - 1);
+        };
+        for (int i = 0; i < 200; i++) {
+            const float a = random.uniform(indexStart, indexStart + indexRange);
+            const float b = random.uniform(indexStart, indexStart + indexRange);
+            const float minValue = std::min(a, b), maxValue = std::max(a, b);
+
+            bool expected = false;
+            for (int entry = entryIndex(minValue); entry <= entryIndex(maxValue); entry++)
+                expected |= colorMap[size_t(entry)].a > 0.0f;
+            REQUIRE(opacityIndex.anyOpacity(minValue, maxValue) == expected);
+        }
+    }
+
+    // The parallel classification matches the per range test, also for a partial last word.
+    render::RenderConfig config {};
+    config.renderMode = render::RenderMode::RenderComposite;
+    config.tfColorMap.fill(glm::vec4(0.0f));
+    config.tfColorMap[128].a = 1.0f;
+    config.tfColorMapIndexStart = 0.0f;
+    config.tfColorMapIndexRange = 256.0f;
+    const render::OpacityRangeIndex opacityIndex { config.tfColorMap, config.tfColorMapIndexStart, config.tfColorMapIndexRange };
+
+    std::vector<glm::vec2> minMaxValues;
+    for (int i = 0; i < 1000; i++) {
+        const float minValue = float(i % 250);
+        minMaxValues.emplace_back(minValue, minValue + float(i % 7));
+    }
+    for (render::RenderMode renderMode : { render::RenderMode::RenderMIP, render::RenderMode::RenderIso, render::RenderMode::RenderComposite }) {
+        config.renderMode = renderMode;
+        const render::ActiveMask mask = render::classifyValueRanges(minMaxValues, config, opacityIndex);
+        REQUIRE(mask.size() == minMaxValues.size());
+        size_t numVisible = 0;
+        for (size_t i = 0; i < minMaxValues.size(); i++) {
+            const bool visible = render::isValueRangeVisible(minMaxValues[i], config, opacityIndex);
+            REQUIRE(mask[i] == visible);
+            numVisible += visible;
+        }
+        REQUIRE(mask.count() == numVisible);
+    }
+    config.renderMode = render::RenderMode::RenderComposite;
+    REQUIRE(render::isValueRangeVisible(glm::vec2(128.2f, 128.9f), config, opacityIndex));
+    REQUIRE(render::isValueRangeVisible(glm::vec2(100.0f, 200.0f), config, opacityIndex));
+    REQUIRE(!render::isValueRangeVisible(glm::vec2(0.0f, 127.9f), config, opacityIndex));
+    REQUIRE(!render::isValueRangeVisible(glm::vec2(129.0f, 255.0f), config, opacityIndex));
+}
+
+TEST_CASE("Span Space Index Tests")
+{
+    // Compare against testing every range, with duplicates, ranges of a single value and empty ranges.
+    TestRandom random { 5432 };
+    for (size_t numRanges : { size_t(0), size_t(1), size_t(7), size_t(1000) }) {
+        std::vector<glm::vec2> minMaxValues;
+        for (size_t i = 0; i < numRanges; i++) {
+            const float a = float(random.uniformInt(0, 199));
+            const float b = float(random.uniformInt(0, 199));
+            if (i % 50 == 0)
+                minMaxValues.emplace_back(std::max(a, b), std::min(a, b) - 1.0f);
+            else if (i % 10 == 0)
+                minMaxValues.emplace_back(a, a);
+            else
+                minMaxValues.emplace_back(std::min(a, b), std::max(a, b));
+        }
+        const render::SpanSpaceIndex index { minMaxValues };
+        REQUIRE(index.size() == numRanges);
+
+        for (float value : { -1.0f, 0.0f, 0.5f, 17.0f, 99.5f, 100.0f, 150.25f, 199.0f, 250.0f }) {
+            std::vector<uint32_t> found = index.query(value);
+            std::sort(std::begin(found), std::end(found));
+            std::vector<uint32_t> expected;
+            for (size_t i = 0; i < numRanges; i++) {
+                if (minMaxValues[i].x <= value && value <= minMaxValues[i].y)
+                    expected.push_back(uint32_t(i));
+            }
+            REQUIRE(found == expected);
+
+            const render::ActiveMask mask = index.activeMask(value);
+            REQUIRE(mask.size() == numRanges);
+            REQUIRE(mask.count() == expected.size());
+            for (uint32_t i : expected)
+                REQUIRE(mask[i]);
+        }
+    }
+
+    // Iso classification through the index matches testing every range, other modes ignore the index.
+    std::vector<glm::vec2> minMaxValues;
+    for (int i = 0; i < 1000; i++) {
+        const float minValue = float(i % 250);
+        minMaxValues.emplace_back(minValue, minValue + float(i % 7));
+    }
+    const render::SpanSpaceIndex index { minMaxValues };
+    render::RenderConfig config {};
+    const render::OpacityRangeIndex opacityIndex { config.tfColorMap, config.tfColorMapIndexStart, config.tfColorMapIndexRange };
+    for (render::RenderMode renderMode : { render::RenderMode::RenderMIP, render::RenderMode::RenderIso, render::RenderMode::RenderComposite }) {
+        config.renderMode = renderMode;
+        for (float isoValue : { 0.0f, 3.5f, 95.0f, 249.0f, 300.0f }) {
+            config.isoValue = isoValue;
+            REQUIRE(render::classifyValueRanges(minMaxValues, config, opacityIndex, &index) == render::classifyValueRanges(minMaxValues, config, opacityIndex));
+        }
+    }
+}
+
+TEST_CASE("Resolution Controller Tests")
+{
+    // A renderer whose frame time scales with the number of pixels and halves per interaction level, with some noise.
+    constexpr float frameTimeTarget = 1.0f / 60.0f;
+    TestRandom random { 1357 };
+    const auto renderFrame = [&](float fullFrameTime, float resolutionScale, int interactionLevels) {
+        const float noise = random.uniform(0.98f, 1.02f);
+        return fullFrameTime * resolutionScale * resolutionScale / float(1 << interactionLevels) * noise;
+    };
+
+    for (float fullFrameTime : { 0.01f, 0.05f, 0.5f }) {
+        for (int availableLevels : { 0, 2 }) {
+            render::ResolutionController controller { frameTimeTarget };
+            float resolutionScale = 1.0f;
+            int interactionLevels = 0;
+            float settledScale = 0.0f;
+            int numScaleChanges = 0;
+            for (int frame = 0; frame < 100; frame++) {
+                controller.addFrame(renderFrame(fullFrameTime, resolutionScale, interactionLevels), resolutionScale, interactionLevels, availableLevels);
+                if (frame >= 20 && controller.resolutionScale() != resolutionScale)
+                    numScaleChanges++;
+                resolutionScale = controller.resolutionScale();
+                interactionLevels = controller.interactionLevels();
+                if (frame == 20)
+                    settledScale = resolutionScale;
+            }
+
+            // Fast frames keep the full resolution and detail, slower frames first use all levels.
+            REQUIRE(interactionLevels <= availableLevels);
+            if (fullFrameTime < frameTimeTarget) {
+                REQUIRE(interactionLevels == 0);
+                REQUIRE(resolutionScale == 1.0f);
+            } else if (resolutionScale < 1.0f) {
+                REQUIRE(interactionLevels == availableLevels);
+            }
+            // Settles close to (and not over) the target, without jumping between scales on noisy frame times.
+            const float frameTime = fullFrameTime * resolutionScale * resolutionScale / float(1 << interactionLevels);
+            if (resolutionScale > 0.125f)
+                REQUIRE(frameTime <= frameTimeTarget * 1.12f);
+            if (resolutionScale < 1.0f && resolutionScale > 0.125f)
+                REQUIRE(frameTime >= frameTimeTarget * 0.7f);
+            REQUIRE(numScaleChanges == 0);
+            REQUIRE(settledScale == resolutionScale);
+        }
+    }
+}
+
+TEST_CASE("Camera Ray Basis Tests")
+{
+    // Pinhole camera like the Trackball, rotated and with a non-square image.
+    class TestCamera : public render::RayTraceCamera {
+    public:
+        glm::vec3 position() const override { return glm::vec3(10.0f, -5.0f, 3.0f); }
+        glm::vec3 forward() const override { return m_rotation * glm::vec3(0, 0, 1); }
+        render::Ray generateRay(const glm::vec2& pixel) const override
+        {
+            const float halfHeight = std::tan(0.5f);
+            const glm::vec3 direction = glm::normalize(glm::vec3(pixel.x * 1.5f * halfHeight, pixel.y * halfHeight, 1.0f));
+            return render::Ray { position(), m_rotation * direction, 0.0f, 1.0f };
+        }
+
+    private:
+        glm::quat m_rotation = glm::angleAxis(0.7f, glm::normalize(glm::vec3(1.0f, 2.0f, -0.5f)));
+    };
+
+    const TestCamera camera;
+    const glm::ivec2 resolution { 300, 200 };
+    const render::CameraRayBasis basis = camera.rayBasis(resolution);
+    for (int y = 0; y < resolution.y; y += 7) {
+        for (int x = 0; x < resolution.x; x += 7) {
+            const render::Ray expected = camera.generateRay(glm::vec2(x, y) / glm::vec2(resolution) * 2.0f - 1.0f);
+            const render::Ray ray = basis.generateRay(x, y);
+            REQUIRE(glm::all(glm::epsilonEqual(ray.origin, expected.origin, 1e-6f)));
+            REQUIRE(glm::all(glm::epsilonEqual(ray.direction, expected.direction, 1e-5f)));
+        }
+    }
+}
+
+TEST_CASE("Tile Coverage Tests")
+{
+    // Whether the ray through the pixel hits the box in front of the camera, like the ray packets of the renderer.
+    const auto rayHitsBox = [](const render::CameraRayBasis& basis, int x, int y, const glm::vec3& lower, const glm::vec3& upper) {
+        const render::Ray ray = basis.generateRay(x, y);
+        const glm::vec3 t0 = (lower - ray.origin) / ray.direction;
+        const glm::vec3 t1 = (upper - ray.origin) / ray.direction;
+        const float tmin = glm::compMax(glm::min(t0, t1));
+        const float tmax = glm::compMin(glm::max(t0, t1));
+        return tmin <= tmax && tmax >= 0.0f;
+    };
+
+    // Cameras in front of, beside and inside of boxes, looking at points around them. A tile with a ray that hits the
+    // slightly shrunk box is never culled, and all rays of an inside tile hit the slightly grown box.
+    TestRandom random { 6420 };
+    const glm::ivec2 resolution { 64, 48 };
+    const int tileSize = 16;
+    int numOutside = 0, numInside = 0;
+    for (int camera = 0; camera < 300; camera++) {
+        const glm::vec3 lower { 0.0f };
+        const glm::vec3 upper = random.uniform(glm::vec3(10.0f), glm::vec3(100.0f));
+        const glm::vec3 origin = random.uniform(-upper, 2.0f * upper);
+        const glm::vec3 forward = glm::normalize(random.uniform(-0.5f * upper, 1.5f * upper) - origin);
+        const glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+        const glm::vec3 up = glm::cross(right, forward);
+        const float halfWidth = random.uniform(0.2f, 1.5f);
+        const float halfHeight = halfWidth * float(resolution.y) / float(resolution.x);
+        const render::CameraRayBasis basis {
+            origin, forward - halfWidth * right - halfHeight * up, 2.0f * halfWidth / float(resolution.x) * right, 2.0f * halfHeight / float(resolution.y) * up
+        };
+
+        for (int tileY = 0; tileY < resolution.y; tileY += tileSize) {
+            for (int tileX = 0; tileX < resolution.x; tileX += tileSize) {
+                const glm::ivec2 begin { tileX, tileY };
+                const glm::ivec2 end = glm::min(begin + tileSize, resolution);
+                const render::TileCoverage coverage = render::classifyTile(basis, lower, upper, begin, end);
+                numOutside += coverage == render::TileCoverage::Outside;
+                numInside += coverage == render::TileCoverage::Inside;
+                for (int y = begin.y; y < end.y; y++) {
+                    for (int x = begin.x; x < end.x; x++) {
+                        if (coverage == render::TileCoverage::Outside)
+                            REQUIRE_FALSE(rayHitsBox(basis, x, y, lower + 0.01f, upper - 0.01f));
+                        else if (coverage == render::TileCoverage::Inside)
+                            REQUIRE(rayHitsBox(basis, x, y, lower - 0.01f, upper + 0.01f));
+                    }
+                }
+            }
+        }
+    }
+    // The cameras see all kinds of tiles.
+    REQUIRE(numOutside > 0);
+    REQUIRE(numInside > 0);
+}
+
+TEST_CASE("Clipping Tests")
+{
+    render::RenderConfig config {};
+    config.clippingPlanes = true;
+    config.numClipPlanes = 2;
+    config.clipPlanes[0] = glm::vec4(1.0f, 0.0f, 0.0f, -10.0f); // keeps x >= 10
+    config.clipPlanes[1] = glm::vec4(glm::normalize(glm::vec3(-1.0f, -1.0f, 0.5f)), 20.0f);
+    const auto isKept = [&](const glm::vec3& position) {
+        for (int i = 0; i < config.numClipPlanes; i++) {
+            if (glm::dot(glm::vec3(config.clipPlanes[size_t(i)]), position) + config.clipPlanes[size_t(i)].w < 0.0f)
+                return false;
+        }
+        return true;
+    };
+
+    // The clipped interval holds exactly the kept samples of the ray.
+    TestRandom random { 2468 };
+    for (int i = 0; i < 200; i++) {
+        const glm::vec3 origin = random.uniform(glm::vec3(-5.0f), glm::vec3(35.0f));
+        const glm::vec3 direction = glm::normalize(random.uniform(glm::vec3(-1.0f), glm::vec3(1.0f)));
+        render::Ray ray { origin, direction, 0.0f, 50.0f };
+        const bool anyLeft = render::clipRayToPlanes(ray, config);
+        for (float t = 0.0f; t <= 50.0f; t += 0.25f) {
+            const glm::vec3 position = origin + t * direction;
+            // ignore samples right at a plane
+            if (std::abs(position.x - 10.0f) < 1e-3f || std::abs(glm::dot(glm::vec3(config.clipPlanes[1]), position) + config.clipPlanes[1].w) < 1e-3f)
+                continue;
+            REQUIRE(isKept(position) == (anyLeft && t >= ray.tmin && t <= ray.tmax));
+        }
+    }
+
+    // A box is clipped away exactly if all of its corners are on the cut side of one of the planes.
+    for (int i = 0; i < 200; i++) {
+        const glm::vec3 lower = random.uniform(glm::vec3(-5.0f), glm::vec3(35.0f));
+        const glm::vec3 upper = lower + random.uniform(glm::vec3(0.0f), glm::vec3(8.0f));
+        bool anyCornerKept = false;
+        bool allCutByOnePlane = false;
+        for (int plane = 0; plane < config.numClipPlanes; plane++) {
+            bool allCut = true;
+            for (int corner = 0; corner < 8; corner++) {
+                const glm::vec3 position = glm::mix(lower, upper, glm::vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1));
+                allCut &= glm::dot(glm::vec3(config.clipPlanes[size_t(plane)]), position) + config.clipPlanes[size_t(plane)].w < 0.0f;
+                anyCornerKept |= isKept(position);
+            }
+            allCutByOnePlane |= allCut;
+        }
+        const bool clippedAway = render::isBoxClippedAway(lower, upper, config);
+        REQUIRE(clippedAway == allCutByOnePlane);
+        REQUIRE((!clippedAway || !anyCornerKept));
+    }
+
+    // Only cells that overlap the region of interest are active.
+    render::RenderConfig roiConfig {};
+    roiConfig.renderMode = render::RenderMode::RenderMIP;
+    roiConfig.regionOfInterest = true;
+    roiConfig.roiLower = glm::vec3(20.0f, 0.0f, 5.0f);
+    roiConfig.roiUpper = glm::vec3(35.0f, 63.0f, 9.0f);
+    const glm::ivec3 gridSize { 8, 8, 8 };
+    const std::vector<glm::vec2> minMaxValues(size_t(gridSize.x * gridSize.y * gridSize.z), glm::vec2(0.0f, 1.0f));
+    const render::ActiveMask cellActive = render::classifyCells(minMaxValues, gridSize, 8, 1, roiConfig, render::OpacityRangeIndex());
+    for (int z = 0; z < gridSize.z; z++) {
+        for (int y = 0; y < gridSize.y; y++) {
+            for (int x = 0; x < gridSize.x; x++) {
+                const glm::ivec3 cell { x, y, z };
+                const glm::vec3 lower = glm::vec3(cell * 8 - 1), upper = glm::vec3((cell + 1) * 8 + 1);
+                const bool overlaps = glm::all(glm::lessThanEqual(lower, roiConfig.roiUpper)) && glm::all(glm::greaterThanEqual(upper, roiConfig.roiLower));
+                REQUIRE(cellActive[size_t((z * gridSize.y + y) * gridSize.x + x)] == overlaps);
+            }
+        }
+    }
+}
+
+// A rippled sphere in a volume of 40 x 36 x 32 voxels.
+static constexpr glm::ivec3 rippledSphereDims { 40, 36, 32 };
+static std::vector<float> rippledSphere()
+{
+    const glm::ivec3 dim = rippledSphereDims;
+    const glm::vec3 center { 19.4f, 17.2f, 15.7f };
+    std::vector<float> data(size_t(dim.x * dim.y * dim.z));
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++) {
+                const float ripple = 10.0f * std::sin(0.7f * float(x)) * std::cos(0.5f * float(y + z));
+                data[size_t((z * dim.y + y) * dim.x + x)] = std::max(150.0f - 8.0f * glm::distance(glm::vec3(x, y, z), center) + ripple, 0.0f);
+            }
+        }
+    }
+    return data;
+}
+
+// Rays between random points of the volume, marched with unit steps up to the first sample at or above the iso value.
+// The hit lies between that sample and the one before it.
+struct IsoHit {
+    render::Ray ray;
+    float t0, t1;
+};
+
+static std::vector<IsoHit> findIsoHits(const volume::Volume& volume, float isoValue, size_t count)
+{
+    const glm::ivec3 dim = volume.dims();
+    std::vector<IsoHit> hits;
+    TestRandom random { 3579 };
+    const auto randomPoint = [&]() { return random.uniform(glm::vec3(0.0f), glm::vec3(dim - 1)); };
+    while (hits.size() < count) {
+        const glm::vec3 origin = randomPoint();
+        const glm::vec3 direction = glm::normalize(randomPoint() - origin);
+        const render::Ray ray { origin, direction, 0.0f, 0.0f };
+        if (volume.getSampleInterpolate(origin) >= isoValue)
+            continue;
+        for (float t = 1.0f; glm::all(glm::greaterThanEqual(origin + t * direction, glm::vec3(0))) && glm::all(glm::lessThanEqual(origin + t * direction, glm::vec3(dim - 1))); t += 1.0f) {
+            if (volume.getSampleInterpolate(origin + t * direction) >= isoValue) {
+                hits.push_back(IsoHit { ray, t - 1.0f, t });
+                break;
+            }
+        }
+    }
+    return hits;
+}
+
+TEST_CASE("Iso Intersection Tests")
+{
+    volume::Volume volume { rippledSphere(), rippledSphereDims };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    const volume::GradientVolume gradient { volume };
+    TestRenderer renderer { &volume, &gradient, nullptr, render::RenderConfig {} };
+    const float isoValue = 80.0f;
+    const std::vector<IsoHit> hits = findIsoHits(volume, isoValue, 2000);
+
+    // The analytic hit is on the surface and is its first crossing, bisection stops at its tolerance of 0.01.
+    float maxAnalyticError = 0.0f, maxBisectionError = 0.0f;
+    for (const IsoHit& hit : hits) {
+        const float tAnalytic = renderer.test_analyticIntersection(hit.ray, hit.t0, hit.t1, isoValue);
+        REQUIRE(tAnalytic >= hit.t0);
+        REQUIRE(tAnalytic <= hit.t1);
+        maxAnalyticError = std::max(maxAnalyticError, std::abs(volume.getSampleInterpolate(hit.ray.origin + tAnalytic * hit.ray.direction) - isoValue));
+        for (float t = hit.t0; t < tAnalytic - 0.01f; t += 0.005f)
+            REQUIRE(volume.getSampleInterpolate(hit.ray.origin + t * hit.ray.direction) < isoValue + 0.001f);
+
+        const float tBisection = renderer.test_bisectionAccuracy(hit.ray, hit.t0, hit.t1, isoValue);
+        maxBisectionError = std::max(maxBisectionError, std::abs(volume.getSampleInterpolate(hit.ray.origin + tBisection * hit.ray.direction) - isoValue));
+    }
+    REQUIRE(maxAnalyticError < 0.001f);
+    REQUIRE(maxBisectionError < 0.011f);
+
+    // Nearest neighbour interpolation has no cells to solve in and is bisected.
+    volume.interpolationMode = volume::InterpolationMode::NearestNeighbour;
+    for (size_t i = 0; i < hits.size(); i += 100)
+        REQUIRE(renderer.test_analyticIntersection(hits[i].ray, hits[i].t0, hits[i].t1, isoValue) == renderer.test_bisectionAccuracy(hits[i].ray, hits[i].t0, hits[i].t1, isoValue));
+
+    // The depth of a traced ray is where it hits the surface, rays that end before the surface have none.
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    render::RenderConfig config {};
+    config.isoValue = isoValue;
+    config.analyticIntersection = true;
+    TestRenderer isoRenderer { &volume, &gradient, nullptr, config };
+    for (size_t i = 0; i < hits.size(); i += 10) {
+        render::Ray ray = hits[i].ray;
+        ray.tmax = hits[i].t1;
+        float depth = 0.0f;
+        REQUIRE(isoRenderer.test_traceRayISO(ray, 1.0f, &depth).a == 1.0f);
+        REQUIRE(depth != render::Renderer::noHitDepth);
+        REQUIRE(std::abs(volume.getSampleInterpolate(ray.origin + depth * ray.direction) - isoValue) < 0.001f);
+
+        ray.tmax = 0.5f;
+        REQUIRE(isoRenderer.test_traceRayISO(ray, 1.0f, &depth) == glm::vec4(0.0f));
+        REQUIRE(depth == render::Renderer::noHitDepth);
+    }
+}
+
+// Hidden from the default run, run with: IntegrityTests "[.benchmark]"
+TEST_CASE("Iso Intersection Benchmark", "[.benchmark]")
+{
+    volume::Volume volume { rippledSphere(), rippledSphereDims };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    const volume::GradientVolume gradient { volume };
+    TestRenderer renderer { &volume, &gradient, nullptr, render::RenderConfig {} };
+    const float isoValue = 80.0f;
+    const std::vector<IsoHit> hits = findIsoHits(volume, isoValue, 2000);
+
+    // Throughput of both on the same hits.
+    const auto time = [&](auto&& refine) {
+        const auto start = std::chrono::steady_clock::now();
+        float sum = 0.0f;
+        for (int repeat = 0; repeat < 20; repeat++) {
+            for (const IsoHit& hit : hits)
+                sum += refine(hit);
+        }
+        REQUIRE(std::isfinite(sum));
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    const double analyticMs = time([&](const IsoHit& hit) { return renderer.test_analyticIntersection(hit.ray, hit.t0, hit.t1, isoValue); });
+    const double bisectionMs = time([&](const IsoHit& hit) { return renderer.test_bisectionAccuracy(hit.ray, hit.t0, hit.t1, isoValue); });
+    WARN("Iso intersection of " << 20 * hits.size() << " hits: analytic " << analyticMs << "ms, bisection " << bisectionMs << "ms");
+}
+
+TEST_CASE("Marching Cubes Tests")
+{
+    // A sphere inside the volume, spanning several slabs of cells in z.
+    const glm::ivec3 dim { 30, 27, 41 };
+    const glm::vec3 center { 14.3f, 13.1f, 20.6f };
+    std::vector<float> data(size_t(dim.x * dim.y * dim.z));
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++)
+                data[size_t((z * dim.y + y) * dim.x + x)] = std::max(200.0f - 10.0f * glm::distance(glm::vec3(x, y, z), center), 0.0f);
+        }
+    }
+    const volume::Volume volume { data, dim };
+    const volume::GradientVolume gradientVolume { volume };
+    const float radius = 11.3f;
+    const render::IsoSurfaceMesh mesh = render::extractIsoSurface(volume, gradientVolume, 200.0f - 10.0f * radius);
+    REQUIRE(mesh.positions.size() == mesh.normals.size());
+    REQUIRE(!mesh.indices.empty());
+    REQUIRE(mesh.indices.size() % 3 == 0);
+
+    // Every directed edge is used once and its reverse once: the mesh is closed and consistently oriented.
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    std::vector<bool> vertexUsed(mesh.positions.size(), false);
+    for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+        for (size_t j = 0; j < 3; j++) {
+            REQUIRE(mesh.indices[i + j] < mesh.positions.size());
+            edges.emplace_back(mesh.indices[i + j], mesh.indices[i + (j + 1) % 3]);
+            vertexUsed[mesh.indices[i + j]] = true;
+        }
+
+        // triangles face the lower values
+        const glm::vec3 p0 = mesh.positions[mesh.indices[i]];
+        const glm::vec3 faceNormal = glm::cross(mesh.positions[mesh.indices[i + 1]] - p0, mesh.positions[mesh.indices[i + 2]] - p0);
+        REQUIRE(glm::dot(faceNormal, p0 - center) >= 0.0f);
+    }
+    std::sort(std::begin(edges), std::end(edges));
+    REQUIRE(std::adjacent_find(std::begin(edges), std::end(edges)) == std::end(edges));
+    for (const auto& [from, to] : edges)
+        REQUIRE(std::binary_search(std::begin(edges), std::end(edges), std::pair(to, from)));
+    REQUIRE(std::all_of(std::begin(vertexUsed), std::end(vertexUsed), [](bool used) { return used; }));
+
+    // A sphere has Euler characteristic 2.
+    const long long numVertices = static_cast<long long>(mesh.positions.size());
+    const long long numEdges = static_cast<long long>(edges.size()) / 2;
+    const long long numFaces = static_cast<long long>(mesh.indices.size()) / 3;
+    REQUIRE(numVertices - numEdges + numFaces == 2);
+
+    // The vertices are on the sphere (up to the linear interpolation) and the normals point inwards (to higher values).
+    for (size_t i = 0; i < mesh.positions.size(); i++) {
+        REQUIRE(std::abs(glm::distance(mesh.positions[i], center) - radius) < 0.1f);
+        REQUIRE(glm::dot(mesh.normals[i], glm::normalize(center - mesh.positions[i])) > 0.95f);
+    }
+
+    // Noise has many ambiguous faces, the mesh is still closed as long as the surface does not reach the border.
+    const glm::ivec3 noiseDim { 20, 19, 35 };
+    std::vector<float> noise(size_t(noiseDim.x * noiseDim.y * noiseDim.z), 0.0f);
+    TestRandom random { 97531 };
+    for (int z = 1; z < noiseDim.z - 1; z++) {
+        for (int y = 1; y < noiseDim.y - 1; y++) {
+            for (int x = 1; x < noiseDim.x - 1; x++)
+                noise[size_t((z * noiseDim.y + y) * noiseDim.x + x)] = float(random.uniformInt(0, 255));
+        }
+    }
+    const volume::Volume noiseVolume { noise, noiseDim };
+    const volume::GradientVolume noiseGradientVolume { noiseVolume };
+    const render::IsoSurfaceMesh noiseMesh = render::extractIsoSurface(noiseVolume, noiseGradientVolume, 128.0f);
+    std::vector<std::pair<uint32_t, uint32_t>> noiseEdges;
+    for (size_t i = 0; i < noiseMesh.indices.size(); i += 3) {
+        for (size_t j = 0; j < 3; j++)
+            noiseEdges.emplace_back(noiseMesh.indices[i + j], noiseMesh.indices[i + (j + 1) % 3]);
+    }
+    std::sort(std::begin(noiseEdges), std::end(noiseEdges));
+    REQUIRE(std::adjacent_find(std::begin(noiseEdges), std::end(noiseEdges)) == std::end(noiseEdges));
+    for (const auto& [from, to] : noiseEdges)
+        REQUIRE(std::binary_search(std::begin(noiseEdges), std::end(noiseEdges), std::pair(to, from)));
+
+    // Cached meshes are shared until they are evicted.
+    render::IsoSurfaceMeshCache cache { &volume, &gradientVolume, 2 };
+    const auto first = cache.mesh(100.0f);
+    REQUIRE(cache.mesh(100.0f) == first);
+    cache.mesh(120.0f);
+    REQUIRE(cache.mesh(100.0f) == first);
+    cache.mesh(140.0f);
+    cache.mesh(160.0f);
+    REQUIRE(cache.mesh(100.0f) != first);
+    REQUIRE(cache.mesh(100.0f)->indices == first->indices);
+
+    // Iso values that round to the same step share a mesh, which is the surface at the rounded value.
+    const float isoValueStep = (volume.maximum() - volume.minimum()) / float(render::IsoSurfaceMeshCache::isoValueSteps);
+    REQUIRE(cache.mesh(100.001f) == cache.mesh(100.0f));
+    REQUIRE(cache.mesh(100.001f)->isoValue == cache.roundIsoValue(100.0f));
+    REQUIRE(std::abs(cache.roundIsoValue(100.0f) - 100.0f) <= 0.5f * isoValueStep);
+    REQUIRE(cache.mesh(100.0f + isoValueStep) != cache.mesh(100.0f));
+}
+
+// Noise with lines shorter (x, y) and longer (z) than the truncated initial value of the prefilter.
+static constexpr glm::ivec3 cubicNoiseDims { 9, 7, 40 };
+static std::vector<float> cubicNoise(uint32_t seed)
+{
+    std::vector<float> data(size_t(cubicNoiseDims.x * cubicNoiseDims.y * cubicNoiseDims.z));
+    TestRandom random { seed };
+    for (float& voxel : data)
+        voxel = float(random.uniformInt(0, 255));
+    return data;
+}
+
+// Weights the 64 B-spline coefficients around the position one by one.
+static float sampleTriCubic64(const TestVolume& volume, const glm::vec3& position)
+{
+    const int z = static_cast<int>(position.z);
+    return TestVolume::test_cubicInterpolate(
+        volume.test_biCubicInterpolate(glm::vec2(position), z - 1), volume.test_biCubicInterpolate(glm::vec2(position), z),
+        volume.test_biCubicInterpolate(glm::vec2(position), z + 1), volume.test_biCubicInterpolate(glm::vec2(position), z + 2), position.z - float(z));
+}
+
+// Volumes can be moved, the B-spline coefficients are not computed lazily behind a synchronization primitive.
+static_assert(std::is_move_constructible_v<volume::Volume>);
+
+TEST_CASE("Cubic Interpolation Tests")
+{
+    const glm::ivec3 dim = cubicNoiseDims;
+    TestVolume volume { cubicNoise(7531), dim };
+    TestRandom random { 7532 };
+
+    // The coefficients are only computed when cubic interpolation is selected, cubic samples are linear until then.
+    volume.interpolationMode = volume::InterpolationMode::Cubic;
+    REQUIRE(volume.bsplineCoefficients().empty());
+    REQUIRE(volume.getSampleInterpolate(glm::vec3(2.3f, 4.1f, 17.8f)) == volume.test_getSampleTriLinearInterpolation(glm::vec3(2.3f, 4.1f, 17.8f)));
+    volume.updateInterpolation();
+    REQUIRE(volume.bsplineCoefficients().size() == volume.getData().size());
+
+    // The B-spline weights of the 4 coefficients around a position sum up to 1.
+    for (float f = 0.0f; f < 1.0f; f += 0.125f)
+        REQUIRE(TestVolume::test_weight(f + 1.0f) + TestVolume::test_weight(f) + TestVolume::test_weight(1.0f - f) + TestVolume::test_weight(2.0f - f) == Approx(1.0f));
+
+    // The prefiltered spline passes through the voxels, except for the outermost ones where the lookups clamp instead of
+    // mirroring the coefficients.
+    for (int z = 1; z < dim.z - 1; z++) {
+        for (int y = 1; y < dim.y - 1; y++) {
+            for (int x = 1; x < dim.x - 1; x++)
+                REQUIRE(volume.getSampleInterpolate(glm::vec3(x, y, z)) == Approx(volume.getVoxel(x, y, z)).margin(0.01f));
+        }
+    }
+
+    // The 8 trilinear lookups give the same samples as weighting the 64 coefficients one by one.
+    std::vector<glm::vec3> positions;
+    for (int i = 0; i < 20000; i++)
+        positions.push_back(random.uniform(glm::vec3(0.0f), glm::vec3(dim - 1)));
+    for (const glm::vec3& position : positions)
+        REQUIRE(volume.test_getSampleTriCubicInterpolation(position) == Approx(sampleTriCubic64(volume, position)).margin(0.01f));
+    REQUIRE(volume.getSampleInterpolate(glm::vec3(-0.5f, 3.0f, 3.0f)) == 0.0f);
+}
+
+// Hidden from the default run, run with: IntegrityTests "[.benchmark]"
+TEST_CASE("Cubic Interpolation Benchmark", "[.benchmark]")
+{
+    // Throughput of the 8 lookups compared to trilinear sampling and the 64 coefficients.
+    const glm::ivec3 dim = cubicNoiseDims;
+    TestVolume volume { cubicNoise(7533), dim };
+    volume.interpolationMode = volume::InterpolationMode::Cubic;
+    volume.updateInterpolation();
+    TestRandom random { 7534 };
+    std::vector<glm::vec3> positions;
+    for (int i = 0; i < 20000; i++)
+        positions.push_back(random.uniform(glm::vec3(0.0f), glm::vec3(dim - 1)));
+
+    const auto time = [&](auto&& sample) {
+        const auto start = std::chrono::steady_clock::now();
+        float sum = 0.0f;
+        for (int repeat = 0; repeat < 20; repeat++) {
+            for (const glm::vec3& position : positions)
+                sum += sample(position);
+        }
+        REQUIRE(std::isfinite(sum));
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    const double linearMs = time([&](const glm::vec3& position) { return volume.test_getSampleTriLinearInterpolation(position); });
+    const double cubicMs = time([&](const glm::vec3& position) { return volume.test_getSampleTriCubicInterpolation(position); });
+    const double cubic64Ms = time([&](const glm::vec3& position) { return sampleTriCubic64(volume, position); });
+    WARN("Sampling " << 20 * positions.size() << " positions: trilinear " << linearMs << "ms, tricubic " << cubicMs << "ms, tricubic with 64 coefficients " << cubic64Ms << "ms");
+}
+
+// Smooth waves in x and y on a ramp in z, in a volume of 24 x 20 x 16 voxels.
+static constexpr glm::ivec3 wavesDims { 24, 20, 16 };
+static std::vector<float> waves()
+{
+    const glm::ivec3 dim = wavesDims;
+    std::vector<float> data(size_t(dim.x * dim.y * dim.z));
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++)
+                data[size_t((z * dim.y + y) * dim.x + x)] = 100.0f + 40.0f * std::sin(0.4f * float(x)) * std::cos(0.3f * float(y)) + 2.0f * float(z);
+        }
+    }
+    return data;
+}
+
+// Random positions within the waves volume that are not within 0.01 of a voxel plane, so that central differences of
+// the trilinear interpolant have both sides in the same cell.
+static std::vector<glm::vec3> wavesSamplePositions()
+{
+    const glm::ivec3 dim = wavesDims;
+    std::vector<glm::vec3> positions;
+    TestRandom random { 86420 };
+    while (positions.size() < 5000) {
+        const glm::vec3 position = random.uniform(glm::vec3(0.0f), glm::vec3(dim - 1));
+        if (glm::all(glm::greaterThan(glm::abs(position - glm::round(position)), glm::vec3(0.01f))))
+            positions.push_back(position);
+    }
+    return positions;
+}
+
+TEST_CASE("Sample Gradient Tests")
+{
+    const glm::ivec3 dim = wavesDims;
+    volume::Volume volume { waves(), dim };
+    const std::vector<glm::vec3> positions = wavesSamplePositions();
+    const auto centralDifferences = [&](const glm::vec3& position, float h) {
+        glm::vec3 gradient;
+        for (int axis = 0; axis < 3; axis++) {
+            glm::vec3 offset { 0.0f };
+            offset[axis] = h;
+            gradient[axis] = (volume.getSampleInterpolate(position + offset) - volume.getSampleInterpolate(position - offset)) / (2.0f * h);
+        }
+        return gradient;
+    };
+
+    // The value is the interpolated sample and the gradient is the derivative of the interpolant.
+    for (const auto& [mode, h] : { std::pair(volume::InterpolationMode::Linear, 0.005f), std::pair(volume::InterpolationMode::Cubic, 0.01f) }) {
+        volume.interpolationMode = mode;
+        volume.updateInterpolation();
+        for (const glm::vec3& position : positions) {
+            const volume::SampleGradient sample = volume.getSampleGradientInterpolate(position);
+            REQUIRE(sample.value == Approx(volume.getSampleInterpolate(position)).margin(0.01f));
+            const glm::vec3 reference = centralDifferences(position, h);
+            for (int axis = 0; axis < 3; axis++)
+                REQUIRE(sample.gradient[axis] == Approx(reference[axis]).margin(0.05f));
+        }
+    }
+
+    for (const auto mode : { volume::InterpolationMode::Linear, volume::InterpolationMode::Cubic }) {
+        volume.interpolationMode = mode;
+        REQUIRE(volume.getSampleGradientInterpolate(glm::vec3(-0.1f, 2.0f, 2.0f)).value == 0.0f);
+        REQUIRE(volume.getSampleGradientInterpolate(glm::vec3(2.0f, 2.0f, float(dim.z) - 0.9f)).gradient == glm::vec3(0.0f));
+    }
+
+    // Nearest neighbour keeps its value but shades with the gradient of the trilinear interpolant.
+    for (const glm::vec3& position : positions) {
+        volume.interpolationMode = volume::InterpolationMode::Linear;
+        const glm::vec3 linearGradient = volume.getSampleGradientInterpolate(position).gradient;
+        volume.interpolationMode = volume::InterpolationMode::NearestNeighbour;
+        const volume::SampleGradient sample = volume.getSampleGradientInterpolate(position);
+        REQUIRE(sample.value == volume.getSampleInterpolate(position));
+        REQUIRE(glm::all(glm::epsilonEqual(sample.gradient, linearGradient, 1e-4f)));
+    }
+    REQUIRE(volume.getSampleGradientInterpolate(glm::vec3(-0.4f, 0.0f, float(dim.z) - 0.6f)).value == volume.getVoxel(0, 0, dim.z - 1));
+}
+
+// Hidden from the default run, run with: IntegrityTests "[.benchmark]"
+TEST_CASE("Sample Gradient Benchmark", "[.benchmark]")
+{
+    volume::Volume volume { waves(), wavesDims };
+    const std::vector<glm::vec3> positions = wavesSamplePositions();
+
+    // Throughput of one fetch compared to a sample and six more for central differences.
+    const auto time = [&](auto&& sample) {
+        const auto start = std::chrono::steady_clock::now();
+        float sum = 0.0f;
+        for (int repeat = 0; repeat < 50; repeat++) {
+            for (const glm::vec3& position : positions)
+                sum += sample(position);
+        }
+        REQUIRE(std::isfinite(sum));
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    const auto centralDifferences = [&](const glm::vec3& position) {
+        glm::vec3 gradient;
+        for (int axis = 0; axis < 3; axis++) {
+            glm::vec3 offset { 0.0f };
+            offset[axis] = 1.0f;
+            gradient[axis] = 0.5f * (volume.getSampleInterpolate(position + offset) - volume.getSampleInterpolate(position - offset));
+        }
+        return gradient;
+    };
+    for (const auto mode : { volume::InterpolationMode::Linear, volume::InterpolationMode::Cubic }) {
+        volume.interpolationMode = mode;
+        const double fusedMs = time([&](const glm::vec3& position) {
+            const volume::SampleGradient sample = volume.getSampleGradientInterpolate(position);
+            return sample.value + sample.gradient.x;
+        });
+        const double separateMs = time([&](const glm::vec3& position) { return volume.getSampleInterpolate(position) + centralDifferences(position).x; });
+        WARN((mode == volume::InterpolationMode::Linear ? "Trilinear" : "Tricubic") << " value and gradient of " << 50 * positions.size() << " positions: fused " << fusedMs << "ms, central differences " << separateMs << "ms");
+    }
+}
+
+TEST_CASE("Time Series Tests")
+{
+    // Five timesteps of a small .dat volume whose voxels are all set to the timestep, with a file of another series
+    // and one with a different number of digits in between.
+    const glm::ivec3 dim { 4, 4, 4 };
+    const auto directory = std::filesystem::temp_directory_path() / "volvis_time_series_test";
+    std::filesystem::create_directories(directory);
+    const auto writeVolume = [&](const std::string& fileName, uint16_t value) {
+        std::ofstream ofs(directory / fileName, std::ios::binary);
+        const std::array<uint16_t, 3> header { uint16_t(dim.x), uint16_t(dim.y), uint16_t(dim.z) };
+        ofs.write(reinterpret_cast<const char*>(header.data()), sizeof(header));
+        const std::vector<uint16_t> voxels(size_t(dim.x * dim.y * dim.z), value);
+        ofs.write(reinterpret_cast<const char*>(voxels.data()), std::streamsize(voxels.size() * sizeof(uint16_t)));
+    };
+    constexpr int numTimesteps = 5;
+    for (int t = numTimesteps - 1; t >= 0; t--)
+        writeVolume("series.00" + std::to_string(t) + ".dat", uint16_t(t));
+    writeVolume("series.1000.dat", 100);
+    writeVolume("other.001.dat", 100);
+
+    const auto files = volume::findTimeSeriesFiles(directory / "series.002.dat");
+    REQUIRE(files.size() == numTimesteps);
+    for (int t = 0; t < numTimesteps; t++)
+        REQUIRE(files[size_t(t)].filename() == "series.00" + std::to_string(t) + ".dat");
+    REQUIRE(volume::findTimeSeriesFiles(directory / "other.001.dat").size() == 1);
+
+    // The window holds the current timestep and the prefetched ones after it, wrapping around at the end.
+    volume::TimeSeries timeSeries { files, {}, 2 };
+    REQUIRE(timeSeries.get(3)->volume.getVoxel(1, 2, 3) == 3.0f);
+    const auto waitForDecoded = [&](int count) {
+        for (int i = 0; i < 1000 && timeSeries.numDecoded() < count; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        return timeSeries.numDecoded();
+    };
+    REQUIRE(waitForDecoded(3) == 3);
+    REQUIRE(timeSeries.tryGet(4));
+    REQUIRE(timeSeries.tryGet(0)->volume.getVoxel(0, 0, 0) == 0.0f);
+    REQUIRE(!timeSeries.tryGet(1));
+
+    // Playback holds the displayed timestep until the requested one is decoded and never waits for it.
+    volume::TimeSeriesPlayback playback { &timeSeries, 10.0f };
+    playback.seek(3);
+    REQUIRE(playback.update(std::chrono::steady_clock::now()));
+    REQUIRE(playback.displayed()->volume.getVoxel(0, 0, 0) == 3.0f);
+    auto now = std::chrono::steady_clock::now();
+    // The prefetch thread decodes a timestep in well under a millisecond, the deadline only keeps a broken prefetch
+    // thread from hanging the tests.
+    const auto deadline = now + std::chrono::seconds(30);
+    playback.play(now);
+    REQUIRE(!playback.update(now));
+    int displayed = playback.displayedTimestep();
+    for (int frame = 0; frame < 4 * numTimesteps; frame++) {
+        now += std::chrono::milliseconds(100);
+        while (!playback.update(now) && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        REQUIRE(playback.displayedTimestep() == (displayed + 1) % numTimesteps);
+        REQUIRE(playback.displayed()->volume.getVoxel(0, 0, 0) == float(playback.displayedTimestep()));
+        displayed = playback.displayedTimestep();
+        // The ring stays bounded while the window moves.
+        REQUIRE(timeSeries.numDecoded() <= 3);
+    }
+
+    // Without looping playback stops at the last timestep.
+    playback.setLoop(false);
+    while (playback.isPlaying() && std::chrono::steady_clock::now() < deadline) {
+        now += std::chrono::milliseconds(100);
+        playback.update(now);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    REQUIRE(!playback.isPlaying());
+    REQUIRE(playback.requestedTimestep() == numTimesteps - 1);
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Mapped File Tests")
+{
+    const auto filePath = std::filesystem::temp_directory_path() / "volvis_mapped_file_test.dat";
+    std::vector<float> values(10000);
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = float(i) * 0.5f;
+    {
+        std::ofstream ofs(filePath, std::ios::binary);
+        ofs.write(reinterpret_cast<const char*>(values.data()), std::streamsize(values.size() * sizeof(float)));
+    }
+
+    {
+        const util::MappedFile file { filePath };
+        REQUIRE(file.isOpen());
+        REQUIRE(file.data().size() == values.size() * sizeof(float));
+        std::vector<float> copy(values.size());
+        std::memcpy(copy.data(), file.data().data(), file.data().size());
+        REQUIRE(copy == values);
+    }
+
+    const util::MappedFile missing { filePath.string() + ".missing" };
+    REQUIRE(!missing.isOpen());
+    REQUIRE(missing.data().empty());
+    std::filesystem::remove(filePath);
+}
@@ -4,8 +4,41 @@ in vec2 v_texCoord;
 layout(location = 0) out vec4 o_fragColor;
 
 uniform sampler2D u_texture;
+// Distance to the first hit per pixel of u_texture, used to upsample frames rendered below the display resolution.
+uniform sampler2D u_depth;
+uniform bool u_depthAwareUpsampling;
+
+// Relative depth difference at which a neighbour has about a third of its bilinear weight.
+const float depthTolerance = 0.05;
 
 void main()
 {
-    o_fragColor = texture(u_texture, 1.0 - v_texCoord);
-}
\ No newline at end of file
+    vec2 texCoord = 1.0 - v_texCoord;
+    if (!u_depthAwareUpsampling) {
+        o_fragColor = texture(u_texture, texCoord);
+        return;
+    }
+
+    // Bilinear interpolation of the 4 closest pixels, where pixels at another depth than the closest one lose
+    // their weight. Surfaces are smooth inside but do not bleed into each other (or the background) at edges.
+    ivec2 size = textureSize(u_texture, 0);
+    vec2 position = texCoord * vec2(size) - 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - vec2(base);
+    float referenceDepth = texelFetch(u_depth, clamp(ivec2(floor(position + 0.5)), ivec2(0), size - 1), 0).r;
+
+    vec4 colorSum = vec4(0.0);
+    float weightSum = 0.0;
+    for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < 2; x++) {
+            ivec2 pixel = clamp(base + ivec2(x, y), ivec2(0), size - 1);
+            float depth = texelFetch(u_depth, pixel, 0).r;
+            // relative to the closest of the two depths, so missed rays (maximum float depth) never blend with hits
+            float depthDifference = abs(depth - referenceDepth) / max(min(depth, referenceDepth), 1.0) / depthTolerance;
+            float weight = (x == 1 ? f.x : 1.0 - f.x) * (y == 1 ? f.y : 1.0 - f.y) * exp(-depthDifference * depthDifference);
+            colorSum += weight * texelFetch(u_texture, pixel, 0);
+            weightSum += weight;
+        }
+    }
+    o_fragColor = colorSum / max(weightSum, 1e-6);
+}
@@ -0,0 +1,66 @@
+#version 330
+out vec4 FragColor;
+
+in vec3 voxelPos;
+in vec3 worldPos;
+in vec3 gradientDir;
+
+// camera position in world coordinates, the light is a headlight like in the raymarchers
+uniform vec3 cameraPosition;
+
+// 1 if the surface is shaded
+uniform int useShading;
+
+// clipping planes and region of interest in voxel coordinates, positions with dot(plane.xyz, p) + plane.w < 0 and
+// outside [roiLower, roiUpper] are cut away
+uniform int numClipPlanes;
+uniform vec4 clipPlanes[4];
+uniform vec3 roiLower;
+uniform vec3 roiUpper;
+
+// Phong shading constants, defined globally to avoid repeated creation in phongShading function
+const float ambientCoefficient = 0.1;
+const float diffuseCoefficient = 0.6;
+const float specularCoefficient = 0.5;
+const int specularPower = 32;
+
+// calculate Phong shading the same way as in the CPU renderer and the iso surface raymarcher
+vec3 phongShading(vec3 color, vec4 gradient, vec3 L, vec3 V)
+{
+    // If the gradient magnitude is zero, return black
+    if (gradient.a == 0.0) {
+        return vec3(0.0);
+    }
+
+    // Ensure the normal is always oriented towards the viewer
+    vec3 N = normalize(gradient.xyz);
+    if (dot(N, V) < 0.0) {
+        N = -N;
+    }
+
+    // Phong reflection model (assuming white light, thus no contribution to the color)
+    vec3 ambient = ambientCoefficient * color;
+    vec3 diffuse = diffuseCoefficient * clamp(dot(L, N), 0.0, 1.0) * color;
+    vec3 R = 2.0 * dot(L, N) * N - L;
+    vec3 specular = specularCoefficient * pow(clamp(dot(R, V), 0.0, 1.0), specularPower) * color;
+
+    return ambient + diffuse + specular;
+}
+
+void main()
+{
+    if (any(lessThan(voxelPos, roiLower)) || any(greaterThan(voxelPos, roiUpper)))
+        discard;
+    for (int i = 0; i < numClipPlanes; i++) {
+        if (dot(clipPlanes[i].xyz, voxelPos) + clipPlanes[i].w < 0.0)
+            discard;
+    }
+
+    // same color as the iso surface raymarcher, the normals are zero at the border of the volume
+    vec3 color = vec3(1, 1, 0);
+    if (useShading == 1) {
+        vec3 V = normalize(cameraPosition - worldPos);
+        color = phongShading(color, vec4(gradientDir, length(gradientDir)), V, V);
+    }
+    FragColor = vec4(color, 1.0);
+}
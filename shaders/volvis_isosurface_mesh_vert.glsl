@@ -0,0 +1,19 @@
+#version 330
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 normal;
+
+// the mesh is in voxel coordinates, u_model moves the voxel centers to where the raymarchers sample them
+uniform mat4 u_modelViewProjection;
+uniform mat4 u_model;
+
+out vec3 voxelPos;
+out vec3 worldPos;
+out vec3 gradientDir;
+
+void main()
+{
+    voxelPos = pos;
+    worldPos = (u_model * vec4(pos, 1.0)).xyz;
+    gradientDir = normal;
+    gl_Position = u_modelViewProjection * vec4(pos, 1.0);
+}
@@ -9,12 +9,52 @@ uniform sampler2D frontFaces;
 // the back faces texture
 uniform sampler2D backFaces;
 
-// the volume or volume cache when using indirection
+// ray entry / exit mode: 0 = front / back face textures, 1 = analytic intersection with the volume bounds,
+// 2 = analytic between the depths of the nearest front face and the farthest back face of the active blocks
+uniform int rayEntryExitMode;
+
+// from clip space to normalized volume coordinates
+uniform mat4 invViewProjection;
+
+// depths of the active blocks for mode 2
+uniform sampler2D entryDepth;
+uniform sampler2D exitDepth;
+
+// clipping planes and region of interest in normalized volume coordinates, positions with dot(plane.xyz, p) + plane.w < 0
+// and outside [roiLower, roiUpper] are cut away
+uniform int numClipPlanes;
+uniform vec4 clipPlanes[4];
+uniform vec3 roiLower;
+uniform vec3 roiUpper;
+
+// the volume or the first texture of the volume cache when using indirection
 uniform sampler3D volumeData;
 
+// further textures of the volume cache when it does not fit into a single texture
+uniform sampler3D volumeAtlas1;
+uniform sampler3D volumeAtlas2;
+uniform sampler3D volumeAtlas3;
+
+// scales normalized volume coordinates to the texture of the selected level of detail (only used without bricking)
+uniform vec3 levelTexScale;
+
 // the volume indirection lookup
 uniform sampler3D volumeIndexData;
 
+// the index covers whole bricks, this scales normalized volume coordinates to normalized index coordinates
+uniform vec3 indexTexScale;
+
+// 1 / size of the brick cache textures in voxels
+uniform vec3 cacheSizeRcp[4];
+
+// multiplies samples of the volume / cache textures to voxel values, 8 and 16 bit volumes are stored normalized
+uniform float valueScale;
+
+// 0 = nearest neighbour, 1 = linear, 2 = cubic: samples the B-spline coefficients of the whole volume instead of the
+// volume / cache textures
+uniform int interpolationMode;
+uniform sampler3D bsplineCoefficients;
+
 // this contains the voxels size in normalized coordinates + 0 if using regular texture and 1 when using bricking
 uniform vec4 volumeInfo; // (voxelsize.x, voxelsize.y, voxelsize.z, use bricking?)
 
@@ -55,59 +95,246 @@ vec3 phongShading(vec3 color, vec4 gradient, vec3 L, vec3 V)
     return ambient + diffuse + specular;
 }
 
-// ======= TODO: IMPLEMENT ========
-//
-// Part of **1. Basic Volume Rendering**
-//
-// This function should calculate the gradient on the fly at the current samplePos
-// Gives the voxelSize (in normalized volume coordinates) for the offset
-// The return is a vec4 intended to contain the gradient magnitude in the fourth component though not strictly necessary
-// Note: The function can be cpoied over to compositing shader once implemented
-vec4 calculateGradient(vec3 samplePos, vec3 voxelSize)
+// tricubic B-spline interpolation with 8 linear lookups of the coefficients: per axis the coefficient pairs (-1, 0) and
+// (1, 2) around the sample are each fetched at the position between them that weights them like the B-spline does
+// (the same as Volume::getSampleTriCubicInterpolation)
+float sampleVolumeCubic(vec3 samplePos)
 {
-    vec4 gradient = vec4(0.0f);
+    vec3 coord = samplePos / volumeInfo.xyz - 0.5;
+    vec3 index = floor(coord);
+    vec3 f = coord - index;
+    vec3 w0 = (1.0 - f) * (1.0 - f) * (1.0 - f) / 6.0;
+    vec3 w1 = (4.0 - 6.0 * f * f + 3.0 * f * f * f) / 6.0;
+    vec3 w3 = f * f * f / 6.0;
+    vec3 g0 = w0 + w1;
+    vec3 g1 = 1.0 - g0;
+    // texel centers are at voxel + 0.5
+    vec3 h0 = (index - 0.5 + w1 / g0) * volumeInfo.xyz;
+    vec3 h1 = (index + 1.5 + w3 / g1) * volumeInfo.xyz;
 
-    return gradient;
+    float plane0 = g0.y * (g0.x * texture(bsplineCoefficients, vec3(h0.x, h0.y, h0.z)).r + g1.x * texture(bsplineCoefficients, vec3(h1.x, h0.y, h0.z)).r)
+                 + g1.y * (g0.x * texture(bsplineCoefficients, vec3(h0.x, h1.y, h0.z)).r + g1.x * texture(bsplineCoefficients, vec3(h1.x, h1.y, h0.z)).r);
+    float plane1 = g0.y * (g0.x * texture(bsplineCoefficients, vec3(h0.x, h0.y, h1.z)).r + g1.x * texture(bsplineCoefficients, vec3(h1.x, h0.y, h1.z)).r)
+                 + g1.y * (g0.x * texture(bsplineCoefficients, vec3(h0.x, h1.y, h1.z)).r + g1.x * texture(bsplineCoefficients, vec3(h1.x, h1.y, h1.z)).r);
+    return g0.z * plane0 + g1.z * plane1;
 }
 
+// sample the volume, with bricking the index stores per brick the offset from volume voxels to cache voxels and the cache texture + 1 in w
+// inactive bricks are not resident, their index entry holds the brick minimum which is invisible for the current TF / iso value
+float sampleVolume(vec3 samplePos)
+{
+    if (interpolationMode == 2) {
+        return sampleVolumeCubic(samplePos);
+    }
+    if (volumeInfo.w < 0.5) {
+        return valueScale * texture(volumeData, samplePos * levelTexScale).r;
+    }
+    vec4 brick = texture(volumeIndexData, samplePos * indexTexScale);
+    int atlas = int(brick.w + 0.5) - 1;
+    if (atlas < 0) {
+        return brick.x;
+    }
+    vec3 cacheVoxel = samplePos / volumeInfo.xyz + brick.xyz;
+    if (atlas == 0) {
+        return valueScale * texture(volumeData, cacheVoxel * cacheSizeRcp[0]).r;
+    } else if (atlas == 1) {
+        return valueScale * texture(volumeAtlas1, cacheVoxel * cacheSizeRcp[1]).r;
+    } else if (atlas == 2) {
+        return valueScale * texture(volumeAtlas2, cacheVoxel * cacheSizeRcp[2]).r;
+    }
+    return valueScale * texture(volumeAtlas3, cacheVoxel * cacheSizeRcp[3]).r;
+}
 
-// ======= TODO: IMPLEMENT ========
-//
-// Part of **1. Basic Volume Rendering**
-//
-// This function should calculate the iso surface rendering with shading and bisection
-// We give the ray set up for front to back following MIP
-// In addition to the CPU version, here you must
-// Implement the gradient calculation on-the-fly instead of from a precomputed volume (can be reused in compositing shader)
-//
-// Part of **3. Volume Bricking**
-//
-// Update the code to use the sampling indirection using volumeIndexData
-// Consider adding a function to separate the sampling that you can also add to the compositing
-void main()
+// the 2x2x2 texels of the cell whose first texel is texel, clamped like GL_CLAMP_TO_EDGE: the texels at x and x + 1
+// of the (y, z) edges 00, 10, 01 and 11
+void fetchCell(sampler3D volume, ivec3 texel, out vec4 lower, out vec4 upper)
+{
+    ivec3 last = textureSize(volume, 0) - 1;
+    ivec3 t0 = clamp(texel, ivec3(0), last);
+    ivec3 t1 = clamp(texel + 1, ivec3(0), last);
+    lower = vec4(texelFetch(volume, t0, 0).r, texelFetch(volume, ivec3(t0.x, t1.y, t0.z), 0).r, texelFetch(volume, ivec3(t0.xy, t1.z), 0).r, texelFetch(volume, ivec3(t0.x, t1.yz), 0).r);
+    upper = vec4(texelFetch(volume, ivec3(t1.x, t0.yz), 0).r, texelFetch(volume, ivec3(t1.xy, t0.z), 0).r, texelFetch(volume, ivec3(t1.x, t0.y, t1.z), 0).r, texelFetch(volume, t1, 0).r);
+}
+
+// the cubic B-spline weights of the coefficients at -1, 0, 1 and 2 for a position f in [0, 1) and their derivatives
+vec4 bsplineWeights(float f)
+{
+    return vec4((1.0 - f) * (1.0 - f) * (1.0 - f), 4.0 - 6.0 * f * f + 3.0 * f * f * f, 1.0 + 3.0 * f + 3.0 * f * f - 3.0 * f * f * f, f * f * f) / 6.0;
+}
+
+vec4 bsplineDerivativeWeights(float f)
+{
+    return vec4(-0.5 * (1.0 - f) * (1.0 - f), 1.5 * f * f - 2.0 * f, 0.5 + f - 1.5 * f * f, 0.5 * f * f);
+}
+
+// value and gradient of the cubic B-spline from one fetch of the 4x4x4 coefficients around samplePos
+vec4 sampleVolumeGradientCubic(vec3 samplePos)
+{
+    vec3 coord = samplePos / volumeInfo.xyz - 0.5;
+    vec3 index = floor(coord);
+    vec3 f = coord - index;
+    vec4 wx = bsplineWeights(f.x);
+    vec4 wy = bsplineWeights(f.y);
+    vec4 wz = bsplineWeights(f.z);
+    vec4 dwx = bsplineDerivativeWeights(f.x);
+    vec4 dwy = bsplineDerivativeWeights(f.y);
+    vec4 dwz = bsplineDerivativeWeights(f.z);
+    ivec3 size = textureSize(bsplineCoefficients, 0);
+
+    vec4 valueGradient = vec4(0.0);
+    for (int k = 0; k < 4; k++) {
+        for (int j = 0; j < 4; j++) {
+            vec4 row = vec4(0.0);
+            for (int i = 0; i < 4; i++) {
+                ivec3 texel = clamp(ivec3(index) + ivec3(i - 1, j - 1, k - 1), ivec3(0), size - 1);
+                row[i] = texelFetch(bsplineCoefficients, texel, 0).r;
+            }
+            float rowValue = dot(wx, row);
+            valueGradient += vec4(wy[j] * wz[k] * dot(dwx, row), dwy[j] * wz[k] * rowValue, wy[j] * dwz[k] * rowValue, wy[j] * wz[k] * rowValue);
+        }
+    }
+    return valueGradient;
+}
+
+// the gradient (per voxel) of the interpolant in xyz and the value in w. Linear and nearest neighbour interpolation fetch
+// the 8 texels of the cell around samplePos once and return the analytic gradient of their trilinear interpolant, nearest
+// neighbour only takes the value of the nearest texel. The same as Volume::getSampleGradientInterpolate.
+vec4 sampleVolumeGradient(vec3 samplePos)
 {
-    // start positions from the front face texture
-    vec3 samplePos = texture(frontFaces, TexCoords).xyz;
+    if (interpolationMode == 2) {
+        return sampleVolumeGradientCubic(samplePos);
+    }
 
-    // ray direction from the direction texture
-    vec3 direction = texture(backFaces, TexCoords).xyz - samplePos;
+    // continuous texel coordinates (texel centers at integers) and the texels per voxel of the volume
+    int atlas = 0;
+    vec3 texelPos;
+    vec3 texelsPerVoxel = vec3(1.0);
+    if (volumeInfo.w < 0.5) {
+        vec3 levelSize = vec3(textureSize(volumeData, 0));
+        texelPos = samplePos * levelTexScale * levelSize - 0.5;
+        texelsPerVoxel = levelTexScale * levelSize * volumeInfo.xyz;
+    } else {
+        vec4 brick = texture(volumeIndexData, samplePos * indexTexScale);
+        atlas = int(brick.w + 0.5) - 1;
+        if (atlas < 0) {
+            return vec4(vec3(0.0), brick.x);
+        }
+        texelPos = samplePos / volumeInfo.xyz + brick.xyz - 0.5;
+    }
 
+    vec3 base = floor(texelPos);
+    vec3 f = texelPos - base;
+    ivec3 texel = ivec3(base);
+    vec4 lower;
+    vec4 upper;
+    if (atlas == 1) {
+        fetchCell(volumeAtlas1, texel, lower, upper);
+    } else if (atlas == 2) {
+        fetchCell(volumeAtlas2, texel, lower, upper);
+    } else if (atlas == 3) {
+        fetchCell(volumeAtlas3, texel, lower, upper);
+    } else {
+        fetchCell(volumeData, texel, lower, upper);
+    }
+    vec4 edge = mix(lower, upper, f.x);
+    vec4 dx = upper - lower;
+    float z0Value = mix(edge.x, edge.y, f.y);
+    float z1Value = mix(edge.z, edge.w, f.y);
+    vec3 gradient = vec3(mix(mix(dx.x, dx.y, f.y), mix(dx.z, dx.w, f.y), f.z), mix(edge.y - edge.x, edge.w - edge.z, f.z), z1Value - z0Value);
 
-    // ======= TODO: IMPLEMENT ========
-    //
-    // Part of **3. Volume Bricking**
-    // fix potential size differences between the bricked volume and the original volume
-    // The index volume is the size of the volume in bricks
-    // If the volume is not an exact multiple of the brickSize this will create a hypothetical volume larger than the original one
-    // e.g., volume = 10x10x10 and the bricksize is 6xx6x6
-    //       the index volume will be 2x2x2
-    //       now we can sample in normalized coordinates in that volume, but that means we are sampling in a hypothetical
-    //       2x2x2 * 6x6x6 = 12x12x12 volume.
-    // There are various ways to fix this. As we do not bother you with the geometry in this assignment
-    //  a simple way to fix it is here in the shader by adjusting the samplePos and direction
-    // NOTE: not all needed information is provided. You need to add additional uniform(s)
-    if(volumeInfo.w > 0.5f){
+    float value = mix(z0Value, z1Value, f.z);
+    if (interpolationMode == 0) {
+        vec3 nearest = step(0.5, f);
+        vec4 nearestEdge = mix(lower, upper, nearest.x);
+        value = mix(mix(nearestEdge.x, nearestEdge.y, nearest.y), mix(nearestEdge.z, nearestEdge.w, nearest.y), nearest.z);
     }
+    return valueScale * vec4(gradient * texelsPerVoxel, value);
+}
+
+// position in normalized volume coordinates of a point on the view ray through this fragment
+vec3 unproject(float depth)
+{
+    vec4 position = invViewProjection * vec4(TexCoords * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    return position.xyz / position.w;
+}
+
+// entry and exit of the view ray in normalized volume coordinates, both are 0 when the ray misses the volume
+void rayEntryExit(out vec3 entry, out vec3 exit)
+{
+    entry = vec3(0.0);
+    exit = vec3(0.0);
+    if (rayEntryExitMode == 0) {
+        entry = texture(frontFaces, TexCoords).xyz;
+        exit = texture(backFaces, TexCoords).xyz;
+        return;
+    }
+    if (rayEntryExitMode == 2) {
+        float nearDepth = texture(entryDepth, TexCoords).r;
+        float farDepth = texture(exitDepth, TexCoords).r;
+        if (nearDepth < farDepth) {
+            entry = clamp(unproject(nearDepth), 0.0, 1.0);
+            exit = clamp(unproject(farDepth), 0.0, 1.0);
+        }
+        return;
+    }
+    // slab test against the unit cube between the near and far plane
+    vec3 nearPosition = unproject(0.0);
+    vec3 direction = unproject(1.0) - nearPosition;
+    vec3 t0 = -nearPosition / direction;
+    vec3 t1 = (1.0 - nearPosition) / direction;
+    vec3 tMin = min(t0, t1);
+    vec3 tMax = max(t0, t1);
+    float tEntry = max(max(tMin.x, tMin.y), max(tMin.z, 0.0));
+    float tExit = min(min(tMax.x, tMax.y), min(tMax.z, 1.0));
+    if (tEntry < tExit) {
+        entry = nearPosition + tEntry * direction;
+        exit = nearPosition + tExit * direction;
+    }
+}
+
+// iso surface rendering: the first sample above the iso value is a hit, the hit position is refined by linear
+// interpolation between the last two samples and shaded with the same headlight as the CPU renderer
+// shrinks the ray segment to the region of interest and the kept side of the clipping planes, so clipped away parts
+// cost no samples
+void clipRay(inout vec3 entry, inout vec3 exit)
+{
+    vec3 direction = exit - entry;
+    if (direction == vec3(0.0))
+        return;
+    vec3 t0 = (roiLower - entry) / direction;
+    vec3 t1 = (roiUpper - entry) / direction;
+    vec3 tMin = min(t0, t1);
+    vec3 tMax = max(t0, t1);
+    float tEntry = max(max(tMin.x, tMin.y), max(tMin.z, 0.0));
+    float tExit = min(min(tMax.x, tMax.y), min(tMax.z, 1.0));
+    for (int i = 0; i < numClipPlanes; i++) {
+        float distance = dot(clipPlanes[i].xyz, entry) + clipPlanes[i].w;
+        float rate = dot(clipPlanes[i].xyz, direction);
+        if (rate > 0.0)
+            tEntry = max(tEntry, -distance / rate);
+        else if (rate < 0.0)
+            tExit = min(tExit, -distance / rate);
+        else if (distance < 0.0)
+            tExit = -1.0;
+    }
+    if (tEntry < tExit) {
+        exit = entry + tExit * direction;
+        entry = entry + tEntry * direction;
+    } else {
+        entry = vec3(0.0);
+        exit = vec3(0.0);
+    }
+}
+
+void main()
+{
+    // start position and direction from the ray entry and exit
+    vec3 samplePos;
+    vec3 exitPos;
+    rayEntryExit(samplePos, exitPos);
+    clipRay(samplePos, exitPos);
+    vec3 direction = exitPos - samplePos;
+
 
     // we split the ray into the normalized direction and the length
     vec3 ray_direction = normalize(direction);
@@ -123,12 +350,26 @@ void main()
     // assing a color for the isosurface
     vec3 color = vec3(1,1,0);
 
+    // view and light direction in voxel space, where the gradient is computed
+    vec3 V = -normalize(ray_direction / volumeInfo.xyz);
+
+    float previousValue = sampleVolume(samplePos);
     for(int i = 0; i < numSteps; i++) {
+        float value = sampleVolume(samplePos);
+        if (value > isoValue) {
+            float t = (value > previousValue && i > 0) ? (isoValue - previousValue) / (value - previousValue) : 1.0;
+            vec3 hitPos = samplePos - (1.0 - t) * ray_increment;
+            if (renderOptions.w > 0.5) {
+                vec3 gradient = sampleVolumeGradient(hitPos).xyz;
+                color = phongShading(color, vec4(gradient, length(gradient)), V, V);
+            }
+            FragColor = vec4(color, 1.0);
+            return;
+        }
+        previousValue = value;
 
-        // ======= TODO: IMPLEMENT ========
-        // replace this with your code
-        FragColor = vec4(color, 1.0);
-        return;
+        // move the ray forward
+        samplePos += ray_increment;
     }
     
     FragColor = vec4(0.0);
@@ -9,22 +9,149 @@ uniform sampler2D frontFaces;
 // the back faces texture
 uniform sampler2D backFaces;
 
+// ray entry / exit mode: 0 = front / back face textures, 1 = analytic intersection with the volume bounds,
+// 2 = analytic between the depths of the nearest front face and the farthest back face of the active blocks
+uniform int rayEntryExitMode;
+
+// from clip space to normalized volume coordinates
+uniform mat4 invViewProjection;
+
+// depths of the active blocks for mode 2
+uniform sampler2D entryDepth;
+uniform sampler2D exitDepth;
+
+// clipping planes and region of interest in normalized volume coordinates, positions with dot(plane.xyz, p) + plane.w < 0
+// and outside [roiLower, roiUpper] are cut away
+uniform int numClipPlanes;
+uniform vec4 clipPlanes[4];
+uniform vec3 roiLower;
+uniform vec3 roiUpper;
+
 // the volume
 uniform sampler3D volumeData;
 
+// scales normalized volume coordinates to the texture of the selected level of detail
+uniform vec3 levelTexScale;
+
+// multiplies samples of the volume texture to voxel values, 8 and 16 bit volumes are stored normalized
+uniform float valueScale;
+
+// 0 = nearest neighbour, 1 = linear, 2 = cubic: samples the B-spline coefficients of the whole volume instead of the
+// volume texture
+uniform int interpolationMode;
+uniform sampler3D bsplineCoefficients;
+
 // contains various rendering options, here stepsize and its reciprocal
 uniform vec4 renderOptions; // (stepSize, 1.0f / stepSize, empty, empty)
 
 // this contains the voxels size in normalized coordinates + the reciprocal of the max intensity of the volume
 uniform vec4 volumeInfo; // (voxelsize.x, voxelsize.y, voxelsize.z, 1.0f/max vol intensity)
 
-void main()
+// position in normalized volume coordinates of a point on the view ray through this fragment
+vec3 unproject(float depth)
+{
+    vec4 position = invViewProjection * vec4(TexCoords * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    return position.xyz / position.w;
+}
+
+// entry and exit of the view ray in normalized volume coordinates, both are 0 when the ray misses the volume
+void rayEntryExit(out vec3 entry, out vec3 exit)
+{
+    entry = vec3(0.0);
+    exit = vec3(0.0);
+    if (rayEntryExitMode == 0) {
+        entry = texture(frontFaces, TexCoords).xyz;
+        exit = texture(backFaces, TexCoords).xyz;
+        return;
+    }
+    if (rayEntryExitMode == 2) {
+        float nearDepth = texture(entryDepth, TexCoords).r;
+        float farDepth = texture(exitDepth, TexCoords).r;
+        if (nearDepth < farDepth) {
+            entry = clamp(unproject(nearDepth), 0.0, 1.0);
+            exit = clamp(unproject(farDepth), 0.0, 1.0);
+        }
+        return;
+    }
+    // slab test against the unit cube between the near and far plane
+    vec3 nearPosition = unproject(0.0);
+    vec3 direction = unproject(1.0) - nearPosition;
+    vec3 t0 = -nearPosition / direction;
+    vec3 t1 = (1.0 - nearPosition) / direction;
+    vec3 tMin = min(t0, t1);
+    vec3 tMax = max(t0, t1);
+    float tEntry = max(max(tMin.x, tMin.y), max(tMin.z, 0.0));
+    float tExit = min(min(tMax.x, tMax.y), min(tMax.z, 1.0));
+    if (tEntry < tExit) {
+        entry = nearPosition + tEntry * direction;
+        exit = nearPosition + tExit * direction;
+    }
+}
+
+// shrinks the ray segment to the region of interest and the kept side of the clipping planes, so clipped away parts
+// cost no samples
+void clipRay(inout vec3 entry, inout vec3 exit)
 {
-    // start positions from the front face texture
-    vec3 samplePos = texture(frontFaces, TexCoords).xyz;
+    vec3 direction = exit - entry;
+    if (direction == vec3(0.0))
+        return;
+    vec3 t0 = (roiLower - entry) / direction;
+    vec3 t1 = (roiUpper - entry) / direction;
+    vec3 tMin = min(t0, t1);
+    vec3 tMax = max(t0, t1);
+    float tEntry = max(max(tMin.x, tMin.y), max(tMin.z, 0.0));
+    float tExit = min(min(tMax.x, tMax.y), min(tMax.z, 1.0));
+    for (int i = 0; i < numClipPlanes; i++) {
+        float distance = dot(clipPlanes[i].xyz, entry) + clipPlanes[i].w;
+        float rate = dot(clipPlanes[i].xyz, direction);
+        if (rate > 0.0)
+            tEntry = max(tEntry, -distance / rate);
+        else if (rate < 0.0)
+            tExit = min(tExit, -distance / rate);
+        else if (distance < 0.0)
+            tExit = -1.0;
+    }
+    if (tEntry < tExit) {
+        exit = entry + tExit * direction;
+        entry = entry + tEntry * direction;
+    } else {
+        entry = vec3(0.0);
+        exit = vec3(0.0);
+    }
+}
 
-    // ray direction from the direction texture
-    vec3 direction = texture(backFaces, TexCoords).xyz - samplePos;
+// tricubic B-spline interpolation with 8 linear lookups of the coefficients: per axis the coefficient pairs (-1, 0) and
+// (1, 2) around the sample are each fetched at the position between them that weights them like the B-spline does
+// (the same as Volume::getSampleTriCubicInterpolation)
+float sampleVolumeCubic(vec3 samplePos)
+{
+    vec3 coord = samplePos / volumeInfo.xyz - 0.5;
+    vec3 index = floor(coord);
+    vec3 f = coord - index;
+    vec3 w0 = (1.0 - f) * (1.0 - f) * (1.0 - f) / 6.0;
+    vec3 w1 = (4.0 - 6.0 * f * f + 3.0 * f * f * f) / 6.0;
+    vec3 w3 = f * f * f / 6.0;
+    vec3 g0 = w0 + w1;
+    vec3 g1 = 1.0 - g0;
+    // texel centers are at voxel + 0.5
+    vec3 h0 = (index - 0.5 + w1 / g0) * volumeInfo.xyz;
+    vec3 h1 = (index + 1.5 + w3 / g1) * volumeInfo.xyz;
+
+    float plane0 = g0.y * (g0.x * texture(bsplineCoefficients, vec3(h0.x, h0.y, h0.z)).r + g1.x * texture(bsplineCoefficients, vec3(h1.x, h0.y, h0.z)).r)
+                 + g1.y * (g0.x * texture(bsplineCoefficients, vec3(h0.x, h1.y, h0.z)).r + g1.x * texture(bsplineCoefficients, vec3(h1.x, h1.y, h0.z)).r);
+    float plane1 = g0.y * (g0.x * texture(bsplineCoefficients, vec3(h0.x, h0.y, h1.z)).r + g1.x * texture(bsplineCoefficients, vec3(h1.x, h0.y, h1.z)).r)
+                 + g1.y * (g0.x * texture(bsplineCoefficients, vec3(h0.x, h1.y, h1.z)).r + g1.x * texture(bsplineCoefficients, vec3(h1.x, h1.y, h1.z)).r);
+    return g0.z * plane0 + g1.z * plane1;
+}
+
+void main()
+{
+    // start position and direction from the ray entry and exit
+    vec3 samplePos;
+    vec3 exitPos;
+    rayEntryExit(samplePos, exitPos);
+    clipRay(samplePos, exitPos);
+    vec3 direction = exitPos - samplePos;
 
     // we split the ray into the normalized direction and the length
     vec3 ray_direction = normalize(direction);
@@ -39,7 +166,7 @@ void main()
     for(int i = 0; i < numSteps; i++) {
     
         // sample the volume
-        float intensity = float(texture(volumeData, samplePos).r);
+        float intensity = interpolationMode == 2 ? sampleVolumeCubic(samplePos) : valueScale * texture(volumeData, samplePos * levelTexScale).r;
         
         // update max value
         maxIntensity = max(intensity, maxIntensity);
@@ -6,6 +6,7 @@
 
 #include "render/renderer.h"
 #include "render/gpu_renderer.h"
+#include "render/resolution_controller.h"
 #include "ui/full_screen_texture_gl.h"
 #include "ui/menu.h"
 #include "ui/surface_cube.h"
@@ -15,13 +16,19 @@
 #include "volume/gradient_volume.h"
 #include "volume/volume.h"
 #include "volume/gpu_volume.h"
+#include "volume/time_series.h"
+#include "volume/volume_pyramid.h"
+#include <algorithm>
 #include <chrono>
 #include <cmath> // log2
+#include <cstdint>
+#include <glm/common.hpp>
 #include <glm/geometric.hpp>
 #include <glm/gtx/component_wise.hpp>
 #include <glm/vec3.hpp>
 #include <imgui.h>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <ratio>
 #include <vector>
@@ -49,9 +56,12 @@ int main(int argc, char** argv)
     // Render instance contains everything you need to render (volume + renderer). Initially there is
     // nothing to render hence the optional (initially it is empty). The optional is passed to the menu
     // class which is responsible for creating the volume + renderer when the user loads a volume.
-    std::optional<volume::Volume> optVolume;
+    // A loaded file is played as a time series of its numbered siblings (a single timestep if there are none). The
+    // renderers point into the displayed timestep, which is kept alive by pTimestep.
+    std::optional<volume::TimeSeries> optTimeSeries;
+    std::optional<volume::TimeSeriesPlayback> optPlayback;
+    std::shared_ptr<volume::Timestep> pTimestep;
     std::optional<volume::GPUVolume> optGPUVolume;
-    std::optional<volume::GradientVolume> optGradientVolume;
     std::optional<render::Renderer> optRenderer;
     std::optional<render::GPURenderer> gpuRenderer;
     ui::Menu volVisMenu { viewportSize };
@@ -65,28 +75,71 @@ int main(int argc, char** argv)
     bool redrawGPUVolume = true;
     bool updateOpacitySumTable = true;
     bool updateVolume = true;
+    // The GPU volume is only uploaded for a new timestep when the GPU renderer is in use.
+    bool updateGPUTimestep = false;
 
     // This value stores a refrence of all the values that can change the render to check if anything changed
     auto loadVolume = [&](const std::filesystem::path& filePath) {
-        optVolume.emplace(filePath.string());
-        optVolume->interpolationMode = volVisMenu.interpolationMode();
-
-        optGradientVolume.emplace(optVolume.value());
-        optGPUVolume.emplace(&optVolume.value());
-        optGPUVolume->interpolationMode = volVisMenu.interpolationMode();
-        optRenderer.emplace(&optVolume.value(), &optGradientVolume.value(), &trackballCamera, volVisMenu.renderConfig());
-        gpuRenderer.emplace(&optGPUVolume.value(), &optVolume.value(), &optGradientVolume.value(), &trackballCamera, volVisMenu.renderConfig(), volVisMenu.meshConfig());
+        volVisMenu.setTimeSeriesPlayback(nullptr);
+        optPlayback.reset();
+        // Start at the file that was selected, the first frame waits for it like a single volume does.
+        auto files = volume::findTimeSeriesFiles(filePath);
+        const auto selectedFile = std::find_if(std::begin(files), std::end(files),
+            [&](const std::filesystem::path& file) { return file.filename() == filePath.filename(); });
+        const int firstTimestep = selectedFile != std::end(files) ? int(selectedFile - std::begin(files)) : 0;
+        optTimeSeries.emplace(std::move(files), volVisMenu.outOfCoreConfig(), volVisMenu.prefetchCount());
+        optPlayback.emplace(&optTimeSeries.value());
+        optPlayback->seek(firstTimestep);
+        auto pFirstTimestep = optTimeSeries->get(firstTimestep);
+        if (!pFirstTimestep) {
+            // The previously loaded volume stays on screen, without playback.
+            optPlayback.reset();
+            optTimeSeries.reset();
+            return;
+        }
+        pTimestep = std::move(pFirstTimestep);
+        optPlayback->update(std::chrono::steady_clock::now());
+        volume::Volume& volume = pTimestep->volume;
+        volume.interpolationMode = volVisMenu.interpolationMode();
+        volume.updateInterpolation();
+        pTimestep->gradientVolume.interpolationMode = volVisMenu.interpolationMode();
+
+        // The textures of a previously loaded volume are reused.
+        if (optGPUVolume) {
+            optGPUVolume->setVolume(&volume, &pTimestep->pyramid, pTimestep->minMaxTable);
+        } else {
+            optGPUVolume.emplace(&volume);
+            optGPUVolume->interpolationMode = volVisMenu.interpolationMode();
+            optGPUVolume->setVolumePyramid(&pTimestep->pyramid);
+        }
+        optRenderer.emplace(&volume, &pTimestep->gradientVolume, &trackballCamera, volVisMenu.renderConfig());
+        optRenderer->setVolumePyramid(&pTimestep->pyramid);
+        gpuRenderer.emplace(&optGPUVolume.value(), &volume, &pTimestep->gradientVolume, &trackballCamera, volVisMenu.renderConfig(), volVisMenu.meshConfig());
         gpuRenderer->setRenderSize(baseRenderResolutionScaled);
 
-        volVisMenu.setLoadedVolume(optVolume.value(), optGradientVolume.value());
+        volVisMenu.setLoadedVolume(volume, pTimestep->gradientVolume);
+        volVisMenu.setTimeSeriesPlayback(&optPlayback.value());
         trackballCamera.enableRotation(true);
 
-        const float maxDimension = float(glm::compMax(optVolume->dims()));
+        const float maxDimension = float(glm::compMax(volume.dims()));
         trackballCamera.setDistance(maxDimension);
         trackballCamera.setWorldScale(maxDimension);
-        trackballCamera.setLookAt(glm::vec3(optVolume->dims()) / 2.0f);
+        trackballCamera.setLookAt(glm::vec3(volume.dims()) / 2.0f);
+
+        redrawUserInteraction = true;
+        updateGPUTimestep = false;
+    };
 
+    // Swap the displayed timestep into the renderers. The transfer function and camera of the first timestep are kept.
+    auto showTimestep = [&](std::shared_ptr<volume::Timestep> pNewTimestep) {
+        pTimestep = std::move(pNewTimestep);
+        pTimestep->volume.interpolationMode = volVisMenu.interpolationMode();
+        pTimestep->volume.updateInterpolation();
+        pTimestep->gradientVolume.interpolationMode = volVisMenu.interpolationMode();
+        optRenderer->setVolume(&pTimestep->volume, &pTimestep->gradientVolume);
+        optRenderer->setVolumePyramid(&pTimestep->pyramid);
         redrawUserInteraction = true;
+        updateGPUTimestep = true;
     };
 
     // Callbacks.
@@ -105,10 +158,11 @@ int main(int argc, char** argv)
         });
     volVisMenu.setInterpolationModeChangedCallback(
         [&](volume::InterpolationMode interpolationMode) {
-            if (optVolume) {
-                optVolume->interpolationMode = interpolationMode;
+            if (pTimestep) {
+                pTimestep->volume.interpolationMode = interpolationMode;
+                pTimestep->volume.updateInterpolation();
                 optGPUVolume->interpolationMode = interpolationMode;
-                optGradientVolume->interpolationMode = interpolationMode;
+                pTimestep->gradientVolume.interpolationMode = interpolationMode;
             }
             redrawUserInteraction = true;
         });
@@ -142,7 +196,7 @@ int main(int argc, char** argv)
         [&](int key, int action, int mods) {
             if (key == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
 
-                glm::vec3 dims = glm::vec3(optVolume->dims());
+                glm::vec3 dims = glm::vec3(pTimestep->volume.dims());
                 glm::vec3 rectMin(0, 0, 0);
                 glm::vec3 rectMax(dims.x, dims.y, 0);
                 glm::vec3 rectNormal(0, 0, 1);
@@ -179,7 +233,7 @@ int main(int argc, char** argv)
         myWindow.registerMouseMoveCallback(
             [&](const glm::vec2& cursorPos) {
             if (myWindow.isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT)) {
-                glm::vec3 dims = glm::vec3(optVolume->dims());
+                glm::vec3 dims = glm::vec3(pTimestep->volume.dims());
                 glm::vec3 rectMin(0, 0, 0);
                 glm::vec3 rectMax(dims.x, dims.y, 0);
                 glm::vec3 rectNormal(0, 0, 1);
@@ -230,7 +284,8 @@ int main(int argc, char** argv)
     ui::SurfaceCube surfaceCube;
 
     // The dynamic resolution scale that was used in previous frame (to keep the frame time below the target).
-    int prevResolutionScale = 1;
+    render::ResolutionController resolutionController { frameTimeTarget };
+    float prevResolutionScale = 1.0f;
 
     std::chrono::duration<double> renderTime { 0 };
     std::chrono::duration<double> renderTimeFrame { 0 };
@@ -244,6 +299,10 @@ int main(int argc, char** argv)
         using clock = std::chrono::steady_clock;
         startFrame = clock::now();
 
+        // Playback only swaps in timesteps that the prefetch thread already decoded.
+        if (optPlayback && optPlayback->update(startFrame))
+            showTimestep(optPlayback->displayed());
+
         if (volVisMenu.getCPURendererInUse()) { // CPU rendering loop
 
             if (optRenderer.has_value()) {
@@ -264,43 +323,54 @@ int main(int argc, char** argv)
                 //  last frame we rendered at a lower resolution and we want to now render at the full resolution.
                 if (redrawUserInteraction || redrawFullResolution) {
                     if (redrawUserInteraction) {
-                        // Reduce the resolution if the performance drops below the target frame time.
-                        // Estimated performance when rendering at full resolution (resolution returned from menu).
-                        // This way we can dynamically update the resolution while the user is moving the camera since
-                        // some views may be slower to render than others.
-                        const float estimatedFullResFrameTime = float(renderTime.count()) * float(prevResolutionScale * prevResolutionScale);
-                        const float performanceScale = estimatedFullResFrameTime / float(frameTimeTarget);
-                        // Resolution scale changes the number of pixels quadratically (scales both width and height).
-                        const int resolutionScale = std::max(int(std::sqrt(performanceScale)) + 1, 1);
+                        // Reduce the level of detail and then the resolution if the performance drops below the target frame time.
+                        // The controller estimates the time of a frame at full resolution and detail (resolution returned from menu)
+                        // from the previous frames. This way we can dynamically update the resolution while the user is moving the
+                        // camera since some views may be slower to render than others.
+                        resolutionController.addFrame(float(renderTime.count()), prevResolutionScale, optRenderer->appliedInteractionLevels(), optRenderer->availableInteractionLevels());
+                        const float resolutionScale = resolutionController.resolutionScale();
 
                         // NOTE(Mathijs): calling setBaseRenderResolution will update the render config and call
                         //  the associated callback. Make sure that you don't read redrawUserInteraction after
                         //  this call because it will always be true.
-                        volVisMenu.setBaseRenderResolution(baseRenderResolution / resolutionScale);
+                        volVisMenu.setInteractionLevelOfDetail(resolutionController.interactionLevels());
+                        volVisMenu.setBaseRenderResolution(glm::max(glm::ivec2(glm::vec2(baseRenderResolution) * resolutionScale), glm::ivec2(1)));
                         redrawFullResolution = true;
                         prevResolutionScale = resolutionScale;
                     } else {
-                        prevResolutionScale = 1;
+                        prevResolutionScale = 1.0f;
+                        volVisMenu.setInteractionLevelOfDetail(0);
                         volVisMenu.setBaseRenderResolution(baseRenderResolution);
                         redrawFullResolution = false;
                     }
+                    // Frames below the full resolution are upsampled for display using the depth of the first hit.
+                    optRenderer->setDepthOutput(prevResolutionScale < 1.0f);
                     redrawUserInteraction = false;
 
+                    // The renderer writes the pixels straight into a mapped pixel buffer of the display texture.
+                    const glm::ivec2 renderResolution = volVisMenu.renderConfig().renderResolution;
+                    const gsl::span<uint32_t> pixels = fullScreenTextureGL.mapPixels(renderResolution);
+                    optRenderer->setPackedOutput(pixels);
+
                     using clock = std::chrono::steady_clock;
                     const auto start = clock::now();
                     optRenderer->render();
                     const auto end = clock::now();
                     renderTime = end - start;
 
-                    fullScreenTextureGL.update(optRenderer->frameBuffer(), volVisMenu.renderConfig().renderResolution);
+                    optRenderer->setPackedOutput({});
+                    if (pixels.empty())
+                        fullScreenTextureGL.update(optRenderer->frameBuffer(), renderResolution);
+                    else
+                        fullScreenTextureGL.unmapPixels(optRenderer->depthBuffer());
                 }
 
                 // === Drawing the framebuffer to the screen and adding the wireframe. ===
 
                 // Make the wireframe slightly larger than the volume to prevent z-fighting
                 constexpr float wireframeMargin = 0.05f;
-                const auto wireframeCubeSize = glm::vec3(optVolume->dims()) * (1.0f + wireframeMargin);
-                const auto wireframeCubeOffset = -glm::vec3(optVolume->dims()) * wireframeMargin * 0.5f;
+                const auto wireframeCubeSize = glm::vec3(pTimestep->volume.dims()) * (1.0f + wireframeMargin);
+                const auto wireframeCubeOffset = -glm::vec3(pTimestep->volume.dims()) * wireframeMargin * 0.5f;
                 constexpr glm::vec3 wireframeColor { 1.0f };
 
                 // Draw on the left side of the screen next to the menu.
@@ -317,7 +387,7 @@ int main(int argc, char** argv)
                 glDepthMask(GL_TRUE);
                 glDepthFunc(GL_LEQUAL);
                 glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-                surfaceCube.draw(trackballCamera, optVolume->dims());
+                surfaceCube.draw(trackballCamera, pTimestep->volume.dims());
 
                 // Enable color writes and depth blending.
                 glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
@@ -365,6 +435,16 @@ int main(int argc, char** argv)
 
                 using clock = std::chrono::steady_clock;
                 const auto start = clock::now();
+                if (updateGPUTimestep) {
+                    // The GPU volume is kept for the whole series, the timestep replaces the contents of its textures.
+                    optGPUVolume->setVolume(&pTimestep->volume, &pTimestep->pyramid, pTimestep->minMaxTable);
+                    gpuRenderer->setVolume(&optGPUVolume.value(), &pTimestep->volume, &pTimestep->gradientVolume);
+                    redrawGPUMesh = true;
+                    redrawGPUVolume = true;
+                    updateVolume = true;
+                    redrawUserInteraction = true;
+                    updateGPUTimestep = false;
+                }
                 if (redrawGPUMesh && !(myWindow.isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT) || myWindow.isMouseButtonPressed(GLFW_MOUSE_BUTTON_RIGHT))) {
                     gpuRenderer->updateGPUMesh(true);
                     redrawGPUMesh = false;
@@ -0,0 +1,54 @@
+#include "clipping.h"
+#include <algorithm>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vector_relational.hpp>
+
+namespace render {
+
+// The signed distance to a plane changes linearly along the ray, moving towards the kept side the ray starts at the
+// plane and moving away from it the ray ends there.
+bool clipRayToPlanes(Ray& ray, const RenderConfig& config)
+{
+    if (!config.clippingPlanes)
+        return true;
+
+    for (int i = 0; i < std::min(config.numClipPlanes, maxClipPlanes); i++) {
+        const glm::vec4& plane = config.clipPlanes[size_t(i)];
+        const float distance = glm::dot(glm::vec3(plane), ray.origin) + plane.w;
+        const float rate = glm::dot(glm::vec3(plane), ray.direction);
+        if (rate > 0.0f)
+            ray.tmin = std::max(ray.tmin, -distance / rate);
+        else if (rate < 0.0f)
+            ray.tmax = std::min(ray.tmax, -distance / rate);
+        else if (distance < 0.0f)
+            return false;
+    }
+    return ray.tmin <= ray.tmax;
+}
+
+void clipBoundsToRegionOfInterest(glm::vec3& lower, glm::vec3& upper, const RenderConfig& config)
+{
+    if (!config.regionOfInterest)
+        return;
+    lower = glm::max(lower, config.roiLower);
+    upper = glm::min(upper, config.roiUpper);
+}
+
+bool isBoxClippedAway(const glm::vec3& lower, const glm::vec3& upper, const RenderConfig& config)
+{
+    if (config.regionOfInterest && (glm::any(glm::lessThan(upper, config.roiLower)) || glm::any(glm::greaterThan(lower, config.roiUpper))))
+        return true;
+
+    if (config.clippingPlanes) {
+        for (int i = 0; i < std::min(config.numClipPlanes, maxClipPlanes); i++) {
+            const glm::vec4& plane = config.clipPlanes[size_t(i)];
+            // corner of the box that is furthest on the kept side
+            const glm::vec3 furthest = glm::mix(lower, upper, glm::vec3(glm::greaterThan(glm::vec3(plane), glm::vec3(0.0f))));
+            if (glm::dot(glm::vec3(plane), furthest) + plane.w < 0.0f)
+                return true;
+        }
+    }
+    return false;
+}
+}
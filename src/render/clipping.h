@@ -0,0 +1,18 @@
+#pragma once
+#include "render/ray.h"
+#include "render/render_config.h"
+#include <glm/vec3.hpp>
+
+namespace render {
+
+// Shrinks [ray.tmin, ray.tmax] to the part on the kept side of all clipping planes (if enabled), so the clipped away
+// parts are never sampled. Returns false if nothing of the ray is left.
+bool clipRayToPlanes(Ray& ray, const RenderConfig& config);
+
+// The given bounds (in voxels) intersected with the region of interest (if enabled). May be empty (lower > upper).
+void clipBoundsToRegionOfInterest(glm::vec3& lower, glm::vec3& upper, const RenderConfig& config);
+
+// Whether all of the box [lower, upper] (in voxels) is outside the region of interest or on the cut side of one of
+// the clipping planes.
+bool isBoxClippedAway(const glm::vec3& lower, const glm::vec3& upper, const RenderConfig& config);
+}
@@ -7,6 +7,13 @@ namespace render {
 struct GPUMeshConfig { 
     int blockSize {8};
     bool useEmptySpaceSkipping {false};
+    // Store the ray entry / exit positions as RGBA16F instead of RGBA32F, halves their memory and bandwidth.
+    bool halfPrecisionRayTargets {false};
+    // Compute the ray entry / exit per fragment instead of rendering the front and back faces into textures. With
+    // empty space skipping only the depths of the active blocks are rendered.
+    bool analyticRayEntryExit {false};
+    // Rasterize a marching cubes mesh of the iso surface instead of raymarching it, meshes are cached per iso value.
+    bool isoSurfaceMesh {false};
 };
 
 // NOTE(Mathijs): should be replaced by C++20 three-way operator (aka spaceship operator) if we require C++ 20 support from Linux users (GCC10 / Clang10).
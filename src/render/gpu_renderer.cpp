@@ -1,7 +1,15 @@
 #include "gpu_renderer.h"
+#include "level_of_detail.h"
+#include "proxy_geometry.h"
+#include "util/trace.h"
+#include <algorithm>
+#include <array>
+#include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/component_wise.hpp>
+#include <glm/matrix.hpp>
 #include <iostream>
+#include <string>
 
 
 namespace render {
@@ -19,9 +27,8 @@ GPURenderer::GPURenderer(
     , m_pCamera(pCamera)
     , m_renderConfig(config)
     , m_meshConfig(meshConfig)
-    , m_positions(std::vector<glm::vec3>())
-    , m_blockActive(std::vector<int>())
     , m_minMaxValues(std::vector<glm::vec2>())
+    , m_isoSurfaceMeshCache(pVolume, pGradientVolume)
 
 {
     // The general framebuffer with depth component
@@ -37,6 +44,14 @@ GPURenderer::GPURenderer(
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
+    // depth of the farthest back face of the active blocks for analytic ray entry / exit
+    glGenTextures(1, &m_exitDepthTexture);
+    glBindTexture(GL_TEXTURE_2D, m_exitDepthTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
     //Create textures for ray parameters, cube positions and cube min max values
     glGenTextures(1, &m_frontfaces_texture);
     glBindTexture(GL_TEXTURE_2D, m_frontfaces_texture);
@@ -61,22 +76,22 @@ GPURenderer::GPURenderer(
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_frontfaces_texture, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    // Buffers to store block position offesets and block active state for empty space skipping
+    // Buffers to store the origin and size of the boxes of active blocks for empty space skipping
     // We use GL_TEXTURE_BUFFER instead of GL_TEXTURE_1D to avoid running into size limitations
     glGenBuffers(1, &positionsBufferID);
     glBindBuffer(GL_TEXTURE_BUFFER, positionsBufferID);
-    glBufferData(GL_TEXTURE_BUFFER, m_positions.size() * sizeof(glm::vec3), m_positions.data(), GL_DYNAMIC_DRAW);
+    glBufferData(GL_TEXTURE_BUFFER, 0, nullptr, GL_DYNAMIC_DRAW);
     glGenTextures(1, &positionsTexID);
     glBindTexture(GL_TEXTURE_BUFFER, positionsTexID);
     glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, positionsBufferID);
     glBindTexture(GL_TEXTURE_BUFFER, 0);
 
-    glGenBuffers(1, &m_blockActiveBufferID);
-    glBindBuffer(GL_TEXTURE_BUFFER, m_blockActiveBufferID);
-    glBufferData(GL_TEXTURE_BUFFER, m_blockActive.size() * sizeof(int), m_blockActive.data(), GL_DYNAMIC_DRAW);
-    glGenTextures(1, &m_blockActiveTexID);
-    glBindTexture(GL_TEXTURE_BUFFER, m_blockActiveTexID);
-    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32I, m_blockActiveBufferID);
+    glGenBuffers(1, &m_boxSizesBufferID);
+    glBindBuffer(GL_TEXTURE_BUFFER, m_boxSizesBufferID);
+    glBufferData(GL_TEXTURE_BUFFER, 0, nullptr, GL_DYNAMIC_DRAW);
+    glGenTextures(1, &m_boxSizesTexID);
+    glBindTexture(GL_TEXTURE_BUFFER, m_boxSizesTexID);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, m_boxSizesBufferID);
     glBindTexture(GL_TEXTURE_BUFFER, 0);
 
     // Vertex Shader for rendering the cube geometry
@@ -93,6 +108,9 @@ GPURenderer::GPURenderer(
     linkShaderProgram(m_isoShader, screenFillingQuadVertexShader, loadShader("volvis_rendermode_isosurface_frag.glsl", GL_FRAGMENT_SHADER));
     linkShaderProgram(m_compositeShader, screenFillingQuadVertexShader, loadShader("volvis_rendermode_compositing_frag.glsl", GL_FRAGMENT_SHADER));
 
+    // Rasterized iso surface mesh
+    linkShaderProgram(m_isoMeshShader, loadShader("volvis_isosurface_mesh_vert.glsl", GL_VERTEX_SHADER), loadShader("volvis_isosurface_mesh_frag.glsl", GL_FRAGMENT_SHADER));
+
     // == geometry
     // screen filling quad
     const float quadVertices[] = {
@@ -164,6 +182,26 @@ GPURenderer::GPURenderer(
 
     glBindVertexArray(0);
 
+    // iso surface mesh, the buffers are filled when the mesh of an iso value is drawn for the first time
+    glGenVertexArrays(1, &m_isoMeshVAO);
+    glBindVertexArray(m_isoMeshVAO);
+
+    glGenBuffers(1, &m_isoMeshPositionsVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_isoMeshPositionsVBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr);
+
+    glGenBuffers(1, &m_isoMeshNormalsVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_isoMeshNormalsVBO);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr);
+
+    glGenBuffers(1, &m_isoMeshIBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_isoMeshIBO);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
     // set clear color
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 
@@ -174,82 +212,77 @@ GPURenderer::GPURenderer(
     updateOpacitySumTable();
 }
 
-// ======= TODO: IMPLEMENT ========
-//
-// Part of **2. Empty Space Skipping**
-// 
-// This function should create the summed area table to help identifying active blocks quickly
+// Creates the prefix count of the TF entries with an opacity, so whether a value range is visible is answered in
+// constant time by the blocks here and the bricks of the GPUVolume
 // It will be updated every time the transfer function changes
-// You can access the transfer function from the render config: m_renderConfig.tfColorMap
-// Store the values in m_opacitySumTable 
 void GPURenderer::updateOpacitySumTable()
 {
+    util::ScopedTimer timer("GPURenderer::updateOpacitySumTable", "tf");
+
+    m_opacityRangeIndex = OpacityRangeIndex(m_renderConfig.tfColorMap, m_renderConfig.tfColorMapIndexStart, m_renderConfig.tfColorMapIndexRange);
 }
 
-// ======= TODO: IMPLEMENT ========
-//
-// Part of **2. Empty Space Skipping**
-//
-// This function should calculate the min and max values for the volume blocks
-// It will be updated when the volume is loaded or the block size changes
-// You can access the volume using m_pVolume like in the CPU renderer
+// Calculates the min and max values per block, it will be updated when the volume is loaded or the block size changes.
+// The table comes from the GPUVolume, which derives it from a finer table it scanned before when the block sizes divide.
+// Blocks are padded by one voxel because samples near a block face interpolate with the neighbouring block.
 void GPURenderer::updateBlockingMinMaxTable()
 {
-    // If empty space skipping is disabled we will only have a single, active block
-    // this contains the number of blocks in 3D
-    // you need to update m_numBlocks3D with the correct values for this to work
-    m_numBlocks3D = glm::vec3(1);
-
-
-    // === The enclosed code works for a single block (start).
-    // You need to update it to calculate m_positions and m_minMaxValues for the general case
-
-    int numBlocks = m_numBlocks3D.x * m_numBlocks3D.y * m_numBlocks3D.z;
+    util::ScopedTimer timer("GPURenderer::updateBlockingMinMaxTable", "blocking");
 
-    // you should save the offset to all blocks in 3D voxel coordinates this as glm::vec3
-    // e.g., [ (0,0,0), (blocksize, 0, 0), (2*blocksize, 0, 0) ... (0, blocksize, 0) ... etc. ]
-    m_positions.clear();
     m_minMaxValues.clear();
 
-    // This reserves the positions and adds the origin, fully implemented you need to add the offset in voxels for every block
-    // we add a single offset at the origin to render one cube
-    m_positions.reserve(numBlocks);
-    m_positions.push_back(glm::vec3(0, 0, 0));
-    // we set the corresponding min-max to 0 and volume max to make sure the block is always visible
-    m_minMaxValues.reserve(numBlocks);
-    m_minMaxValues.push_back(glm::vec2(0, m_pVolume->maximum()));
-    // === The enclosed code works for a single block (end).
-
-    // after updating the positions we load them to the GPU
-    glBindBuffer(GL_TEXTURE_BUFFER, positionsBufferID);
-    glBufferData(GL_TEXTURE_BUFFER, m_positions.size() * sizeof(glm::vec3), m_positions.data(), GL_DYNAMIC_DRAW);
+    // If empty space skipping is disabled we will only have a single, active block
+    // out-of-core volumes are not rendered on the GPU, so we do not stream them to compute the table
+    if (!m_meshConfig.useEmptySpaceSkipping || m_pVolume->isOutOfCore()) {
+        m_numBlocks3D = glm::vec3(1);
+        m_blockGridSize = glm::ivec3(1);
+        m_minMaxValues.push_back(glm::vec2(0, m_pVolume->maximum()));
+    } else {
+        const volume::MinMaxTable table = m_pGPUVolume->minMaxTable(m_meshConfig.blockSize, 1);
+        // the cubes are scaled by 1 / m_numBlocks3D in the vertex shader, a fractional number of blocks keeps them the
+        // size of a block and the shader clamps the last row of cubes to the volume
+        m_numBlocks3D = glm::vec3(m_pVolume->dims()) / float(m_meshConfig.blockSize);
+
+        // blocks are stored x first, boxes of them are positioned in units of blocks
+        m_blockGridSize = table.size();
+        m_minMaxValues.assign(std::begin(table.values()), std::end(table.values()));
+    }
+    m_blockSpanSpaceIndex = SpanSpaceIndex(m_minMaxValues);
 }
 
-// ======= TODO: IMPLEMENT ========
-//
-// Part of **2. Empty Space Skipping**
-//
-// This function should calculate whether a block is active or not
+// Calculates whether a block is active or not
 // It will be updated whenever the volume is loaded or the block size changes
 // and when the transfer function or iso value changes
-// You need to acces the m_opacitySumTable for the compositing mode.
-// This works the same way as accessing the TF in the CPU renderer. Have a look at the getTFValue in renderer.cpp
 void GPURenderer::updateActiveBlocks()
 {
-    // this vector simply should contain 1 if the block is active and 0 otherwise
-    // we resize it to the size of the positions vector (both are the size of the number of blocks)
-    m_blockActive.resize(m_positions.size());
-
-    // for the single cube case
-    if (m_blockActive.size() == 1) {
-        //  we set the active state to 1 to make it active
-        m_blockActive[0] = 1;
+    util::ScopedTimer timer("GPURenderer::updateActiveBlocks", "tf");
+
+    // one bit per block, classified in parallel, blocks outside the region of interest or clipped away are inactive
+    // a single block is always active
+    if (m_minMaxValues.size() == 1) {
+        m_blockActive = ActiveMask(1);
+        m_blockActive.set(0, true);
+    } else {
+        m_blockActive = classifyCells(m_minMaxValues, m_blockGridSize, m_meshConfig.blockSize, 1, m_renderConfig, m_opacityRangeIndex, &m_blockSpanSpaceIndex);
+    }
+
+    // only the active blocks are drawn, merged into boxes, so the proxy geometry follows the surface of the active region
+    const std::vector<BlockBox> boxes = mergeActiveBlocks(m_blockActive, m_blockGridSize);
+    std::vector<glm::vec3> boxOrigins;
+    std::vector<glm::vec3> boxSizes;
+    boxOrigins.reserve(boxes.size());
+    boxSizes.reserve(boxes.size());
+    for (const BlockBox& box : boxes) {
+        boxOrigins.push_back(glm::vec3(box.origin));
+        boxSizes.push_back(glm::vec3(box.size));
     }
+    m_numProxyBoxes = boxes.size();
 
-    // this works for any m_blockActive size
-    // after updating the positions we load them to the GPU
-    glBindBuffer(GL_TEXTURE_BUFFER, m_blockActiveBufferID);
-    glBufferData(GL_TEXTURE_BUFFER, m_blockActive.size() * sizeof(int), m_blockActive.data(), GL_DYNAMIC_DRAW);
+    // after merging the boxes we load them to the GPU
+    glBindBuffer(GL_TEXTURE_BUFFER, positionsBufferID);
+    glBufferData(GL_TEXTURE_BUFFER, GLsizeiptr(boxOrigins.size() * sizeof(glm::vec3)), boxOrigins.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, m_boxSizesBufferID);
+    glBufferData(GL_TEXTURE_BUFFER, GLsizeiptr(boxSizes.size() * sizeof(glm::vec3)), boxSizes.data(), GL_DYNAMIC_DRAW);
 }
 
 // ======= DO NOT MODIFY THIS FUNCTION ========
@@ -263,6 +296,16 @@ void GPURenderer::updateGPUMesh(bool updateMinMax)
     updateActiveBlocks();
 }
 
+// The cached iso surface meshes belong to the previous volume.
+void GPURenderer::setVolume(volume::GPUVolume* pGPUVolume, const volume::Volume* pVolume, const volume::GradientVolume* pGradientVolume)
+{
+    m_pGPUVolume = pGPUVolume;
+    m_pVolume = pVolume;
+    m_pGradientVolume = pGradientVolume;
+    m_isoSurfaceMeshCache = IsoSurfaceMeshCache(pVolume, pGradientVolume);
+    m_pIsoSurfaceMesh = nullptr;
+}
+
 // ======= DO NOT MODIFY THIS FUNCTION ========
 // sets the render configuration
 void GPURenderer::setRenderConfig(const RenderConfig& config)
@@ -300,12 +343,8 @@ void GPURenderer::updateMatrices()
 // function for the off screen front faces and directions render passes
 void GPURenderer::renderDirections()
 {
-    // Manage the depth buffer
-    glBindTexture(GL_TEXTURE_2D, m_depthTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, m_renderResolution.x, m_renderResolution.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-
-    glBindTexture(GL_TEXTURE_2D, m_frontfaces_texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_renderResolution.x, m_renderResolution.y, 0, GL_RGBA, GL_FLOAT, nullptr);
+    // (Re)allocate the depth buffer and the front / back face textures if the resolution or precision changed
+    resizeRenderTargets();
 
     // Bind the framebuffer and attach textures
     glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
@@ -325,10 +364,6 @@ void GPURenderer::renderDirections()
     drawGeometry(m_facesShader);
 
     // === render the back faces
-    // Update texture for the directions
-    glBindTexture(GL_TEXTURE_2D, m_backfaces_texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_renderResolution.x, m_renderResolution.y, 0, GL_RGBA, GL_FLOAT, nullptr);
-
     // Attach direction texture to framebuffer
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_backfaces_texture, 0);
 
@@ -351,18 +386,113 @@ void GPURenderer::renderDirections()
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+// How the raymarching shaders find the entry and exit of each ray (see rayEntryExit() in the shaders):
+// 0 = front / back face textures, 1 = analytic intersection with the volume bounds, 2 = analytic between the depths of
+// the active blocks. The debug render steps show the face textures, so they always use mode 0.
+int GPURenderer::rayEntryExitMode() const
+{
+    if (!m_meshConfig.analyticRayEntryExit || m_renderConfig.renderStep != 3)
+        return 0;
+    return m_meshConfig.useEmptySpaceSkipping ? 2 : 1;
+}
+
+// Depth-only variant of renderDirections for analytic rays with empty space skipping: the nearest front face and the
+// farthest back face of the active blocks bound the part of each ray that is marched.
+void GPURenderer::renderBlockDepths()
+{
+    resizeRenderTargets();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glEnable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glUseProgram(m_facesShader);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_depthTexture, 0);
+    glClearDepth(1.0f);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glDepthFunc(GL_LESS);
+    drawGeometry(m_facesShader);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_exitDepthTexture, 0);
+    glClearDepth(0.0f);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glDepthFunc(GL_GREATER);
+    drawGeometry(m_facesShader);
+
+    // restore the state renderDirections leaves behind
+    glClearDepth(1.0f);
+    glDepthFunc(GL_LEQUAL);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_depthTexture, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Uniforms of rayEntryExit() and clipRay() in the raymarching shaders, the face textures themselves are bound by the callers.
+void GPURenderer::bindRayEntryExit(GLuint shader)
+{
+    glUniform1i(glGetUniformLocation(shader, "rayEntryExitMode"), rayEntryExitMode());
+    // the cube geometry is the unit cube scaled by the model matrix, so this maps clip space to normalized volume coordinates
+    const glm::mat4 invViewProjection = glm::inverse(m_viewProjectionMatrix);
+    glUniformMatrix4fv(glGetUniformLocation(shader, "invViewProjection"), 1, GL_FALSE, glm::value_ptr(invViewProjection));
+
+    glActiveTexture(GL_TEXTURE10);
+    glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+    glUniform1i(glGetUniformLocation(shader, "entryDepth"), 10);
+    glActiveTexture(GL_TEXTURE11);
+    glBindTexture(GL_TEXTURE_2D, m_exitDepthTexture);
+    glUniform1i(glGetUniformLocation(shader, "exitDepth"), 11);
+
+    // the shaders clip the rays in normalized volume coordinates (p / dims), a plane n.p + w keeps its offset when
+    // the normal is scaled by the dimensions
+    const glm::vec3 volumeDims = m_pVolume->dims();
+    std::array<glm::vec4, maxClipPlanes> clipPlanes;
+    for (size_t i = 0; i < clipPlanes.size(); i++)
+        clipPlanes[i] = glm::vec4(glm::vec3(m_renderConfig.clipPlanes[i]) * volumeDims, m_renderConfig.clipPlanes[i].w);
+    const int numClipPlanes = m_renderConfig.clippingPlanes ? std::clamp(m_renderConfig.numClipPlanes, 0, maxClipPlanes) : 0;
+    glUniform1i(glGetUniformLocation(shader, "numClipPlanes"), numClipPlanes);
+    glUniform4fv(glGetUniformLocation(shader, "clipPlanes"), maxClipPlanes, glm::value_ptr(clipPlanes[0]));
+    const glm::vec3 roiLower = m_renderConfig.regionOfInterest ? m_renderConfig.roiLower / volumeDims : glm::vec3(0.0f);
+    const glm::vec3 roiUpper = m_renderConfig.regionOfInterest ? m_renderConfig.roiUpper / volumeDims : glm::vec3(1.0f);
+    glUniform3fv(glGetUniformLocation(shader, "roiLower"), 1, glm::value_ptr(roiLower));
+    glUniform3fv(glGetUniformLocation(shader, "roiUpper"), 1, glm::value_ptr(roiUpper));
+}
+
+// The render targets keep their storage between frames and are only reallocated when setRenderSize() changed the
+// resolution or the precision of the ray targets was toggled. Half floats store the entry / exit positions (normalized
+// volume coordinates) with an error of at most 1/2048, about a quarter voxel for a 512^3 volume.
+void GPURenderer::resizeRenderTargets()
+{
+    const GLint rayTargetFormat = m_meshConfig.halfPrecisionRayTargets ? GL_RGBA16F : GL_RGBA32F;
+    if (m_renderTargetSize == m_renderResolution && m_rayTargetFormat == rayTargetFormat)
+        return;
+
+    for (GLuint texture : { m_depthTexture, m_exitDepthTexture }) {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, m_renderResolution.x, m_renderResolution.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    }
+    for (GLuint texture : { m_frontfaces_texture, m_backfaces_texture }) {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, rayTargetFormat, m_renderResolution.x, m_renderResolution.y, 0, GL_RGBA, GL_FLOAT, nullptr);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_renderTargetSize = m_renderResolution;
+    m_rayTargetFormat = rayTargetFormat;
+}
+
 // ======= DO NOT MODIFY THIS FUNCTION ========
 // draws the actual bounding geometry
 void GPURenderer::drawGeometry(GLuint shaderID)
 {
-    // texture buffers for the vertex shader to decide whether to keep a block
+    // texture buffers with the origin and size of every box of active blocks
     glActiveTexture(GL_TEXTURE5); //We start from texture 5 to avoid overlapping textures 
     glBindTexture(GL_TEXTURE_BUFFER, positionsTexID);
     glUniform1i(glGetUniformLocation(shaderID, "positionCube"), 5);
 
     glActiveTexture(GL_TEXTURE6);
-    glBindTexture(GL_TEXTURE_BUFFER, m_blockActiveTexID);
-    glUniform1i(glGetUniformLocation(shaderID, "blockActive"), 6);
+    glBindTexture(GL_TEXTURE_BUFFER, m_boxSizesTexID);
+    glUniform1i(glGetUniformLocation(shaderID, "boxSize"), 6);
 
     // the size of each cube in normalized volume coordinates
     glUniform3fv(glGetUniformLocation(shaderID, "cubeSize"), 1, glm::value_ptr(1.0f / m_numBlocks3D));
@@ -373,10 +503,9 @@ void GPURenderer::drawGeometry(GLuint shaderID)
 
     glClear(GL_COLOR_BUFFER_BIT);
 
-    // we draw an instance of the cube for every item in m_positions
-    // we can then handle cubes that are empty in the vertex shader by moving them out of the view so that they are automatically culled
+    // we draw an instance of the cube for every box of active blocks, the vertex shader scales it to the box
     glBindVertexArray(m_vao);
-    glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0, m_positions.size());
+    glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0, GLsizei(m_numProxyBoxes));
 }
 
 // ======= DO NOT MODIFY THIS FUNCTION ========
@@ -400,11 +529,25 @@ void GPURenderer::renderTextureToScreen(GLuint texture)
 // Called to render a frame, passes the call along to the correct render method after some shared setup  
 void GPURenderer::render()
 {
+    util::ScopedTimer timer("GPURenderer::render", "render");
+
     // update the model view projection
     updateMatrices();
 
-    // we render front faces and directions into textures here
-    renderDirections();
+    // pick the level of the volume pyramid whose voxels are about the size of a pixel (see Renderer::render)
+    int levelOfDetail = 0;
+    if (m_renderConfig.levelOfDetail) {
+        const float pixelSize = projectedPixelSize(*m_pCamera, m_renderResolution, glm::vec3(0.0f), glm::vec3(m_pVolume->dims() - glm::ivec3(1)));
+        levelOfDetail = m_pGPUVolume->selectLevelOfDetail(pixelSize, m_renderConfig.lodBias + float(m_renderConfig.interactionLod));
+    }
+    m_pGPUVolume->setLevelOfDetail(levelOfDetail);
+
+    // we render front faces and directions into textures here, analytic rays only need the depths of the active blocks
+    const int rayMode = rayEntryExitMode();
+    if (rayMode == 0)
+        renderDirections();
+    else if (rayMode == 2)
+        renderBlockDepths();
 
     // when setting the gui to show front faces or directions we render the corresponding texture
     if (m_renderConfig.renderStep == 1) {
@@ -443,6 +586,7 @@ void GPURenderer::renderMIP()
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, m_frontfaces_texture);
     glUniform1i(glGetUniformLocation(m_mipShader, "frontFaces"), 1);
+    bindRayEntryExit(m_mipShader);
 
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_3D, m_pGPUVolume->getTexId());
@@ -450,11 +594,15 @@ void GPURenderer::renderMIP()
 
     // we bring the stepsize into normalized volume coordinates
     // first we need the max volume extent
+    // coarser levels of detail take proportionally larger steps
     glm::vec3 volDims = m_pVolume->dims();
     float maxExtent = std::max(volDims.x, std::max(volDims.y, volDims.z));
-    float stepSizeNorm = m_renderConfig.stepSize / maxExtent;
+    float stepSizeNorm = m_renderConfig.stepSize * volume::VolumePyramid::levelScale(m_pGPUVolume->getLevelOfDetail()) / maxExtent;
     glm::vec4 renderOptions = glm::vec4(stepSizeNorm, 1.0f / stepSizeNorm, 0.0f, 0.0f);
     glUniform4fv(glGetUniformLocation(m_mipShader, "renderOptions"), 1, glm::value_ptr(renderOptions));
+    glUniform3fv(glGetUniformLocation(m_mipShader, "levelTexScale"), 1, glm::value_ptr(m_pGPUVolume->getLevelTexCoordScale()));
+    glUniform1f(glGetUniformLocation(m_mipShader, "valueScale"), m_pGPUVolume->getValueScale());
+    bindInterpolation(m_mipShader);
 
     // the reciprocal of the volDims is the voxelSize in 0..1 space, the reciprocal of the maximum vol value eases GPU load
     glm::vec4 volumeInfo = glm::vec4(1.0f / volDims, 1.0f / m_pVolume->maximum());
@@ -468,16 +616,15 @@ void GPURenderer::renderMIP()
     glBindVertexArray(0);
 }
 
-// ======= TODO: IMPLEMENT ========
-// 
-// Part of **3. Volume Bricking**
-// 
-// This function is largely complete.
-// You only need to add further uniforms as needed.
-// 
 // GPU implementation of a iso-surface raycaster
 void GPURenderer::renderIso()
 {
+        // out-of-core volumes have no voxel data to extract a mesh from
+        if (m_meshConfig.isoSurfaceMesh && !m_pVolume->isOutOfCore()) {
+            renderIsoSurfaceMesh();
+            return;
+        }
+
         glUseProgram(m_isoShader);
 
         // Pass textures
@@ -488,6 +635,7 @@ void GPURenderer::renderIso()
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, m_frontfaces_texture);
         glUniform1i(glGetUniformLocation(m_isoShader, "frontFaces"), 1);
+        bindRayEntryExit(m_isoShader);
 
         glActiveTexture(GL_TEXTURE2);
         glBindTexture(GL_TEXTURE_3D, m_pGPUVolume->getTexId());
@@ -503,17 +651,19 @@ void GPURenderer::renderIso()
         glm::vec4 volumeInfo = glm::vec4(1.0f / volDims, m_pGPUVolume->useBricking());
         glUniform4fv(glGetUniformLocation(m_isoShader, "volumeInfo"), 1, glm::value_ptr(volumeInfo));
 
-        // we bring the stepsize into normalized volume coordinates
+        // we bring the stepsize into normalized volume coordinates, coarser levels of detail take larger steps
         float maxExtent = std::max(volDims.x, std::max(volDims.y, volDims.z));
-        glUniform4fv(glGetUniformLocation(m_isoShader, "renderOptions"), 1, glm::value_ptr(glm::vec4( m_renderConfig.stepSize / maxExtent,
-                                                                                                      maxExtent / m_renderConfig.stepSize,
+        const float stepSize = m_renderConfig.stepSize * volume::VolumePyramid::levelScale(m_pGPUVolume->getLevelOfDetail());
+        glUniform3fv(glGetUniformLocation(m_isoShader, "levelTexScale"), 1, glm::value_ptr(m_pGPUVolume->getLevelTexCoordScale()));
+        glUniform1f(glGetUniformLocation(m_isoShader, "valueScale"), m_pGPUVolume->getValueScale());
+        glUniform4fv(glGetUniformLocation(m_isoShader, "renderOptions"), 1, glm::value_ptr(glm::vec4( stepSize / maxExtent,
+                                                                                                      maxExtent / stepSize,
                                                                                                       m_renderConfig.isoValue,
                                                                                                       m_renderConfig.volumeShading )));
  
-// ======= TODO: IMPLEMENT ========
-//
-// Part of **3. Volume Bricking**
-// Add further uniforms as needed
+        bindBrickCache(m_isoShader);
+        bindInterpolation(m_isoShader);
+
         glClear(GL_COLOR_BUFFER_BIT);
 
         // rendering happens drawing the screenfilling quad and using the front faces and direction as input
@@ -522,13 +672,6 @@ void GPURenderer::renderIso()
         glBindVertexArray(0);
 }
 
-// ======= TODO: IMPLEMENT ========
-//
-// Part of **3. Volume Bricking**
-//
-// This function is largely complete.
-// You only need to add further uniforms as needed.
-//
 // GPU implementation of a Composite raycaster with a given 1D transferfunction 
 void GPURenderer::renderComposite()
 {
@@ -542,6 +685,7 @@ void GPURenderer::renderComposite()
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, m_frontfaces_texture);
         glUniform1i(glGetUniformLocation(m_compositeShader, "frontFaces"), 1);
+        bindRayEntryExit(m_compositeShader);
 
         glActiveTexture(GL_TEXTURE2);
         glBindTexture(GL_TEXTURE_3D, m_pGPUVolume->getTexId());
@@ -557,11 +701,15 @@ void GPURenderer::renderComposite()
 
         // we bring the stepsize into normalized volume coordinates
         // first we need the max volume extent
+        // coarser levels of detail take proportionally larger steps
         glm::vec3 volDims = m_pVolume->dims();
         float maxExtent = std::max(volDims.x, std::max(volDims.y, volDims.z));
-        glUniform4fv(glGetUniformLocation(m_compositeShader, "renderOptions"), 1, glm::value_ptr(glm::vec4( m_renderConfig.stepSize / maxExtent,
-                                                                                                            maxExtent / m_renderConfig.stepSize,
-                                                                                                            m_renderConfig.stepSize,
+        const float stepSize = m_renderConfig.stepSize * volume::VolumePyramid::levelScale(m_pGPUVolume->getLevelOfDetail());
+        glUniform3fv(glGetUniformLocation(m_compositeShader, "levelTexScale"), 1, glm::value_ptr(m_pGPUVolume->getLevelTexCoordScale()));
+        glUniform1f(glGetUniformLocation(m_compositeShader, "valueScale"), m_pGPUVolume->getValueScale());
+        glUniform4fv(glGetUniformLocation(m_compositeShader, "renderOptions"), 1, glm::value_ptr(glm::vec4( stepSize / maxExtent,
+                                                                                                            maxExtent / stepSize,
+                                                                                                            stepSize,
                                                                                                             m_renderConfig.volumeShading )));
 
         glUniform4fv(glGetUniformLocation(m_compositeShader, "gmParams"), 1, glm::value_ptr(glm::vec4( m_renderConfig.illustrativeParams.x,
@@ -577,10 +725,8 @@ void GPURenderer::renderComposite()
         glUniform2fv(glGetUniformLocation(m_compositeShader, "volumeMaxValues"), 1, glm::value_ptr(glm::vec2( 1.0f/m_pVolume->maximum(),
                                                                                                               1.0f/m_pGradientVolume->maxMagnitude())));
         
-        // ======= TODO: IMPLEMENT ========
-        //
-        // Part of **3. Volume Bricking**
-        // Add further uniforms as needed
+        bindBrickCache(m_compositeShader);
+        bindInterpolation(m_compositeShader);
 
         glClear(GL_COLOR_BUFFER_BIT);
 
@@ -590,13 +736,102 @@ void GPURenderer::renderComposite()
         glBindVertexArray(0);
 }
 
+// Makes the mesh of the current iso value the one in the vertex / index buffers. It is only extracted the first time an
+// iso value is used (or after it dropped out of the cache), otherwise drawing the surface costs no search along rays.
+void GPURenderer::uploadIsoSurfaceMesh()
+{
+    if (m_pIsoSurfaceMesh && m_pIsoSurfaceMesh->isoValue == m_isoSurfaceMeshCache.roundIsoValue(m_renderConfig.isoValue))
+        return;
+
+    m_pIsoSurfaceMesh = m_isoSurfaceMeshCache.mesh(m_renderConfig.isoValue);
+    util::ScopedTimer timer("GPURenderer::uploadIsoSurfaceMesh", "isosurface");
+    glBindBuffer(GL_ARRAY_BUFFER, m_isoMeshPositionsVBO);
+    glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(m_pIsoSurfaceMesh->positions.size() * sizeof(glm::vec3)), m_pIsoSurfaceMesh->positions.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, m_isoMeshNormalsVBO);
+    glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(m_pIsoSurfaceMesh->normals.size() * sizeof(glm::vec3)), m_pIsoSurfaceMesh->normals.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // the element buffer is part of the vertex array state
+    glBindVertexArray(m_isoMeshVAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_isoMeshIBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(m_pIsoSurfaceMesh->indices.size() * sizeof(uint32_t)), m_pIsoSurfaceMesh->indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+}
+
+// Rasterizes the iso surface mesh with the depth test, shaded like the raymarched surface. The mesh is in voxel
+// coordinates and the raymarchers sample voxel (x, y, z) at (x, y, z) + 0.5 of the unit cube scaled by the dimensions.
+void GPURenderer::renderIsoSurfaceMesh()
+{
+    uploadIsoSurfaceMesh();
+
+    glUseProgram(m_isoMeshShader);
+    const glm::mat4 model = glm::translate(glm::identity<glm::mat4>(), glm::vec3(0.5f));
+    const glm::mat4 modelViewProjection = m_pCamera->projectionMatrix() * m_pCamera->viewMatrix() * model;
+    glUniformMatrix4fv(glGetUniformLocation(m_isoMeshShader, "u_model"), 1, GL_FALSE, glm::value_ptr(model));
+    glUniformMatrix4fv(glGetUniformLocation(m_isoMeshShader, "u_modelViewProjection"), 1, GL_FALSE, glm::value_ptr(modelViewProjection));
+    glUniform3fv(glGetUniformLocation(m_isoMeshShader, "cameraPosition"), 1, glm::value_ptr(m_pCamera->position()));
+    glUniform1i(glGetUniformLocation(m_isoMeshShader, "useShading"), m_renderConfig.volumeShading);
+
+    // the clipping planes and region of interest are in voxel coordinates like the mesh
+    const int numClipPlanes = m_renderConfig.clippingPlanes ? std::clamp(m_renderConfig.numClipPlanes, 0, maxClipPlanes) : 0;
+    glUniform1i(glGetUniformLocation(m_isoMeshShader, "numClipPlanes"), numClipPlanes);
+    glUniform4fv(glGetUniformLocation(m_isoMeshShader, "clipPlanes"), maxClipPlanes, glm::value_ptr(m_renderConfig.clipPlanes[0]));
+    const glm::vec3 roiLower = m_renderConfig.regionOfInterest ? m_renderConfig.roiLower : glm::vec3(0.0f);
+    const glm::vec3 roiUpper = m_renderConfig.regionOfInterest ? m_renderConfig.roiUpper : glm::vec3(m_pVolume->dims() - glm::ivec3(1));
+    glUniform3fv(glGetUniformLocation(m_isoMeshShader, "roiLower"), 1, glm::value_ptr(roiLower));
+    glUniform3fv(glGetUniformLocation(m_isoMeshShader, "roiUpper"), 1, glm::value_ptr(roiUpper));
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glBindVertexArray(m_isoMeshVAO);
+    glDrawElements(GL_TRIANGLES, GLsizei(m_pIsoSurfaceMesh->indices.size()), GL_UNSIGNED_INT, nullptr);
+    glBindVertexArray(0);
+    glDepthFunc(GL_LEQUAL);
+}
+
+// The bricked lookup needs the index coverage and the brick cache, which can be spread over several textures.
+// The first cache texture is bound as volumeData, the others to units 7 and up. Samplers of unused cache textures
+// get the first one, a sampler3D may not share a unit with the 2D textures.
+void GPURenderer::bindBrickCache(GLuint shader)
+{
+    glUniform3fv(glGetUniformLocation(shader, "indexTexScale"), 1, glm::value_ptr(m_pGPUVolume->getIndexTexCoordScale()));
+
+    std::array<glm::vec3, volume::maxBrickAtlasTextures> cacheSizeRcp;
+    for (int atlas = 0; atlas < volume::maxBrickAtlasTextures; atlas++) {
+        const bool used = atlas < m_pGPUVolume->getNumCacheTextures();
+        cacheSizeRcp[size_t(atlas)] = 1.0f / glm::vec3(m_pGPUVolume->getBrickVolumeSize(used ? atlas : 0));
+        if (atlas == 0)
+            continue;
+
+        glActiveTexture(GL_TEXTURE6 + GLenum(atlas));
+        glBindTexture(GL_TEXTURE_3D, used ? m_pGPUVolume->getCacheTexId(atlas) : m_pGPUVolume->getTexId());
+        const std::string samplerName = "volumeAtlas" + std::to_string(atlas);
+        glUniform1i(glGetUniformLocation(shader, samplerName.c_str()), 6 + atlas);
+    }
+    glUniform3fv(glGetUniformLocation(shader, "cacheSizeRcp"), volume::maxBrickAtlasTextures, glm::value_ptr(cacheSizeRcp[0]));
+}
+
+// The shaders need the interpolation mode for the gradients, which they compute from the texels around a sample. With
+// cubic interpolation sampleVolume() reads the B-spline coefficients of the whole volume on unit 12 instead of the
+// volume texture or the brick cache.
+void GPURenderer::bindInterpolation(GLuint shader)
+{
+    int interpolationMode = m_pGPUVolume->interpolationMode == volume::InterpolationMode::NearestNeighbour ? 0 : 1;
+    if (m_pGPUVolume->useCubicInterpolation())
+        interpolationMode = 2;
+    glUniform1i(glGetUniformLocation(shader, "interpolationMode"), interpolationMode);
+    glActiveTexture(GL_TEXTURE12);
+    glBindTexture(GL_TEXTURE_3D, m_pGPUVolume->getBSplineTexId());
+    glUniform1i(glGetUniformLocation(shader, "bsplineCoefficients"), 12);
+}
+
 // ======= DO NOT MODIFY THIS FUNCTION ========
 // Note: Only used to pass update events through to the GPU Volume
 // Upate the volume bricks after a tf/iso change or setting the bricksize
 // only updates the cache, should not be called when bricksize change. call setVolumeBricksSize in that case
 void GPURenderer::updateVolumeBricks()
 {
-    m_pGPUVolume->updateBrickCache(m_renderConfig, m_opacitySumTable);
+    m_pGPUVolume->updateBrickCache(m_renderConfig, m_opacityRangeIndex);
 }
 
 // ======= DO NOT MODIFY THIS FUNCTION ========
@@ -604,7 +839,7 @@ void GPURenderer::updateVolumeBricks()
 // sets a new bricksize and updates the bricking volume (full update)
 void GPURenderer::setVolumeBricksSize()
 {
-    m_pGPUVolume->brickSizeChanged(m_renderConfig, m_opacitySumTable);
+    m_pGPUVolume->brickSizeChanged(m_renderConfig, m_opacityRangeIndex);
 }
 
 // ======= DO NOT MODIFY THIS FUNCTION ========
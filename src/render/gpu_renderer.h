@@ -3,9 +3,13 @@
 #include "ui/trackball.h"
 #include "render/render_config.h"
 #include "render/gpu_mesh_config.h"
+#include "render/marching_cubes.h"
+#include "render/opacity_range_index.h"
+#include "render/span_space_index.h"
 #include "volume/gpu_volume.h"
 #include "volume/volume.h"
 #include "volume/gradient_volume.h"
+#include <memory>
 
 
 namespace render {
@@ -22,6 +26,9 @@ public:
         const GPUMeshConfig& meshConfig);
 
     void updateGPUMesh(bool updateMinMax);
+    // Render another volume, e.g. the next timestep of a time series. The blocks, bricks and volume textures are not
+    // updated here, call updateGPUMesh(true), setVolumeBricksSize() and updateVolumeBricks() afterwards.
+    void setVolume(volume::GPUVolume* pGPUVolume, const volume::Volume* pVolume, const volume::GradientVolume* pGradientVolume);
 
     void setRenderConfig(const RenderConfig& config);
     void setMeshConfig(const GPUMeshConfig& config);
@@ -47,10 +54,18 @@ private:
     void renderTextureToScreen(GLuint texture);
 
     void renderDirections();
+    void resizeRenderTargets();
+    int rayEntryExitMode() const;
+    void renderBlockDepths();
+    void bindRayEntryExit(GLuint shader);
 
     void renderIso();
+    void renderIsoSurfaceMesh();
+    void uploadIsoSurfaceMesh();
     void renderMIP();
     void renderComposite();
+    void bindBrickCache(GLuint shader);
+    void bindInterpolation(GLuint shader);
 
     void linkShaderProgram(GLuint& shader, GLuint vertexShader, GLuint fragmentShader);
 
@@ -69,18 +84,28 @@ private:
 
     GLuint m_ibo, m_vbo, m_vao, m_fbo;
     GLuint m_quadVAO, m_quadVBO;
-    GLuint m_facesShader, m_isoShader, m_mipShader, m_compositeShader, m_screenFillingQuadShader;
+    GLuint m_facesShader, m_isoShader, m_mipShader, m_compositeShader, m_screenFillingQuadShader, m_isoMeshShader;
     GLuint m_backfaces_texture;
     GLuint m_frontfaces_texture;
-    GLuint m_depthTexture;
+    GLuint m_depthTexture; // also the entry depth of the active blocks for analytic rays
+    GLuint m_exitDepthTexture;
+    glm::ivec2 m_renderTargetSize { 0 }; // resolution the targets above are allocated with
+    GLint m_rayTargetFormat { 0 };
 
     GLuint positionsBufferID, positionsTexID;
-    GLuint m_blockActiveBufferID, m_blockActiveTexID;
+    GLuint m_boxSizesBufferID, m_boxSizesTexID;
 
     glm::vec3 m_numBlocks3D;
-    std::vector<glm::vec3> m_positions;
-    std::vector<int> m_blockActive;
+    glm::ivec3 m_blockGridSize { 1 };
+    size_t m_numProxyBoxes { 0 }; // boxes of active blocks in the position / box size buffers
+    ActiveMask m_blockActive;
     std::vector<glm::vec2> m_minMaxValues; // min = x, max = y in the vector
-    std::array<float, 256> m_opacitySumTable;
+    SpanSpaceIndex m_blockSpanSpaceIndex; // of m_minMaxValues, finds the active blocks when the iso value changes
+    OpacityRangeIndex m_opacityRangeIndex; // of the current TF, shared with the GPUVolume for bricking
+
+    // iso surface meshes, the one in the buffers below is kept alive by m_pIsoSurfaceMesh
+    IsoSurfaceMeshCache m_isoSurfaceMeshCache;
+    std::shared_ptr<const IsoSurfaceMesh> m_pIsoSurfaceMesh;
+    GLuint m_isoMeshVAO, m_isoMeshPositionsVBO, m_isoMeshNormalsVBO, m_isoMeshIBO;
 };
 }
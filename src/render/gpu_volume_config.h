@@ -7,6 +7,8 @@ namespace render {
 struct GPUVolumeConfig {
     int brickSize { 32 };
     bool useVolumeBricking { false };
+    // Only copy the bricks that changed when the TF or iso value changes instead of rebuilding the cache.
+    bool incrementalBrickUpdates { true };
 };
 
 // NOTE: should be replaced by C++20 three-way operator (aka spaceship operator) if we require C++ 20 support from Linux users (GCC10 / Clang10).
@@ -0,0 +1,182 @@
+#include "iso_intersection.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <glm/common.hpp>
+#include <glm/vec3.hpp>
+#include <limits>
+#include <utility>
+
+namespace render {
+
+// Polynomial in s with the coefficients of s^0 to s^3.
+using Cubic = std::array<float, 4>;
+
+static float evaluate(const Cubic& p, float s)
+{
+    return ((p[3] * s + p[2]) * s + p[1]) * s + p[0];
+}
+
+static float evaluateDerivative(const Cubic& p, float s)
+{
+    return (3.0f * p[3] * s + 2.0f * p[2]) * s + p[1];
+}
+
+// The trilinear interpolation of the corners (x first) along u(s) = a + s * d in the local coordinates of the cell.
+// Interpolating (1 - u) * p0 + u * p1 raises the degree by one per axis: along x to 4 lines, along y to 2 parabolas
+// and along z to the cubic.
+static Cubic cellPolynomial(const std::array<float, 8>& corners, const glm::vec3& a, const glm::vec3& d)
+{
+    std::array<float, 4> line0, line1;
+    for (size_t i = 0; i < 4; i++) {
+        const float difference = corners[2 * i + 1] - corners[2 * i];
+        line0[i] = corners[2 * i] + a.x * difference;
+        line1[i] = d.x * difference;
+    }
+
+    std::array<float, 2> parabola0, parabola1, parabola2;
+    for (size_t i = 0; i < 2; i++) {
+        const float difference0 = line0[2 * i + 1] - line0[2 * i];
+        const float difference1 = line1[2 * i + 1] - line1[2 * i];
+        parabola0[i] = line0[2 * i] + a.y * difference0;
+        parabola1[i] = line1[2 * i] + a.y * difference1 + d.y * difference0;
+        parabola2[i] = d.y * difference1;
+    }
+
+    const float difference0 = parabola0[1] - parabola0[0];
+    const float difference1 = parabola1[1] - parabola1[0];
+    const float difference2 = parabola2[1] - parabola2[0];
+    return Cubic {
+        parabola0[0] + a.z * difference0,
+        parabola1[0] + a.z * difference1 + d.z * difference0,
+        parabola2[0] + a.z * difference2 + d.z * difference1,
+        d.z * difference2
+    };
+}
+
+// Root of p in [lo, hi] where p is monotonic with p(lo) < 0 <= p(hi). Starts at the secant and keeps the bracket, so
+// a Newton step that leaves it falls back to bisection.
+static float refineRoot(const Cubic& p, float lo, float hi, float pLo, float pHi)
+{
+    static constexpr int maxNewtonSteps = 8;
+    static constexpr float convergence = 1e-5f;
+
+    float s = lo + (hi - lo) * (-pLo / (pHi - pLo));
+    for (int i = 0; i < maxNewtonSteps; i++) {
+        const float value = evaluate(p, s);
+        if (value == 0.0f)
+            return s;
+        if (value < 0.0f)
+            lo = s;
+        else
+            hi = s;
+
+        float next = s - value / evaluateDerivative(p, s);
+        if (!(next >= lo && next <= hi))
+            next = 0.5f * (lo + hi);
+        if (std::abs(next - s) < convergence)
+            return next;
+        s = next;
+    }
+    return s;
+}
+
+// First s in [0, sEnd] with p(s) >= 0 or -1 if there is none. The extrema of p split [0, sEnd] into at most three
+// monotonic pieces, of which the first that ends at or above zero holds the root.
+static float firstRoot(const Cubic& p, float sEnd)
+{
+    std::array<float, 4> pieces { 0.0f };
+    size_t numPieces = 1;
+    const auto addExtremum = [&](float s) {
+        if (s > 0.0f && s < sEnd)
+            pieces[numPieces++] = s;
+    };
+    // p'(s) = qa s^2 + qb s + qc
+    const float qa = 3.0f * p[3], qb = 2.0f * p[2], qc = p[1];
+    if (qa != 0.0f) {
+        const float discriminant = qb * qb - 4.0f * qa * qc;
+        if (discriminant > 0.0f) {
+            // the form without cancellation
+            const float q = -0.5f * (qb + std::copysign(std::sqrt(discriminant), qb));
+            addExtremum(q / qa);
+            if (q != 0.0f)
+                addExtremum(qc / q);
+        }
+    } else if (qb != 0.0f) {
+        addExtremum(-qc / qb);
+    }
+    if (numPieces == 3 && pieces[1] > pieces[2])
+        std::swap(pieces[1], pieces[2]);
+    pieces[numPieces++] = sEnd;
+
+    float lo = pieces[0];
+    float pLo = evaluate(p, lo);
+    if (pLo >= 0.0f)
+        return lo;
+    for (size_t i = 1; i < numPieces; i++) {
+        const float hi = pieces[i];
+        const float pHi = evaluate(p, hi);
+        if (pHi >= 0.0f)
+            return refineRoot(p, lo, hi, pLo, pHi);
+        lo = hi;
+        pLo = pHi;
+    }
+    return -1.0f;
+}
+
+float intersectTrilinearIsoSurface(const volume::Volume& volume, const Ray& ray, float t0, float t1, float isoValue)
+{
+    const glm::ivec3 dims = volume.dims();
+    const glm::ivec3 maxCell = glm::max(dims - 2, glm::ivec3(0));
+
+    // The cells are walked like the bricks when prefetching. A position on the far border of the volume belongs to
+    // the last cell.
+    const glm::vec3 entry = ray.origin + t0 * ray.direction;
+    glm::ivec3 cell = glm::clamp(glm::ivec3(glm::floor(entry)), glm::ivec3(0), maxCell);
+    glm::ivec3 step;
+    glm::vec3 tNext, tDelta;
+    for (int axis = 0; axis < 3; axis++) {
+        const float direction = ray.direction[axis];
+        if (direction > 0.0f) {
+            step[axis] = 1;
+            tNext[axis] = (float(cell[axis] + 1) - ray.origin[axis]) / direction;
+            tDelta[axis] = 1.0f / direction;
+        } else if (direction < 0.0f) {
+            step[axis] = -1;
+            tNext[axis] = (float(cell[axis]) - ray.origin[axis]) / direction;
+            tDelta[axis] = -1.0f / direction;
+        } else {
+            step[axis] = 0;
+            tNext[axis] = std::numeric_limits<float>::max();
+            tDelta[axis] = std::numeric_limits<float>::max();
+        }
+    }
+
+    float t = t0;
+    while (t < t1) {
+        const int axis = tNext.x < tNext.y ? (tNext.x < tNext.z ? 0 : 2) : (tNext.y < tNext.z ? 1 : 2);
+        const float tExit = std::min(std::max(tNext[axis], t), t1);
+
+        const int x1 = std::min(cell.x + 1, dims.x - 1), y1 = std::min(cell.y + 1, dims.y - 1), z1 = std::min(cell.z + 1, dims.z - 1);
+        const std::array<float, 8> corners {
+            volume.getVoxel(cell.x, cell.y, cell.z), volume.getVoxel(x1, cell.y, cell.z), volume.getVoxel(cell.x, y1, cell.z), volume.getVoxel(x1, y1, cell.z),
+            volume.getVoxel(cell.x, cell.y, z1), volume.getVoxel(x1, cell.y, z1), volume.getVoxel(cell.x, y1, z1), volume.getVoxel(x1, y1, z1)
+        };
+        // the interpolation stays below the largest corner
+        if (*std::max_element(std::begin(corners), std::end(corners)) >= isoValue) {
+            Cubic polynomial = cellPolynomial(corners, ray.origin + t * ray.direction - glm::vec3(cell), ray.direction);
+            polynomial[0] -= isoValue;
+            const float s = firstRoot(polynomial, tExit - t);
+            if (s >= 0.0f)
+                return t + s;
+        }
+
+        t = tExit;
+        tNext[axis] += tDelta[axis];
+        cell[axis] += step[axis];
+        if (cell[axis] < 0 || cell[axis] > maxCell[axis])
+            break;
+    }
+    return t1;
+}
+}
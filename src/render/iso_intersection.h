@@ -0,0 +1,13 @@
+#pragma once
+#include "render/ray.h"
+#include "volume/volume.h"
+
+namespace render {
+
+// Exact intersection of a ray with the iso surface of the trilinear interpolation of the volume. Within a cell the
+// interpolated value along the ray is a cubic polynomial in t, so the segment [t0, t1] is walked cell by cell (3D DDA)
+// and the first root of each cubic is found in its monotonic pieces between the extrema, refined by a few safeguarded
+// Newton steps. The value must be below isoValue at t0 (e.g., the last sample before a hit). Returns the first t in
+// [t0, t1] where the value reaches isoValue, or t1 if there is none.
+float intersectTrilinearIsoSurface(const volume::Volume& volume, const Ray& ray, float t0, float t1, float isoValue);
+}
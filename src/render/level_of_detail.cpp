@@ -0,0 +1,19 @@
+#include "level_of_detail.h"
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+namespace render {
+
+float projectedPixelSize(const RayTraceCamera& camera, const glm::ivec2& resolution, const glm::vec3& lower, const glm::vec3& upper)
+{
+    // Angle between the rays through two neighbouring pixels in the center of the screen. The angles are tiny so
+    // the length of the cross product (the sine) is used instead of an imprecise acos.
+    const glm::vec3 center = glm::normalize(camera.generateRay(glm::vec2(0.0f)).direction);
+    const glm::vec3 neighbour = glm::normalize(camera.generateRay(glm::vec2(2.0f / float(resolution.x), 0.0f)).direction);
+    const float pixelAngle = glm::length(glm::cross(center, neighbour));
+
+    const glm::vec3 cameraPosition = camera.position();
+    const glm::vec3 closestPoint = glm::clamp(cameraPosition, lower, upper);
+    return glm::distance(cameraPosition, closestPoint) * pixelAngle;
+}
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include "render/ray_trace_camera.h"
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+namespace render {
+
+// Size of a pixel in voxels at the point of the volume bounds that is closest to the camera. This is the finest detail
+// that is visible anywhere in the image, which is what VolumePyramid::selectLevel() expects.
+float projectedPixelSize(const RayTraceCamera& camera, const glm::ivec2& resolution, const glm::vec3& lower, const glm::vec3& upper);
+}
@@ -0,0 +1,301 @@
+#include "marching_cubes.h"
+#include "util/trace.h"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vector_relational.hpp>
+
+namespace render {
+
+// like the classic table, no case needs more triangles
+static constexpr int maxTrianglesPerCell = 5;
+
+struct CellCase {
+    int numTriangles { 0 };
+    std::array<std::array<uint8_t, 3>, maxTrianglesPerCell> triangles {};
+};
+
+// Corner c of a cell is at offset (c & 1, (c >> 1) & 1, (c >> 2) & 1). Edge e runs along axis e / 4 from corner
+// edgeCorners[e][0] to edgeCorners[e][1], the other two axes of its start are the bits of e % 4.
+struct CaseTable {
+    std::array<std::array<int, 2>, 12> edgeCorners;
+    std::array<CellCase, 256> cases;
+};
+
+// Triangulates the polygon of crossed edges without diagonals between two edges of the same face: the cell on the
+// other side of that face could triangulate its polygon with the same diagonal, and the two triangles would overlap.
+static bool triangulateLoop(const std::vector<int>& loop, const std::array<std::array<int, 2>, 12>& edgeFaces, std::vector<std::array<int, 3>>& triangles)
+{
+    if (loop.size() == 3) {
+        triangles.push_back({ loop[0], loop[1], loop[2] });
+        return true;
+    }
+    const auto shareFace = [&](int edge0, int edge1) {
+        for (int face : edgeFaces[size_t(edge0)]) {
+            if (face == edgeFaces[size_t(edge1)][0] || face == edgeFaces[size_t(edge1)][1])
+                return true;
+        }
+        return false;
+    };
+
+    // the side (loop[0], loop[1]) is part of a triangle with a third vertex, which splits off up to two polygons
+    const size_t numTriangles = triangles.size();
+    for (size_t k = 2; k < loop.size(); k++) {
+        if ((k != 2 && shareFace(loop[1], loop[k])) || (k + 1 != loop.size() && shareFace(loop[k], loop[0])))
+            continue;
+        triangles.push_back({ loop[0], loop[1], loop[k] });
+        const std::vector<int> first(std::begin(loop) + 1, std::begin(loop) + ptrdiff_t(k) + 1);
+        std::vector<int> second(std::begin(loop) + ptrdiff_t(k), std::end(loop));
+        second.push_back(loop[0]);
+        if ((first.size() < 3 || triangulateLoop(first, edgeFaces, triangles)) && (second.size() < 3 || triangulateLoop(second, edgeFaces, triangles)))
+            return true;
+        triangles.resize(numTriangles);
+    }
+    return false;
+}
+
+// The contour on a face is traced counter clockwise seen from outside the cell with the inside corners on its left.
+// A segment starts where the boundary of the face leaves a run of inside corners and ends where it entered that run,
+// so ambiguous faces (two diagonal inside corners) separate the inside corners, whichever cell looks at the face. Every
+// crossed edge starts a segment on one of its faces and ends one on the other, the segments form closed loops.
+static CaseTable buildCaseTable()
+{
+    CaseTable table;
+    std::array<std::array<int, 8>, 8> cornerEdge;
+    std::array<std::array<int, 2>, 12> edgeFaces; // face = axis * 2 + side
+    for (int axis = 0; axis < 3; axis++) {
+        const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+        for (int k = 0; k < 4; k++) {
+            const int start = ((k & 1) << std::min(u, v)) | (((k >> 1) & 1) << std::max(u, v));
+            const int edge = axis * 4 + k;
+            table.edgeCorners[size_t(edge)] = { start, start | (1 << axis) };
+            edgeFaces[size_t(edge)] = { u * 2 + ((start >> u) & 1), v * 2 + ((start >> v) & 1) };
+            cornerEdge[size_t(start)][size_t(start | (1 << axis))] = edge;
+            cornerEdge[size_t(start | (1 << axis))][size_t(start)] = edge;
+        }
+    }
+
+    // corners of the faces in counter clockwise order seen from outside
+    std::array<std::array<int, 4>, 6> faces;
+    for (int axis = 0; axis < 3; axis++) {
+        const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+        for (int side = 0; side < 2; side++) {
+            std::array<int, 4>& face = faces[size_t(axis * 2 + side)];
+            const std::array<glm::ivec2, 4> uv { glm::ivec2(0, 0), glm::ivec2(1, 0), glm::ivec2(1, 1), glm::ivec2(0, 1) };
+            for (size_t i = 0; i < 4; i++)
+                face[i] = (side << axis) | (uv[i].x << u) | (uv[i].y << v);
+            // u x v = axis, so the order above is counter clockwise seen from the positive side
+            if (side == 0)
+                std::reverse(std::begin(face), std::end(face));
+        }
+    }
+
+    for (int caseIndex = 0; caseIndex < 256; caseIndex++) {
+        const auto inside = [&](int corner) { return (caseIndex >> corner) & 1; };
+
+        std::array<int, 12> nextEdge;
+        nextEdge.fill(-1);
+        for (const std::array<int, 4>& face : faces) {
+            for (int i = 0; i < 4; i++) {
+                if (!inside(face[size_t(i)]) || inside(face[size_t((i + 1) % 4)]))
+                    continue;
+                int first = i;
+                while (inside(face[size_t((first + 3) % 4)]))
+                    first = (first + 3) % 4;
+                const int exitEdge = cornerEdge[size_t(face[size_t(i)])][size_t(face[size_t((i + 1) % 4)])];
+                nextEdge[size_t(exitEdge)] = cornerEdge[size_t(face[size_t((first + 3) % 4)])][size_t(face[size_t(first)])];
+            }
+        }
+
+        // The loops go counter clockwise around the inside corners, reversing the triangles faces them to the outside.
+        CellCase& cellCase = table.cases[size_t(caseIndex)];
+        std::array<bool, 12> visited {};
+        for (int startEdge = 0; startEdge < 12; startEdge++) {
+            if (nextEdge[size_t(startEdge)] < 0 || visited[size_t(startEdge)])
+                continue;
+            std::vector<int> loop;
+            for (int edge = startEdge; !visited[size_t(edge)]; edge = nextEdge[size_t(edge)]) {
+                visited[size_t(edge)] = true;
+                loop.push_back(edge);
+            }
+            std::vector<std::array<int, 3>> triangles;
+            [[maybe_unused]] const bool triangulated = triangulateLoop(loop, edgeFaces, triangles);
+            assert(triangulated);
+            for (const std::array<int, 3>& triangle : triangles) {
+                assert(cellCase.numTriangles < maxTrianglesPerCell);
+                cellCase.triangles[size_t(cellCase.numTriangles++)] = { uint8_t(triangle[0]), uint8_t(triangle[2]), uint8_t(triangle[1]) };
+            }
+        }
+    }
+    return table;
+}
+
+static const CaseTable& caseTable()
+{
+    static const CaseTable table = buildCaseTable();
+    return table;
+}
+
+namespace {
+// Vertices and triangles of a slab of cells. Vertex indices are local to the slab, the vertices on the in-plane edges
+// of the top layer of voxels come last and are the same (in the same order) as the first ones of the next slab.
+struct MeshSlab {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<uint32_t> indices;
+    uint32_t topLayerBegin { 0 };
+};
+}
+
+// Number of layers of cells per slab, slabs are the unit of parallel work.
+static constexpr int slabLayers = 8;
+
+IsoSurfaceMesh extractIsoSurface(const volume::Volume& volume, const volume::GradientVolume& gradientVolume, float isoValue)
+{
+    util::ScopedTimer timer("extractIsoSurface", "isosurface");
+
+    IsoSurfaceMesh mesh;
+    mesh.isoValue = isoValue;
+    const glm::ivec3 dims = volume.dims();
+    if (volume.isOutOfCore() || glm::any(glm::lessThan(dims, glm::ivec3(2))))
+        return mesh;
+
+    const CaseTable& table = caseTable();
+    const auto data = volume.getData();
+    const auto voxelIndex = [&](int x, int y, int z) { return (size_t(z) * size_t(dims.y) + size_t(y)) * size_t(dims.x) + size_t(x); };
+    const std::array<glm::ivec3, 3> axisSteps { glm::ivec3(1, 0, 0), glm::ivec3(0, 1, 0), glm::ivec3(0, 0, 1) };
+
+    const int numCellLayers = dims.z - 1;
+    const int numSlabs = (numCellLayers + slabLayers - 1) / slabLayers;
+    std::vector<MeshSlab> slabs(static_cast<size_t>(numSlabs));
+#pragma omp parallel
+    {
+        // vertex of each edge (3 per voxel) of the two layers of voxels around the current layer of cells
+        std::array<std::vector<uint32_t>, 2> layerEdgeVertices;
+        layerEdgeVertices[0].resize(size_t(dims.x) * size_t(dims.y) * 3);
+        layerEdgeVertices[1].resize(size_t(dims.x) * size_t(dims.y) * 3);
+
+#pragma omp for schedule(dynamic)
+        for (int slabIndex = 0; slabIndex < numSlabs; slabIndex++) {
+            MeshSlab& slab = slabs[size_t(slabIndex)];
+            const int zBegin = slabIndex * slabLayers;
+            const int zEnd = std::min(zBegin + slabLayers, numCellLayers);
+
+            const auto addEdgeVertex = [&](const glm::ivec3& voxel, int axis) {
+                const glm::ivec3 other = voxel + axisSteps[size_t(axis)];
+                const float v0 = data[voxelIndex(voxel.x, voxel.y, voxel.z)];
+                const float v1 = data[voxelIndex(other.x, other.y, other.z)];
+                if ((v0 >= isoValue) == (v1 >= isoValue))
+                    return;
+                const float t = (isoValue - v0) / (v1 - v0);
+                const glm::vec3 normal = glm::mix(gradientVolume.getGradient(voxel.x, voxel.y, voxel.z).dir, gradientVolume.getGradient(other.x, other.y, other.z).dir, t);
+                layerEdgeVertices[size_t((voxel.z - zBegin) & 1)][(size_t(voxel.y) * size_t(dims.x) + size_t(voxel.x)) * 3 + size_t(axis)] = uint32_t(slab.positions.size());
+                slab.positions.push_back(glm::vec3(voxel) + t * glm::vec3(axisSteps[size_t(axis)]));
+                slab.normals.push_back(glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f));
+            };
+            // the edges in x and y of a layer first, so the top layer of a slab matches the bottom layer of the next
+            const auto addLayerVertices = [&](int z, bool edgesInZ) {
+                for (int y = 0; y < dims.y; y++) {
+                    for (int x = 0; x < dims.x; x++) {
+                        if (x + 1 < dims.x)
+                            addEdgeVertex(glm::ivec3(x, y, z), 0);
+                        if (y + 1 < dims.y)
+                            addEdgeVertex(glm::ivec3(x, y, z), 1);
+                    }
+                }
+                if (!edgesInZ)
+                    return;
+                for (int y = 0; y < dims.y; y++) {
+                    for (int x = 0; x < dims.x; x++)
+                        addEdgeVertex(glm::ivec3(x, y, z), 2);
+                }
+            };
+
+            addLayerVertices(zBegin, true);
+            for (int z = zBegin; z < zEnd; z++) {
+                if (z + 1 == zEnd)
+                    slab.topLayerBegin = uint32_t(slab.positions.size());
+                addLayerVertices(z + 1, z + 1 < zEnd);
+
+                for (int y = 0; y + 1 < dims.y; y++) {
+                    for (int x = 0; x + 1 < dims.x; x++) {
+                        int caseIndex = 0;
+                        for (int corner = 0; corner < 8; corner++) {
+                            const float value = data[voxelIndex(x + (corner & 1), y + ((corner >> 1) & 1), z + ((corner >> 2) & 1))];
+                            caseIndex |= int(value >= isoValue) << corner;
+                        }
+                        const CellCase& cellCase = table.cases[size_t(caseIndex)];
+                        for (int triangle = 0; triangle < cellCase.numTriangles; triangle++) {
+                            for (uint8_t edge : cellCase.triangles[size_t(triangle)]) {
+                                const int start = table.edgeCorners[edge][0];
+                                const glm::ivec3 voxel { x + (start & 1), y + ((start >> 1) & 1), z + ((start >> 2) & 1) };
+                                const std::vector<uint32_t>& edgeVertices = layerEdgeVertices[size_t((voxel.z - zBegin) & 1)];
+                                slab.indices.push_back(edgeVertices[(size_t(voxel.y) * size_t(dims.x) + size_t(voxel.x)) * 3 + size_t(edge / 4)]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // The top layer of every slab but the last is dropped in favour of the bottom layer of the next slab.
+    std::vector<uint32_t> vertexOffsets(slabs.size() + 1, 0);
+    std::vector<size_t> indexOffsets(slabs.size() + 1, 0);
+    for (size_t i = 0; i < slabs.size(); i++) {
+        const bool last = i + 1 == slabs.size();
+        vertexOffsets[i + 1] = vertexOffsets[i] + (last ? uint32_t(slabs[i].positions.size()) : slabs[i].topLayerBegin);
+        indexOffsets[i + 1] = indexOffsets[i] + slabs[i].indices.size();
+    }
+    mesh.positions.resize(vertexOffsets.back());
+    mesh.normals.resize(vertexOffsets.back());
+    mesh.indices.resize(indexOffsets.back());
+
+#pragma omp parallel for
+    for (int slabIndex = 0; slabIndex < numSlabs; slabIndex++) {
+        const MeshSlab& slab = slabs[size_t(slabIndex)];
+        const uint32_t numKept = vertexOffsets[size_t(slabIndex) + 1] - vertexOffsets[size_t(slabIndex)];
+        std::copy_n(std::begin(slab.positions), numKept, std::begin(mesh.positions) + vertexOffsets[size_t(slabIndex)]);
+        std::copy_n(std::begin(slab.normals), numKept, std::begin(mesh.normals) + vertexOffsets[size_t(slabIndex)]);
+
+        const uint32_t offset = vertexOffsets[size_t(slabIndex)];
+        const uint32_t nextOffset = vertexOffsets[size_t(slabIndex) + 1];
+        std::transform(std::begin(slab.indices), std::end(slab.indices), std::begin(mesh.indices) + ptrdiff_t(indexOffsets[size_t(slabIndex)]),
+            [&](uint32_t index) { return index < numKept ? offset + index : nextOffset + (index - slab.topLayerBegin); });
+    }
+    return mesh;
+}
+
+IsoSurfaceMeshCache::IsoSurfaceMeshCache(const volume::Volume* pVolume, const volume::GradientVolume* pGradientVolume, size_t capacity)
+    : m_pVolume(pVolume)
+    , m_pGradientVolume(pGradientVolume)
+    , m_capacity(std::max(capacity, size_t(1)))
+    , m_isoValueStep((pVolume->maximum() - pVolume->minimum()) / float(isoValueSteps))
+{
+}
+
+float IsoSurfaceMeshCache::roundIsoValue(float isoValue) const
+{
+    if (m_isoValueStep <= 0.0f)
+        return isoValue;
+    return m_pVolume->minimum() + std::round((isoValue - m_pVolume->minimum()) / m_isoValueStep) * m_isoValueStep;
+}
+
+std::shared_ptr<const IsoSurfaceMesh> IsoSurfaceMeshCache::mesh(float isoValue)
+{
+    isoValue = roundIsoValue(isoValue);
+    auto iter = std::find_if(std::begin(m_meshes), std::end(m_meshes),
+        [&](const std::shared_ptr<const IsoSurfaceMesh>& pMesh) { return pMesh->isoValue == isoValue; });
+    if (iter == std::end(m_meshes)) {
+        if (m_meshes.size() == m_capacity)
+            m_meshes.pop_back();
+        m_meshes.insert(std::begin(m_meshes), std::make_shared<const IsoSurfaceMesh>(extractIsoSurface(*m_pVolume, *m_pGradientVolume, isoValue)));
+    } else {
+        std::rotate(std::begin(m_meshes), iter, iter + 1);
+    }
+    return m_meshes.front();
+}
+}
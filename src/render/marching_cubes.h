@@ -0,0 +1,53 @@
+#pragma once
+#include "volume/gradient_volume.h"
+#include "volume/volume.h"
+#include <cstdint>
+#include <glm/vec3.hpp>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace render {
+
+// Indexed triangle mesh of an iso surface in voxel coordinates (voxel (x, y, z) is at position (x, y, z)). Every
+// vertex lies on an edge between two voxels and is shared by all triangles around that edge, so the mesh of a surface
+// that does not touch the volume border is closed. Triangles are wound counter clockwise seen from the side of the
+// lower values, the normals are the interpolated gradients (pointing to the higher values, zero at the border).
+struct IsoSurfaceMesh {
+    float isoValue { 0.0f };
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<uint32_t> indices;
+};
+
+// Marching cubes over all cells of the volume, voxels with a value >= isoValue are inside. The cases are not taken
+// from the usual hand written table but derived from the contour on the faces of the cell, where ambiguous faces always
+// separate the inside corners. Neighbouring cells therefore agree on their shared face and the surface has no holes.
+// Slabs of cells are extracted in parallel into their own vertex arrays, a vertex is created once per crossed edge and
+// the copies of the vertices on the layer between two slabs are merged afterwards. Out-of-core volumes have no voxels in
+// memory and give an empty mesh.
+IsoSurfaceMesh extractIsoSurface(const volume::Volume& volume, const volume::GradientVolume& gradientVolume, float isoValue);
+
+// Meshes of the most recently used iso values of a volume, so switching back to an iso value does not extract again.
+// Iso values are rounded to isoValueSteps steps over the value range of the volume, so values that only differ in the
+// last bits (from dragging the iso value back and forth) share a mesh.
+class IsoSurfaceMeshCache {
+public:
+    static constexpr int isoValueSteps = 4096;
+
+    IsoSurfaceMeshCache(const volume::Volume* pVolume, const volume::GradientVolume* pGradientVolume, size_t capacity = 4);
+
+    // The iso value that mesh() extracts for the given one.
+    float roundIsoValue(float isoValue) const;
+    // Extracts the mesh if it is not cached, the least recently used mesh is dropped when the cache is full. The mesh
+    // is the surface at roundIsoValue(isoValue).
+    std::shared_ptr<const IsoSurfaceMesh> mesh(float isoValue);
+
+private:
+    const volume::Volume* m_pVolume;
+    const volume::GradientVolume* m_pGradientVolume;
+    size_t m_capacity;
+    float m_isoValueStep;
+    std::vector<std::shared_ptr<const IsoSurfaceMesh>> m_meshes; // most recently used first
+};
+}
@@ -0,0 +1,147 @@
+#include "opacity_range_index.h"
+#include "clipping.h"
+#include "span_space_index.h"
+#include <algorithm>
+#include <bitset>
+#include <cassert>
+#include <numeric>
+
+namespace render {
+
+ActiveMask::ActiveMask(size_t size)
+    : m_size(size)
+    , m_words((size + 63) / 64, 0)
+{
+}
+
+size_t ActiveMask::size() const
+{
+    return m_size;
+}
+
+size_t ActiveMask::count() const
+{
+    return std::accumulate(std::begin(m_words), std::end(m_words), size_t(0),
+        [](size_t sum, uint64_t word) { return sum + std::bitset<64>(word).count(); });
+}
+
+bool ActiveMask::operator[](size_t i) const
+{
+    return (m_words[i / 64] >> (i % 64)) & 1;
+}
+
+void ActiveMask::set(size_t i, bool value)
+{
+    const uint64_t bit = uint64_t(1) << (i % 64);
+    if (value)
+        m_words[i / 64] |= bit;
+    else
+        m_words[i / 64] &= ~bit;
+}
+
+size_t ActiveMask::numWords() const
+{
+    return m_words.size();
+}
+
+void ActiveMask::setWord(size_t wordIndex, uint64_t bits)
+{
+    m_words[wordIndex] = bits;
+}
+
+bool ActiveMask::operator==(const ActiveMask& other) const
+{
+    return m_size == other.m_size && m_words == other.m_words;
+}
+
+bool ActiveMask::operator!=(const ActiveMask& other) const
+{
+    return !(*this == other);
+}
+
+OpacityRangeIndex::OpacityRangeIndex(gsl::span<const glm::vec4> colorMap, float indexStart, float indexRange)
+    : m_indexStart(indexStart)
+    , m_indexRange(indexRange)
+    , m_opaqueCount(colorMap.size())
+{
+    uint32_t opaqueCount = 0;
+    for (size_t i = 0; i < colorMap.size(); i++) {
+        opaqueCount += colorMap[i].a > 0.0f;
+        m_opaqueCount[i] = opaqueCount;
+    }
+}
+
+// Same mapping as Renderer::getTFValue, clamped to the table.
+int OpacityRangeIndex::entryIndex(float value) const
+{
+    const float range01 = (value - m_indexStart) / m_indexRange;
+    return std::clamp(int(range01 * float(m_opaqueCount.size())), 0, int(m_opaqueCount.size()) - 1);
+}
+
+bool OpacityRangeIndex::anyOpacity(float minValue, float maxValue) const
+{
+    if (m_opaqueCount.empty())
+        return false;
+    const int first = entryIndex(minValue);
+    const int last = entryIndex(maxValue);
+    return m_opaqueCount[size_t(last)] > (first > 0 ? m_opaqueCount[size_t(first - 1)] : 0u);
+}
+
+size_t OpacityRangeIndex::size() const
+{
+    return m_opaqueCount.size();
+}
+
+bool isValueRangeVisible(const glm::vec2& minMax, const RenderConfig& config, const OpacityRangeIndex& opacityIndex)
+{
+    if (config.renderMode == RenderMode::RenderIso)
+        return minMax.x <= config.isoValue && config.isoValue <= minMax.y;
+    if (config.renderMode == RenderMode::RenderComposite)
+        return opacityIndex.anyOpacity(minMax.x, minMax.y);
+    return true;
+}
+
+ActiveMask classifyValueRanges(gsl::span<const glm::vec2> minMaxValues, const RenderConfig& config, const OpacityRangeIndex& opacityIndex, const SpanSpaceIndex* pSpanSpaceIndex)
+{
+    if (pSpanSpaceIndex && config.renderMode == RenderMode::RenderIso) {
+        assert(pSpanSpaceIndex->size() == minMaxValues.size());
+        return pSpanSpaceIndex->activeMask(config.isoValue);
+    }
+
+    ActiveMask mask(minMaxValues.size());
+    const int numWords = int(mask.numWords());
+#pragma omp parallel for
+    for (int wordIndex = 0; wordIndex < numWords; wordIndex++) {
+        const size_t begin = size_t(wordIndex) * 64;
+        const size_t end = std::min(begin + 64, minMaxValues.size());
+        uint64_t word = 0;
+        for (size_t i = begin; i < end; i++)
+            word |= uint64_t(isValueRangeVisible(minMaxValues[i], config, opacityIndex)) << (i - begin);
+        mask.setWord(size_t(wordIndex), word);
+    }
+    return mask;
+}
+
+ActiveMask classifyCells(gsl::span<const glm::vec2> minMaxValues, const glm::ivec3& gridSize, int cellSize, int padding, const RenderConfig& config, const OpacityRangeIndex& opacityIndex, const SpanSpaceIndex* pSpanSpaceIndex)
+{
+    ActiveMask mask = classifyValueRanges(minMaxValues, config, opacityIndex, pSpanSpaceIndex);
+    if (!config.regionOfInterest && !config.clippingPlanes)
+        return mask;
+
+    const int numWords = int(mask.numWords());
+#pragma omp parallel for
+    for (int wordIndex = 0; wordIndex < numWords; wordIndex++) {
+        const size_t begin = size_t(wordIndex) * 64;
+        const size_t end = std::min(begin + 64, minMaxValues.size());
+        uint64_t word = 0;
+        for (size_t i = begin; i < end; i++) {
+            const glm::ivec3 cell { int(i % size_t(gridSize.x)), int(i / size_t(gridSize.x) % size_t(gridSize.y)), int(i / size_t(gridSize.x) / size_t(gridSize.y)) };
+            const glm::vec3 lower = glm::vec3(cell * cellSize - padding);
+            const glm::vec3 upper = glm::vec3((cell + 1) * cellSize + padding);
+            word |= uint64_t(mask[i] && !isBoxClippedAway(lower, upper, config)) << (i - begin);
+        }
+        mask.setWord(size_t(wordIndex), word);
+    }
+    return mask;
+}
+}
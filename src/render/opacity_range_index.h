@@ -0,0 +1,65 @@
+#pragma once
+#include "render/render_config.h"
+#include <cstdint>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <gsl/span>
+#include <vector>
+
+namespace render {
+
+class SpanSpaceIndex;
+
+// Fixed size set of bits that can be filled in parallel, every task writes whole 64 bit words.
+class ActiveMask {
+public:
+    ActiveMask() = default;
+    explicit ActiveMask(size_t size);
+
+    size_t size() const;
+    size_t count() const;
+    bool operator[](size_t i) const;
+    void set(size_t i, bool value);
+    // bits [64 * wordIndex, 64 * wordIndex + 64), different words can be set from different threads
+    size_t numWords() const;
+    void setWord(size_t wordIndex, uint64_t bits);
+
+    bool operator==(const ActiveMask& other) const;
+    bool operator!=(const ActiveMask& other) const;
+
+private:
+    size_t m_size { 0 };
+    std::vector<uint64_t> m_words;
+};
+
+// Prefix count of the transfer function entries with a non zero opacity, for a TF of any resolution. Values map to
+// entries like Renderer::getTFValue, so whether any value in a range is visible is a difference of two counts.
+class OpacityRangeIndex {
+public:
+    OpacityRangeIndex() = default;
+    OpacityRangeIndex(gsl::span<const glm::vec4> colorMap, float indexStart, float indexRange);
+
+    // Whether any TF entry of the values in [minValue, maxValue] has an opacity above zero, in constant time.
+    bool anyOpacity(float minValue, float maxValue) const;
+    size_t size() const;
+
+private:
+    int entryIndex(float value) const;
+
+    float m_indexStart { 0.0f };
+    float m_indexRange { 1.0f };
+    std::vector<uint32_t> m_opaqueCount; // number of entries with opacity > 0 up to and including i
+};
+
+// Whether any value in [minMax.x, minMax.y] can be seen in the current render mode, used to skip blocks and bricks.
+// Iso surfaces need the iso value in the range, compositing any opacity in it and MIP needs the whole volume.
+bool isValueRangeVisible(const glm::vec2& minMax, const RenderConfig& config, const OpacityRangeIndex& opacityIndex);
+
+// Classifies all ranges (e.g., the cells of a MinMaxTable) in parallel. In iso mode the ranges are looked up in the
+// span space index instead if one is given, which must have been built from the same minMaxValues.
+ActiveMask classifyValueRanges(gsl::span<const glm::vec2> minMaxValues, const RenderConfig& config, const OpacityRangeIndex& opacityIndex, const SpanSpaceIndex* pSpanSpaceIndex = nullptr);
+// Classifies the cells of a grid (stored x first) of cellSize^3 voxels extended by padding voxels on each side, like
+// the blocks and bricks. Cells outside the region of interest or cut away by the clipping planes are never active.
+ActiveMask classifyCells(gsl::span<const glm::vec2> minMaxValues, const glm::ivec3& gridSize, int cellSize, int padding, const RenderConfig& config, const OpacityRangeIndex& opacityIndex, const SpanSpaceIndex* pSpanSpaceIndex = nullptr);
+}
@@ -0,0 +1,62 @@
+#include "proxy_geometry.h"
+#include <cassert>
+#include <cstdint>
+
+namespace render {
+
+std::vector<BlockBox> mergeActiveBlocks(const ActiveMask& blockActive, const glm::ivec3& gridSize)
+{
+    assert(blockActive.size() == size_t(gridSize.x) * size_t(gridSize.y) * size_t(gridSize.z));
+
+    const auto index = [&](int x, int y, int z) {
+        return (size_t(z) * size_t(gridSize.y) + size_t(y)) * size_t(gridSize.x) + size_t(x);
+    };
+    // active blocks that are not covered by a box yet
+    std::vector<uint8_t> uncovered(blockActive.size());
+    for (size_t i = 0; i < blockActive.size(); i++)
+        uncovered[i] = blockActive[i];
+    const auto isRowUncovered = [&](int xBegin, int xEnd, int y, int z) {
+        for (int x = xBegin; x < xEnd; x++) {
+            if (!uncovered[index(x, y, z)])
+                return false;
+        }
+        return true;
+    };
+    const auto isSlabUncovered = [&](int xBegin, int xEnd, int yBegin, int yEnd, int z) {
+        for (int y = yBegin; y < yEnd; y++) {
+            if (!isRowUncovered(xBegin, xEnd, y, z))
+                return false;
+        }
+        return true;
+    };
+
+    std::vector<BlockBox> boxes;
+    for (int z = 0; z < gridSize.z; z++) {
+        for (int y = 0; y < gridSize.y; y++) {
+            for (int x = 0; x < gridSize.x; x++) {
+                if (!uncovered[index(x, y, z)])
+                    continue;
+
+                int xEnd = x + 1;
+                while (xEnd < gridSize.x && uncovered[index(xEnd, y, z)])
+                    xEnd++;
+                int yEnd = y + 1;
+                while (yEnd < gridSize.y && isRowUncovered(x, xEnd, yEnd, z))
+                    yEnd++;
+                int zEnd = z + 1;
+                while (zEnd < gridSize.z && isSlabUncovered(x, xEnd, y, yEnd, zEnd))
+                    zEnd++;
+
+                for (int boxZ = z; boxZ < zEnd; boxZ++) {
+                    for (int boxY = y; boxY < yEnd; boxY++) {
+                        for (int boxX = x; boxX < xEnd; boxX++)
+                            uncovered[index(boxX, boxY, boxZ)] = 0;
+                    }
+                }
+                boxes.push_back({ glm::ivec3(x, y, z), glm::ivec3(xEnd - x, yEnd - y, zEnd - z) });
+            }
+        }
+    }
+    return boxes;
+}
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "render/opacity_range_index.h"
+#include <glm/vec3.hpp>
+#include <vector>
+
+namespace render {
+
+// Box of blocks that is drawn as a single cube of the proxy geometry, in units of blocks.
+struct BlockBox {
+    glm::ivec3 origin;
+    glm::ivec3 size;
+};
+
+// Merges the active blocks of a grid (stored x first) greedily into boxes: a run of active blocks in x is grown in y
+// while the next row is active, and then in z while the next slab is. The boxes cover exactly the active blocks and do
+// not overlap, so the proxy geometry scales with the surface of the active region instead of the number of blocks.
+std::vector<BlockBox> mergeActiveBlocks(const ActiveMask& blockActive, const glm::ivec3& gridSize);
+}
@@ -1,10 +1,28 @@
 #pragma once
 #include "ray.h"
+#include <glm/geometric.hpp>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <limits>
 
 namespace render {
 
+// The rays of a pinhole camera for one frame. The direction through pixel (x, y) (with the mapping of
+// Renderer::render, pixel / resolution * 2 - 1 in NDC) is direction00 + x * pixelStepX + y * pixelStepY before
+// normalization, so rays of neighbouring pixels are generated with vector increments.
+struct CameraRayBasis {
+    glm::vec3 origin;
+    glm::vec3 direction00;
+    glm::vec3 pixelStepX;
+    glm::vec3 pixelStepY;
+
+    Ray generateRay(int x, int y) const
+    {
+        return Ray { origin, glm::normalize(direction00 + float(x) * pixelStepX + float(y) * pixelStepY),
+            std::numeric_limits<float>::lowest(), std::numeric_limits<float>::max() };
+    }
+};
+
 class RayTraceCamera {
 public:
     virtual ~RayTraceCamera() = default;
@@ -13,6 +31,24 @@ public:
     virtual glm::vec3 forward() const = 0;
 
     virtual render::Ray generateRay(const glm::vec2& pixel) const = 0;
+
+    // Per frame ray basis, only three calls to generateRay. Scaling the directions such that their distance along
+    // forward() is 1 puts them on the image plane, where they are linear in the pixel for any pinhole camera. The
+    // steps are taken over the whole image, a single pixel step would lose precision.
+    virtual CameraRayBasis rayBasis(const glm::ivec2& resolution) const
+    {
+        const auto imagePlaneDirection = [&](const glm::vec2& pixel) {
+            const glm::vec3 direction = generateRay(pixel / glm::vec2(resolution) * 2.0f - 1.0f).direction;
+            return direction / glm::dot(direction, forward());
+        };
+        const glm::vec3 direction00 = imagePlaneDirection(glm::vec2(0.0f));
+        return CameraRayBasis {
+            position(),
+            direction00,
+            (imagePlaneDirection(glm::vec2(resolution.x, 0.0f)) - direction00) / float(resolution.x),
+            (imagePlaneDirection(glm::vec2(0.0f, resolution.y)) - direction00) / float(resolution.y)
+        };
+    }
 };
 
-}
\ No newline at end of file
+}
@@ -17,6 +17,8 @@ enum class RenderMode {
     RenderComposite = 3
 };
 
+constexpr int maxClipPlanes = 4;
+
 struct RenderConfig {
     RenderMode renderMode { RenderMode::RenderSlicer };
     glm::ivec2 renderResolution;
@@ -24,6 +26,13 @@ struct RenderConfig {
 
     bool volumeShading { false };
     bool clippingPlanes { false };
+    // Positions p (in voxels) with dot(plane.xyz, p) + plane.w < 0 are cut away by the first numClipPlanes planes.
+    int numClipPlanes { 1 };
+    std::array<glm::vec4, maxClipPlanes> clipPlanes {};
+    // Only [roiLower, roiUpper] (in voxels) of the volume is rendered.
+    bool regionOfInterest { false };
+    glm::vec3 roiLower { 0.0f };
+    glm::vec3 roiUpper { 0.0f };
 
     bool useOpacityModulation {false };
     glm::vec4 illustrativeParams { glm::vec4(0.0, 1.0, 1.0, 1.0) };
@@ -32,9 +41,16 @@ struct RenderConfig {
 
     float isoValue { 95.0f };
     bool bisection { false };
+    // Solve for the surface in the trilinear cells instead of bisecting, takes precedence over bisection.
+    bool analyticIntersection { false };
     
     int renderStep { 3 };
 
+    // Sample coarser levels of the volume pyramid when voxels project to less than a pixel.
+    bool levelOfDetail { true };
+    float lodBias { 0.0f };
+    int interactionLod { 0 }; // Extra levels used while the user interacts, set by the main loop.
+
     // 1D transfer function.
     std::array<glm::vec4, 256> tfColorMap;
     // Used to convert from a value to an index in the color map.
@@ -1,12 +1,25 @@
 #include "renderer.h"
+#include "clipping.h"
+#include "iso_intersection.h"
+#include "level_of_detail.h"
+#include "tile_coverage.h"
+#include "util/trace.h"
 #include <algorithm>
 #include <algorithm> // std::fill
+#include <array>
+#include <cassert>
 #include <cmath>
+#include <cstddef>
 #include <functional>
 #include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/packing.hpp>
 #include <glm/gtx/component_wise.hpp>
+#include <glm/vector_relational.hpp>
 #include <iostream>
+#include <limits>
 #include <tuple>
+#include <utility>
 
 namespace render {
 
@@ -36,16 +49,41 @@ void Renderer::setConfig(const RenderConfig& config)
     m_config = config;
 }
 
+// The pyramid is optional, without it every frame samples the full resolution volume.
+void Renderer::setVolumePyramid(const volume::VolumePyramid* pVolumePyramid)
+{
+    m_pVolumePyramid = pVolumePyramid;
+}
+
+// The iso cells belong to the previous volume, they are rebuilt on the next iso surface frame.
+void Renderer::setVolume(const volume::Volume* pVolume, const volume::GradientVolume* pGradientVolume)
+{
+    m_pVolume = pVolume;
+    m_pGradientVolume = pGradientVolume;
+    m_pVolumePyramid = nullptr;
+    m_isoCellTable = volume::MinMaxTable();
+}
+
 // Resize the framebuffer and fill it with black pixels.
 void Renderer::resizeImage(const glm::ivec2& resolution)
 {
     m_frameBuffer.resize(size_t(resolution.x) * size_t(resolution.y), glm::vec4(0.0f));
+    m_depthBuffer.resize(m_depthOutput ? m_frameBuffer.size() : 0, noHitDepth);
 }
 
-// Clear the framebuffer by setting all pixels to black.
-void Renderer::resetImage()
+// Clear the pixels [begin, end) of the framebuffer by setting them to black, one row at a time.
+void Renderer::resetImage(const glm::ivec2& begin, const glm::ivec2& end)
 {
-    std::fill(std::begin(m_frameBuffer), std::end(m_frameBuffer), glm::vec4(0.0f));
+    for (int y = begin.y; y < end.y; y++) {
+        const std::ptrdiff_t rowBegin = std::ptrdiff_t(m_config.renderResolution.x) * y + begin.x;
+        const std::ptrdiff_t rowEnd = rowBegin + (end.x - begin.x);
+        if (m_packedOutput.empty())
+            std::fill(std::begin(m_frameBuffer) + rowBegin, std::begin(m_frameBuffer) + rowEnd, glm::vec4(0.0f));
+        else
+            std::fill(std::begin(m_packedOutput) + rowBegin, std::begin(m_packedOutput) + rowEnd, 0u);
+        if (m_depthOutput)
+            std::fill(std::begin(m_depthBuffer) + rowBegin, std::begin(m_depthBuffer) + rowEnd, noHitDepth);
+    }
 }
 
 // Return a VIEW into the framebuffer. This view is merely a reference to the m_frameBuffer member variable.
@@ -55,15 +93,120 @@ gsl::span<const glm::vec4> Renderer::frameBuffer() const
     return m_frameBuffer;
 }
 
+// The float framebuffer is not written while the packed output is set.
+void Renderer::setPackedOutput(gsl::span<uint32_t> pixels)
+{
+    m_packedOutput = pixels;
+}
+
+void Renderer::setDepthOutput(bool enabled)
+{
+    m_depthOutput = enabled;
+    m_depthBuffer.resize(m_depthOutput ? m_frameBuffer.size() : 0, noHitDepth);
+}
+
+gsl::span<const float> Renderer::depthBuffer() const
+{
+    return m_depthBuffer;
+}
+
+// The image is rendered in tiles of renderTileSize^2 pixels that are handed out to the threads dynamically, since
+// tiles that miss the volume (or only hit empty space) are much cheaper than others.
+static constexpr int renderTileSize = 16;
+// Rays of neighbouring pixels in a row are set up together, in structure of arrays form so that the normalization
+// and the bounds test vectorize.
+static constexpr int rayPacketSize = 8;
+
+struct RayPacket {
+    float directionX[rayPacketSize], directionY[rayPacketSize], directionZ[rayPacketSize];
+    float tmin[rayPacketSize], tmax[rayPacketSize]; // tmin > tmax if the ray misses the volume
+};
+
+static void generateRayPacket(const CameraRayBasis& basis, const Bounds& bounds, int x, int y, RayPacket& packet)
+{
+    const glm::vec3 firstDirection = basis.direction00 + float(x) * basis.pixelStepX + float(y) * basis.pixelStepY;
+    const glm::vec3 lower = bounds.IndividualBounds.lower - basis.origin;
+    const glm::vec3 upper = bounds.IndividualBounds.upper - basis.origin;
+#pragma omp simd
+    for (int i = 0; i < rayPacketSize; i++) {
+        float directionX = firstDirection.x + float(i) * basis.pixelStepX.x;
+        float directionY = firstDirection.y + float(i) * basis.pixelStepX.y;
+        float directionZ = firstDirection.z + float(i) * basis.pixelStepX.z;
+        const float invLength = 1.0f / std::sqrt(directionX * directionX + directionY * directionY + directionZ * directionZ);
+        directionX *= invLength;
+        directionY *= invLength;
+        directionZ *= invLength;
+
+        // Slab test without branches on the sign, the inverse direction of axis parallel rays is infinite.
+        const float invDirectionX = 1.0f / directionX, invDirectionY = 1.0f / directionY, invDirectionZ = 1.0f / directionZ;
+        const float tx0 = lower.x * invDirectionX, tx1 = upper.x * invDirectionX;
+        const float ty0 = lower.y * invDirectionY, ty1 = upper.y * invDirectionY;
+        const float tz0 = lower.z * invDirectionZ, tz1 = upper.z * invDirectionZ;
+        packet.directionX[i] = directionX;
+        packet.directionY[i] = directionY;
+        packet.directionZ[i] = directionZ;
+        packet.tmin[i] = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::min(tz0, tz1));
+        packet.tmax[i] = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::max(tz0, tz1));
+    }
+}
+
+// Assigns a value to a variable and restores the previous value when it goes out of scope.
+template <typename T>
+class ScopedAssignment {
+public:
+    ScopedAssignment(T& variable, T value)
+        : m_variable(variable)
+        , m_previous(std::exchange(variable, value))
+    {
+    }
+    ~ScopedAssignment() { m_variable = m_previous; }
+
+    ScopedAssignment(const ScopedAssignment&) = delete;
+    ScopedAssignment& operator=(const ScopedAssignment&) = delete;
+
+private:
+    T& m_variable;
+    T m_previous;
+};
+
 // Main render function. It computes an image according to the current renderMode.
 // Multithreading is enabled in Release/RelWithDebInfo modes. In Debug mode multithreading is disabled to make debugging easier.
 void Renderer::render()
 {
-    resetImage();
+    util::ScopedTimer timer("Renderer::render", "render");
+    assert(m_packedOutput.empty() || m_packedOutput.size() == m_frameBuffer.size());
 
     const glm::vec3 planeNormal = -glm::normalize(m_pCamera->forward());
     const glm::vec3 volumeCenter = glm::vec3(m_pVolume->dims()) / 2.0f;
-    const Bounds bounds {glm::vec3(0.0f),  glm::vec3(m_pVolume->dims() - glm::ivec3(1))};
+    Bounds bounds {glm::vec3(0.0f),  glm::vec3(m_pVolume->dims() - glm::ivec3(1))};
+
+    // Rays only enter the region of interest, so the tiles outside of it are culled and the rays inside are not
+    // sampled outside of it.
+    clipBoundsToRegionOfInterest(bounds.IndividualBounds.lower, bounds.IndividualBounds.upper, m_config);
+    if (glm::any(glm::greaterThan(bounds.IndividualBounds.lower, bounds.IndividualBounds.upper))) {
+        resetImage(glm::ivec2(0), m_config.renderResolution);
+        return;
+    }
+
+    // Rays are traced through the level of the volume pyramid whose voxels are about the size of a pixel. A ray is
+    // moved into the voxel space of that level by transforming its origin and dividing its direction by the level
+    // scale. That keeps t (and tmin/tmax) in level 0 units, so only the step size has to grow by the level scale.
+    // NOTE: sample positions of coarse levels are in the voxel space of that level, not of m_pCamera.
+    m_baseLevelOfDetail = selectLevelOfDetail(bounds, 0);
+    m_levelOfDetail = selectLevelOfDetail(bounds, m_config.interactionLod);
+    // The trace functions sample m_pVolume and m_pGradientVolume, which point at the level until the frame is done.
+    const ScopedAssignment levelVolume { m_pVolume, m_levelOfDetail > 0 ? &m_pVolumePyramid->level(m_levelOfDetail) : m_pVolume };
+    const ScopedAssignment levelGradientVolume { m_pGradientVolume, m_levelOfDetail > 0 ? &m_pVolumePyramid->gradientLevel(m_levelOfDetail) : m_pGradientVolume };
+    if (m_levelOfDetail == 0)
+        prefetchBricks(bounds);
+    // Iso surfaces at full resolution march over the cells that the surface does not pass through. Cubic
+    // interpolation can overshoot the value range of a cell, so it samples every step.
+    m_useIsoCells = m_config.renderMode == RenderMode::RenderIso && m_levelOfDetail == 0 && !m_pVolume->isOutOfCore() && m_pVolume->interpolationMode != volume::InterpolationMode::Cubic;
+    if (m_useIsoCells)
+        updateIsoCells();
+    const float levelScale = volume::VolumePyramid::levelScale(m_levelOfDetail);
+    const glm::vec3 levelVolumeCenter = volume::VolumePyramid::toLevelCoordinate(volumeCenter, m_levelOfDetail);
+    const float sampleStep = m_config.stepSize * levelScale;
 
     // 0 = sequential (single-core), 1 = OMP (multi-core)
 #ifdef NDEBUG
@@ -74,46 +217,184 @@ void Renderer::render()
 #define PARALLELISM 0
 #endif
 
+    // The camera is only asked for its rays once per frame, rays of the pixels follow from vector increments.
+    const CameraRayBasis rayBasis = m_pCamera->rayBasis(m_config.renderResolution);
+    const glm::ivec2 numTiles = (m_config.renderResolution + renderTileSize - 1) / renderTileSize;
+
 #if PARALLELISM == 1
-    #pragma omp parallel for
+    #pragma omp parallel for schedule(dynamic)
 #endif
-    for (int x = 0; x < m_config.renderResolution.x; x++) {
-        for (int y = 0; y < m_config.renderResolution.y; y++) {
+    for (int tile = 0; tile < numTiles.x * numTiles.y; tile++) {
+        const glm::ivec2 tileBegin = glm::ivec2(tile % numTiles.x, tile / numTiles.x) * renderTileSize;
+        const glm::ivec2 tileEnd = glm::min(tileBegin + renderTileSize, m_config.renderResolution);
+        // Tiles are cleared in bulk. Those that miss the volume need nothing else, so the render time follows the
+        // area that the volume covers on the screen.
+        resetImage(tileBegin, tileEnd);
+        const TileCoverage coverage = classifyTile(rayBasis, bounds.IndividualBounds.lower, bounds.IndividualBounds.upper, tileBegin, tileEnd);
+        if (coverage == TileCoverage::Outside)
+            continue;
+
+        for (int y = tileBegin.y; y < tileEnd.y; y++) {
+            for (int packetX = tileBegin.x; packetX < tileEnd.x; packetX += rayPacketSize) {
+                // Compute the rays of the pixels and where they enter and exit the volume.
+                RayPacket packet;
+                generateRayPacket(rayBasis, bounds, packetX, y, packet);
+                for (int x = packetX; x < std::min(packetX + rayPacketSize, tileEnd.x); x++) {
+                    const int lane = x - packetX;
+
+                    // If the ray misses the volume then we continue to the next pixel.
+                    if (coverage == TileCoverage::Partial && !(packet.tmin[lane] <= packet.tmax[lane]))
+                        continue;
+                    Ray ray { rayBasis.origin, glm::vec3(packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane]), packet.tmin[lane], packet.tmax[lane] };
+                    // Clipped away parts of the ray are never sampled.
+                    if (!clipRayToPlanes(ray, m_config))
+                        continue;
+
+                    if (m_levelOfDetail > 0) {
+                        ray.origin = volume::VolumePyramid::toLevelCoordinate(ray.origin, m_levelOfDetail);
+                        ray.direction /= levelScale;
+                    }
+
+                    // Get a color for the current pixel according to the current render mode. MIP and the slicer
+                    // have no surface and use where the ray enters the volume as the depth.
+                    glm::vec4 color {};
+                    float depth = ray.tmin;
+                    switch (m_config.renderMode) {
+                    case RenderMode::RenderSlicer: {
+                        color = traceRaySlice(ray, levelVolumeCenter, planeNormal);
+                        break;
+                    }
+                    case RenderMode::RenderMIP: {
+                        color = traceRayMIP(ray, sampleStep);
+                        break;
+                    }
+                    case RenderMode::RenderComposite: {
+                        color = traceRayComposite(ray, sampleStep, m_depthOutput ? &depth : nullptr);
+                        break;
+                    }
+                    case RenderMode::RenderIso: {
+                        color = traceRayISO(ray, sampleStep, m_depthOutput ? &depth : nullptr);
+                        break;
+                    }
+                    };
+                    // Write the resulting color to the screen.
+                    fillColor(x, y, color);
+                    if (m_depthOutput)
+                        m_depthBuffer[size_t(m_config.renderResolution.x * y + x)] = depth;
+                }
+            }
+        }
+    }
+}
+
+// Select the level of the volume pyramid for the current view, coarsened by the given number of interaction levels.
+int Renderer::selectLevelOfDetail(const Bounds& bounds, int interactionLevels) const
+{
+    if (!m_pVolumePyramid || !m_config.levelOfDetail)
+        return 0;
+
+    const float pixelSize = projectedPixelSize(*m_pCamera, m_config.renderResolution, bounds.IndividualBounds.lower, bounds.IndividualBounds.upper);
+    return m_pVolumePyramid->selectLevel(pixelSize, m_config.lodBias + float(interactionLevels));
+}
+
+int Renderer::levelOfDetail() const
+{
+    return m_levelOfDetail;
+}
+
+int Renderer::appliedInteractionLevels() const
+{
+    return m_levelOfDetail - m_baseLevelOfDetail;
+}
+
+int Renderer::availableInteractionLevels() const
+{
+    if (!m_pVolumePyramid || !m_config.levelOfDetail)
+        return 0;
+    return m_pVolumePyramid->numLevels() - 1 - m_baseLevelOfDetail;
+}
 
-            // Compute a ray for the current pixel.
-            const glm::vec2 pixelPos = glm::vec2(x, y) / glm::vec2(m_config.renderResolution);
-            Ray ray = m_pCamera->generateRay(pixelPos * 2.0f - 1.0f);
+// Cells of isoCellSize^3 voxels padded by one voxel, so nearest neighbour and trilinear samples in a cell only read
+// voxels within its value range.
+static constexpr int isoCellSize = 8;
 
-            // Compute where the ray enters and exists the volume.
-            // If the ray misses the volume then we continue to the next pixel.
+// The table and its index are built on the first iso surface frame, afterwards only a change of the iso value
+// queries the index again.
+void Renderer::updateIsoCells()
+{
+    if (m_isoCellTable.values().empty()) {
+        m_isoCellTable = volume::MinMaxTable(*m_pVolume, isoCellSize, 1);
+        m_isoCellIndex = SpanSpaceIndex(m_isoCellTable.values());
+        m_isoCellActive = m_isoCellIndex.activeMask(m_config.isoValue);
+        m_isoCellValue = m_config.isoValue;
+    } else if (m_isoCellValue != m_config.isoValue) {
+        m_isoCellActive = m_isoCellIndex.activeMask(m_config.isoValue);
+        m_isoCellValue = m_config.isoValue;
+    }
+}
+
+// Out-of-core volumes load their bricks on demand. To overlap disk reads with rendering we trace a coarse grid of rays
+// through the brick grid (3D DDA) and let the cache prefetch the bricks in the order in which the rays first reach them.
+void Renderer::prefetchBricks(const Bounds& bounds) const
+{
+    const auto pBrickCache = m_pVolume->brickCache();
+    if (!pBrickCache)
+        return;
+    util::ScopedTimer timer("Renderer::prefetchBricks", "render");
+
+    const glm::ivec3 numBricks = pBrickCache->numBricks();
+    const float brickSize = float(pBrickCache->header().brickSize);
+    std::vector<float> firstHit(size_t(numBricks.x) * size_t(numBricks.y) * size_t(numBricks.z), std::numeric_limits<float>::max());
+
+    constexpr int pixelStride = 8;
+    const CameraRayBasis rayBasis = m_pCamera->rayBasis(m_config.renderResolution);
+    for (int x = 0; x < m_config.renderResolution.x; x += pixelStride) {
+        for (int y = 0; y < m_config.renderResolution.y; y += pixelStride) {
+            Ray ray = rayBasis.generateRay(x, y);
             if (!instersectRayVolumeBounds(ray, bounds))
                 continue;
 
-            // Get a color for the current pixel according to the current render mode.
-            glm::vec4 color {};
-            switch (m_config.renderMode) {
-            case RenderMode::RenderSlicer: {
-                color = traceRaySlice(ray, volumeCenter, planeNormal);
-                break;
-            }
-            case RenderMode::RenderMIP: {
-                color = traceRayMIP(ray, m_config.stepSize);
-                break;
-            }
-            case RenderMode::RenderComposite: {
-                color = traceRayComposite(ray, m_config.stepSize);
-                break;
+            const glm::vec3 entry = ray.origin + ray.tmin * ray.direction;
+            glm::ivec3 brick = glm::clamp(glm::ivec3(entry / brickSize), glm::ivec3(0), numBricks - 1);
+            glm::ivec3 step;
+            glm::vec3 tNext, tDelta;
+            for (int axis = 0; axis < 3; axis++) {
+                const float direction = ray.direction[axis];
+                if (direction > 0.0f) {
+                    step[axis] = 1;
+                    tNext[axis] = ray.tmin + (float(brick[axis] + 1) * brickSize - entry[axis]) / direction;
+                    tDelta[axis] = brickSize / direction;
+                } else if (direction < 0.0f) {
+                    step[axis] = -1;
+                    tNext[axis] = ray.tmin + (float(brick[axis]) * brickSize - entry[axis]) / direction;
+                    tDelta[axis] = -brickSize / direction;
+                } else {
+                    step[axis] = 0;
+                    tNext[axis] = std::numeric_limits<float>::max();
+                    tDelta[axis] = std::numeric_limits<float>::max();
+                }
             }
-            case RenderMode::RenderIso: {
-                color = traceRayISO(ray, m_config.stepSize);
-                break;
-            }
-            };
-            // Write the resulting color to the screen.
-            fillColor(x, y, color);
 
+            float t = ray.tmin;
+            while (t <= ray.tmax && glm::all(glm::greaterThanEqual(brick, glm::ivec3(0))) && glm::all(glm::lessThan(brick, numBricks))) {
+                float& brickHit = firstHit[size_t(pBrickCache->brickIndex(brick))];
+                brickHit = std::min(brickHit, t);
+
+                const int axis = tNext.x < tNext.y ? (tNext.x < tNext.z ? 0 : 2) : (tNext.y < tNext.z ? 1 : 2);
+                t = tNext[axis];
+                tNext[axis] += tDelta[axis];
+                brick[axis] += step[axis];
+            }
         }
     }
+
+    std::vector<int> orderedBricks;
+    for (size_t i = 0; i < firstHit.size(); i++) {
+        if (firstHit[i] != std::numeric_limits<float>::max())
+            orderedBricks.push_back(int(i));
+    }
+    std::sort(std::begin(orderedBricks), std::end(orderedBricks), [&](int lhs, int rhs) { return firstHit[size_t(lhs)] < firstHit[size_t(rhs)]; });
+    pBrickCache->prefetch(std::move(orderedBricks));
 }
 
 // ======= DO NOT MODIFY THIS FUNCTION ========
@@ -148,28 +429,100 @@ glm::vec4 Renderer::traceRayMIP(const Ray& ray, float stepSize) const
     return glm::vec4(glm::vec3(maxVal) / m_pVolume->maximum(), 1.0f);
 }
 
-// ======= TODO: IMPLEMENT ========
-// This function should find the position where the ray intersects with the volume's isosurface.
-// If volume shading is DISABLED then simply return the isoColor.
-// If volume shading is ENABLED then return the phong-shaded color at that location using the local gradient (from m_pGradientVolume).
-//   Use the camera position (m_pCamera->position()) as the light position.
-// Use the bisectionAccuracy function (to be implemented) to get a more precise isosurface location between two steps.
-glm::vec4 Renderer::traceRayISO(const Ray& ray, float stepSize) const
+// This function finds the position where the ray intersects with the volume's isosurface.
+// If volume shading is disabled it returns the isoColor, otherwise the Phong shaded color at that location with the
+// light at the camera. bisectionAccuracy or analyticIntersection refine the isosurface location between two steps.
+//
+// The surface is hit by the first sample at or above the iso value. During render() samples in cells that lie
+// completely below the iso value are skipped, the march continues at the last sample before the ray leaves the cell.
+glm::vec4 Renderer::traceRayISO(const Ray& ray, float stepSize, float* pFirstHitT) const
 {
     static constexpr glm::vec3 isoColor { 0.8f, 0.8f, 0.2f };
-    return glm::vec4(isoColor, 1.0f);
+    if (pFirstHitT)
+        *pFirstHitT = noHitDepth;
+
+    glm::vec3 samplePos = ray.origin + ray.tmin * ray.direction;
+    const glm::vec3 increment = stepSize * ray.direction;
+    float previousT = ray.tmin;
+    for (float t = ray.tmin; t <= ray.tmax; t += stepSize, samplePos += increment) {
+        if (m_useIsoCells) {
+            const glm::ivec3 cell = glm::clamp(glm::ivec3(glm::floor(samplePos)) / isoCellSize, glm::ivec3(0), m_isoCellTable.size() - 1);
+            const size_t cellIndex = size_t(cell.x) + size_t(m_isoCellTable.size().x) * (size_t(cell.y) + size_t(m_isoCellTable.size().y) * size_t(cell.z));
+            if (!m_isoCellActive[cellIndex] && m_isoCellTable.values()[cellIndex].y < m_config.isoValue) {
+                // Samples within half a voxel of the cell only read voxels of its padded range, which leaves room
+                // for rounding at the exit.
+                const glm::vec3 lower = glm::vec3(cell * isoCellSize) - 0.5f;
+                const glm::vec3 upper = lower + float(isoCellSize);
+                float tExit = std::numeric_limits<float>::max();
+                for (int axis = 0; axis < 3; axis++) {
+                    if (ray.direction[axis] > 0.0f)
+                        tExit = std::min(tExit, (upper[axis] - ray.origin[axis]) / ray.direction[axis]);
+                    else if (ray.direction[axis] < 0.0f)
+                        tExit = std::min(tExit, (lower[axis] - ray.origin[axis]) / ray.direction[axis]);
+                }
+                t += std::max(std::floor((tExit - t) / stepSize), 0.0f) * stepSize;
+                samplePos = ray.origin + t * ray.direction;
+                previousT = t;
+                continue;
+            }
+        }
+
+        const float val = m_pVolume->getSampleInterpolate(samplePos);
+        if (val >= m_config.isoValue) {
+            float hitT = t;
+            if (t > ray.tmin && m_config.analyticIntersection)
+                hitT = analyticIntersection(ray, previousT, t, m_config.isoValue);
+            else if (t > ray.tmin && m_config.bisection)
+                hitT = bisectionAccuracy(ray, previousT, t, m_config.isoValue);
+            if (pFirstHitT)
+                *pFirstHitT = hitT;
+            if (!m_config.volumeShading)
+                return glm::vec4(isoColor, 1.0f);
+
+            // The light is at the camera, so L = V. The direction is used instead of the camera position because
+            // rays through a coarse level of the volume pyramid start at the camera in the voxel space of that level.
+            // The normal is the gradient of the interpolant, read from the voxels instead of the gradient volume.
+            const glm::vec3 hitPos = ray.origin + hitT * ray.direction;
+            const glm::vec3 V = -glm::normalize(ray.direction);
+            const glm::vec3 gradient = m_pVolume->getSampleGradientInterpolate(hitPos).gradient;
+            return glm::vec4(computePhongShading(isoColor, volume::GradientVoxel { gradient, glm::length(gradient) }, V, V), 1.0f);
+        }
+        previousT = t;
+    }
+    return glm::vec4(0.0f);
 }
 
-// ======= TODO: IMPLEMENT ========
 // Given that the iso value lies somewhere between t0 and t1, find a t for which the value
-// closely matches the iso value (less than 0.01 difference). Add a limit to the number of
-// iterations such that it does not get stuck in degerate cases.
+// closely matches the iso value (less than 0.01 difference). The number of iterations is
+// limited such that it does not get stuck in degenerate cases.
 float Renderer::bisectionAccuracy(const Ray& ray, float t0, float t1, float isoValue) const
 {
-    return 0.0f;
+    static constexpr int maxIterations = 16;
+    static constexpr float tolerance = 0.01f;
+
+    // The value is below the iso value at t0 and at or above it at t1.
+    for (int i = 0; i < maxIterations; i++) {
+        const float t = 0.5f * (t0 + t1);
+        const float val = m_pVolume->getSampleInterpolate(ray.origin + t * ray.direction);
+        if (std::abs(val - isoValue) < tolerance)
+            return t;
+        if (val < isoValue)
+            t0 = t;
+        else
+            t1 = t;
+    }
+    return 0.5f * (t0 + t1);
+}
+
+// The same contract as bisectionAccuracy, but exact for trilinear interpolation. It reads the eight voxels of every
+// cell that the ray crosses between t0 and t1 instead of sampling repeatedly. Other interpolation modes are bisected.
+float Renderer::analyticIntersection(const Ray& ray, float t0, float t1, float isoValue) const
+{
+    if (m_pVolume->interpolationMode != volume::InterpolationMode::Linear)
+        return bisectionAccuracy(ray, t0, t1, isoValue);
+    return intersectTrilinearIsoSurface(*m_pVolume, ray, t0, t1, isoValue);
 }
 
-// ======= TODO: IMPLEMENT ========
 // Compute Phong Shading given the voxel color (material color), the gradient, the light vector and view vector.
 // You can find out more about the Phong shading model at:
 // https://en.wikipedia.org/wiki/Phong_reflection_model
@@ -178,15 +531,61 @@ float Renderer::bisectionAccuracy(const Ray& ray, float t0, float t1, float isoV
 
 glm::vec3 Renderer::computePhongShading(const glm::vec3& color, const volume::GradientVoxel& gradient, const glm::vec3& L, const glm::vec3& V, float ambientCoefficient, float diffuseCoefficient, float specularCoefficient, int specularPower)
 {
-    return glm::vec3(0.0f);
+    // Without a gradient there is no surface to shade.
+    if (gradient.magnitude == 0.0f)
+        return glm::vec3(0.0f);
+
+    // The normal faces the viewer, whichever side of the surface it is on.
+    glm::vec3 N = glm::normalize(gradient.dir);
+    if (glm::dot(N, V) < 0.0f)
+        N = -N;
+
+    // white light, so only the material color contributes
+    const float NdotL = glm::dot(L, N);
+    const glm::vec3 ambient = ambientCoefficient * color;
+    const glm::vec3 diffuse = diffuseCoefficient * std::clamp(NdotL, 0.0f, 1.0f) * color;
+    const glm::vec3 R = 2.0f * NdotL * N - L;
+    const glm::vec3 specular = specularCoefficient * std::pow(std::clamp(glm::dot(R, V), 0.0f, 1.0f), float(specularPower)) * color;
+    return ambient + diffuse + specular;
 }
 
-// ======= TODO: IMPLEMENT ========
-// In this function, implement 1D transfer function raycasting.
-// Use getTFValue to compute the color for a given volume value according to the 1D transfer function.
-glm::vec4 Renderer::traceRayComposite(const Ray& ray, float stepSize) const
+// 1D transfer function raycasting, getTFValue gives the color for a given volume value.
+//
+// Front to back compositing with early ray termination, like the GPU raycaster. The opacities are corrected for step
+// sizes that differ from one voxel. Shading and the opacity modulation by the gradient magnitude (Rheingans and Ebert:
+// alpha * (kc + ks * |g|^ke)) take the value and the gradient of the interpolant from a single fetch of the voxels.
+glm::vec4 Renderer::traceRayComposite(const Ray& ray, float stepSize, float* pFirstHitT) const
 {
-    return glm::vec4(0.0f);
+    if (pFirstHitT)
+        *pFirstHitT = noHitDepth;
+    const bool useGradient = m_config.volumeShading || m_config.useOpacityModulation;
+    const glm::vec3 V = -glm::normalize(ray.direction);
+
+    glm::vec3 samplePos = ray.origin + ray.tmin * ray.direction;
+    const glm::vec3 increment = stepSize * ray.direction;
+    glm::vec4 color { 0.0f };
+    for (float t = ray.tmin; t <= ray.tmax; t += stepSize, samplePos += increment) {
+        const volume::SampleGradient sample = useGradient ? m_pVolume->getSampleGradientInterpolate(samplePos) : volume::SampleGradient { m_pVolume->getSampleInterpolate(samplePos), glm::vec3(0.0f) };
+        glm::vec4 tfColor = getTFValue(sample.value);
+        if (tfColor.a <= 0.0f)
+            continue;
+        if (pFirstHitT && *pFirstHitT == noHitDepth)
+            *pFirstHitT = t;
+
+        const float magnitude = glm::length(sample.gradient);
+        if (m_config.useOpacityModulation && m_pGradientVolume->maxMagnitude() > 0.0f) {
+            const glm::vec4& params = m_config.illustrativeParams;
+            tfColor.a *= params.x + params.y * std::pow(magnitude / m_pGradientVolume->maxMagnitude(), params.z);
+        }
+        if (m_config.volumeShading)
+            tfColor = glm::vec4(computePhongShading(glm::vec3(tfColor), volume::GradientVoxel { sample.gradient, magnitude }, V, V), tfColor.a);
+
+        const float alpha = 1.0f - std::pow(1.0f - std::clamp(tfColor.a, 0.0f, 1.0f), stepSize);
+        color += (1.0f - color.a) * glm::vec4(alpha * glm::vec3(tfColor), alpha);
+        if (color.a > 0.99f)
+            break;
+    }
+    return color;
 }
 
 // ======= DO NOT MODIFY THIS FUNCTION ========
@@ -236,6 +635,9 @@ bool Renderer::instersectRayVolumeBounds(Ray& ray, const Bounds& bounds) const
 void Renderer::fillColor(int x, int y, const glm::vec4& color)
 {
     const size_t index = static_cast<size_t>(m_config.renderResolution.x * y + x);
-    m_frameBuffer[index] = color;
+    if (m_packedOutput.empty())
+        m_frameBuffer[index] = color;
+    else
+        m_packedOutput[index] = glm::packUnorm4x8(color);
 }
 }
@@ -1,15 +1,21 @@
 #pragma once
 #include "render/ray.h"
 #include "render/ray_trace_camera.h"
+#include "render/opacity_range_index.h"
 #include "render/render_config.h"
+#include "render/span_space_index.h"
 #include "volume/gradient_volume.h"
+#include "volume/min_max_table.h"
 #include "volume/volume.h"
+#include "volume/volume_pyramid.h"
+#include <cstdint>
 #include <cstring> // memcmp
 #include <glm/mat4x4.hpp>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 #include <gsl/span>
+#include <limits>
 #include <memory>
 #include <tuple>
 #include <vector>
@@ -33,16 +39,36 @@ public:
         const RenderConfig& config);
 
     void setConfig(const RenderConfig& config);
+    void setVolumePyramid(const volume::VolumePyramid* pVolumePyramid);
+    // Render another volume of the same size, e.g. the next timestep of a time series. The pyramid has to be set again.
+    void setVolume(const volume::Volume* pVolume, const volume::GradientVolume* pGradientVolume);
     void render();
     gsl::span<const glm::vec4> frameBuffer() const;
+    // Render RGBA8 pixels (red in the lowest byte) into the given pixels instead of the float framebuffer, e.g. into a
+    // mapped pixel buffer for display. They must cover the render resolution and stay valid until render() returns,
+    // an empty span switches back to the framebuffer.
+    void setPackedOutput(gsl::span<uint32_t> pixels);
+    // Distance along the ray to the first visible sample per pixel (noHitDepth if there is none), which is used to
+    // upsample frames rendered below the display resolution. Empty unless enabled.
+    void setDepthOutput(bool enabled);
+    gsl::span<const float> depthBuffer() const;
+    static constexpr float noHitDepth = std::numeric_limits<float>::max();
+
+    // Level of the volume pyramid used for the last frame and how many of the requested interaction levels
+    // (RenderConfig::interactionLod) it applied on top of the level that the view needs.
+    int levelOfDetail() const;
+    int appliedInteractionLevels() const;
+    int availableInteractionLevels() const;
 
 protected:
     // These functions will be automatically tested.
     glm::vec4 traceRaySlice(const Ray& ray, const glm::vec3& volumeCenter, const glm::vec3& planeNormal) const;
     glm::vec4 traceRayMIP(const Ray& ray, float sampleStep) const;
-    glm::vec4 traceRayISO(const Ray& ray, float sampleStep) const;
-    glm::vec4 traceRayComposite(const Ray& ray, float sampleStep) const;
+    // Both store the t of the first visible sample in pFirstHitT (noHitDepth if there is none) when it is given.
+    glm::vec4 traceRayISO(const Ray& ray, float sampleStep, float* pFirstHitT = nullptr) const;
+    glm::vec4 traceRayComposite(const Ray& ray, float sampleStep, float* pFirstHitT = nullptr) const;
     float bisectionAccuracy(const Ray& ray, float t0, float t1, float isoValue) const;
+    float analyticIntersection(const Ray& ray, float t0, float t1, float isoValue) const;
 
     static glm::vec3 computePhongShading(const glm::vec3& color, const volume::GradientVoxel& gradient, const glm::vec3& L, const glm::vec3& V, float ambientCoefficient=0.1f, float diffuseCoefficient=0.7f, float specularCoefficient=0.2f, int specularPower=25);
 
@@ -50,19 +76,36 @@ protected:
 
 private:
     void resizeImage(const glm::ivec2& resolution);
-    void resetImage();
+    void resetImage(const glm::ivec2& begin, const glm::ivec2& end);
 
     glm::vec4 getTFValue(float val) const;
     bool instersectRayVolumeBounds(Ray& ray, const Bounds& volumeBounds) const;
+    void prefetchBricks(const Bounds& volumeBounds) const;
+    int selectLevelOfDetail(const Bounds& volumeBounds, int interactionLevels) const;
     void fillColor(int x, int y, const glm::vec4& color);
+    void updateIsoCells();
 
 protected:
     const volume::Volume* m_pVolume;
     const volume::GradientVolume* m_pGradientVolume;
     const render::RayTraceCamera* m_pCamera;
+    const volume::VolumePyramid* m_pVolumePyramid { nullptr };
     RenderConfig m_config {};
 
+    int m_levelOfDetail { 0 };
+    int m_baseLevelOfDetail { 0 };
+
+    // Cells of the full resolution volume that the iso surface passes through, rays march over the others.
+    volume::MinMaxTable m_isoCellTable;
+    SpanSpaceIndex m_isoCellIndex;
+    ActiveMask m_isoCellActive;
+    float m_isoCellValue { 0.0f };
+    bool m_useIsoCells { false };
+
     std::vector<glm::vec4> m_frameBuffer;
+    gsl::span<uint32_t> m_packedOutput;
+    bool m_depthOutput { false };
+    std::vector<float> m_depthBuffer;
 };
 
 }
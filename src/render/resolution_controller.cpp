@@ -0,0 +1,58 @@
+#include "resolution_controller.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/common.hpp>
+#include <limits>
+
+namespace render {
+
+// Weight of the last frame in the estimate, views change while the user interacts so it should follow quickly.
+static constexpr float frameTimeSmoothing = 0.5f;
+// The scale is only lowered when the frame is 5% over the target and only raised when it can grow by 10%. A level
+// is only dropped when the frame would still be 20% under the target without it.
+static constexpr float scaleDownHysteresis = 0.05f;
+static constexpr float scaleUpHysteresis = 0.1f;
+static constexpr float levelHysteresis = 0.2f;
+
+ResolutionController::ResolutionController(float frameTimeTarget, float minResolutionScale)
+    : m_frameTimeTarget(frameTimeTarget)
+    , m_minResolutionScale(minResolutionScale)
+{
+}
+
+void ResolutionController::addFrame(float renderTime, float resolutionScale, int interactionLevels, int availableLevels)
+{
+    // The time scales with the number of pixels (quadratic in the scale) and every level of the volume pyramid halves
+    // the number of samples per ray.
+    const float fullFrameTime = renderTime / (resolutionScale * resolutionScale) * float(1 << interactionLevels);
+    m_fullFrameTime = m_fullFrameTime > 0.0f ? glm::mix(m_fullFrameTime, fullFrameTime, frameTimeSmoothing) : fullFrameTime;
+
+    // Coarser levels also read 8x less data, so those are used before the resolution is lowered.
+    int levels = std::clamp(m_interactionLevels, 0, availableLevels);
+    while (levels < availableLevels && m_fullFrameTime / float(1 << levels) > m_frameTimeTarget)
+        levels++;
+    while (levels > 0 && m_fullFrameTime / float(1 << (levels - 1)) < m_frameTimeTarget * (1.0f - levelHysteresis))
+        levels--;
+    m_interactionLevels = levels;
+
+    const float remainingFrameTime = m_fullFrameTime / float(1 << levels);
+    const float fittingScale = remainingFrameTime > 0.0f ? std::sqrt(m_frameTimeTarget / remainingFrameTime) : std::numeric_limits<float>::max();
+    if (fittingScale < m_resolutionScale * (1.0f - scaleDownHysteresis) || fittingScale > m_resolutionScale * (1.0f + scaleUpHysteresis))
+        m_resolutionScale = std::clamp(fittingScale, m_minResolutionScale, 1.0f);
+}
+
+int ResolutionController::interactionLevels() const
+{
+    return m_interactionLevels;
+}
+
+float ResolutionController::resolutionScale() const
+{
+    return m_resolutionScale;
+}
+
+float ResolutionController::fullFrameTime() const
+{
+    return m_fullFrameTime;
+}
+}
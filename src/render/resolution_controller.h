@@ -0,0 +1,29 @@
+#pragma once
+
+namespace render {
+
+// Picks the interaction level of detail and a fractional resolution scale so that frames rendered while the user
+// interacts take about frameTimeTarget. The time of a frame at full resolution and detail is estimated from the
+// measured frames and smoothed, and the resolution only changes when it is off by more than the hysteresis, so the
+// image does not jump between sizes from frame to frame.
+class ResolutionController {
+public:
+    explicit ResolutionController(float frameTimeTarget, float minResolutionScale = 0.125f);
+
+    // Time of the last frame and the resolution scale (of the width and height) and interaction levels it used.
+    void addFrame(float renderTime, float resolutionScale, int interactionLevels, int availableLevels);
+
+    int interactionLevels() const;
+    float resolutionScale() const;
+    // Smoothed estimate of the time of a frame at full resolution without interaction levels.
+    float fullFrameTime() const;
+
+private:
+    float m_frameTimeTarget;
+    float m_minResolutionScale;
+
+    float m_fullFrameTime { 0.0f };
+    int m_interactionLevels { 0 };
+    float m_resolutionScale { 1.0f };
+};
+}
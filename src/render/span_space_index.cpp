@@ -0,0 +1,112 @@
+#include "span_space_index.h"
+#include "util/trace.h"
+#include <algorithm>
+#include <cassert>
+
+namespace render {
+
+SpanSpaceIndex::SpanSpaceIndex(gsl::span<const glm::vec2> minMaxValues)
+    : m_size(minMaxValues.size())
+{
+    util::ScopedTimer timer("SpanSpaceIndex::build", "isosurface");
+
+    std::vector<uint32_t> ranges;
+    ranges.reserve(minMaxValues.size());
+    for (size_t i = 0; i < minMaxValues.size(); i++) {
+        if (minMaxValues[i].x <= minMaxValues[i].y)
+            ranges.push_back(uint32_t(i));
+    }
+    m_byMin.reserve(ranges.size());
+    m_byMax.reserve(ranges.size());
+    if (ranges.empty())
+        return;
+
+    // Nodes are built from an explicit stack of [begin, end) of the ranges, the children are linked when they are
+    // created. The median range contains the center, so every node keeps at least one range and the tree has at most
+    // as many nodes as there are ranges.
+    struct Task {
+        size_t begin, end;
+        int32_t parent;
+        bool above;
+    };
+    std::vector<Task> tasks { Task { 0, ranges.size(), -1, false } };
+    const auto midpoint = [&](uint32_t i) { return minMaxValues[i].x + 0.5f * (minMaxValues[i].y - minMaxValues[i].x); };
+    while (!tasks.empty()) {
+        const Task task = tasks.back();
+        tasks.pop_back();
+
+        const auto first = std::begin(ranges) + ptrdiff_t(task.begin);
+        const auto last = std::begin(ranges) + ptrdiff_t(task.end);
+        const auto median = first + (last - first) / 2;
+        std::nth_element(first, median, last, [&](uint32_t lhs, uint32_t rhs) { return midpoint(lhs) < midpoint(rhs); });
+        const float center = midpoint(*median);
+
+        // below the center | containing it | above it
+        const auto containing = std::partition(first, last, [&](uint32_t i) { return minMaxValues[i].y < center; });
+        const auto above = std::partition(containing, last, [&](uint32_t i) { return minMaxValues[i].x <= center; });
+        assert(containing != above);
+
+        Node node { center, uint32_t(m_byMin.size()), 0, -1, -1 };
+        for (auto iter = containing; iter != above; ++iter) {
+            m_byMin.push_back(Entry { minMaxValues[*iter].x, *iter });
+            m_byMax.push_back(Entry { minMaxValues[*iter].y, *iter });
+        }
+        node.end = uint32_t(m_byMin.size());
+        std::sort(std::begin(m_byMin) + node.begin, std::end(m_byMin), [](const Entry& lhs, const Entry& rhs) { return lhs.bound < rhs.bound; });
+        std::sort(std::begin(m_byMax) + node.begin, std::end(m_byMax), [](const Entry& lhs, const Entry& rhs) { return lhs.bound > rhs.bound; });
+
+        const int32_t nodeIndex = int32_t(m_nodes.size());
+        m_nodes.push_back(node);
+        if (task.parent >= 0)
+            (task.above ? m_nodes[size_t(task.parent)].above : m_nodes[size_t(task.parent)].below) = nodeIndex;
+
+        if (first != containing)
+            tasks.push_back(Task { task.begin, size_t(containing - std::begin(ranges)), nodeIndex, false });
+        if (above != last)
+            tasks.push_back(Task { size_t(above - std::begin(ranges)), task.end, nodeIndex, true });
+    }
+}
+
+// Below the center only the mins of the ranges at a node have to be checked (all maxes are >= center > value), above
+// it only the maxes.
+template <typename F>
+void SpanSpaceIndex::forEachContaining(float value, F&& f) const
+{
+    int32_t nodeIndex = m_nodes.empty() ? -1 : 0;
+    while (nodeIndex >= 0) {
+        const Node& node = m_nodes[size_t(nodeIndex)];
+        if (value < node.center) {
+            for (uint32_t i = node.begin; i < node.end && m_byMin[i].bound <= value; i++)
+                f(m_byMin[i].index);
+            nodeIndex = node.below;
+        } else if (value > node.center) {
+            for (uint32_t i = node.begin; i < node.end && m_byMax[i].bound >= value; i++)
+                f(m_byMax[i].index);
+            nodeIndex = node.above;
+        } else {
+            for (uint32_t i = node.begin; i < node.end; i++)
+                f(m_byMin[i].index);
+            nodeIndex = -1;
+        }
+    }
+}
+
+std::vector<uint32_t> SpanSpaceIndex::query(float value) const
+{
+    std::vector<uint32_t> indices;
+    forEachContaining(value, [&](uint32_t index) { indices.push_back(index); });
+    return indices;
+}
+
+ActiveMask SpanSpaceIndex::activeMask(float value) const
+{
+    ActiveMask mask(m_size);
+    forEachContaining(value, [&](uint32_t index) { mask.set(index, true); });
+    return mask;
+}
+
+size_t SpanSpaceIndex::size() const
+{
+    return m_size;
+}
+}
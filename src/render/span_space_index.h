@@ -0,0 +1,46 @@
+#pragma once
+#include "render/opacity_range_index.h"
+#include <cstdint>
+#include <glm/vec2.hpp>
+#include <gsl/span>
+#include <vector>
+
+namespace render {
+
+// Interval tree over the value ranges of cells (e.g., the blocks or bricks of a MinMaxTable) that finds the cells
+// containing a value, the cells an iso surface can pass through. Every node keeps the ranges that contain its center
+// (the median of their midpoints) sorted by min and by max, the ranges below / above the center go to its children.
+// A query visits one node per level and stops at the first range that does not contain the value, so it costs
+// O(log n + k) for k cells instead of testing all n ranges whenever the iso value changes.
+class SpanSpaceIndex {
+public:
+    SpanSpaceIndex() = default;
+    // Empty ranges (min > max) are never found.
+    explicit SpanSpaceIndex(gsl::span<const glm::vec2> minMaxValues);
+
+    // Indices of the ranges with min <= value <= max, in no particular order.
+    std::vector<uint32_t> query(float value) const;
+    // The same as one bit per range.
+    ActiveMask activeMask(float value) const;
+    size_t size() const;
+
+private:
+    template <typename F>
+    void forEachContaining(float value, F&& f) const;
+
+    struct Entry {
+        float bound; // min in m_byMin, max in m_byMax
+        uint32_t index;
+    };
+    struct Node {
+        float center;
+        uint32_t begin, end; // entries of the node in m_byMin and m_byMax
+        int32_t below, above; // children, -1 if there is none
+    };
+
+    size_t m_size { 0 };
+    std::vector<Node> m_nodes; // the root is the first node
+    std::vector<Entry> m_byMin; // increasing min per node
+    std::vector<Entry> m_byMax; // decreasing max per node
+};
+}
@@ -0,0 +1,49 @@
+#include "tile_coverage.h"
+#include <array>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include <glm/vector_relational.hpp>
+
+namespace render {
+
+// Whether the line through the origin in the given direction hits the box (of positions relative to the origin),
+// the same test as the ray packets of Renderer::render.
+static bool lineHitsBox(const glm::vec3& direction, const glm::vec3& lower, const glm::vec3& upper, float& tmin)
+{
+    const glm::vec3 t0 = lower / direction;
+    const glm::vec3 t1 = upper / direction;
+    tmin = glm::compMax(glm::min(t0, t1));
+    return tmin <= glm::compMin(glm::max(t0, t1));
+}
+
+// The rays of the tile lie in the pyramid spanned by the rays through the corner pixels, which misses the box if the
+// box is completely outside one of its side planes. If the camera is outside the box, the directions that hit it in
+// front of the camera form a convex cone, so the tile is inside when its corner rays are.
+TileCoverage classifyTile(const CameraRayBasis& basis, const glm::vec3& boundsLower, const glm::vec3& boundsUpper, const glm::ivec2& begin, const glm::ivec2& end)
+{
+    const glm::vec3 lower = boundsLower - basis.origin;
+    const glm::vec3 upper = boundsUpper - basis.origin;
+    const auto direction = [&](int x, int y) { return basis.direction00 + float(x) * basis.pixelStepX + float(y) * basis.pixelStepY; };
+    const std::array<glm::vec3, 4> corners { direction(begin.x, begin.y), direction(end.x - 1, begin.y), direction(end.x - 1, end.y - 1), direction(begin.x, end.y - 1) };
+    const glm::vec3 center = corners[0] + corners[1] + corners[2] + corners[3];
+
+    for (size_t i = 0; i < corners.size(); i++) {
+        glm::vec3 normal = glm::cross(corners[i], corners[(i + 1) % corners.size()]);
+        if (glm::dot(normal, center) < 0.0f)
+            normal = -normal;
+        // corner of the box that is furthest along the inward normal
+        const glm::vec3 furthest = glm::mix(lower, upper, glm::vec3(glm::greaterThan(normal, glm::vec3(0.0f))));
+        if (glm::dot(normal, furthest) < 0.0f)
+            return TileCoverage::Outside;
+    }
+
+    const bool cameraInside = glm::all(glm::lessThanEqual(lower, glm::vec3(0.0f))) && glm::all(glm::greaterThanEqual(upper, glm::vec3(0.0f)));
+    for (const glm::vec3& corner : corners) {
+        float tmin;
+        if (!lineHitsBox(corner, lower, upper, tmin) || (!cameraInside && tmin <= 0.0f))
+            return TileCoverage::Partial;
+    }
+    return TileCoverage::Inside;
+}
+}
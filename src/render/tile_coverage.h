@@ -0,0 +1,17 @@
+#pragma once
+#include "render/ray_trace_camera.h"
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+namespace render {
+
+enum class TileCoverage {
+    Outside, // no ray of the tile hits the volume
+    Partial,
+    Inside // every ray of the tile hits the volume
+};
+
+// Conservative test of the rays through the pixels [begin, end) against the box [lower, upper] (in voxels). A tile is
+// only Outside if none of its rays hits the box in front of the camera, and only Inside if all of them hit it.
+TileCoverage classifyTile(const CameraRayBasis& basis, const glm::vec3& lower, const glm::vec3& upper, const glm::ivec2& begin, const glm::ivec2& end);
+}
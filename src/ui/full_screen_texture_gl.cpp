@@ -1,6 +1,9 @@
 #include "ui/full_screen_texture_gl.h"
 #include "opengl.h"
 #include "ui/gl_error.h"
+#include "util/trace.h"
+#include <cstddef>
+#include <cstring>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/vec3.hpp>
 
@@ -9,7 +12,10 @@ namespace ui {
 FullScreenTextureGL::FullScreenTextureGL()
 {
     // Generate texture
-    glGenTextures(1, &m_texture);
+    m_texture = createTexture();
+    m_depthTexture = createTexture();
+    glGenBuffers(2, m_colorPixelBuffers.buffers.data());
+    glGenBuffers(2, m_depthPixelBuffers.buffers.data());
     glBindTexture(GL_TEXTURE_2D, m_texture);
     /*glTexImage2D(
 			GL_TEXTURE_2D,
@@ -21,8 +27,6 @@ FullScreenTextureGL::FullScreenTextureGL()
 			GL_RGBA,
 			GL_FLOAT,
 			nullptr);*/
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glBindTexture(GL_TEXTURE_2D, 0);
 
     // Create full screen quad
@@ -73,29 +77,147 @@ FullScreenTextureGL::FullScreenTextureGL()
 FullScreenTextureGL::~FullScreenTextureGL()
 {
     glDeleteTextures(1, &m_texture);
+    glDeleteTextures(1, &m_depthTexture);
+    for (PixelBuffers* pPixelBuffers : { &m_colorPixelBuffers, &m_depthPixelBuffers }) {
+        glDeleteBuffers(2, pPixelBuffers->buffers.data());
+        for (GLsync fence : pPixelBuffers->fences)
+            glDeleteSync(fence);
+    }
     glDeleteVertexArrays(1, &m_vao);
     glDeleteBuffers(1, &m_vbo);
     glDeleteProgram(m_shader);
 }
 
+GLuint FullScreenTextureGL::createTexture()
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+// Immutable storage can not be resized or reused for float pixels, so a new texture is made whenever the
+// resolution changes (which does not happen every frame).
+void FullScreenTextureGL::allocateStorage(GLuint& texture, GLenum internalFormat, GLenum format, GLenum type, const glm::ivec2& resolution)
+{
+    glDeleteTextures(1, &texture);
+    texture = createTexture();
+    glBindTexture(GL_TEXTURE_2D, texture);
+    if (GLEW_ARB_texture_storage)
+        glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, resolution.x, resolution.y);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GLint(internalFormat), resolution.x, resolution.y, 0, format, type, nullptr);
+}
+
+// The renderer writes into one pixel buffer while the transfer of the previous frame from the other buffer may still
+// be running. The storage is only allocated when the size changes, instead of orphaning it every frame, and mapped
+// without synchronization: the fence of the upload from two frames ago is practically always signaled already.
+void* FullScreenTextureGL::mapPixelBuffer(PixelBuffers& pixelBuffers, GLsizeiptr numBytes)
+{
+    const size_t index = pixelBuffers.next;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffers.buffers[index]);
+    if (pixelBuffers.sizes[index] != numBytes) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, numBytes, nullptr, GL_STREAM_DRAW);
+        pixelBuffers.sizes[index] = numBytes;
+    }
+    if (pixelBuffers.fences[index]) {
+        glClientWaitSync(pixelBuffers.fences[index], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(pixelBuffers.fences[index]);
+        pixelBuffers.fences[index] = nullptr;
+    }
+    void* pPixels = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, numBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return pPixels;
+}
+
+// glTexSubImage2D only queues the copy from the buffer into the texture instead of waiting for it like glTexImage2D
+// from client memory. A buffer whose contents got lost while mapped is not uploaded, the previous frame stays.
+void FullScreenTextureGL::uploadPixelBuffer(PixelBuffers& pixelBuffers, GLuint texture, const glm::ivec2& resolution, GLenum format, GLenum type)
+{
+    const size_t index = pixelBuffers.next;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffers.buffers[index]);
+    if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, resolution.x, resolution.y, format, type, nullptr);
+        pixelBuffers.fences[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    pixelBuffers.next = 1 - index;
+}
+
 void FullScreenTextureGL::update(gsl::span<const glm::vec3> frameBuffer, const glm::ivec2& resolution)
 {
+    if (m_packedResolution != glm::ivec2(0)) {
+        glDeleteTextures(1, &m_texture);
+        m_texture = createTexture();
+        m_packedResolution = glm::ivec2(0);
+    }
+    m_depthAwareUpsampling = false;
     glBindTexture(GL_TEXTURE_2D, m_texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, resolution.x, resolution.y, 0, GL_RGB, GL_FLOAT, frameBuffer.data());
 }
 
 void FullScreenTextureGL::update(gsl::span<const glm::vec4> frameBuffer, const glm::ivec2& resolution)
 {
+    if (m_packedResolution != glm::ivec2(0)) {
+        glDeleteTextures(1, &m_texture);
+        m_texture = createTexture();
+        m_packedResolution = glm::ivec2(0);
+    }
+    m_depthAwareUpsampling = false;
     glBindTexture(GL_TEXTURE_2D, m_texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, resolution.x, resolution.y, 0, GL_RGBA, GL_FLOAT, frameBuffer.data());
 }
 
+gsl::span<uint32_t> FullScreenTextureGL::mapPixels(const glm::ivec2& resolution)
+{
+    if (resolution != m_packedResolution) {
+        allocateStorage(m_texture, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, resolution);
+        m_packedResolution = resolution;
+    }
+    const size_t numPixels = size_t(resolution.x) * size_t(resolution.y);
+    void* pPixels = mapPixelBuffer(m_colorPixelBuffers, GLsizeiptr(numPixels * sizeof(uint32_t)));
+    if (!pPixels)
+        return {};
+    return { static_cast<uint32_t*>(pPixels), numPixels };
+}
+
+void FullScreenTextureGL::unmapPixels(gsl::span<const float> depthBuffer)
+{
+    util::ScopedTimer timer("FullScreenTextureGL::unmapPixels", "present");
+
+    uploadPixelBuffer(m_colorPixelBuffers, m_texture, m_packedResolution, GL_RGBA, GL_UNSIGNED_BYTE);
+
+    // Only frames below the display resolution come with a depth buffer.
+    m_depthAwareUpsampling = !depthBuffer.empty();
+    if (m_depthAwareUpsampling) {
+        if (m_packedResolution != m_depthResolution) {
+            allocateStorage(m_depthTexture, GL_R32F, GL_RED, GL_FLOAT, m_packedResolution);
+            m_depthResolution = m_packedResolution;
+        }
+        void* pDepth = mapPixelBuffer(m_depthPixelBuffers, GLsizeiptr(depthBuffer.size_bytes()));
+        m_depthAwareUpsampling = pDepth != nullptr;
+        if (pDepth) {
+            std::memcpy(pDepth, depthBuffer.data(), depthBuffer.size_bytes());
+            uploadPixelBuffer(m_depthPixelBuffers, m_depthTexture, m_depthResolution, GL_RED, GL_FLOAT);
+        }
+    }
+}
+
 void FullScreenTextureGL::draw()
 {
     glUseProgram(m_shader);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, m_texture);
     glUniform1i(glGetUniformLocation(m_shader, "u_texture"), 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+    glUniform1i(glGetUniformLocation(m_shader, "u_depth"), 1);
+    glUniform1i(glGetUniformLocation(m_shader, "u_depthAwareUpsampling"), m_depthAwareUpsampling);
+    glActiveTexture(GL_TEXTURE0);
 
     glBindVertexArray(m_vao);
 
@@ -1,5 +1,8 @@
 #pragma once
 #include "ui/window.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
@@ -14,10 +17,36 @@ public:
 
     void update(gsl::span<const glm::vec3> frameBuffer, const glm::ivec2& resolution);
     void update(gsl::span<const glm::vec4> frameBuffer, const glm::ivec2& resolution);
+    // Map RGBA8 pixels (red in the lowest byte) of a pixel buffer for the renderer to write into
+    // (Renderer::setPackedOutput), empty if the buffer can not be mapped. unmapPixels uploads them asynchronously.
+    gsl::span<uint32_t> mapPixels(const glm::ivec2& resolution);
+    // With the depth of the first hit per pixel (Renderer::depthBuffer) the image is upsampled to the display
+    // resolution without blurring across the edges of surfaces.
+    void unmapPixels(gsl::span<const float> depthBuffer);
     void draw();
 
+private:
+    // Two pixel buffers used in turns, a buffer is written again once the upload of two frames ago from it finished.
+    struct PixelBuffers {
+        std::array<GLuint, 2> buffers;
+        std::array<GLsizeiptr, 2> sizes { 0, 0 };
+        std::array<GLsync, 2> fences { nullptr, nullptr };
+        size_t next { 0 };
+    };
+
+    static GLuint createTexture();
+    static void allocateStorage(GLuint& texture, GLenum internalFormat, GLenum format, GLenum type, const glm::ivec2& resolution);
+    static void* mapPixelBuffer(PixelBuffers& pixelBuffers, GLsizeiptr numBytes);
+    static void uploadPixelBuffer(PixelBuffers& pixelBuffers, GLuint texture, const glm::ivec2& resolution, GLenum format, GLenum type);
+
 private:
     GLuint m_texture;
+    glm::ivec2 m_packedResolution { 0 }; // size of the RGBA8 storage, 0 if the texture holds float pixels
+    GLuint m_depthTexture;
+    glm::ivec2 m_depthResolution { 0 };
+    bool m_depthAwareUpsampling { false };
+    PixelBuffers m_colorPixelBuffers;
+    PixelBuffers m_depthPixelBuffers;
     GLuint m_vbo, m_vao;
     GLuint m_shader;
 };
@@ -1,10 +1,14 @@
 #include "menu.h"
 #include "render/renderer.h"
+#include "util/trace.h"
+#include <algorithm>
+#include <cmath>
 #include <filesystem>
 #include <fmt/format.h>
 #include <imgui.h>
 #include <iostream>
 #include <nfd.h>
+#include <glm/geometric.hpp>
 #include <glm/gtx/component_wise.hpp>
 
 namespace ui {
@@ -60,6 +64,16 @@ volume::InterpolationMode Menu::interpolationMode() const
     return m_interpolationMode;
 }
 
+volume::OutOfCoreConfig Menu::outOfCoreConfig() const
+{
+    return m_outOfCoreConfig;
+}
+
+int Menu::prefetchCount() const
+{
+    return m_prefetchCount;
+}
+
 bool Menu::getCPURendererInUse()
 {
     return CPURendererInUse;
@@ -77,6 +91,15 @@ void Menu::setBaseRenderResolution(const glm::ivec2& baseRenderResolution)
     callRenderConfigChangedCallback();
 }
 
+// Extra levels of the volume pyramid to use while the user interacts, set by the main loop like the resolution.
+void Menu::setInteractionLevelOfDetail(int interactionLevels)
+{
+    if (m_renderConfig.interactionLod == interactionLevels)
+        return;
+    m_renderConfig.interactionLod = interactionLevels;
+    callRenderConfigChangedCallback();
+}
+
 // This function handles a part of the volume loading where we create the widget histograms, set some config values
 //  and set the menu volume information
 void Menu::setLoadedVolume(const volume::Volume& volume, const volume::GradientVolume& gradientVolume)
@@ -87,15 +110,37 @@ void Menu::setLoadedVolume(const volume::Volume& volume, const volume::GradientV
     const glm::ivec3 dim = volume.dims();
     m_volumeInfo = fmt::format("Volume info:\n{}\nDimensions: ({}, {}, {})\nVoxel value range: {} - {}\n",
         volume.fileName(), dim.x, dim.y, dim.z, volume.minimum(), volume.maximum());
+    if (volume.isOutOfCore()) {
+        const auto pBrickCache = volume.brickCache();
+        m_volumeInfo += fmt::format("Out-of-core: {}^3 bricks, {} MB budget\n",
+            pBrickCache->header().brickSize, pBrickCache->memoryBudget() >> 20);
+    }
     m_volumeMax = int(volume.maximum());
     m_volumeDimensions = volume.dims();
     m_volumeLoaded = true;
+    // The region of interest starts as the whole volume and each plane cuts along another axis through its center.
+    m_renderConfig.roiLower = glm::vec3(0.0f);
+    m_renderConfig.roiUpper = glm::vec3(m_volumeDimensions - 1);
+    for (int i = 0; i < render::maxClipPlanes; i++) {
+        glm::vec3 normal { 0.0f };
+        normal[i % 3] = i < 3 ? 1.0f : -1.0f;
+        m_renderConfig.clipPlanes[size_t(i)] = glm::vec4(normal, -glm::dot(normal, glm::vec3(m_volumeDimensions) / 2.0f));
+    }
+    m_volumeOutOfCore = volume.isOutOfCore();
+    // Out-of-core volumes are never uploaded to the GPU.
+    if (m_volumeOutOfCore)
+        CPURendererInUse = true;
     m_dataType = volume::VolumeType::Volume;
 
     // change to correct render mode when load data from vector field to volume
     m_renderConfig.renderMode = render::RenderMode::RenderSlicer;
 }
 
+void Menu::setTimeSeriesPlayback(volume::TimeSeriesPlayback* pPlayback)
+{
+    m_pPlayback = pPlayback;
+}
+
 //This overloaded function is used for the vector fields instead of the DVR implementation
 void Menu::setLoadedVolume(const volume::Volume& volume)
 {
@@ -127,7 +172,8 @@ void Menu::drawMenu(const glm::ivec2& pos, const glm::ivec2& size, std::chrono::
 
         if (m_dataType == volume::VolumeType::Volume) {
             showRayCastTab(renderTime, renderTimeFrame);
-            showGPURayCastTab(renderTime, renderTimeFrame);
+            if (!m_volumeOutOfCore)
+                showGPURayCastTab(renderTime, renderTimeFrame);
             showTransFuncTab();
         } else {
             showTransFuncTab();
@@ -168,13 +214,74 @@ void Menu::showLoadVolTab()
             }
         }
 
+        // Stream volumes that do not fit in memory from a brick file, applies to the next volume that is loaded.
+        ImGui::Checkbox("Out-of-core (stream bricks from disk)", &m_outOfCoreConfig.enabled);
+        if (m_outOfCoreConfig.enabled) {
+            int brickSizePower = int(std::log2(m_outOfCoreConfig.brickSize));
+            if (ImGui::SliderInt("Brick size (2^n)", &brickSizePower, 4, 7))
+                m_outOfCoreConfig.brickSize = 1 << brickSizePower;
+            ImGui::DragInt("Memory budget (MB)", &m_outOfCoreConfig.memoryBudgetMB, 16.0f, 64, 65536);
+        }
+
         if (m_volumeLoaded)
             ImGui::Text("%s", m_volumeInfo.c_str());
+        showPlaybackOptions();
+
+        // Export the spans recorded by util::ScopedTimer (loading, gradients, TF updates, bricking and rendering)
+        ImGui::NewLine();
+        bool traceEnabled = util::TraceRecorder::instance().enabled();
+        if (ImGui::Checkbox("Record timeline", &traceEnabled))
+            util::TraceRecorder::instance().setEnabled(traceEnabled);
+        if (ImGui::Button("Export Timeline (Chrome trace)")) {
+            nfdchar_t* pOutPath = nullptr;
+            nfdresult_t result = NFD_SaveDialog("json", nullptr, &pOutPath);
+
+            if (result == NFD_OKAY) {
+                std::filesystem::path path = pOutPath;
+                if (!path.has_extension())
+                    path.replace_extension(".json");
+                util::TraceRecorder::instance().exportChromeTrace(path);
+            }
+        }
 
         ImGui::EndTabItem();
     }
 }
 
+// Controls for playing a time series (files named name.00000.fld, name.00001.fld, ...). The prefetch count is the
+//  number of timesteps that are decoded ahead of the displayed one, it applies to the loaded series right away.
+void Menu::showPlaybackOptions()
+{
+    ImGui::NewLine();
+    if (ImGui::SliderInt("Prefetched timesteps", &m_prefetchCount, 1, 16) && m_pPlayback)
+        m_pPlayback->timeSeries().setPrefetchCount(m_prefetchCount);
+    if (!m_pPlayback || m_pPlayback->timeSeries().numTimesteps() < 2)
+        return;
+
+    volume::TimeSeries& timeSeries = m_pPlayback->timeSeries();
+    if (ImGui::Button(m_pPlayback->isPlaying() ? "Pause" : "Play")) {
+        if (m_pPlayback->isPlaying())
+            m_pPlayback->pause();
+        else
+            m_pPlayback->play(std::chrono::steady_clock::now());
+    }
+    ImGui::SameLine();
+    bool loop = m_pPlayback->loop();
+    if (ImGui::Checkbox("Loop", &loop))
+        m_pPlayback->setLoop(loop);
+    float frameRate = m_pPlayback->frameRate();
+    if (ImGui::SliderFloat("Timesteps per second", &frameRate, 1.0f, 60.0f))
+        m_pPlayback->setFrameRate(frameRate);
+    int timestep = m_pPlayback->requestedTimestep();
+    if (ImGui::SliderInt("Timestep", &timestep, 0, timeSeries.numTimesteps() - 1))
+        m_pPlayback->seek(timestep);
+
+    const std::string playbackInfo = fmt::format("Displayed: {} ({})\nDecoded timesteps: {}\nHeld frames: {}",
+        m_pPlayback->displayedTimestep(), timeSeries.file(std::max(m_pPlayback->displayedTimestep(), 0)).filename().string(),
+        timeSeries.numDecoded(), m_pPlayback->heldFrames());
+    ImGui::Text("%s", playbackInfo.c_str());
+}
+
 // This renders the RayCast tab, where the user can set the render mode, interpolation mode and other
 //  render-related settings
 void Menu::showRayCastTab(std::chrono::duration<double> renderTime, std::chrono::duration<double> renderTimeFrame)
@@ -201,15 +308,23 @@ void Menu::showRayCastTab(std::chrono::duration<double> renderTime, std::chrono:
         ImGui::DragFloat("Iso Value", &m_renderConfig.isoValue, 1.0f, 0.0f, float(m_volumeMax));
         
         ImGui::Checkbox("Use Bisection", &m_renderConfig.bisection);
+        ImGui::Checkbox("Use Analytic Intersection", &m_renderConfig.analyticIntersection);
 
         ImGui::NewLine();
         ImGui::DragFloat("Step Size", &m_renderConfig.stepSize, 0.25f, 0.25f, 5.0f);
 
+        ImGui::NewLine();
+        ImGui::Checkbox("Level of Detail", &m_renderConfig.levelOfDetail);
+        ImGui::DragFloat("LOD Bias", &m_renderConfig.lodBias, 0.1f, -2.0f, 4.0f);
+
+        showClippingOptions();
+
         ImGui::NewLine();
         int* pInterpolationModeInt = reinterpret_cast<int*>(&m_interpolationMode);
         ImGui::Text("Interpolation:");
         ImGui::RadioButton("Nearest Neighbour", pInterpolationModeInt, int(volume::InterpolationMode::NearestNeighbour));
         ImGui::RadioButton("Linear", pInterpolationModeInt, int(volume::InterpolationMode::Linear));
+        ImGui::RadioButton("Cubic", pInterpolationModeInt, int(volume::InterpolationMode::Cubic));
 
         ImGui::EndTabItem();
     }
@@ -238,11 +353,16 @@ void Menu::showGPURayCastTab(std::chrono::duration<double> renderTime, std::chro
         ImGui::NewLine();
         ImGui::DragFloat("Step size", &m_renderConfig.stepSize, 0.25f, 0.25f, 5.0f);
 
+        ImGui::NewLine();
+        ImGui::Checkbox("Level of Detail (without bricking)", &m_renderConfig.levelOfDetail);
+        ImGui::DragFloat("LOD Bias", &m_renderConfig.lodBias, 0.1f, -2.0f, 4.0f);
+
         ImGui::NewLine();
         ImGui::Checkbox("Volume Shading", &m_renderConfig.volumeShading);
 
         ImGui::NewLine();
         ImGui::DragFloat("Iso Value", &m_renderConfig.isoValue, 1.0f, 0.0f, float(m_volumeMax));
+        ImGui::Checkbox("Iso surface as mesh (marching cubes)", &m_gpuMeshConfig.isoSurfaceMesh);
 
         ImGui::NewLine();
         ImGui::Checkbox("Opacity Modulation", &m_renderConfig.useOpacityModulation);
@@ -256,22 +376,23 @@ void Menu::showGPURayCastTab(std::chrono::duration<double> renderTime, std::chro
         ImGui::NewLine();
         ImGui::Checkbox("Empty space skipping", &m_gpuMeshConfig.useEmptySpaceSkipping);
         ImGui::DragInt("Block size", &m_gpuMeshConfig.blockSize, 1, 2, glm::compMax(m_volumeDimensions));
+        ImGui::Checkbox("Half precision ray targets", &m_gpuMeshConfig.halfPrecisionRayTargets);
+        ImGui::Checkbox("Analytic ray entry / exit", &m_gpuMeshConfig.analyticRayEntryExit);
 
         ImGui::NewLine();
         ImGui::Checkbox("Use volume bricking", &m_gpuVolumeConfig.useVolumeBricking);
         ImGui::DragInt("Brick size", &m_gpuVolumeConfig.brickSize, 1, 8, glm::compMax(m_volumeDimensions));
+        ImGui::Checkbox("Incremental brick updates", &m_gpuVolumeConfig.incrementalBrickUpdates);
 
-        ImGui::NewLine();
+        showClippingOptions();
 
-        // There is no cubic in the GPU so we set it to linear
-        if (m_interpolationMode == volume::InterpolationMode::Cubic) {
-            m_interpolationMode = volume::InterpolationMode::Linear;
-        }
+        ImGui::NewLine();
 
         int* pInterpolationModeInt = reinterpret_cast<int*>(&m_interpolationMode);
         ImGui::Text("Interpolation:");
         ImGui::RadioButton("Nearest Neighbour", pInterpolationModeInt, int(volume::InterpolationMode::NearestNeighbour));
         ImGui::RadioButton("Linear", pInterpolationModeInt, int(volume::InterpolationMode::Linear));
+        ImGui::RadioButton("Cubic", pInterpolationModeInt, int(volume::InterpolationMode::Cubic));
 
         ImGui::NewLine();
 
@@ -279,6 +400,31 @@ void Menu::showGPURayCastTab(std::chrono::duration<double> renderTime, std::chro
     }
 }
 
+// Clipping planes and the region of interest are shared by the CPU and GPU raycasters, all in voxel coordinates.
+void Menu::showClippingOptions()
+{
+    ImGui::NewLine();
+    ImGui::Checkbox("Clipping planes", &m_renderConfig.clippingPlanes);
+    if (m_renderConfig.clippingPlanes) {
+        ImGui::SliderInt("Number of planes", &m_renderConfig.numClipPlanes, 1, render::maxClipPlanes);
+        const float maxOffset = float(glm::compMax(m_volumeDimensions)) * 2.0f;
+        for (int i = 0; i < m_renderConfig.numClipPlanes; i++) {
+            ImGui::PushID(i);
+            glm::vec4& plane = m_renderConfig.clipPlanes[size_t(i)];
+            ImGui::DragFloat3("Plane normal", &plane.x, 0.01f, -1.0f, 1.0f);
+            ImGui::DragFloat("Plane offset", &plane.w, 1.0f, -maxOffset, maxOffset);
+            ImGui::PopID();
+        }
+    }
+
+    ImGui::Checkbox("Region of interest", &m_renderConfig.regionOfInterest);
+    if (m_renderConfig.regionOfInterest) {
+        const float maxCoordinate = float(glm::compMax(m_volumeDimensions - 1));
+        ImGui::DragFloat3("ROI lower", &m_renderConfig.roiLower.x, 1.0f, 0.0f, maxCoordinate);
+        ImGui::DragFloat3("ROI upper", &m_renderConfig.roiUpper.x, 1.0f, 0.0f, maxCoordinate);
+    }
+}
+
 // This renders the 1D Transfer Function Widget.
 void Menu::showTransFuncTab()
 {
@@ -4,6 +4,7 @@
 #include "render/gpu_volume_config.h"
 #include "ui/transfer_func.h"
 #include "volume/gradient_volume.h"
+#include "volume/time_series.h"
 #include "volume/volume.h"
 #include <chrono>
 #include <filesystem>
@@ -40,10 +41,15 @@ public:
     render::GPUMeshConfig meshConfig() const;
     render::GPUVolumeConfig volumeConfig() const;
     volume::InterpolationMode interpolationMode() const;
+    volume::OutOfCoreConfig outOfCoreConfig() const;
+    int prefetchCount() const;
 
     void setBaseRenderResolution(const glm::ivec2& baseRenderResolution);
+    void setInteractionLevelOfDetail(int interactionLevels);
     void setLoadedVolume(const volume::Volume& volume, const volume::GradientVolume& gradientVolume);
     void setLoadedVolume(const volume::Volume& volume);
+    // Playback of the loaded time series, controlled from the Load tab. Set to nullptr before it is destroyed.
+    void setTimeSeriesPlayback(volume::TimeSeriesPlayback* pPlayback);
 
     void drawMenu(const glm::ivec2& pos, const glm::ivec2& size, std::chrono::duration<double> renderTime, std::chrono::duration<double> renderTimeFrame);
 
@@ -56,6 +62,8 @@ private:
     void showRayCastTab(std::chrono::duration<double> renderTime, std::chrono::duration<double> renderTimeFrame);
     void showGPURayCastTab(std::chrono::duration<double> renderTime, std::chrono::duration<double> renderTimeFrame);
     void showTransFuncTab();
+    void showClippingOptions();
+    void showPlaybackOptions();
 
     void callRenderConfigChangedCallback() const;
     void callGPUMeshConfigChangedCallback() const;
@@ -64,6 +72,7 @@ private:
 
 private:
     bool m_volumeLoaded = false;
+    bool m_volumeOutOfCore = false;
     bool CPURendererInUse = true;
     std::string m_volumeInfo;
     int m_volumeMax;
@@ -80,6 +89,9 @@ private:
     render::GPUMeshConfig m_gpuMeshConfig {};
     render::GPUVolumeConfig m_gpuVolumeConfig {};
     volume::InterpolationMode m_interpolationMode { volume::InterpolationMode::NearestNeighbour };
+    volume::OutOfCoreConfig m_outOfCoreConfig {};
+    int m_prefetchCount { 4 };
+    volume::TimeSeriesPlayback* m_pPlayback { nullptr };
 
     std::optional<LoadVolumeCallback> m_optLoadVolumeCallback;
     std::optional<RenderConfigChangedCallback> m_optRenderConfigChangedCallback;
@@ -1,4 +1,5 @@
 #include "ui/transfer_func.h"
+#include "util/trace.h"
 #include <algorithm>
 #include <cassert>
 #include <filesystem>
@@ -220,6 +221,8 @@ void TransferFunctionWidget::draw()
 // (Re)compute the colormap color array
 void TransferFunctionWidget::updateColormap()
 {
+    util::ScopedTimer timer("TransferFunctionWidget::updateColormap", "tf");
+
     // Update the color map texture.
     auto left = std::begin(m_tfPoints);
     auto right = ++std::begin(m_tfPoints);
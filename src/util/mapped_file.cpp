@@ -0,0 +1,80 @@
+#include "mapped_file.h"
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace util {
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::filesystem::path& filePath)
+{
+    HANDLE file = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+    m_fileHandle = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+        return;
+    m_mappingHandle = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mappingHandle)
+        return;
+    m_pData = static_cast<const std::byte*>(MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (m_pData)
+        m_size = size_t(size.QuadPart);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_pData)
+        UnmapViewOfFile(m_pData);
+    if (m_mappingHandle)
+        CloseHandle(m_mappingHandle);
+    if (m_fileHandle)
+        CloseHandle(m_fileHandle);
+}
+#else
+// The descriptor can be closed right away, the mapping keeps the file open.
+MappedFile::MappedFile(const std::filesystem::path& filePath)
+{
+    const int file = open(filePath.c_str(), O_RDONLY);
+    if (file < 0)
+        return;
+
+    struct stat status;
+    if (fstat(file, &status) == 0 && status.st_size > 0) {
+        void* pMapping = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+        if (pMapping != MAP_FAILED) {
+            // The file is copied front to back, let the OS read ahead.
+            madvise(pMapping, size_t(status.st_size), MADV_SEQUENTIAL);
+            m_pData = static_cast<const std::byte*>(pMapping);
+            m_size = size_t(status.st_size);
+        }
+    }
+    close(file);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_pData)
+        munmap(const_cast<std::byte*>(m_pData), m_size);
+}
+#endif
+
+bool MappedFile::isOpen() const
+{
+    return m_pData != nullptr;
+}
+
+gsl::span<const std::byte> MappedFile::data() const
+{
+    return { m_pData, m_size };
+}
+}
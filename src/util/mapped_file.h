@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <gsl/span>
+
+namespace util {
+
+// Read-only memory mapping of a whole file. The pages are read by the OS when they are first touched, so copying out of
+// the mapping skips the intermediate buffer of a stream read. data() is empty if the file could not be mapped.
+class MappedFile {
+public:
+    explicit MappedFile(const std::filesystem::path& filePath);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const;
+    gsl::span<const std::byte> data() const;
+
+private:
+    const std::byte* m_pData { nullptr };
+    size_t m_size { 0 };
+#ifdef _WIN32
+    void* m_fileHandle { nullptr };
+    void* m_mappingHandle { nullptr };
+#endif
+};
+}
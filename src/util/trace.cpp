@@ -0,0 +1,172 @@
+#include "trace.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+
+// Spans currently alive on this thread, used to determine the nesting depth of new spans.
+static thread_local uint32_t threadSpanDepth = 0;
+static thread_local int64_t threadId = -1;
+
+static void writeJsonString(std::ostream& os, std::string_view str);
+
+namespace util {
+
+TraceRecorder& TraceRecorder::instance()
+{
+    // Enough for a few minutes of interaction with per frame render spans.
+    static TraceRecorder recorder { 1 << 16 };
+    return recorder;
+}
+
+TraceRecorder::TraceRecorder(size_t capacity)
+    : m_ring(capacity)
+    , m_epoch(std::chrono::steady_clock::now())
+{
+}
+
+void TraceRecorder::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+}
+
+bool TraceRecorder::enabled() const
+{
+    return m_enabled;
+}
+
+// Changing the capacity drops all recorded spans.
+void TraceRecorder::setCapacity(size_t capacity)
+{
+    std::scoped_lock lock { m_mutex };
+    m_ring.assign(std::max(capacity, size_t(1)), TraceEvent {});
+    m_head = 0;
+    m_count = 0;
+}
+
+size_t TraceRecorder::capacity() const
+{
+    std::scoped_lock lock { m_mutex };
+    return m_ring.size();
+}
+
+void TraceRecorder::record(const TraceEvent& event)
+{
+    if (!m_enabled)
+        return;
+
+    std::scoped_lock lock { m_mutex };
+    m_ring[m_head] = event;
+    m_head = (m_head + 1) % m_ring.size();
+    m_count = std::min(m_count + 1, m_ring.size());
+}
+
+void TraceRecorder::clear()
+{
+    std::scoped_lock lock { m_mutex };
+    m_head = 0;
+    m_count = 0;
+}
+
+std::vector<TraceEvent> TraceRecorder::events() const
+{
+    std::scoped_lock lock { m_mutex };
+    std::vector<TraceEvent> out;
+    out.reserve(m_count);
+    // When the ring buffer is full the oldest event lives at the write position.
+    const size_t first = (m_head + m_ring.size() - m_count) % m_ring.size();
+    for (size_t i = 0; i < m_count; i++)
+        out.push_back(m_ring[(first + i) % m_ring.size()]);
+    return out;
+}
+
+// Write the spans in the Chrome trace event format using complete ("X") events.
+// https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+bool TraceRecorder::exportChromeTrace(const std::filesystem::path& filePath) const
+{
+    const std::vector<TraceEvent> spans = events();
+
+    std::ofstream ofs(filePath);
+    if (!ofs.is_open()) {
+        std::cerr << "Cannot open trace file: " << filePath.string() << std::endl;
+        return false;
+    }
+
+    uint32_t maxThreadId = 0;
+    ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (size_t i = 0; i < spans.size(); i++) {
+        const TraceEvent& span = spans[i];
+        maxThreadId = std::max(maxThreadId, span.threadId);
+        if (i > 0)
+            ofs << ",";
+        ofs << "\n{\"name\":";
+        writeJsonString(ofs, span.name);
+        ofs << ",\"cat\":";
+        writeJsonString(ofs, span.category);
+        ofs << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << span.threadId
+            << ",\"ts\":" << span.startMicroseconds
+            << ",\"dur\":" << span.durationMicroseconds
+            << ",\"args\":{\"depth\":" << span.depth << "}}";
+    }
+    // Name the threads so they are sorted in the order in which they first recorded a span.
+    for (uint32_t tid = 0; tid <= maxThreadId && !spans.empty(); tid++) {
+        ofs << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+            << ",\"args\":{\"name\":\"thread " << tid << "\"}}";
+    }
+    ofs << "\n]}\n";
+
+    std::cout << "Exported " << spans.size() << " trace events to " << filePath.string() << std::endl;
+    return ofs.good();
+}
+
+int64_t TraceRecorder::now() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+uint32_t TraceRecorder::currentThreadId()
+{
+    if (threadId < 0)
+        threadId = m_nextThreadId++;
+    return uint32_t(threadId);
+}
+
+ScopedTimer::ScopedTimer(const char* name, const char* category)
+    : m_name(name)
+    , m_category(category)
+    , m_start(TraceRecorder::instance().now())
+    , m_depth(threadSpanDepth++)
+{
+}
+
+ScopedTimer::~ScopedTimer()
+{
+    threadSpanDepth--;
+
+    TraceRecorder& recorder = TraceRecorder::instance();
+    if (!recorder.enabled())
+        return;
+    const int64_t end = recorder.now();
+    recorder.record(TraceEvent { m_name, m_category, m_start, end - m_start, recorder.currentThreadId(), m_depth });
+}
+
+double ScopedTimer::elapsedMs() const
+{
+    return double(TraceRecorder::instance().now() - m_start) / 1000.0;
+}
+
+}
+
+static void writeJsonString(std::ostream& os, std::string_view str)
+{
+    os << '"';
+    for (const char c : str) {
+        if (c == '"' || c == '\\')
+            os << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+            os << ' ';
+        else
+            os << c;
+    }
+    os << '"';
+}
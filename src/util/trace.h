@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+namespace util {
+
+// A single completed span on the timeline.
+// The name and category are not copied so they should point to string literals.
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    int64_t startMicroseconds;
+    int64_t durationMicroseconds;
+    uint32_t threadId;
+    uint32_t depth; // nesting level of the span on its thread, 0 for top level spans
+};
+
+// Collects the spans of all threads into a fixed size ring buffer, when the buffer is full the oldest spans are overwritten.
+// The recorded timeline can be exported as a Chrome trace (JSON) which opens in chrome://tracing or https://ui.perfetto.dev
+// Recording is off until it is enabled (the "Record timeline" checkbox), so spans on the render, OpenMP and prefetch
+// threads do not contend for the ring buffer lock unless a timeline is wanted.
+class TraceRecorder {
+public:
+    static TraceRecorder& instance();
+
+    void setEnabled(bool enabled);
+    bool enabled() const;
+
+    void setCapacity(size_t capacity);
+    size_t capacity() const;
+
+    void record(const TraceEvent& event);
+    void clear();
+
+    // Returns the recorded spans from oldest to newest.
+    std::vector<TraceEvent> events() const;
+    bool exportChromeTrace(const std::filesystem::path& filePath) const;
+
+    // Microseconds since the recorder was created.
+    int64_t now() const;
+    // Small sequential id of the calling thread (the first thread to record gets 0).
+    uint32_t currentThreadId();
+
+private:
+    TraceRecorder(size_t capacity);
+
+private:
+    mutable std::mutex m_mutex;
+    std::vector<TraceEvent> m_ring;
+    size_t m_head { 0 }; // next slot to write
+    size_t m_count { 0 }; // number of valid slots
+
+    const std::chrono::steady_clock::time_point m_epoch;
+    std::atomic<bool> m_enabled { false };
+    std::atomic<uint32_t> m_nextThreadId { 0 };
+};
+
+// Records a span from construction until destruction. Spans that are created while another span is alive on the same
+// thread are nested below it in the timeline.
+class ScopedTimer {
+public:
+    ScopedTimer(const char* name, const char* category = "default");
+    ~ScopedTimer();
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    // Time since construction, useful to keep printing timings to the console.
+    double elapsedMs() const;
+
+private:
+    const char* m_name;
+    const char* m_category;
+    int64_t m_start;
+    uint32_t m_depth;
+};
+
+}
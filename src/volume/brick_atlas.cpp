@@ -0,0 +1,44 @@
+#include "brick_atlas.h"
+#include <algorithm>
+#include <limits>
+
+namespace volume {
+
+// We enumerate x and y (at most maxExtent^2 pairs) and take the smallest z that fits. Once a solution without waste
+// is found, larger x can not be more cube-like.
+glm::ivec3 fitBricksInCuboid(int N, int maxExtent)
+{
+    glm::ivec3 optimalDimensions { 0 };
+    long long bestWaste = std::numeric_limits<long long>::max();
+    int bestExtent = std::numeric_limits<int>::max();
+    for (int x = 1; x <= std::min(maxExtent, N); x++) {
+        for (int y = 1; y <= std::min(maxExtent, (N + x - 1) / x); y++) {
+            const int z = (N + x * y - 1) / (x * y);
+            if (z > maxExtent)
+                continue;
+            const long long waste = static_cast<long long>(x) * y * z - N;
+            const int extent = std::max(x, std::max(y, z));
+            if (waste < bestWaste || (waste == bestWaste && extent < bestExtent)) {
+                optimalDimensions = glm::ivec3(x, y, z);
+                bestWaste = waste;
+                bestExtent = extent;
+            }
+        }
+        if (bestWaste == 0 && bestExtent <= x)
+            break;
+    }
+    return optimalDimensions;
+}
+
+std::vector<glm::ivec3> packBrickAtlas(int N, int maxExtent, int maxTextures)
+{
+    const long long cubeCapacity = static_cast<long long>(maxExtent) * maxExtent * maxExtent;
+    const long long numTextures = (N + cubeCapacity - 1) / cubeCapacity;
+    if (numTextures > maxTextures)
+        return std::vector<glm::ivec3>(size_t(maxTextures), glm::ivec3(maxExtent));
+
+    std::vector<glm::ivec3> atlas(size_t(std::max(numTextures - 1, 0LL)), glm::ivec3(maxExtent));
+    atlas.push_back(fitBricksInCuboid(int(N - static_cast<long long>(atlas.size()) * cubeCapacity), maxExtent));
+    return atlas;
+}
+}
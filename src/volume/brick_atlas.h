@@ -0,0 +1,19 @@
+#pragma once
+#include <glm/vec3.hpp>
+#include <vector>
+
+namespace volume {
+
+// The brick cache is spread over at most this many 3D textures (the shaders have one sampler per texture).
+constexpr int maxBrickAtlasTextures = 4;
+
+// Size in bricks of the cuboid with at most maxExtent bricks per axis that holds N bricks with the least empty space,
+// on ties the most cube-like one. E.g., N=10 gives 5x2x1 instead of the 3x3x3 cube. Returns (0, 0, 0) if N bricks
+// do not fit into a single cuboid.
+glm::ivec3 fitBricksInCuboid(int N, int maxExtent);
+
+// Spread N bricks over at most maxTextures cuboids of at most maxExtent bricks per axis: full cubes followed by the
+// tightest cuboid for the remaining bricks. If the bricks do not fit, all maxTextures cubes are returned and the
+// caller has to leave bricks out.
+std::vector<glm::ivec3> packBrickAtlas(int N, int maxExtent, int maxTextures = maxBrickAtlasTextures);
+}
@@ -0,0 +1,347 @@
+#include "brick_cache.h"
+#include "util/trace.h"
+#include "volume.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+static constexpr std::array<char, 8> brickFileMagic { 'V', 'V', 'B', 'R', 'I', 'C', 'K', '1' };
+
+static std::atomic<uint64_t> nextCacheId { 1 };
+
+static void writeBrickFileHeader(std::ofstream& ofs, const volume::BrickFileHeader& header);
+static float decodeElement(const char* pElement, size_t elementSize);
+
+namespace volume {
+
+BrickCache::BrickCache(const std::filesystem::path& brickFile, size_t memoryBudgetBytes)
+    : m_cacheId(nextCacheId++)
+    , m_header()
+    , m_numBricks(0)
+    , m_brickVoxels(0)
+    , m_memoryBudget(memoryBudgetBytes)
+{
+    m_file.open(brickFile, std::ios::binary);
+    if (!m_file.is_open() || !readBrickFileHeader(m_file, m_header)) {
+        std::cerr << "Cannot read brick file: " << brickFile.string() << std::endl;
+        m_header = BrickFileHeader { glm::ivec3(0), 1, 1, 0.0f, 0.0f, {}, 0 };
+    }
+    m_numBricks = (m_header.dim + m_header.brickSize - 1) / m_header.brickSize;
+    m_brickVoxels = size_t(m_header.brickSize) * size_t(m_header.brickSize) * size_t(m_header.brickSize);
+
+    m_prefetchThread = std::thread([this]() { prefetchLoop(); });
+}
+
+BrickCache::~BrickCache()
+{
+    {
+        std::scoped_lock lock { m_prefetchMutex };
+        m_stopPrefetching = true;
+    }
+    m_prefetchCondition.notify_all();
+    m_prefetchThread.join();
+}
+
+std::filesystem::path BrickCache::brickFilePath(const std::filesystem::path& volumeFile, int brickSize)
+{
+    return std::filesystem::path(volumeFile.string() + ".b" + std::to_string(brickSize) + ".bricks");
+}
+
+// Stream the voxel data of the volume file one slab of bricks at a time and write it out brick by brick.
+// The statistics that the Volume normally computes after loading (min, max, histogram) are gathered on the way.
+// The bricks are written to a temporary file that replaces the brick file once it is complete, so a failed build
+// never leaves a brick file behind that a later run would reuse.
+bool BrickCache::buildBrickFile(const std::filesystem::path& volumeFile, const std::filesystem::path& brickFile, int brickSize)
+{
+    util::ScopedTimer timer("BrickCache::buildBrickFile", "load");
+
+    // Reuse the brick file if it was built from the current version of the volume file.
+    std::error_code error;
+    if (std::filesystem::exists(brickFile, error)
+        && std::filesystem::last_write_time(brickFile, error) >= std::filesystem::last_write_time(volumeFile, error)) {
+        std::ifstream ifs(brickFile, std::ios::binary);
+        BrickFileHeader header;
+        if (readBrickFileHeader(ifs, header) && header.brickSize == brickSize)
+            return true;
+    }
+
+    const auto optInfo = readVolumeFileInfo(volumeFile);
+    if (!optInfo || brickSize <= 0) {
+        std::cerr << "Cannot stream volume file: " << volumeFile.string() << std::endl;
+        return false;
+    }
+    const glm::ivec3 dim = optInfo->dim;
+    const size_t elementSize = optInfo->elementSize;
+
+    const std::filesystem::path partialFile = brickFile.string() + ".partial";
+    std::ifstream ifs(volumeFile, std::ios::binary);
+    ifs.seekg(optInfo->dataOffset);
+    std::ofstream ofs(partialFile, std::ios::binary | std::ios::trunc);
+    const auto discard = [&]() {
+        ofs.close();
+        std::filesystem::remove(partialFile, error);
+        return false;
+    };
+    if (!ifs.is_open() || !ofs.is_open()) {
+        std::cerr << "Cannot create brick file: " << brickFile.string() << std::endl;
+        return discard();
+    }
+
+    BrickFileHeader header { dim, brickSize, elementSize, std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest(), {}, 0 };
+    // The histogram is stored with room for every value of the element type so the header size is known up front.
+    header.histogram.resize(size_t(1) << (8 * elementSize), 0);
+    writeBrickFileHeader(ofs, header);
+
+    const glm::ivec3 numBricks = (dim + brickSize - 1) / brickSize;
+    const size_t sliceBytes = size_t(dim.x) * size_t(dim.y) * elementSize;
+    const size_t rowBytes = size_t(brickSize) * elementSize;
+    std::vector<char> slab(sliceBytes * size_t(brickSize));
+    std::vector<char> brick(size_t(brickSize) * size_t(brickSize) * rowBytes);
+
+    for (int bz = 0; bz < numBricks.z; bz++) {
+        const int slices = std::min(brickSize, dim.z - bz * brickSize);
+        const size_t slabBytes = sliceBytes * size_t(slices);
+        ifs.read(slab.data(), std::streamsize(slabBytes));
+        if (size_t(ifs.gcount()) != slabBytes) {
+            std::cerr << "Error: File size mismatch!" << std::endl;
+            return discard();
+        }
+
+        for (size_t i = 0; i < slabBytes; i += elementSize) {
+            const float value = decodeElement(&slab[i], elementSize);
+            header.minimum = std::min(header.minimum, value);
+            header.maximum = std::max(header.maximum, value);
+            header.histogram[size_t(value)]++;
+        }
+
+        for (int by = 0; by < numBricks.y; by++) {
+            for (int bx = 0; bx < numBricks.x; bx++) {
+                std::fill(std::begin(brick), std::end(brick), char(0));
+                const int rows = std::min(brickSize, dim.y - by * brickSize);
+                const size_t copyBytes = size_t(std::min(brickSize, dim.x - bx * brickSize)) * elementSize;
+                for (int z = 0; z < slices; z++) {
+                    for (int y = 0; y < rows; y++) {
+                        const size_t src = (size_t(z) * size_t(dim.y) + size_t(by * brickSize + y)) * size_t(dim.x) + size_t(bx * brickSize);
+                        const size_t dst = (size_t(z) * size_t(brickSize) + size_t(y)) * rowBytes;
+                        std::memcpy(&brick[dst], &slab[src * elementSize], copyBytes);
+                    }
+                }
+                ofs.write(brick.data(), std::streamsize(brick.size()));
+            }
+        }
+    }
+
+    // Now that the statistics are known we can fill in the header.
+    ofs.seekp(0);
+    writeBrickFileHeader(ofs, header);
+    ofs.close();
+    if (!ofs) {
+        std::cerr << "Cannot write brick file: " << brickFile.string() << std::endl;
+        return discard();
+    }
+    std::filesystem::rename(partialFile, brickFile, error);
+    if (error) {
+        std::cerr << "Cannot create brick file: " << brickFile.string() << " (" << error.message() << ")" << std::endl;
+        return discard();
+    }
+
+    std::cout << "Built brick file " << brickFile.string() << " in " << timer.elapsedMs() << "ms" << std::endl;
+    return true;
+}
+
+bool BrickCache::readBrickFileHeader(std::ifstream& ifs, BrickFileHeader& header)
+{
+    std::array<char, brickFileMagic.size()> magic {};
+    ifs.read(magic.data(), std::streamsize(magic.size()));
+    if (!ifs || magic != brickFileMagic)
+        return false;
+
+    std::array<int32_t, 5> layout {};
+    std::array<float, 2> range {};
+    int32_t histogramSize = 0;
+    ifs.read(reinterpret_cast<char*>(layout.data()), sizeof(layout));
+    ifs.read(reinterpret_cast<char*>(range.data()), sizeof(range));
+    ifs.read(reinterpret_cast<char*>(&histogramSize), sizeof(histogramSize));
+    // Voxels are bytes or uint16_ts, so a valid range lies within [0, 65535] and the histogram has at most one
+    // entry per value of the element type.
+    const bool validElementSize = layout[4] == 1 || layout[4] == 2;
+    if (!ifs || layout[0] <= 0 || layout[1] <= 0 || layout[2] <= 0 || layout[3] <= 0 || !validElementSize)
+        return false;
+    const int32_t numValues = 1 << (8 * layout[4]);
+    if (!(range[0] >= 0.0f && range[0] <= range[1] && range[1] < float(numValues)) || histogramSize < 0 || histogramSize > numValues)
+        return false;
+
+    header.dim = glm::ivec3(layout[0], layout[1], layout[2]);
+    header.brickSize = layout[3];
+    header.elementSize = size_t(layout[4]);
+    header.minimum = range[0];
+    header.maximum = range[1];
+    header.histogram.resize(size_t(histogramSize));
+    ifs.read(reinterpret_cast<char*>(header.histogram.data()), std::streamsize(header.histogram.size() * sizeof(int32_t)));
+    header.dataOffset = ifs.tellg();
+    // Match the histogram of a resident volume which ranges from 0 to the maximum.
+    header.histogram.resize(std::min(header.histogram.size(), size_t(header.maximum) + 1));
+    return bool(ifs);
+}
+
+const BrickFileHeader& BrickCache::header() const
+{
+    return m_header;
+}
+
+glm::ivec3 BrickCache::numBricks() const
+{
+    return m_numBricks;
+}
+
+int BrickCache::brickIndex(const glm::ivec3& brick) const
+{
+    return brick.x + m_numBricks.x * (brick.y + m_numBricks.y * brick.z);
+}
+
+float BrickCache::voxel(int x, int y, int z) const
+{
+    const int b = m_header.brickSize;
+    const int index = brickIndex(glm::ivec3(x / b, y / b, z / b));
+
+    // Consecutive samples along a ray mostly fall in the same brick, so every thread remembers its last brick
+    // to skip the locked cache lookup.
+    thread_local uint64_t lastCacheId = 0;
+    thread_local int lastIndex = -1;
+    thread_local std::shared_ptr<const Brick> pLastBrick;
+    if (lastCacheId != m_cacheId || lastIndex != index) {
+        pLastBrick = brick(index);
+        lastCacheId = m_cacheId;
+        lastIndex = index;
+    }
+
+    const size_t localIndex = size_t(x % b + b * (y % b + b * (z % b)));
+    return (*pLastBrick)[localIndex];
+}
+
+// Returns the brick from the cache or loads it when it is not resident. Threads requesting a brick that is
+// currently being loaded wait for that load instead of reading it again.
+std::shared_ptr<const BrickCache::Brick> BrickCache::brick(int index) const
+{
+    std::promise<std::shared_ptr<const Brick>> promise;
+    std::shared_future<std::shared_ptr<const Brick>> future;
+    bool load = false;
+    {
+        std::scoped_lock lock { m_cacheMutex };
+        const auto iter = m_entries.find(index);
+        if (iter != std::end(m_entries)) {
+            m_lru.splice(std::begin(m_lru), m_lru, iter->second.lruPosition);
+            future = iter->second.brick;
+        } else {
+            m_lru.push_front(index);
+            future = promise.get_future().share();
+            m_entries.emplace(index, Entry { future, std::begin(m_lru) });
+            m_residentBytes += m_brickVoxels * sizeof(float);
+            evictLeastRecentlyUsed();
+            load = true;
+        }
+    }
+
+    if (load)
+        promise.set_value(readBrick(index));
+    return future.get();
+}
+
+void BrickCache::prefetch(std::vector<int> orderedBricks)
+{
+    // Prefetching more than fits in the budget would evict the bricks that are needed first.
+    const size_t maxBricks = std::max(m_memoryBudget / (m_brickVoxels * sizeof(float)), size_t(1));
+    if (orderedBricks.size() > maxBricks)
+        orderedBricks.resize(maxBricks);
+
+    {
+        std::scoped_lock lock { m_prefetchMutex };
+        m_prefetchQueue.assign(std::begin(orderedBricks), std::end(orderedBricks));
+    }
+    m_prefetchCondition.notify_one();
+}
+
+size_t BrickCache::residentBytes() const
+{
+    std::scoped_lock lock { m_cacheMutex };
+    return m_residentBytes;
+}
+
+size_t BrickCache::memoryBudget() const
+{
+    return m_memoryBudget;
+}
+
+std::shared_ptr<const BrickCache::Brick> BrickCache::readBrick(int index) const
+{
+    const size_t rawBytes = m_brickVoxels * m_header.elementSize;
+    std::vector<char> raw(rawBytes);
+    size_t bytesRead = 0;
+    {
+        std::scoped_lock lock { m_fileMutex };
+        m_file.clear();
+        m_file.seekg(m_header.dataOffset + std::streamoff(size_t(index) * rawBytes));
+        m_file.read(raw.data(), std::streamsize(rawBytes));
+        bytesRead = size_t(m_file.gcount());
+    }
+
+    // A brick that cannot be read completely is returned as zeros.
+    auto pBrick = std::make_shared<Brick>(m_brickVoxels, 0.0f);
+    if (bytesRead != rawBytes) {
+        std::cerr << "Cannot read brick " << index << " from the brick file" << std::endl;
+        return pBrick;
+    }
+    for (size_t i = 0; i < m_brickVoxels; i++)
+        (*pBrick)[i] = decodeElement(&raw[i * m_header.elementSize], m_header.elementSize);
+    return pBrick;
+}
+
+// Drop bricks from the back of the LRU list until we are within budget. Threads that still use an evicted brick
+// keep it alive through their shared_ptr. The most recently used brick is never evicted.
+void BrickCache::evictLeastRecentlyUsed() const
+{
+    while (m_residentBytes > m_memoryBudget && m_lru.size() > 1) {
+        m_entries.erase(m_lru.back());
+        m_lru.pop_back();
+        m_residentBytes -= m_brickVoxels * sizeof(float);
+    }
+}
+
+void BrickCache::prefetchLoop()
+{
+    while (true) {
+        int index;
+        {
+            std::unique_lock lock { m_prefetchMutex };
+            m_prefetchCondition.wait(lock, [this]() { return m_stopPrefetching || !m_prefetchQueue.empty(); });
+            if (m_stopPrefetching)
+                return;
+            index = m_prefetchQueue.front();
+            m_prefetchQueue.pop_front();
+        }
+        brick(index);
+    }
+}
+}
+
+static void writeBrickFileHeader(std::ofstream& ofs, const volume::BrickFileHeader& header)
+{
+    const std::array<int32_t, 5> layout { header.dim.x, header.dim.y, header.dim.z, header.brickSize, int32_t(header.elementSize) };
+    const std::array<float, 2> range { header.minimum, header.maximum };
+    const int32_t histogramSize = int32_t(header.histogram.size());
+    ofs.write(brickFileMagic.data(), std::streamsize(brickFileMagic.size()));
+    ofs.write(reinterpret_cast<const char*>(layout.data()), sizeof(layout));
+    ofs.write(reinterpret_cast<const char*>(range.data()), sizeof(range));
+    ofs.write(reinterpret_cast<const char*>(&histogramSize), sizeof(histogramSize));
+    ofs.write(reinterpret_cast<const char*>(header.histogram.data()), std::streamsize(header.histogram.size() * sizeof(int32_t)));
+}
+
+// Same conversion as Volume::loadVolumeData: bytes or little endian uint16_ts.
+static float decodeElement(const char* pElement, size_t elementSize)
+{
+    if (elementSize == 1)
+        return static_cast<float>(pElement[0] & 0xFF);
+    return static_cast<float>((pElement[0] & 0xFF) + (pElement[1] & 0xFF) * 256);
+}
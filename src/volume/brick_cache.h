@@ -0,0 +1,101 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <glm/vec3.hpp>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace volume {
+
+// Settings for streaming a volume from disk instead of keeping it resident.
+struct OutOfCoreConfig {
+    bool enabled { false };
+    int brickSize { 32 };
+    int memoryBudgetMB { 1024 };
+};
+
+// Contents of the header of a brick file. The bricks follow the header in x, y, z order and always contain
+// brickSize^3 voxels stored with the element size of the original file (voxels outside the volume are 0).
+struct BrickFileHeader {
+    glm::ivec3 dim;
+    int brickSize;
+    size_t elementSize;
+    float minimum, maximum;
+    std::vector<int> histogram;
+    std::streamoff dataOffset;
+};
+
+// LRU cache of the bricks of a brick file. Bricks are loaded on demand when a voxel is requested and the least recently
+// used bricks are dropped when the memory budget is exceeded. A background thread loads bricks that are prefetched.
+class BrickCache {
+public:
+    using Brick = std::vector<float>;
+
+    BrickCache(const std::filesystem::path& brickFile, size_t memoryBudgetBytes);
+    ~BrickCache();
+
+    BrickCache(const BrickCache&) = delete;
+    BrickCache& operator=(const BrickCache&) = delete;
+
+    // Location of the brick file that belongs to a volume file.
+    static std::filesystem::path brickFilePath(const std::filesystem::path& volumeFile, int brickSize);
+    // Convert a volume file into a brick file by streaming it slab by slab, so the volume never has to fit in memory.
+    // Does nothing when an up to date brick file already exists.
+    static bool buildBrickFile(const std::filesystem::path& volumeFile, const std::filesystem::path& brickFile, int brickSize);
+    static bool readBrickFileHeader(std::ifstream& ifs, BrickFileHeader& header);
+
+    const BrickFileHeader& header() const;
+    glm::ivec3 numBricks() const;
+    int brickIndex(const glm::ivec3& brick) const;
+
+    float voxel(int x, int y, int z) const;
+    std::shared_ptr<const Brick> brick(int index) const;
+
+    // Replace the prefetch queue, bricks are loaded in the given order.
+    void prefetch(std::vector<int> orderedBricks);
+
+    size_t residentBytes() const;
+    size_t memoryBudget() const;
+
+private:
+    std::shared_ptr<const Brick> readBrick(int index) const;
+    void evictLeastRecentlyUsed() const;
+    void prefetchLoop();
+
+private:
+    struct Entry {
+        std::shared_future<std::shared_ptr<const Brick>> brick;
+        std::list<int>::iterator lruPosition;
+    };
+
+    // Unique id so threads can cache their last brick without mixing up cache instances.
+    const uint64_t m_cacheId;
+    BrickFileHeader m_header;
+    glm::ivec3 m_numBricks;
+    size_t m_brickVoxels;
+    const size_t m_memoryBudget;
+
+    mutable std::mutex m_fileMutex;
+    mutable std::ifstream m_file;
+
+    mutable std::mutex m_cacheMutex;
+    mutable std::unordered_map<int, Entry> m_entries;
+    mutable std::list<int> m_lru; // most recently used brick at the front
+    mutable size_t m_residentBytes { 0 };
+
+    std::mutex m_prefetchMutex;
+    std::condition_variable m_prefetchCondition;
+    std::deque<int> m_prefetchQueue;
+    bool m_stopPrefetching { false };
+    std::thread m_prefetchThread;
+};
+}
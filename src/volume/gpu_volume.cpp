@@ -1,30 +1,100 @@
 #include "gpu_volume.h"
+#include "util/trace.h"
+#include <algorithm>
 #include <glm/common.hpp>
 #include <iostream>
-#include <chrono>
 
 #include <glm/gtx/component_wise.hpp>
 
 namespace volume {
 
+// 8 and 16 bit volumes are stored at their native size as normalized textures, other volumes as half floats. Values
+// outside of the range of the chosen format (e.g. volumes that were not loaded from a file) fall back to a wider one.
+static TextureFormat selectTextureFormat(const Volume* volume)
+{
+    const float minimum = volume->minimum();
+    const float maximum = volume->maximum();
+    if (volume->elementSize() == 1 && minimum >= 0.0f && maximum <= textureValueScale(TextureFormat::R8))
+        return TextureFormat::R8;
+    if (volume->elementSize() == 2 && minimum >= 0.0f && maximum <= textureValueScale(TextureFormat::R16))
+        return TextureFormat::R16;
+    if (minimum >= -65504.0f && maximum <= 65504.0f) // largest finite half float
+        return TextureFormat::R16F;
+    return TextureFormat::R32F;
+}
+
+// Out-of-core volumes are not uploaded (they are only rendered by the CPU raycaster), they get a single voxel texture.
+static Texture createVolumeTexture(const Volume* volume, TextureFormat format)
+{
+    if (volume->isOutOfCore())
+        return Texture(std::vector<float>(1, 0.0f), glm::ivec3(1), format);
+    return Texture(volume->getData(), volume->dims(), format);
+}
+
 GPUVolume::GPUVolume(const Volume* volume)
-    : m_volumeTexture(Texture(volume->getData(), volume->dims()))
+    : m_textureFormat(selectTextureFormat(volume))
+    , m_volumeTexture(createVolumeTexture(volume, m_textureFormat))
     , m_indexTexture(Texture(std::vector<float>(0), glm::ivec3(1)))
     , m_pVolume(volume)
-    , m_minMaxValues(std::vector<glm::vec2>())
-    , m_brickVolumeSize(glm::ivec3(0))
-    , m_brickVolume(std::vector<float>())
-    , m_indexVolumeSize(glm::ivec3(0))
-    , m_indexVolume(std::vector<glm::vec3>())
-    , m_volumeDims(glm::vec3(-1))
     , m_brickSize(-1)
     , m_useBricking(false)
     , m_brickPadding(2)
+    , m_volumeTextureHoldsVolume(!volume->isOutOfCore())
+    , m_volumeDims(glm::vec3(-1))
+    , m_indexVolumeSize(glm::ivec3(0))
+    , m_indexVolume(std::vector<glm::vec4>())
 {
     // The index texture should not interpolate offsets
     m_indexTexture.setInterpolationMode(GL_NEAREST);
 }
 
+// Replace the contents of the texture, it is created if it does not exist yet and recreated if the format differs.
+// Assigning a Texture deletes the texture object it replaces.
+static void uploadTexture(std::optional<Texture>& optTexture, gsl::span<const float> data, glm::ivec3 dims, TextureFormat format)
+{
+    if (!optTexture)
+        optTexture.emplace(data, dims, format);
+    else if (optTexture->getFormat() != format)
+        *optTexture = Texture(data, dims, format);
+    else
+        optTexture->update(data, dims);
+}
+
+// Texture destructors do not delete the texture object (copies share it), so textures that are dropped are deleted here.
+static void deleteTexture(std::optional<Texture>& optTexture)
+{
+    if (optTexture)
+        glDeleteTextures(1, optTexture->getTexIdPointer());
+    optTexture.reset();
+}
+
+// The volume texture gets the new voxels (or the brick cache built from them) on the next updateBrickCache(), the brick
+// min max table is recomputed by the next brickSizeChanged().
+void GPUVolume::setVolume(const Volume* volume, const VolumePyramid* pVolumePyramid, const MinMaxTable& scannedMinMaxTable)
+{
+    util::ScopedTimer timer("GPUVolume::setVolume", "load");
+    m_pVolume = volume;
+
+    const TextureFormat textureFormat = selectTextureFormat(volume);
+    if (textureFormat != m_textureFormat) {
+        m_textureFormat = textureFormat;
+        m_volumeTexture = createVolumeTexture(volume, m_textureFormat);
+        for (Texture& atlasTexture : m_atlasTextures)
+            atlasTexture = Texture(std::vector<float>(1, 0.0f), glm::ivec3(1), m_textureFormat);
+    }
+    m_volumeTextureHoldsVolume = false;
+    m_brickSlots.clear();
+    if (m_useBricking)
+        m_volumeDims = glm::ivec3(-1);
+
+    m_scannedMinMaxTables.clear();
+    if (scannedMinMaxTable.cellSize() > 0)
+        m_scannedMinMaxTables.push_back(scannedMinMaxTable);
+
+    m_bsplineTextureIsCurrent = false;
+    setVolumePyramid(pVolumePyramid);
+}
+
 // ======= DO NOT MODIFY THIS FUNCTION ========
 // update the config
 // Note: whenever this is called brickSizeChanged(...) should also be called
@@ -35,7 +105,7 @@ void GPUVolume::setVolumeConfig(const render::GPUVolumeConfig& config)
 
 // ======= DO NOT MODIFY THIS FUNCTION ========
 // Full update of the min max data structure and cache neded when loading data or changing brick size
-void GPUVolume::brickSizeChanged(render::RenderConfig renderConfig, std::array<float, 256>& opacitySumTable)
+void GPUVolume::brickSizeChanged(render::RenderConfig renderConfig, const render::OpacityRangeIndex& opacityIndex)
 { 
     // only update when the values changed
     if (m_brickSize != m_volumeConfig.brickSize || m_useBricking != m_volumeConfig.useVolumeBricking || m_volumeDims != m_pVolume->dims())
@@ -46,130 +116,350 @@ void GPUVolume::brickSizeChanged(render::RenderConfig renderConfig, std::array<f
         m_volumeDims = m_pVolume->dims();
 
         updateMinMax();
-        updateBrickCache(renderConfig, opacitySumTable);
+        updateBrickCache(renderConfig, opacityIndex);
     }
 }
 
-// ======= TODO: IMPLEMENT ========
-//
-// Part of **3. Volume Bricking**
-//
-// This function should calculate the minimum and maximum values per brick
-// We store the values in the 1D std::vector m_minMaxValues with min and max in a glm::vec2
-// This function is very similar to the min max calculation for the blocking you did in Part 2 but with the bricksize
-// However, here you need to consider padding and you do not need to store position
-//
-// The bricksize is set in m_brickSize (as a single integer, as we want cubic bricks)
-// To allow interpolation and gradient calculation without recalculating the indirection, we add padding to the bricks
-// Use m_brickPadding as the size of the padding, in this implementation it is set to 2 and does not change but be generic
-// You need to set m_indexVolumeSize (glm::vec3) as the size (in voxels) of the redirection index
+// Calculates the minimum and maximum values per brick, including the padding around it because the GPU interpolates
+// into the padding. The min max table is the only data structure that depends on the brick size, so the brick cache
+// has to be rebuilt from scratch afterwards.
 void GPUVolume::updateMinMax()
 {
     // we initialize a timer to test this method
-    using clock = std::chrono::steady_clock;
-    std::chrono::steady_clock::time_point start = clock::now();
+    util::ScopedTimer timer("GPUVolume::updateMinMax", "bricking");
 
-    // ======= TODO: calculate m_indexVolumeSize  based on volume dimensions and m_brickSize
-    m_indexVolumeSize = glm::vec3(1);
+    m_brickSlots.clear();
 
-    // the number of bricks
-    int numBricksLinear = m_indexVolumeSize.x * m_indexVolumeSize.y * m_indexVolumeSize.z;
-    // resize m_minMaxValues to take one vec2(min, max) per brick
-    m_minMaxValues.resize(numBricksLinear);
+    // out-of-core volumes are never bricked on the GPU, we do not stream the whole volume to compute the table
+    if (m_pVolume->isOutOfCore()) {
+        m_indexVolumeSize = glm::ivec3(1);
+        return;
+    }
+
+    m_minMaxTable = minMaxTable(m_brickSize, m_brickPadding);
+    m_brickSpanSpaceIndex = render::SpanSpaceIndex(m_minMaxTable.values());
+    m_indexVolumeSize = m_minMaxTable.size();
+
+    std::cout << "updateMinMax() executed in " << timer.elapsedMs() << "ms" << std::endl;
+}
 
-    // ======= TODO: replace this and calculate all actual min max values
-    m_minMaxValues[0] = glm::vec2(0.0f, m_pVolume->maximum());
-    // stop the timer
-    using clock = std::chrono::steady_clock;
-    std::chrono::steady_clock::time_point stop = clock::now();
+// Tables with a cell size that is a multiple of a previously scanned one are derived from it instead of scanning the
+// volume again, e.g. doubling the brick size. Tables with cells smaller than 4^3 voxels are about as large as the
+// volume itself and are not kept.
+MinMaxTable GPUVolume::minMaxTable(int cellSize, int padding)
+{
+    const MinMaxTable* pFinest = nullptr;
+    for (const MinMaxTable& scanned : m_scannedMinMaxTables) {
+        if (scanned.canCoarsen(cellSize, padding) && (!pFinest || scanned.cellSize() > pFinest->cellSize()))
+            pFinest = &scanned;
+    }
+    if (pFinest) {
+        if (pFinest->cellSize() == cellSize && pFinest->padding() == padding)
+            return *pFinest;
+        return pFinest->coarsen(cellSize, padding);
+    }
 
-    std::cout << "updateMinMax() executed in " << std::chrono::duration<double, std::milli>(stop - start).count() << "ms" << std::endl;
+    MinMaxTable table { *m_pVolume, cellSize, padding };
+    if (cellSize >= 4) {
+        if (m_scannedMinMaxTables.size() == 4)
+            m_scannedMinMaxTables.erase(std::begin(m_scannedMinMaxTables));
+        m_scannedMinMaxTables.push_back(table);
+    }
+    return table;
 }
 
-// ======= TODO: IMPLEMENT ========
+// Determines which bricks are active for the current TF / iso value and updates the cache and index textures.
+// It will be called whenever the volume is loaded, the brick size changes and when the transfer function or iso value changes
 //
-// Part of **3. Volume Bricking**
+// m_brickVolume: the cache, padded bricks stored in slots of m_atlasSizeInBricks per cache texture
+// m_brickVolumeSize: the size of the cache textures in voxels
+// m_indexVolume: per brick the offset from volume voxels to cache voxels and the cache texture + 1, or the brick minimum and 0
 //
-// This function should calculate whether a brick is active or not
-// and adds the offset to the index volume and copies the actual brick data into the cache
-// It will be called whenever the volume is loaded, the brick size changes and when the transfer function or iso value changes
-// 
-// In principle this function is very similar to the updateActiveBlocks function you created for empty space skipping
-// However, we also prepare the volume index and cache data for the GPU
-// You need to update several variables for this to work downstream
-// m_brickVolume: the actual volume cache should contain a brick at positions given by the offsets in the index
-// m_brickVolumeSize: the size of the cache volume in 3D in voxels i.e., your result of findOptimalDimensions (num bricks in 3D) times the padded brick size
-// m_indexVolume: the index redirection data should contain the offset into m_brickVolume in 3D (consider already normalizing these to save cycles on the GPU)
-// NOTE: doing this correctly with padding can be tricky. If you get stuck debugging, consider without padding first.
-// NOTE: you should have updated m_indexVolumeSize already in updateMinMax()
-void GPUVolume::updateBrickCache(render::RenderConfig renderConfig, std::array<float, 256>& opacitySumTable)
+// With incremental updates the active set is diffed against the previous one: only bricks that became active are
+// copied (and uploaded as sub-regions), bricks that became inactive just get a new index entry.
+void GPUVolume::updateBrickCache(render::RenderConfig renderConfig, const render::OpacityRangeIndex& opacityIndex)
 {
     // we initialize a timer to test this method
-    using clock = std::chrono::steady_clock;
-    std::chrono::steady_clock::time_point start = clock::now();
+    util::ScopedTimer timer("GPUVolume::updateBrickCache", "bricking");
 
     // no bricking means we just add a single item and the cache becomes the volume
+    if (m_pVolume->isOutOfCore())
+        return;
     if (!m_volumeConfig.useVolumeBricking) { // if volume bricking is turned off just return the entire volume
-        m_volumeTexture.update(m_pVolume->getData(), m_pVolume->dims());
-        m_indexTexture.update(std::vector<glm::vec4> { glm::vec4(0) }, glm::ivec3(1));
+        // The volume does not change when the TF or iso value changes, so only upload it when the texture held the cache.
+        if (!m_volumeTextureHoldsVolume) {
+            m_volumeTexture.update(m_pVolume->getData(), m_pVolume->dims());
+            m_indexTexture.update(std::vector<glm::vec4> { glm::vec4(0) }, glm::ivec3(1));
+            m_volumeTextureHoldsVolume = true;
+            m_brickSlots.clear();
+        }
+        return;
+    }
+    // the config callback updates the cache before brickSizeChanged() had a chance to recompute the min max table
+    if (!m_useBricking || m_brickSize != m_volumeConfig.brickSize)
+        return;
+
+    const render::ActiveMask brickActive = render::classifyCells(m_minMaxTable.values(), m_minMaxTable.size(), m_minMaxTable.cellSize(), m_minMaxTable.padding(), renderConfig, opacityIndex, &m_brickSpanSpaceIndex);
+    const int numBricks = int(brickActive.size());
+
+    const bool canUpdateIncrementally = m_volumeConfig.incrementalBrickUpdates && !m_volumeTextureHoldsVolume && m_brickSlots.size() == size_t(numBricks);
+    if (canUpdateIncrementally && updateBrickCacheIncremental(brickActive)) {
+        std::cout << "updateCache() incremental executed in " << timer.elapsedMs() << "ms" << std::endl;
         return;
     }
+    rebuildBrickCache(brickActive);
 
+    std::cout << "updateCache() executed in " << timer.elapsedMs() << "ms" << std::endl;
+}
+
+// Full rebuild: allocate a cache for the active bricks plus some room to grow, copy all active bricks and upload the textures.
+void GPUVolume::rebuildBrickCache(const render::ActiveMask& brickActive)
+{
+    const int numBricks = int(brickActive.size());
+    const int numActive = int(brickActive.count());
+    // leave a quarter of free slots so small TF edits can stay incremental
+    const int numSlotsWanted = std::clamp(numActive + numActive / 4, 1, numBricks);
+    // keep the current layout while it fits the active bricks without too much waste, the cache textures then keep
+    // their storage and are only refilled
+    int numCurrentSlots = 0;
+    for (const glm::ivec3& sizeInBricks : m_atlasSizeInBricks)
+        numCurrentSlots += sizeInBricks.x * sizeInBricks.y * sizeInBricks.z;
+    if (m_brickSlots.size() != size_t(numBricks) || numCurrentSlots < numActive || numCurrentSlots > 2 * numSlotsWanted)
+        m_atlasSizeInBricks = findOptimalDimensions(numSlotsWanted);
+
+    int numSlots = 0;
+    m_brickVolumeSize.clear();
+    m_brickVolume.resize(m_atlasSizeInBricks.size());
+    for (size_t atlas = 0; atlas < m_atlasSizeInBricks.size(); atlas++) {
+        const glm::ivec3 sizeInBricks = m_atlasSizeInBricks[atlas];
+        numSlots += sizeInBricks.x * sizeInBricks.y * sizeInBricks.z;
+        m_brickVolumeSize.push_back(sizeInBricks * (m_brickSize + 2 * m_brickPadding));
+        m_brickVolume[atlas].assign(size_t(m_brickVolumeSize[atlas].x) * size_t(m_brickVolumeSize[atlas].y) * size_t(m_brickVolumeSize[atlas].z), 0.0f);
+    }
+    if (numSlots < numActive)
+        std::cerr << "Brick cache only fits " << numSlots << " of " << numActive << " active bricks" << std::endl;
+
+    m_brickActive = brickActive;
+    m_brickSlots.assign(size_t(numBricks), -1);
+    int nextSlot = 0;
+    for (int brickIndex = 0; brickIndex < numBricks && nextSlot < numSlots; brickIndex++) {
+        if (brickActive[size_t(brickIndex)])
+            m_brickSlots[size_t(brickIndex)] = nextSlot++;
+    }
+    // free slots are taken from the back, so hand out the lowest ones first
+    m_freeSlots.clear();
+    for (int slot = numSlots - 1; slot >= nextSlot; slot--)
+        m_freeSlots.push_back(slot);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int brickIndex = 0; brickIndex < numBricks; brickIndex++) {
+        if (m_brickSlots[size_t(brickIndex)] >= 0)
+            copyBrick(brickIndex, m_brickSlots[size_t(brickIndex)]);
+    }
 
     // NOTE: m_indexVolume needs to be filled in the right order to work as a 3D volume on the GPU
     // (0,0,0) should be in index 0, (1,0,0) = 1, etc.
-    // m_brickVolume can be filled in any way, as long as you keep correct offsets in your index
-    // as long as you implement the redirected lookup on the GPU in the same way
-    // we update the textures with the calculated values
-    // NOTE: this might crash as long as m_brickVolumeSize and m_indexVolumeSize are not set correctly when enabling bricking
-    m_volumeTexture.update(m_brickVolume, m_brickVolumeSize);
+    m_indexVolume.resize(size_t(numBricks));
+    for (int brickIndex = 0; brickIndex < numBricks; brickIndex++)
+        m_indexVolume[size_t(brickIndex)] = indexEntry(brickIndex);
+
+    // textures of atlases that are no longer used are shrunk to a single voxel to release their memory
+    while (m_atlasTextures.size() + 1 < std::size_t(maxBrickAtlasTextures))
+        m_atlasTextures.emplace_back(std::vector<float>(1, 0.0f), glm::ivec3(1), m_textureFormat);
+    for (size_t atlas = 1; atlas < size_t(maxBrickAtlasTextures); atlas++) {
+        if (atlas < m_brickVolume.size())
+            m_atlasTextures[atlas - 1].update(m_brickVolume[atlas], m_brickVolumeSize[atlas]);
+        else if (m_atlasTextures[atlas - 1].getDims() != glm::ivec3(1))
+            m_atlasTextures[atlas - 1].update(std::vector<float>(1, 0.0f), glm::ivec3(1));
+    }
+    updateInterpolation();
+
+    m_volumeTexture.update(m_brickVolume[0], m_brickVolumeSize[0]);
     m_indexTexture.update(m_indexVolume, m_indexVolumeSize);
+    m_volumeTextureHoldsVolume = false;
+}
 
-    // stop the timer
-    using clock = std::chrono::steady_clock;
-    std::chrono::steady_clock::time_point stop = clock::now();
+// Incremental update: bricks that became active get a free slot, or the slot of a brick that is no longer active.
+// Returns false if the cache is too small, the caller then rebuilds it with a larger size.
+bool GPUVolume::updateBrickCacheIncremental(const render::ActiveMask& brickActive)
+{
+    const int numBricks = int(brickActive.size());
+    std::vector<int> newlyResident;
+    size_t numReclaimable = 0;
+    for (int brickIndex = 0; brickIndex < numBricks; brickIndex++) {
+        const bool resident = m_brickSlots[size_t(brickIndex)] >= 0;
+        if (brickActive[size_t(brickIndex)] && !resident)
+            newlyResident.push_back(brickIndex);
+        else if (!brickActive[size_t(brickIndex)] && resident)
+            numReclaimable++;
+    }
+    if (newlyResident.size() > m_freeSlots.size() + numReclaimable)
+        return false;
 
-    std::cout << "updateCache() executed in " << std::chrono::duration<double, std::milli>(stop - start).count() << "ms" << std::endl;
+    int reclaimIndex = 0;
+    for (int brickIndex : newlyResident) {
+        int slot;
+        if (!m_freeSlots.empty()) {
+            slot = m_freeSlots.back();
+            m_freeSlots.pop_back();
+        } else {
+            // the evicted brick is inactive, its index entry does not reference the slot
+            while (brickActive[size_t(reclaimIndex)] || m_brickSlots[size_t(reclaimIndex)] < 0)
+                reclaimIndex++;
+            slot = m_brickSlots[size_t(reclaimIndex)];
+            m_brickSlots[size_t(reclaimIndex)] = -1;
+        }
+        m_brickSlots[size_t(brickIndex)] = slot;
+    }
+
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < int(newlyResident.size()); i++)
+        copyBrick(newlyResident[size_t(i)], m_brickSlots[size_t(newlyResident[size_t(i)])]);
+
+    const glm::ivec3 paddedBrickSize = glm::ivec3(m_brickSize + 2 * m_brickPadding);
+    for (int brickIndex : newlyResident) {
+        const SlotLocation location = slotLocation(m_brickSlots[size_t(brickIndex)]);
+        Texture& cacheTexture = location.atlas == 0 ? m_volumeTexture : m_atlasTextures[size_t(location.atlas - 1)];
+        cacheTexture.updateSubRegion(m_brickVolume[size_t(location.atlas)], m_brickVolumeSize[size_t(location.atlas)], location.origin, paddedBrickSize);
+    }
+
+    // only upload the box of index entries that changed
+    glm::ivec3 changedLower = m_indexVolumeSize;
+    glm::ivec3 changedUpper = glm::ivec3(0);
+    const auto updateIndexEntry = [&](int brickIndex) {
+        m_brickActive.set(size_t(brickIndex), brickActive[size_t(brickIndex)]);
+        m_indexVolume[size_t(brickIndex)] = indexEntry(brickIndex);
+
+        const glm::ivec3 brick { brickIndex % m_indexVolumeSize.x, (brickIndex / m_indexVolumeSize.x) % m_indexVolumeSize.y, brickIndex / (m_indexVolumeSize.x * m_indexVolumeSize.y) };
+        changedLower = glm::min(changedLower, brick);
+        changedUpper = glm::max(changedUpper, brick + 1);
+    };
+    for (int brickIndex = 0; brickIndex < numBricks; brickIndex++) {
+        if (m_brickActive[size_t(brickIndex)] != brickActive[size_t(brickIndex)])
+            updateIndexEntry(brickIndex);
+    }
+    // bricks that did not fit into the cache during the last rebuild were active without being resident
+    for (int brickIndex : newlyResident)
+        updateIndexEntry(brickIndex);
+    if (glm::all(glm::lessThan(changedLower, changedUpper)))
+        m_indexTexture.updateSubRegion(m_indexVolume, m_indexVolumeSize, changedLower, changedUpper - changedLower);
+
+    std::cout << "updateCache() copied " << newlyResident.size() << " of " << numBricks << " bricks" << std::endl;
+    return true;
 }
 
-// ======= TODO: IMPLEMENT ========
-//
-// Part of **3. Volume Bricking**
-//
-// This helper function should calculate the size of the cache volume in number of bricks in 3D
-// The input N is the total number of bricks
-// The input maxSize is the maximum texture size divided by the (padded) brick size
-// The output is the number of bricks when tightly packing it into a 3D structure
-// This is needed as the extent of textures on the GPU is limited
-// There are various ways to do this, the goal is to find a 3D volume that has little empty space
-// One that always works is taking the smallest cube that fits N, i.e., the next highest integer of the cubic root of N
-// However this can be very wasteful
-// E.g., N=10 bricks could be packed into a 5x2x1 cube without waste or the next cubic root 4x4x4 cuboid with six blocks of wasted space
-// The goal of this function is to find a cuboid with little wasted space that fits into the texture extents in a short time
-glm::ivec3 GPUVolume::findOptimalDimensions(int N)
+// Copies a brick including its padding into a cache slot, padding outside the volume repeats the border like GL_CLAMP_TO_EDGE.
+void GPUVolume::copyBrick(int brickIndex, int slot)
 {
-    // we initialize a timer to test this method
-    using clock = std::chrono::steady_clock;
-    std::chrono::steady_clock::time_point start = clock::now();
+    const glm::ivec3 dims = m_pVolume->dims();
+    const glm::ivec3 brick { brickIndex % m_indexVolumeSize.x, (brickIndex / m_indexVolumeSize.x) % m_indexVolumeSize.y, brickIndex / (m_indexVolumeSize.x * m_indexVolumeSize.y) };
+    const glm::ivec3 volumeOrigin = brick * m_brickSize - m_brickPadding;
+    const SlotLocation location = slotLocation(slot);
+    const glm::ivec3 cacheOrigin = location.origin;
+    const glm::ivec3 cacheSize = m_brickVolumeSize[size_t(location.atlas)];
+    std::vector<float>& cache = m_brickVolume[size_t(location.atlas)];
+    const int paddedBrickSize = m_brickSize + 2 * m_brickPadding;
 
-    // TODO: calculate the optimal dimensions for the cache volume here
-    glm::ivec3 optimalDimensions = glm::vec3(1, 1, 1);
+    const auto data = m_pVolume->getData();
+    for (int z = 0; z < paddedBrickSize; z++) {
+        const int volumeZ = std::clamp(volumeOrigin.z + z, 0, dims.z - 1);
+        for (int y = 0; y < paddedBrickSize; y++) {
+            const int volumeY = std::clamp(volumeOrigin.y + y, 0, dims.y - 1);
+            const size_t volumeRow = (size_t(volumeZ) * size_t(dims.y) + size_t(volumeY)) * size_t(dims.x);
+            const size_t cacheRow = (size_t(cacheOrigin.z + z) * size_t(cacheSize.y) + size_t(cacheOrigin.y + y)) * size_t(cacheSize.x) + size_t(cacheOrigin.x);
+            for (int x = 0; x < paddedBrickSize; x++)
+                cache[cacheRow + size_t(x)] = data[volumeRow + size_t(std::clamp(volumeOrigin.x + x, 0, dims.x - 1))];
+        }
+    }
+}
 
-    // stop the timer
-    using clock = std::chrono::steady_clock;
-    std::chrono::steady_clock::time_point stop = clock::now();
+// cache texture and first voxel of a slot, the slots of a texture follow those of the previous one
+GPUVolume::SlotLocation GPUVolume::slotLocation(int slot) const
+{
+    int atlas = 0;
+    for (; atlas + 1 < int(m_atlasSizeInBricks.size()); atlas++) {
+        const glm::ivec3 sizeInBricks = m_atlasSizeInBricks[size_t(atlas)];
+        const int numSlots = sizeInBricks.x * sizeInBricks.y * sizeInBricks.z;
+        if (slot < numSlots)
+            break;
+        slot -= numSlots;
+    }
+    const glm::ivec3 sizeInBricks = m_atlasSizeInBricks[size_t(atlas)];
+    const glm::ivec3 slot3D { slot % sizeInBricks.x, (slot / sizeInBricks.x) % sizeInBricks.y, slot / (sizeInBricks.x * sizeInBricks.y) };
+    return SlotLocation { atlas, slot3D * (m_brickSize + 2 * m_brickPadding) };
+}
 
-    std::cout << "findOptimalDimensions() with cube executed in " << std::chrono::duration<double, std::milli>(stop - start).count() << "ms" << std::endl;
-    std::cout << "fitting cube uses " << (float)N/(optimalDimensions.x*optimalDimensions.y*optimalDimensions.z)*100.0f << "\% of available space" << std::endl;
+// The index stores the offset from voxel coordinates in the volume to voxel coordinates in the cache, so the GPU only
+// needs one addition and a multiplication with the reciprocal cache size, and the cache texture + 1 in w.
+// Inactive bricks are not sampled, the GPU returns their minimum which is invisible for the current TF / iso value.
+glm::vec4 GPUVolume::indexEntry(int brickIndex) const
+{
+    const int slot = m_brickSlots[size_t(brickIndex)];
+    if (!m_brickActive[size_t(brickIndex)] || slot < 0)
+        return glm::vec4(m_minMaxTable.values()[size_t(brickIndex)].x, 0.0f, 0.0f, 0.0f);
+    const glm::ivec3 brick { brickIndex % m_indexVolumeSize.x, (brickIndex / m_indexVolumeSize.x) % m_indexVolumeSize.y, brickIndex / (m_indexVolumeSize.x * m_indexVolumeSize.y) };
+    const SlotLocation location = slotLocation(slot);
+    return glm::vec4(glm::vec3(location.origin + m_brickPadding - brick * m_brickSize), float(location.atlas + 1));
+}
+
+// Calculates the size in bricks of the cache textures for N bricks, within the maximum 3D texture size.
+// Caches larger than a single texture are spread over several (see packBrickAtlas).
+std::vector<glm::ivec3> GPUVolume::findOptimalDimensions(int N)
+{
+    // we initialize a timer to test this method
+    util::ScopedTimer timer("GPUVolume::findOptimalDimensions", "bricking");
+
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxTextureSize);
+    const int maxBricks = std::max(1, maxTextureSize / (m_brickSize + 2 * m_brickPadding));
+    const std::vector<glm::ivec3> atlas = packBrickAtlas(N, maxBricks);
+
+    long long numSlots = 0;
+    for (const glm::ivec3& sizeInBricks : atlas)
+        numSlots += static_cast<long long>(sizeInBricks.x) * sizeInBricks.y * sizeInBricks.z;
+    std::cout << "findOptimalDimensions() executed in " << timer.elapsedMs() << "ms" << std::endl;
+    std::cout << "packing " << N << " bricks into " << atlas.size() << " texture(s) uses " << float(N) / float(numSlots) * 100.0f << "% of available space" << std::endl;
 
     // return the optimal dimensions
-    return optimalDimensions;
+    return atlas;
 }
 
-// ======= DO NOT MODIFY THIS FUNCTION ========
-// get the OpenGL id of the volume / cache texture
+int GPUVolume::getNumCacheTextures() const
+{
+    return std::max(1, int(m_brickVolumeSize.size()));
+}
+
+GLuint GPUVolume::getCacheTexId(int atlas) const
+{
+    if (atlas == 0)
+        return m_volumeTexture.getTexId();
+    return m_atlasTextures[size_t(atlas - 1)].getTexId();
+}
+
+glm::ivec3 GPUVolume::getBrickVolumeSize(int atlas) const
+{
+    if (size_t(atlas) >= m_brickVolumeSize.size())
+        return glm::ivec3(1);
+    return m_brickVolumeSize[size_t(atlas)];
+}
+
+glm::vec3 GPUVolume::getIndexTexCoordScale() const
+{
+    if (m_brickSize <= 0 || glm::compMin(m_indexVolumeSize) <= 0)
+        return glm::vec3(1.0f);
+    return glm::vec3(m_pVolume->dims()) / glm::vec3(m_indexVolumeSize * m_brickSize);
+}
+
+float GPUVolume::getValueScale() const
+{
+    return textureValueScale(m_textureFormat);
+}
+
+// get the OpenGL id of the volume / cache texture or the texture of the selected level of detail
 GLuint GPUVolume::getTexId() const 
 {
+    if (m_levelOfDetail > 0)
+        return m_levelTextures[size_t(m_levelOfDetail - 1)]->getTexId();
     return m_volumeTexture.getTexId();
 }
 
@@ -180,14 +470,85 @@ GLuint GPUVolume::getIndexTexId() const
     return m_indexTexture.getTexId();
 }
 
-// ======= DO NOT MODIFY THIS FUNCTION ========
 // on the GPU to switch between nearest and linear we just have to update the texture properties
 void GPUVolume::updateInterpolation()
 {
-    if (interpolationMode == InterpolationMode::NearestNeighbour) {
-        m_volumeTexture.setInterpolationMode(GL_NEAREST);
-    } else {
-        m_volumeTexture.setInterpolationMode(GL_LINEAR);
+    const GLint mode = interpolationMode == InterpolationMode::NearestNeighbour ? GL_NEAREST : GL_LINEAR;
+    m_volumeTexture.setInterpolationMode(mode);
+    for (auto& atlasTexture : m_atlasTextures)
+        atlasTexture.setInterpolationMode(mode);
+    for (auto& optLevelTexture : m_levelTextures) {
+        if (optLevelTexture)
+            optLevelTexture->setInterpolationMode(mode);
+    }
+
+    if (useCubicInterpolation() && !m_bsplineTextureIsCurrent) {
+        uploadTexture(m_bsplineTexture, m_pVolume->bsplineCoefficients(), m_pVolume->dims(), TextureFormat::R32F);
+        m_bsplineTextureIsCurrent = true;
+    }
+}
+
+// The cubic lookups of the shaders are linear interpolations of the coefficient texture. Volumes without coefficients
+// (out-of-core, or Volume::updateInterpolation() was not called) are sampled linearly like on the CPU.
+bool GPUVolume::useCubicInterpolation() const
+{
+    return interpolationMode == InterpolationMode::Cubic && !m_pVolume->bsplineCoefficients().empty();
+}
+
+// Samplers may not be left unbound, without coefficients the volume texture stands in.
+GLuint GPUVolume::getBSplineTexId() const
+{
+    return m_bsplineTexture ? m_bsplineTexture->getTexId() : m_volumeTexture.getTexId();
+}
+
+// Upload the coarser levels of the pyramid, level 0 is the volume texture itself. The level textures of the previous
+// pyramid are refilled, so swapping in a pyramid of the same size does not create texture objects.
+void GPUVolume::setVolumePyramid(const VolumePyramid* pVolumePyramid)
+{
+    util::ScopedTimer timer("GPUVolume::setVolumePyramid", "load");
+    m_pVolumePyramid = pVolumePyramid;
+    m_levelOfDetail = 0;
+
+    const size_t numLevelTextures = pVolumePyramid ? size_t(std::max(pVolumePyramid->numLevels() - 1, 0)) : 0;
+    for (size_t i = numLevelTextures; i < m_levelTextures.size(); i++)
+        deleteTexture(m_levelTextures[i]);
+    m_levelTextures.resize(numLevelTextures);
+    for (size_t i = 0; i < numLevelTextures; i++) {
+        const int level = int(i) + 1;
+        if (!pVolumePyramid->hasLevel(level)) {
+            deleteTexture(m_levelTextures[i]);
+            continue;
+        }
+        const Volume& levelVolume = pVolumePyramid->level(level);
+        uploadTexture(m_levelTextures[i], levelVolume.getData(), levelVolume.dims(), m_textureFormat);
     }
+    updateInterpolation();
+}
+
+// The bricked cache and the B-spline coefficients only hold level 0, so with bricking or cubic interpolation we always
+// render the full resolution.
+int GPUVolume::selectLevelOfDetail(float pixelSize, float bias) const
+{
+    if (!m_pVolumePyramid || m_volumeConfig.useVolumeBricking || m_pVolume->isOutOfCore() || useCubicInterpolation())
+        return 0;
+    return m_pVolumePyramid->selectLevel(pixelSize, bias);
+}
+
+void GPUVolume::setLevelOfDetail(int level)
+{
+    m_levelOfDetail = level;
+}
+
+int GPUVolume::getLevelOfDetail() const
+{
+    return m_levelOfDetail;
+}
+
+glm::vec3 GPUVolume::getLevelTexCoordScale() const
+{
+    if (m_levelOfDetail == 0)
+        return glm::vec3(1.0f);
+    const glm::vec3 levelDims = m_pVolumePyramid->level(m_levelOfDetail).dims();
+    return glm::vec3(m_pVolume->dims()) / (VolumePyramid::levelScale(m_levelOfDetail) * levelDims);
 }
 }
\ No newline at end of file
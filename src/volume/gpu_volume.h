@@ -1,12 +1,19 @@
 #ifndef VOLUME_GPU_VOLUME_H
 #define VOLUME_GPU_VOLUME_H
 
+#include "brick_atlas.h"
+#include "min_max_table.h"
 #include "volume.h"
+#include "volume_pyramid.h"
 #include "texture.h"
 #include <glm/vec3.hpp>
+#include <cstdint>
+#include <optional>
 #include <string>
 #include <vector>
+#include <render/opacity_range_index.h>
 #include <render/render_config.h>
+#include <render/span_space_index.h>
 #include <render/gpu_volume_config.h>
 #ifdef __linux__
 #include <GL/glew.h>
@@ -22,46 +29,101 @@ public:
 public:
     GPUVolume(const Volume* volume);
 
+    // Swap in another volume of the same kind, e.g. the next timestep of a time series. Textures with the same size and
+    // format keep their storage and only get new contents. The min max tables of the volume are derived from
+    // scannedMinMaxTable when possible (it may be empty), so it can be scanned up front on another thread.
+    void setVolume(const Volume* volume, const VolumePyramid* pVolumePyramid, const MinMaxTable& scannedMinMaxTable);
+
     void setVolumeConfig(const render::GPUVolumeConfig& config);
 
-    void brickSizeChanged(render::RenderConfig renderConfig, std::array<float, 256>& opacitySumTable);
-    void updateBrickCache(render::RenderConfig renderConfig, std::array<float, 256>& opacitySumTable);
+    void brickSizeChanged(render::RenderConfig renderConfig, const render::OpacityRangeIndex& opacityIndex);
+    void updateBrickCache(render::RenderConfig renderConfig, const render::OpacityRangeIndex& opacityIndex);
 
     GLuint getTexId() const;
     GLuint getIndexTexId() const;
+    // Samples of the volume and cache textures have to be multiplied by this to get the voxel values.
+    float getValueScale() const;
     
     void updateInterpolation();
+    // Cubic interpolation samples the B-spline coefficients of the whole volume at full resolution, without bricking or
+    // levels of detail. The coefficient texture is uploaded from Volume::bsplineCoefficients() by updateInterpolation().
+    bool useCubicInterpolation() const;
+    GLuint getBSplineTexId() const;
+
+    // Level of detail: without bricking the levels of the volume pyramid are uploaded as separate textures and
+    // getTexId() returns the texture of the selected level.
+    void setVolumePyramid(const VolumePyramid* pVolumePyramid);
+    int selectLevelOfDetail(float pixelSize, float bias) const;
+    void setLevelOfDetail(int level);
+    int getLevelOfDetail() const;
+    // Scale from normalized coordinates of the volume to normalized coordinates of the level texture, levels of
+    // volumes with odd dimensions cover slightly more than the volume.
+    glm::vec3 getLevelTexCoordScale() const;
 
     // some accessors for the bricking properties
     inline int getBrickSize() { return m_brickSize; };
-    inline glm::ivec3 getBrickVolumeSize() { return m_brickVolumeSize; };
+    // the brick cache is spread over up to maxBrickAtlasTextures textures, the first one is the volume texture
+    int getNumCacheTextures() const;
+    GLuint getCacheTexId(int atlas) const;
+    glm::ivec3 getBrickVolumeSize(int atlas) const;
     inline bool useBricking(){ return m_volumeConfig.useVolumeBricking; };
     inline glm::ivec3 getIndexVolumeSize() { return m_indexVolumeSize; };
 
+    // Min max table of the volume for the given cell size and padding, also used for the blocks of the GPURenderer.
+    MinMaxTable minMaxTable(int cellSize, int padding);
+    // Scale from normalized volume coordinates to normalized index coordinates, the index covers whole bricks.
+    glm::vec3 getIndexTexCoordScale() const;
+
 private:
 
+    TextureFormat m_textureFormat; // of the volume, level and cache textures
     Texture m_volumeTexture;
     Texture m_indexTexture;
     
     const volume::Volume* m_pVolume;
+    const volume::VolumePyramid* m_pVolumePyramid { nullptr };
+    std::vector<std::optional<Texture>> m_levelTextures; // levels 1 and up
+    std::optional<Texture> m_bsplineTexture; // B-spline coefficients as 32 bit floats, they are not limited to the value range
+    bool m_bsplineTextureIsCurrent { false }; // false after the volume was swapped
+    int m_levelOfDetail { 0 };
 
     render::GPUVolumeConfig m_volumeConfig;
 
     int m_brickSize;
     bool m_useBricking;
     int m_brickPadding;
+    bool m_volumeTextureHoldsVolume; // false while the volume texture holds the brick cache
     glm::ivec3 m_volumeDims;
 
-    glm::ivec3 m_brickVolumeSize;
-    std::vector<float> m_brickVolume;
+    std::vector<Texture> m_atlasTextures; // cache textures 1 and up
+    std::vector<glm::ivec3> m_brickVolumeSize; // per cache texture in voxels
+    std::vector<std::vector<float>> m_brickVolume; // per cache texture
 
     glm::ivec3 m_indexVolumeSize;
-    std::vector<glm::vec3> m_indexVolume;
-    std::vector<glm::vec2> m_minMaxValues; // min = x, max = y in the vector
+    std::vector<glm::vec4> m_indexVolume; // offset from volume to cache voxels + 1 for active bricks, (min, 0, 0, 0) otherwise
+    MinMaxTable m_minMaxTable; // per brick including padding
+    render::SpanSpaceIndex m_brickSpanSpaceIndex; // of m_minMaxTable, finds the bricks an iso surface passes through
+    std::vector<MinMaxTable> m_scannedMinMaxTables;
+
+    // Residency of the bricks in the cache, kept between updates so a TF or iso change only copies the bricks that
+    // became active. Inactive bricks keep their slot until it is needed for another brick.
+    std::vector<glm::ivec3> m_atlasSizeInBricks; // per cache texture, slots are numbered through all textures
+    std::vector<int> m_brickSlots; // cache slot per brick, -1 if not resident
+    std::vector<int> m_freeSlots;
+    render::ActiveMask m_brickActive;
 
-    glm::ivec3 findOptimalDimensions(int N);
+    std::vector<glm::ivec3> findOptimalDimensions(int N);
 
     void updateMinMax();
+    void rebuildBrickCache(const render::ActiveMask& brickActive);
+    bool updateBrickCacheIncremental(const render::ActiveMask& brickActive);
+    void copyBrick(int brickIndex, int slot);
+    struct SlotLocation {
+        int atlas;
+        glm::ivec3 origin; // first voxel in the cache texture
+    };
+    SlotLocation slotLocation(int slot) const;
+    glm::vec4 indexEntry(int brickIndex) const;
 };
 }
 
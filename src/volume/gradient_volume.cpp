@@ -1,5 +1,8 @@
 #include "gradient_volume.h"
+#include "util/trace.h"
 #include <algorithm>
+#include <cstddef>
+#include <cmath>
 #include <exception>
 #include <glm/geometric.hpp>
 #include <glm/vector_relational.hpp>
@@ -10,6 +13,8 @@ namespace volume {
 // Compute the maximum magnitude from all gradient voxels
 static float computeMaxMagnitude(gsl::span<const GradientVoxel> data)
 {
+    if (data.empty())
+        return 0.0f;
     return std::max_element(
         std::begin(data),
         std::end(data),
@@ -22,6 +27,8 @@ static float computeMaxMagnitude(gsl::span<const GradientVoxel> data)
 // Compute the minimum magnitude from all gradient voxels
 static float computeMinMagnitude(gsl::span<const GradientVoxel> data)
 {
+    if (data.empty())
+        return 0.0f;
     return std::min_element(
         std::begin(data),
         std::end(data),
@@ -31,22 +38,33 @@ static float computeMinMagnitude(gsl::span<const GradientVoxel> data)
         ->magnitude;
 }
 
+// Central difference gradient at an interior voxel
+static GradientVoxel computeGradient(const Volume& volume, int x, int y, int z)
+{
+    const float gx = (volume.getVoxel(x + 1, y, z) - volume.getVoxel(x - 1, y, z)) / 2.0f;
+    const float gy = (volume.getVoxel(x, y + 1, z) - volume.getVoxel(x, y - 1, z)) / 2.0f;
+    const float gz = (volume.getVoxel(x, y, z + 1) - volume.getVoxel(x, y, z - 1)) / 2.0f;
+
+    const glm::vec3 v { gx, gy, gz };
+    return GradientVoxel { v, glm::length(v) };
+}
+
 // Compute a gradient volume from a volume
 static std::vector<GradientVoxel> computeGradientVolume(const Volume& volume)
 {
+    // Storing the gradients would take four times the memory of the volume itself.
+    if (volume.isOutOfCore())
+        return {};
+
+    util::ScopedTimer timer("computeGradientVolume", "gradient");
     const auto dim = volume.dims();
 
     std::vector<GradientVoxel> out(static_cast<size_t>(dim.x * dim.y * dim.z));
     for (int z = 1; z < dim.z - 1; z++) {
         for (int y = 1; y < dim.y - 1; y++) {
             for (int x = 1; x < dim.x - 1; x++) {
-                const float gx = (volume.getVoxel(x + 1, y, z) - volume.getVoxel(x - 1, y, z)) / 2.0f;
-                const float gy = (volume.getVoxel(x, y + 1, z) - volume.getVoxel(x, y - 1, z)) / 2.0f;
-                const float gz = (volume.getVoxel(x, y, z + 1) - volume.getVoxel(x, y, z - 1)) / 2.0f;
-
-                const glm::vec3 v { gx, gy, gz };
                 const size_t index = static_cast<size_t>(x + dim.x * (y + dim.y * z));
-                out[index] = GradientVoxel { v, glm::length(v) };
+                out[index] = computeGradient(volume, x, y, z);
             }
         }
     }
@@ -54,10 +72,12 @@ static std::vector<GradientVoxel> computeGradientVolume(const Volume& volume)
 }
 
 GradientVolume::GradientVolume(const Volume& volume)
-    : m_dim(volume.dims())
+    : m_pVolume(&volume)
+    , m_dim(volume.dims())
     , m_data(computeGradientVolume(volume))
     , m_minMagnitude(computeMinMagnitude(m_data))
-    , m_maxMagnitude(computeMaxMagnitude(m_data))
+    // Without the gradient volume we use the largest possible central difference as an upper bound.
+    , m_maxMagnitude(volume.isOutOfCore() ? (volume.maximum() - volume.minimum()) * std::sqrt(3.0f) / 2.0f : computeMaxMagnitude(m_data))
 {
 }
 
@@ -81,16 +101,11 @@ glm::vec4 GradientVolume::gradientToVec4(GradientVoxel voxel) const
     return glm::vec4(voxel.dir, voxel.magnitude);
 }
 
-//Convert list to vec4 to make it easier to convert to texture
-std::vector<glm::vec4> GradientVolume::getVec4Data() const
+// A GradientVoxel has the same layout as a vec4 (dir, magnitude), so the gradients can be passed to a texture directly.
+static_assert(sizeof(GradientVoxel) == sizeof(glm::vec4) && offsetof(GradientVoxel, magnitude) == 3 * sizeof(float));
+gsl::span<const glm::vec4> GradientVolume::getVec4Data() const
 {
-    std::vector<glm::vec4> vec4List;
-    vec4List.reserve(m_data.size()); // Reserve space for efficiency 
-    for (const auto& voxel : m_data) 
-    { 
-        vec4List.emplace_back(gradientToVec4(voxel)); 
-    } 
-    return vec4List;
+    return gsl::span<const glm::vec4>(reinterpret_cast<const glm::vec4*>(m_data.data()), m_data.size());
 }
 
 // This function returns a gradientVoxel at coord based on the current interpolation mode.
@@ -146,6 +161,13 @@ GradientVoxel GradientVolume::linearInterpolate(const GradientVoxel& g0, const G
 // This function returns a gradientVoxel without using interpolation
 GradientVoxel GradientVolume::getGradient(int x, int y, int z) const
 {
+    if (m_data.empty()) {
+        // Border voxels have a zero gradient, like in the precomputed gradient volume.
+        if (x < 1 || y < 1 || z < 1 || x >= m_dim.x - 1 || y >= m_dim.y - 1 || z >= m_dim.z - 1)
+            return { glm::vec3(0.0f), 0.0f };
+        return computeGradient(*m_pVolume, x, y, z);
+    }
+
     const size_t i = static_cast<size_t>(x + m_dim.x * (y + m_dim.y * z));
     return m_data[i];
 }
@@ -2,6 +2,7 @@
 #include "volume.h"
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <gsl/span>
 #include <string>
 #include <vector>
 
@@ -26,7 +27,8 @@ public:
     float minMagnitude() const;
     float maxMagnitude() const;
     glm::ivec3 dims() const;
-    std::vector<glm::vec4> getVec4Data() const;
+    // View of the gradients as (dir, magnitude) vec4s without copying them, empty for out-of-core volumes.
+    gsl::span<const glm::vec4> getVec4Data() const;
 
 protected:
     GradientVoxel getGradientNearestNeighbor(const glm::vec3& coord) const;
@@ -34,8 +36,9 @@ protected:
     static GradientVoxel linearInterpolate(const GradientVoxel& g0, const GradientVoxel& g1, float factor);
 
 protected:
+    const Volume* m_pVolume;
     const glm::ivec3 m_dim;
-    const std::vector<GradientVoxel> m_data;
+    const std::vector<GradientVoxel> m_data; // empty for out-of-core volumes, their gradients are computed on the fly
     const float m_minMagnitude, m_maxMagnitude;
 };
 }
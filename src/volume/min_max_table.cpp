@@ -0,0 +1,141 @@
+#include "min_max_table.h"
+#include "util/trace.h"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+namespace volume {
+
+static const glm::vec2 emptyRange { std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() };
+
+static glm::ivec3 numCells(const glm::ivec3& volumeDims, int cellSize)
+{
+    return (volumeDims + glm::ivec3(cellSize - 1)) / cellSize;
+}
+
+MinMaxTable::MinMaxTable(const Volume& volume, int cellSize, int padding)
+    : m_volumeDims(volume.dims())
+    , m_size(numCells(volume.dims(), cellSize))
+    , m_cellSize(cellSize)
+    , m_padding(padding)
+    , m_values(size_t(m_size.x) * size_t(m_size.y) * size_t(m_size.z), emptyRange)
+{
+    assert(!volume.isOutOfCore());
+    assert(cellSize > 0 && padding >= 0);
+    util::ScopedTimer timer("MinMaxTable::scan", "minmax");
+
+    const auto data = volume.getData();
+    const glm::ivec3 dims = m_volumeDims;
+    // Every thread owns a slab of cells in z. Each voxel row is reduced once per cell in x (SIMD) and the row results
+    // are merged into all cells in y whose padded range contains the row.
+#pragma omp parallel
+    {
+        std::vector<glm::vec2> rowMinMax(size_t(m_size.x));
+#pragma omp for schedule(dynamic)
+        for (int cellZ = 0; cellZ < m_size.z; cellZ++) {
+            glm::vec2* pSlab = m_values.data() + size_t(cellZ) * size_t(m_size.x) * size_t(m_size.y);
+            const int zBegin = std::max(cellZ * cellSize - padding, 0);
+            const int zEnd = std::min((cellZ + 1) * cellSize + padding, dims.z);
+            for (int z = zBegin; z < zEnd; z++) {
+                for (int y = 0; y < dims.y; y++) {
+                    const float* pRow = data.data() + (size_t(z) * size_t(dims.y) + size_t(y)) * size_t(dims.x);
+                    for (int cellX = 0; cellX < m_size.x; cellX++) {
+                        const int xBegin = std::max(cellX * cellSize - padding, 0);
+                        const int xEnd = std::min((cellX + 1) * cellSize + padding, dims.x);
+                        float minValue = emptyRange.x;
+                        float maxValue = emptyRange.y;
+#pragma omp simd reduction(min : minValue) reduction(max : maxValue)
+                        for (int x = xBegin; x < xEnd; x++) {
+                            minValue = std::min(minValue, pRow[x]);
+                            maxValue = std::max(maxValue, pRow[x]);
+                        }
+                        rowMinMax[size_t(cellX)] = glm::vec2(minValue, maxValue);
+                    }
+
+                    // cell y covers [y * cellSize - padding, (y + 1) * cellSize + padding)
+                    const int cellYBegin = y < padding ? 0 : (y - padding) / cellSize;
+                    const int cellYEnd = std::min((y + padding) / cellSize + 1, m_size.y);
+                    for (int cellY = cellYBegin; cellY < cellYEnd; cellY++) {
+                        glm::vec2* pCellRow = pSlab + size_t(cellY) * size_t(m_size.x);
+                        for (int cellX = 0; cellX < m_size.x; cellX++) {
+                            pCellRow[cellX].x = std::min(pCellRow[cellX].x, rowMinMax[size_t(cellX)].x);
+                            pCellRow[cellX].y = std::max(pCellRow[cellX].y, rowMinMax[size_t(cellX)].y);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool MinMaxTable::canCoarsen(int cellSize, int padding) const
+{
+    return m_cellSize > 0 && cellSize % m_cellSize == 0 && padding >= m_padding && (padding - m_padding) % m_cellSize == 0;
+}
+
+// Coarse cell c covers [c * cellSize - padding, (c + 1) * cellSize + padding), which is the union of our cells
+// [c * factor - paddingCells, (c + 1) * factor + paddingCells), also after clamping both to the volume.
+MinMaxTable MinMaxTable::coarsen(int cellSize, int padding) const
+{
+    assert(canCoarsen(cellSize, padding));
+    util::ScopedTimer timer("MinMaxTable::coarsen", "minmax");
+
+    const int factor = cellSize / m_cellSize;
+    const int paddingCells = (padding - m_padding) / m_cellSize;
+
+    MinMaxTable coarse;
+    coarse.m_volumeDims = m_volumeDims;
+    coarse.m_size = numCells(m_volumeDims, cellSize);
+    coarse.m_cellSize = cellSize;
+    coarse.m_padding = padding;
+    coarse.m_values.resize(size_t(coarse.m_size.x) * size_t(coarse.m_size.y) * size_t(coarse.m_size.z));
+
+#pragma omp parallel for
+    for (int z = 0; z < coarse.m_size.z; z++) {
+        for (int y = 0; y < coarse.m_size.y; y++) {
+            for (int x = 0; x < coarse.m_size.x; x++) {
+                const glm::ivec3 cell { x, y, z };
+                const glm::ivec3 lower = glm::max(cell * factor - paddingCells, glm::ivec3(0));
+                const glm::ivec3 upper = glm::min((cell + 1) * factor + paddingCells, m_size);
+                glm::vec2 range = emptyRange;
+                for (int fineZ = lower.z; fineZ < upper.z; fineZ++) {
+                    for (int fineY = lower.y; fineY < upper.y; fineY++) {
+                        for (int fineX = lower.x; fineX < upper.x; fineX++) {
+                            const glm::vec2 fineRange = minMax(glm::ivec3(fineX, fineY, fineZ));
+                            range.x = std::min(range.x, fineRange.x);
+                            range.y = std::max(range.y, fineRange.y);
+                        }
+                    }
+                }
+                coarse.m_values[(size_t(z) * size_t(coarse.m_size.y) + size_t(y)) * size_t(coarse.m_size.x) + size_t(x)] = range;
+            }
+        }
+    }
+    return coarse;
+}
+
+glm::ivec3 MinMaxTable::size() const
+{
+    return m_size;
+}
+
+int MinMaxTable::cellSize() const
+{
+    return m_cellSize;
+}
+
+int MinMaxTable::padding() const
+{
+    return m_padding;
+}
+
+glm::vec2 MinMaxTable::minMax(const glm::ivec3& cell) const
+{
+    return m_values[(size_t(cell.z) * size_t(m_size.y) + size_t(cell.y)) * size_t(m_size.x) + size_t(cell.x)];
+}
+
+gsl::span<const glm::vec2> MinMaxTable::values() const
+{
+    return m_values;
+}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "volume.h"
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <gsl/span>
+#include <vector>
+
+namespace volume {
+
+// Minimum and maximum value per cell of cellSize^3 voxels, used to decide which blocks / bricks can be skipped.
+// Every cell is extended by padding voxels on each side (clamped to the volume), so values interpolated near the
+// border of a cell are within its range. Cells at the far border of the volume only cover the remaining voxels.
+class MinMaxTable {
+public:
+    MinMaxTable() = default;
+    // Scan the volume, slabs of cells in parallel and rows with SIMD. Out-of-core volumes are not supported.
+    MinMaxTable(const Volume& volume, int cellSize, int padding);
+
+    // A table with a cell size that is a multiple of ours and the same padding plus whole cells covers exactly the
+    // union of some of our cells, so it can be derived from this table without touching the volume.
+    bool canCoarsen(int cellSize, int padding) const;
+    MinMaxTable coarsen(int cellSize, int padding) const;
+
+    glm::ivec3 size() const;
+    int cellSize() const;
+    int padding() const;
+
+    // min = x, max = y, cells are stored x first
+    glm::vec2 minMax(const glm::ivec3& cell) const;
+    gsl::span<const glm::vec2> values() const;
+
+private:
+    glm::ivec3 m_volumeDims { 0 };
+    glm::ivec3 m_size { 0 };
+    int m_cellSize { 0 };
+    int m_padding { 0 };
+    std::vector<glm::vec2> m_values;
+};
+}
@@ -1,16 +1,110 @@
 #include "texture.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 
 namespace volume {
 
+struct GLTextureFormat {
+    GLint internalFormat;
+    GLenum type;
+    size_t texelSize;
+};
+
+static GLTextureFormat glTextureFormat(TextureFormat format)
+{
+    switch (format) {
+    case TextureFormat::R8:
+        return { GL_R8, GL_UNSIGNED_BYTE, 1 };
+    case TextureFormat::R16:
+        return { GL_R16, GL_UNSIGNED_SHORT, 2 };
+    case TextureFormat::R16F:
+        return { GL_R16F, GL_HALF_FLOAT, 2 };
+    default:
+        return { GL_R32F, GL_FLOAT, 4 };
+    }
+}
+
+// Sub-region uploads read the box straight out of the full data.
+static size_t firstTexel(glm::ivec3 dataDims, glm::ivec3 offset)
+{
+    return (size_t(offset.z) * size_t(dataDims.y) + size_t(offset.y)) * size_t(dataDims.x) + size_t(offset.x);
+}
+
+static constexpr size_t streamingChunkBytes = size_t(4) << 20;
+
+Texture::StreamingBuffers::~StreamingBuffers()
+{
+    if (buffers[0] != 0)
+        glDeleteBuffers(2, buffers.data());
+}
+
+// Uploads the box [offset, offset + size) of a 3D texture in chunks of whole slices of at most 4 MB (or a single
+// slice if that is larger). fillRow(voxel, count, pTarget) writes the count texels starting at voxel of the box.
+// The chunks alternate between the two streaming buffers, so OpenGL can transfer one chunk while the next one is
+// being prepared in the other buffer.
+template <typename FillRow>
+void Texture::streamBox(glm::ivec3 offset, glm::ivec3 size, size_t texelSize, GLenum format, GLenum type, FillRow&& fillRow)
+{
+    const size_t rowBytes = size_t(size.x) * texelSize;
+    const size_t sliceBytes = rowBytes * size_t(size.y);
+    const int chunkDepth = std::clamp(int(streamingChunkBytes / sliceBytes), 1, size.z);
+
+    glBindTexture(GL_TEXTURE_3D, m_texId);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int chunkStart = 0; chunkStart < size.z; chunkStart += chunkDepth) {
+        const int depth = std::min(chunkDepth, size.z - chunkStart);
+        const size_t chunkBytes = sliceBytes * size_t(depth);
+        auto* pChunk = static_cast<std::byte*>(mapStreamingBuffer(GLsizeiptr(sliceBytes * size_t(chunkDepth)), GLsizeiptr(chunkBytes)));
+        if (pChunk) {
+            const int numRows = depth * size.y;
+#pragma omp parallel for if (chunkBytes >= streamingChunkBytes / 4)
+            for (int row = 0; row < numRows; row++)
+                fillRow(offset + glm::ivec3(0, row % size.y, chunkStart + row / size.y), size_t(size.x), pChunk + size_t(row) * rowBytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glTexSubImage3D(GL_TEXTURE_3D, 0, offset.x, offset.y, offset.z + chunkStart, size.x, size.y, depth, format, type, nullptr);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_3D, 0); // Unbind the texture
+}
+
+// Binds the next streaming buffer and maps its first numBytes. The storage is only allocated when the chunk capacity of
+// an upload changes instead of orphaning it for every chunk. Invalidating the mapped range tells OpenGL that the chunk
+// from two turns ago that is still read from the buffer does not have to be preserved.
+void* Texture::mapStreamingBuffer(GLsizeiptr capacity, GLsizeiptr numBytes)
+{
+    if (!m_pStreamingBuffers) {
+        m_pStreamingBuffers = std::make_shared<StreamingBuffers>();
+        glGenBuffers(2, m_pStreamingBuffers->buffers.data());
+    }
+    StreamingBuffers& streamingBuffers = *m_pStreamingBuffers;
+    const size_t index = streamingBuffers.next;
+    streamingBuffers.next = 1 - index;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, streamingBuffers.buffers[index]);
+    if (streamingBuffers.sizes[index] != capacity) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+        streamingBuffers.sizes[index] = capacity;
+    }
+    return glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, numBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
 Texture::Texture(const Texture& other)
     : m_dims(other.getDims())
     , m_texId(other.getTexId())
+    , m_format(other.getFormat())
+    , m_interpolationMode(other.m_interpolationMode)
+    , m_internalFormat(other.m_internalFormat)
+    , m_hasStorage(other.m_hasStorage)
+    , m_pStreamingBuffers(other.m_pStreamingBuffers)
 {
 }
 
 // Constructor for float textures
-Texture::Texture(const std::vector<float>& floatTexture, glm::ivec3 dims)
+Texture::Texture(gsl::span<const float> floatTexture, glm::ivec3 dims, TextureFormat format)
     : m_dims(dims)
+    , m_format(format)
 {
     glGenTextures(1, &m_texId);
     if (dims[2] == 0) {
@@ -22,19 +116,13 @@ Texture::Texture(const std::vector<float>& floatTexture, glm::ivec3 dims)
         glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, m_dims.x, m_dims.y, 0, GL_RED, GL_FLOAT, floatTexture.data());
         glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
     } else {
-        glBindTexture(GL_TEXTURE_3D, m_texId);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, m_dims.x, m_dims.y, m_dims.z, 0, GL_RED, GL_FLOAT, floatTexture.data());
-        glBindTexture(GL_TEXTURE_3D, 0); // Unbind the texture
+        setParameters3D();
+        update(floatTexture, dims);
     }
 }
 
 // Constructor for vec3 textures
-Texture::Texture(const std::vector<glm::vec3>& vec3Texture, glm::ivec3 dims)
+Texture::Texture(gsl::span<const glm::vec3> vec3Texture, glm::ivec3 dims)
     : m_dims(dims)
 {
     glGenTextures(1, &m_texId);
@@ -59,7 +147,7 @@ Texture::Texture(const std::vector<glm::vec3>& vec3Texture, glm::ivec3 dims)
 }
 
 // Constructor for vec4 textures
-Texture::Texture(const std::vector<glm::vec4>& vec4Texture, glm::ivec3 dims)
+Texture::Texture(gsl::span<const glm::vec4> vec4Texture, glm::ivec3 dims)
     : m_dims(dims)
 {
     glGenTextures(1, &m_texId);
@@ -72,14 +160,8 @@ Texture::Texture(const std::vector<glm::vec4>& vec4Texture, glm::ivec3 dims)
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_dims.x, m_dims.y, 0, GL_RGBA, GL_FLOAT, vec4Texture.data());
         glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
     } else {
-        glBindTexture(GL_TEXTURE_3D, m_texId);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, m_dims.x, m_dims.y, m_dims.z, 0, GL_RGBA, GL_FLOAT, vec4Texture.data());
-        glBindTexture(GL_TEXTURE_3D, 0); // Unbind the texture
+        setParameters3D();
+        update(vec4Texture, dims);
     }
 }
 
@@ -100,6 +182,11 @@ Texture& Texture::operator=(const Texture& other)
 
     m_texId = other.getTexId();
     m_dims = other.m_dims;
+    m_format = other.m_format;
+    m_interpolationMode = other.m_interpolationMode;
+    m_internalFormat = other.m_internalFormat;
+    m_hasStorage = other.m_hasStorage;
+    m_pStreamingBuffers = other.m_pStreamingBuffers;
 
     return *this;
 }
@@ -119,8 +206,14 @@ glm::ivec3 Texture::getDims() const
     return m_dims;
 }
 
+TextureFormat Texture::getFormat() const
+{
+    return m_format;
+}
+
 void Texture::setInterpolationMode(GLint interpolationMode)
 {
+    m_interpolationMode = interpolationMode;
     if (m_dims[2] == 0) {
         glBindTexture(GL_TEXTURE_2D, m_texId);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, interpolationMode);
@@ -134,21 +227,23 @@ void Texture::setInterpolationMode(GLint interpolationMode)
     } 
 }
 
-void Texture::update(const std::vector<float>& floatTexture, glm::ivec3 dims)
+void Texture::update(gsl::span<const float> floatTexture, glm::ivec3 dims)
 {
-    m_dims = dims;
     if (dims[2] == 0) {
+        m_dims = dims;
         glBindTexture(GL_TEXTURE_2D, m_texId);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, m_dims.x, m_dims.y, 0, GL_RED, GL_FLOAT, floatTexture.data());
         glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
     } else {
-        glBindTexture(GL_TEXTURE_3D, m_texId);
-        glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, m_dims.x, m_dims.y, m_dims.z, 0, GL_RED, GL_FLOAT, floatTexture.data());
-        glBindTexture(GL_TEXTURE_3D, 0); // Unbind the texture
+        // converted chunk by chunk while streaming, a converted copy of the whole volume is not needed
+        const GLTextureFormat glFormat = glTextureFormat(m_format);
+        allocateStorage3D(dims, glFormat.internalFormat, GL_RED, glFormat.type);
+        if (!floatTexture.empty())
+            updateSubRegion(floatTexture, dims, glm::ivec3(0), dims);
     }
 }
 
-void Texture::update(const std::vector<glm::vec3>& vec3Texture, glm::ivec3 dims)
+void Texture::update(gsl::span<const glm::vec3> vec3Texture, glm::ivec3 dims)
 {
     m_dims = dims;
     if (dims[2] == 0) {
@@ -162,17 +257,68 @@ void Texture::update(const std::vector<glm::vec3>& vec3Texture, glm::ivec3 dims)
     }
 }
 
-void Texture::update(const std::vector<glm::vec4>& vec4Texture, glm::ivec3 dims)
+void Texture::update(gsl::span<const glm::vec4> vec4Texture, glm::ivec3 dims)
 {
-    m_dims = dims;
     if (dims[2] == 0) {
+        m_dims = dims;
         glBindTexture(GL_TEXTURE_2D, m_texId);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_dims.x, m_dims.y, 0, GL_RGBA, GL_FLOAT, vec4Texture.data());
         glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
     } else {
+        allocateStorage3D(dims, GL_RGBA32F, GL_RGBA, GL_FLOAT);
+        if (!vec4Texture.empty())
+            updateSubRegion(vec4Texture, dims, glm::ivec3(0), dims);
+    }
+}
+
+void Texture::updateSubRegion(gsl::span<const float> floatTexture, glm::ivec3 dataDims, glm::ivec3 offset, glm::ivec3 size)
+{
+    const GLTextureFormat glFormat = glTextureFormat(m_format);
+    streamBox(offset, size, glFormat.texelSize, GL_RED, glFormat.type, [&](glm::ivec3 voxel, size_t count, std::byte* pTarget) {
+        convertToTexels(floatTexture.data() + firstTexel(dataDims, voxel), count, m_format, pTarget);
+    });
+}
+
+void Texture::updateSubRegion(gsl::span<const glm::vec4> vec4Texture, glm::ivec3 dataDims, glm::ivec3 offset, glm::ivec3 size)
+{
+    streamBox(offset, size, sizeof(glm::vec4), GL_RGBA, GL_FLOAT, [&](glm::ivec3 voxel, size_t count, std::byte* pTarget) {
+        std::memcpy(pTarget, vec4Texture.data() + firstTexel(dataDims, voxel), count * sizeof(glm::vec4));
+    });
+}
+
+void Texture::setParameters3D()
+{
+    glBindTexture(GL_TEXTURE_3D, m_texId);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, m_interpolationMode);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, m_interpolationMode);
+    glBindTexture(GL_TEXTURE_3D, 0); // Unbind the texture
+}
+
+// Updates with the same dimensions and format keep the storage and only replace the contents. Immutable storage (OpenGL 4.2 or
+// ARB_texture_storage) can not be resized, so a resize creates a new texture object with the same parameters.
+void Texture::allocateStorage3D(glm::ivec3 dims, GLint internalFormat, GLenum format, GLenum type)
+{
+    if (m_hasStorage && dims == m_dims && internalFormat == m_internalFormat)
+        return;
+
+    m_dims = dims;
+    m_internalFormat = internalFormat;
+    if (GLEW_ARB_texture_storage) {
+        if (m_hasStorage) {
+            glDeleteTextures(1, &m_texId);
+            glGenTextures(1, &m_texId);
+            setParameters3D();
+        }
         glBindTexture(GL_TEXTURE_3D, m_texId);
-        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, m_dims.x, m_dims.y, m_dims.z, 0, GL_RGBA, GL_FLOAT, vec4Texture.data());
-        glBindTexture(GL_TEXTURE_3D, 0); // Unbind the texture
+        glTexStorage3D(GL_TEXTURE_3D, 1, GLenum(internalFormat), m_dims.x, m_dims.y, m_dims.z);
+    } else {
+        glBindTexture(GL_TEXTURE_3D, m_texId);
+        glTexImage3D(GL_TEXTURE_3D, 0, internalFormat, m_dims.x, m_dims.y, m_dims.z, 0, format, type, nullptr);
     }
+    glBindTexture(GL_TEXTURE_3D, 0); // Unbind the texture
+    m_hasStorage = true;
+}
 }
-}
\ No newline at end of file
@@ -5,8 +5,13 @@
 #else
 #include <gl/glew.h>
 #endif
+#include "texture_format.h"
+#include <array>
+#include <cstddef>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <gsl/span>
+#include <memory>
 #include <vector>
 
 namespace volume {
@@ -15,9 +20,10 @@ class Texture {
 public:
     // Copy constructor needed for the textureManager
     Texture(const Texture& other);
-    Texture(const std::vector<float>& floatTexture, glm::ivec3 dims);
-    Texture(const std::vector<glm::vec3>& vec3Texture, glm::ivec3 dims);
-    Texture(const std::vector<glm::vec4>& vec4Texture, glm::ivec3 dims);
+    // Float textures can be stored in a reduced precision format, the data is converted slab by slab while uploading.
+    Texture(gsl::span<const float> floatTexture, glm::ivec3 dims, TextureFormat format = TextureFormat::R32F);
+    Texture(gsl::span<const glm::vec3> vec3Texture, glm::ivec3 dims);
+    Texture(gsl::span<const glm::vec4> vec4Texture, glm::ivec3 dims);
 
     ~Texture();
 
@@ -27,15 +33,43 @@ public:
     GLuint* getTexIdPointer();
 
     glm::ivec3 getDims() const;
+    TextureFormat getFormat() const;
 
     void setInterpolationMode(GLint interpolationMode);
 
-    void update(const std::vector<float>& floatTexture, glm::ivec3 dims);
-    void update(const std::vector<glm::vec3>& vec3Texture, glm::ivec3 dims);
-    void update(const std::vector<glm::vec4>& vec4Texture, glm::ivec3 dims);
+    // 3D textures keep their storage when updated with the same dimensions, only the contents are replaced. Uploads are
+    // streamed in chunks through pixel buffers. A resize may give the texture a new id.
+    void update(gsl::span<const float> floatTexture, glm::ivec3 dims);
+    void update(gsl::span<const glm::vec3> vec3Texture, glm::ivec3 dims);
+    void update(gsl::span<const glm::vec4> vec4Texture, glm::ivec3 dims);
+
+    // Replace the box [offset, offset + size) of a 3D texture with the same box of data, which holds a volume of dataDims.
+    void updateSubRegion(gsl::span<const float> floatTexture, glm::ivec3 dataDims, glm::ivec3 offset, glm::ivec3 size);
+    void updateSubRegion(gsl::span<const glm::vec4> vec4Texture, glm::ivec3 dataDims, glm::ivec3 offset, glm::ivec3 size);
 
 private:
+    // Two pixel buffers that uploads are streamed through in turns. Copies of a texture share them (like the texture
+    // id) and the last copy deletes them.
+    struct StreamingBuffers {
+        ~StreamingBuffers();
+
+        std::array<GLuint, 2> buffers { 0, 0 };
+        std::array<GLsizeiptr, 2> sizes { 0, 0 };
+        size_t next { 0 };
+    };
+
+    void setParameters3D();
+    void allocateStorage3D(glm::ivec3 dims, GLint internalFormat, GLenum format, GLenum type);
+    template <typename FillRow>
+    void streamBox(glm::ivec3 offset, glm::ivec3 size, size_t texelSize, GLenum format, GLenum type, FillRow&& fillRow);
+    void* mapStreamingBuffer(GLsizeiptr capacity, GLsizeiptr numBytes);
+
     glm::ivec3 m_dims; // dimensions of the texture
     GLuint m_texId; 
+    TextureFormat m_format { TextureFormat::R32F }; // of 3D float textures
+    GLint m_interpolationMode { GL_LINEAR };
+    GLint m_internalFormat { 0 }; // 3D textures only
+    bool m_hasStorage { false };
+    std::shared_ptr<StreamingBuffers> m_pStreamingBuffers; // created by the first streamed upload
 };
 }
\ No newline at end of file
@@ -0,0 +1,48 @@
+#include "texture_format.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <glm/gtc/packing.hpp>
+#include <limits>
+
+namespace volume {
+
+float textureValueScale(TextureFormat format)
+{
+    switch (format) {
+    case TextureFormat::R8:
+        return 255.0f;
+    case TextureFormat::R16:
+        return 65535.0f;
+    default:
+        return 1.0f;
+    }
+}
+
+template <typename T>
+static T toNormalized(float value)
+{
+    return T(std::clamp(std::round(value), 0.0f, float(std::numeric_limits<T>::max())));
+}
+
+void convertToTexels(const float* pValues, size_t count, TextureFormat format, std::byte* pTexels)
+{
+    switch (format) {
+    case TextureFormat::R8:
+        for (size_t i = 0; i < count; i++)
+            reinterpret_cast<uint8_t*>(pTexels)[i] = toNormalized<uint8_t>(pValues[i]);
+        break;
+    case TextureFormat::R16:
+        for (size_t i = 0; i < count; i++)
+            reinterpret_cast<uint16_t*>(pTexels)[i] = toNormalized<uint16_t>(pValues[i]);
+        break;
+    case TextureFormat::R16F:
+        for (size_t i = 0; i < count; i++)
+            reinterpret_cast<uint16_t*>(pTexels)[i] = glm::packHalf1x16(pValues[i]);
+        break;
+    default:
+        std::copy(pValues, pValues + count, reinterpret_cast<float*>(pTexels));
+        break;
+    }
+}
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+
+namespace volume {
+
+// Internal format of single channel 3D textures. R8 and R16 are normalized, a sample returns value / 255 or
+// value / 65535, so they store integer volumes at their native size. R16F keeps 11 bits of precision.
+enum class TextureFormat {
+    R8,
+    R16,
+    R16F,
+    R32F
+};
+
+// Scale that turns a sample of a texture with this format back into the original value.
+float textureValueScale(TextureFormat format);
+
+// Converts count float values to the texels of the format. R8 and R16 round the values and clamp them to their
+// integer range, R16F rounds them to the nearest half float.
+void convertToTexels(const float* pValues, size_t count, TextureFormat format, std::byte* pTexels);
+}
@@ -0,0 +1,326 @@
+#include "time_series.h"
+#include "util/trace.h"
+#include <algorithm>
+#include <cctype>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <utility>
+
+// Split the stem of name.00012.fld into the name and the number, returns false if the stem does not end in .<digits>.
+static bool splitTimestepNumber(const std::string& stem, std::string& name, std::string& number);
+
+namespace volume {
+
+Timestep::Timestep(const std::filesystem::path& file, const OutOfCoreConfig& outOfCore)
+    : volume(file, outOfCore)
+    , gradientVolume(volume)
+    , pyramid(volume, gradientVolume)
+{
+    if (!volume.isOutOfCore())
+        minMaxTable = MinMaxTable(volume, 4, 1);
+}
+
+std::vector<std::filesystem::path> findTimeSeriesFiles(const std::filesystem::path& file)
+{
+    std::string name, number;
+    if (!splitTimestepNumber(file.stem().string(), name, number))
+        return { file };
+
+    // Only numbers with the same number of digits, so name.00001 does not pick up name.1 of another series.
+    std::vector<std::pair<long long, std::filesystem::path>> numberedFiles;
+    std::error_code error;
+    const auto directory = file.has_parent_path() ? file.parent_path() : std::filesystem::path(".");
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+        const auto& path = entry.path();
+        std::string siblingName, siblingNumber;
+        if (entry.is_regular_file(error) && path.extension() == file.extension()
+            && splitTimestepNumber(path.stem().string(), siblingName, siblingNumber)
+            && siblingName == name && siblingNumber.size() == number.size())
+            numberedFiles.emplace_back(std::stoll(siblingNumber), path);
+    }
+    if (numberedFiles.empty())
+        return { file };
+
+    std::sort(std::begin(numberedFiles), std::end(numberedFiles),
+        [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+    std::vector<std::filesystem::path> files;
+    for (auto& [timestepNumber, path] : numberedFiles)
+        files.push_back(std::move(path));
+    return files;
+}
+
+TimeSeries::TimeSeries(std::vector<std::filesystem::path> files, const OutOfCoreConfig& outOfCore, int prefetchCount)
+    : m_files(std::move(files))
+    , m_outOfCore(outOfCore)
+    , m_prefetchCount(std::max(prefetchCount, 0))
+{
+    m_ring.resize(size_t(std::min(m_prefetchCount + 1, numTimesteps())));
+    m_prefetchThread = std::thread([this]() { prefetchLoop(); });
+}
+
+TimeSeries::~TimeSeries()
+{
+    {
+        std::scoped_lock lock { m_mutex };
+        m_stopPrefetching = true;
+    }
+    m_prefetchCondition.notify_all();
+    m_prefetchThread.join();
+}
+
+int TimeSeries::numTimesteps() const
+{
+    return int(m_files.size());
+}
+
+const std::filesystem::path& TimeSeries::file(int timestep) const
+{
+    return m_files[size_t(timestep)];
+}
+
+void TimeSeries::setCurrent(int timestep)
+{
+    {
+        std::scoped_lock lock { m_mutex };
+        m_current = std::clamp(timestep, 0, std::max(numTimesteps() - 1, 0));
+    }
+    m_prefetchCondition.notify_one();
+}
+
+int TimeSeries::prefetchCount() const
+{
+    std::scoped_lock lock { m_mutex };
+    return m_prefetchCount;
+}
+
+// Keeps the decoded timesteps that are still in the window when the ring is resized.
+void TimeSeries::setPrefetchCount(int prefetchCount)
+{
+    {
+        std::scoped_lock lock { m_mutex };
+        m_prefetchCount = std::max(prefetchCount, 0);
+        std::vector<Slot> ring;
+        for (Slot& slot : m_ring) {
+            if (slot.pTimestep && inWindow(slot.timestep))
+                ring.push_back(std::move(slot));
+        }
+        ring.resize(size_t(std::min(m_prefetchCount + 1, numTimesteps())));
+        m_ring = std::move(ring);
+    }
+    m_prefetchCondition.notify_one();
+}
+
+std::shared_ptr<Timestep> TimeSeries::tryGet(int timestep) const
+{
+    std::scoped_lock lock { m_mutex };
+    const auto iter = std::find_if(std::begin(m_ring), std::end(m_ring),
+        [=](const Slot& slot) { return slot.timestep == timestep; });
+    return iter != std::end(m_ring) ? iter->pTimestep : nullptr;
+}
+
+std::shared_ptr<Timestep> TimeSeries::get(int timestep)
+{
+    setCurrent(timestep);
+    std::unique_lock lock { m_mutex };
+    std::shared_ptr<Timestep> pTimestep;
+    m_decodedCondition.wait(lock, [&]() {
+        const auto iter = std::find_if(std::begin(m_ring), std::end(m_ring),
+            [=](const Slot& slot) { return slot.timestep == timestep; });
+        if (iter == std::end(m_ring))
+            return false;
+        pTimestep = iter->pTimestep;
+        return true;
+    });
+    return pTimestep;
+}
+
+bool TimeSeries::hasFailed(int timestep) const
+{
+    std::scoped_lock lock { m_mutex };
+    return std::any_of(std::begin(m_ring), std::end(m_ring),
+        [=](const Slot& slot) { return slot.timestep == timestep && !slot.pTimestep; });
+}
+
+int TimeSeries::numDecoded() const
+{
+    std::scoped_lock lock { m_mutex };
+    return int(std::count_if(std::begin(m_ring), std::end(m_ring), [](const Slot& slot) { return slot.pTimestep != nullptr; }));
+}
+
+// The window is the current timestep and the prefetchCount timesteps after it, wrapping around at the end.
+bool TimeSeries::inWindow(int timestep) const
+{
+    const int distance = (timestep - m_current + numTimesteps()) % numTimesteps();
+    return timestep >= 0 && distance < int(m_ring.size());
+}
+
+int TimeSeries::nextToDecode() const
+{
+    for (int i = 0; i < int(m_ring.size()); i++) {
+        const int timestep = (m_current + i) % numTimesteps();
+        const bool decoded = std::any_of(std::begin(m_ring), std::end(m_ring),
+            [=](const Slot& slot) { return slot.timestep == timestep; });
+        if (!decoded)
+            return timestep;
+    }
+    return -1;
+}
+
+// Timesteps are decoded without holding the lock, so the render thread can keep taking timesteps from the ring. A
+// decoded timestep replaces a slot that is empty or outside the window, there always is one because the window holds
+// as many timesteps as the ring. A timestep that throws while loading takes a slot without data, which wakes up get().
+void TimeSeries::prefetchLoop()
+{
+    while (true) {
+        int timestep;
+        {
+            std::unique_lock lock { m_mutex };
+            m_prefetchCondition.wait(lock, [&]() { return m_stopPrefetching || (timestep = nextToDecode()) >= 0; });
+            if (m_stopPrefetching)
+                return;
+        }
+
+        std::shared_ptr<Timestep> pTimestep;
+        try {
+            util::ScopedTimer timer("TimeSeries::decode", "load");
+            pTimestep = std::make_shared<Timestep>(m_files[size_t(timestep)], m_outOfCore);
+        } catch (const std::exception& exception) {
+            std::cerr << "Cannot load timestep " << m_files[size_t(timestep)].string() << ": " << exception.what() << std::endl;
+        }
+
+        std::shared_ptr<Timestep> pEvicted;
+        {
+            std::scoped_lock lock { m_mutex };
+            // The window may have moved on while decoding.
+            if (!inWindow(timestep))
+                continue;
+            const auto iter = std::find_if(std::begin(m_ring), std::end(m_ring),
+                [this](const Slot& slot) { return !inWindow(slot.timestep); });
+            pEvicted = std::move(iter->pTimestep);
+            *iter = Slot { timestep, std::move(pTimestep) };
+        }
+        m_decodedCondition.notify_all();
+    }
+}
+
+TimeSeriesPlayback::TimeSeriesPlayback(TimeSeries* pTimeSeries, float frameRate)
+    : m_pTimeSeries(pTimeSeries)
+    , m_frameRate(frameRate)
+{
+}
+
+TimeSeries& TimeSeriesPlayback::timeSeries() const
+{
+    return *m_pTimeSeries;
+}
+
+// Playing a series that stopped at its last timestep starts it over.
+void TimeSeriesPlayback::play(clock::time_point now)
+{
+    if (!m_loop && m_requested == m_pTimeSeries->numTimesteps() - 1)
+        seek(0);
+    m_playing = true;
+    m_lastAdvance = now;
+}
+
+void TimeSeriesPlayback::pause()
+{
+    m_playing = false;
+}
+
+bool TimeSeriesPlayback::isPlaying() const
+{
+    return m_playing;
+}
+
+void TimeSeriesPlayback::setLoop(bool loop)
+{
+    m_loop = loop;
+}
+
+bool TimeSeriesPlayback::loop() const
+{
+    return m_loop;
+}
+
+void TimeSeriesPlayback::setFrameRate(float frameRate)
+{
+    m_frameRate = std::max(frameRate, 0.1f);
+}
+
+float TimeSeriesPlayback::frameRate() const
+{
+    return m_frameRate;
+}
+
+void TimeSeriesPlayback::seek(int timestep)
+{
+    m_requested = std::clamp(timestep, 0, std::max(m_pTimeSeries->numTimesteps() - 1, 0));
+    m_pTimeSeries->setCurrent(m_requested);
+}
+
+// The next timestep is only requested once the previous one is displayed. Playback keeps its pace while the timesteps
+// are ready in time; after a held frame it continues from now instead of rushing through the timesteps to catch up.
+bool TimeSeriesPlayback::update(clock::time_point now)
+{
+    const auto framePeriod = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / double(m_frameRate)));
+    if (m_playing && m_displayed == m_requested && now - m_lastAdvance >= framePeriod) {
+        int next = m_requested + 1;
+        if (next >= m_pTimeSeries->numTimesteps()) {
+            next = m_loop ? 0 : m_requested;
+            m_playing = m_loop;
+        }
+        if (next != m_requested)
+            seek(next);
+        m_lastAdvance = now - m_lastAdvance < 2 * framePeriod ? m_lastAdvance + framePeriod : now;
+    }
+
+    if (m_displayed == m_requested)
+        return false;
+    auto pTimestep = m_pTimeSeries->tryGet(m_requested);
+    if (!pTimestep) {
+        // A timestep that failed to load is skipped, the previous one stays on screen.
+        if (m_pTimeSeries->hasFailed(m_requested))
+            m_displayed = m_requested;
+        else
+            m_heldFrames++;
+        return false;
+    }
+    m_displayed = m_requested;
+    m_pDisplayed = std::move(pTimestep);
+    return true;
+}
+
+std::shared_ptr<Timestep> TimeSeriesPlayback::displayed() const
+{
+    return m_pDisplayed;
+}
+
+int TimeSeriesPlayback::displayedTimestep() const
+{
+    return m_displayed;
+}
+
+int TimeSeriesPlayback::requestedTimestep() const
+{
+    return m_requested;
+}
+
+int TimeSeriesPlayback::heldFrames() const
+{
+    return m_heldFrames;
+}
+}
+
+static bool splitTimestepNumber(const std::string& stem, std::string& name, std::string& number)
+{
+    const size_t dot = stem.find_last_of('.');
+    if (dot == std::string::npos || dot + 1 == stem.size())
+        return false;
+    if (!std::all_of(std::begin(stem) + std::ptrdiff_t(dot + 1), std::end(stem), [](char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; }))
+        return false;
+    name = stem.substr(0, dot);
+    number = stem.substr(dot + 1);
+    return true;
+}
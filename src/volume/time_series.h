@@ -0,0 +1,130 @@
+#pragma once
+#include "brick_cache.h"
+#include "gradient_volume.h"
+#include "min_max_table.h"
+#include "volume.h"
+#include "volume_pyramid.h"
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace volume {
+
+// Everything the renderers need of one timestep. Decoding a timestep loads the volume and builds its gradients,
+// pyramid and min max table, which is done on the prefetch thread of the TimeSeries.
+struct Timestep {
+    Timestep(const std::filesystem::path& file, const OutOfCoreConfig& outOfCore);
+
+    Volume volume;
+    GradientVolume gradientVolume;
+    VolumePyramid pyramid;
+    // Cells of 4^3 voxels with a padding of 1, the tables of the GPU blocks are derived from it. Empty if out-of-core.
+    MinMaxTable minMaxTable;
+};
+
+// Files of the time series that the given file belongs to: the files in the same directory with the same name and
+// extension that only differ in the number before the extension (name.00000.fld, name.00001.fld, ...), ordered by
+// that number. Just the file itself if its name does not end in a number.
+std::vector<std::filesystem::path> findTimeSeriesFiles(const std::filesystem::path& file);
+
+// Sequence of timesteps of which only a window is kept in memory. A background thread decodes the current timestep and
+// the prefetchCount timesteps after it (wrapping around at the end) into a ring of prefetchCount + 1 slots, timesteps
+// that leave the window are overwritten. The timesteps are shared, so a timestep that is still displayed stays alive
+// after it was dropped from the ring.
+class TimeSeries {
+public:
+    TimeSeries(std::vector<std::filesystem::path> files, const OutOfCoreConfig& outOfCore, int prefetchCount);
+    ~TimeSeries();
+
+    TimeSeries(const TimeSeries&) = delete;
+    TimeSeries& operator=(const TimeSeries&) = delete;
+
+    int numTimesteps() const;
+    const std::filesystem::path& file(int timestep) const;
+
+    // Move the prefetch window so it starts at the given timestep, the timesteps closest to it are decoded first.
+    void setCurrent(int timestep);
+    int prefetchCount() const;
+    void setPrefetchCount(int prefetchCount);
+
+    // The timestep if it is decoded, nullptr otherwise. Never waits for the prefetch thread.
+    std::shared_ptr<Timestep> tryGet(int timestep) const;
+    // Moves the window to the timestep and waits until it is decoded, for the first frame after loading. Returns nullptr
+    // if the timestep could not be loaded.
+    std::shared_ptr<Timestep> get(int timestep);
+    // Whether loading the timestep threw, it is tried again once it left the window and comes back in.
+    bool hasFailed(int timestep) const;
+    int numDecoded() const;
+
+private:
+    bool inWindow(int timestep) const;
+    int nextToDecode() const;
+    void prefetchLoop();
+
+private:
+    // A slot whose timestep failed to load keeps the timestep without data, so it is not decoded over and over.
+    struct Slot {
+        int timestep { -1 };
+        std::shared_ptr<Timestep> pTimestep;
+    };
+
+    const std::vector<std::filesystem::path> m_files;
+    const OutOfCoreConfig m_outOfCore;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_prefetchCondition;
+    std::condition_variable m_decodedCondition;
+    std::vector<Slot> m_ring;
+    int m_current { 0 };
+    int m_prefetchCount;
+    bool m_stopPrefetching { false };
+    std::thread m_prefetchThread;
+};
+
+// Plays a time series at a fixed frame rate. Playback only moves on to timesteps that are decoded: when the prefetch
+// thread falls behind, the displayed timestep is held and the next one is shown as soon as it is ready, so rendering
+// never waits for the disk.
+class TimeSeriesPlayback {
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit TimeSeriesPlayback(TimeSeries* pTimeSeries, float frameRate = 10.0f);
+
+    TimeSeries& timeSeries() const;
+
+    void play(clock::time_point now);
+    void pause();
+    bool isPlaying() const;
+    void setLoop(bool loop);
+    bool loop() const;
+    void setFrameRate(float frameRate);
+    float frameRate() const;
+    // Show the given timestep once it is decoded.
+    void seek(int timestep);
+
+    // Advance playback to the given time. Returns true if the displayed timestep changed.
+    bool update(clock::time_point now);
+    // The timestep that is displayed (nullptr until the first one is decoded) and the one that playback waits for.
+    std::shared_ptr<Timestep> displayed() const;
+    int displayedTimestep() const;
+    int requestedTimestep() const;
+    // Number of frames for which the requested timestep was not decoded yet.
+    int heldFrames() const;
+
+private:
+    TimeSeries* m_pTimeSeries;
+    float m_frameRate;
+    bool m_playing { false };
+    bool m_loop { true };
+    clock::time_point m_lastAdvance;
+
+    int m_requested { 0 };
+    int m_displayed { -1 };
+    std::shared_ptr<Timestep> m_pDisplayed;
+    int m_heldFrames { 0 };
+};
+}
@@ -1,23 +1,30 @@
 #include "volume.h"
+#include "util/mapped_file.h"
+#include "util/trace.h"
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cctype> // isspace
-#include <chrono>
+#include <cmath>
 #include <filesystem>
 #include <fstream>
 #include <glm/glm.hpp>
 #include <gsl/span>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <cstring>
 #include <unordered_map>
+#include <utility>
 
 
 struct Header {
     glm::ivec3 dim;
     size_t elementSize;
 };
+static std::optional<volume::FileExtension> parseFileExtension(const std::filesystem::path& file);
 static Header readHeader(std::ifstream& ifs, const volume::VolumeType& dataType, const volume::FileExtension& fileExtension);
 static Header readVolumeHeader_fld(std::ifstream& ifs);
 static Header readVolumeHeader_dat(std::ifstream& ifs);
@@ -26,19 +33,56 @@ static Header readVectorFieldHeader(std::ifstream& ifs);
 static float computeMinimum(gsl::span<const float> data);
 static float computeMaximum(gsl::span<const float> data);
 static std::vector<int> computeHistogram(gsl::span<const float> data);
+static void prefilterBSplineLines(float* pFirst, int length, size_t stride, int lanes);
+static float sampleCoefficientsLinear(gsl::span<const float> coefficients, const glm::ivec3& dim, const glm::vec3& position);
 
 namespace volume {
 
-Volume::Volume(const std::filesystem::path& file)
+std::optional<VolumeFileInfo> readVolumeFileInfo(const std::filesystem::path& file)
+{
+    const auto optExtension = parseFileExtension(file);
+    std::ifstream ifs(file, std::ios::binary);
+    if (!optExtension || !ifs.is_open())
+        return {};
+
+    const auto header = readHeader(ifs, VolumeType::Volume, *optExtension);
+    std::streamoff dataOffset = ifs.tellg();
+    // Data section is separated from header by two /f characters.
+    if (*optExtension == FileExtension::FLD)
+        dataOffset += 2;
+    return VolumeFileInfo { header.dim, header.elementSize, dataOffset };
+}
+
+Volume::Volume(const std::filesystem::path& file, const OutOfCoreConfig& outOfCore)
     : m_fileName(file.string())
 {
-    using clock = std::chrono::high_resolution_clock;
-    auto start = clock::now();
-    loadFile(file);
-    auto end = clock::now();
-    std::cout << "Time to load: " << std::chrono::duration<double, std::milli>(end - start).count() << "ms" << std::endl;
+    util::ScopedTimer timer("Volume::Volume", "load");
+    if (outOfCore.enabled) {
+        // Stream the volume into a brick file once, after that only the statistics are kept in memory.
+        const auto brickFile = BrickCache::brickFilePath(file, outOfCore.brickSize);
+        if (BrickCache::buildBrickFile(file, brickFile, outOfCore.brickSize)) {
+            m_pBrickCache = std::make_shared<BrickCache>(brickFile, size_t(outOfCore.memoryBudgetMB) << 20);
+            const BrickFileHeader& header = m_pBrickCache->header();
+            m_dataType = VolumeType::Volume;
+            m_fileExtension = parseFileExtension(file).value_or(FileExtension::FLD);
+            m_elementSize = header.elementSize;
+            m_dim = header.dim;
+            m_minimum = header.minimum;
+            m_maximum = header.maximum;
+            m_histogram = header.histogram;
+            return;
+        }
+        std::cerr << "Falling back to loading the whole volume" << std::endl;
+    }
+
+    {
+        util::ScopedTimer loadTimer("Volume::loadFile", "load");
+        loadFile(file);
+        std::cout << "Time to load: " << loadTimer.elapsedMs() << "ms" << std::endl;
+    }
 
     if (m_dataType == VolumeType::Volume && m_data.size() > 0) {
+        util::ScopedTimer statisticsTimer("Volume statistics", "load");
         m_minimum = computeMinimum(m_data);
         m_maximum = computeMaximum(m_data);
         m_histogram = computeHistogram(m_data);
@@ -66,7 +110,7 @@ float Volume::maximum() const
     return m_maximum;
 }
 
-std::vector<int> Volume::histogram() const
+gsl::span<const int> Volume::histogram() const
 {
     return m_histogram;
 }
@@ -81,13 +125,50 @@ std::string_view Volume::fileName() const
     return m_fileName;
 }
 
+size_t Volume::elementSize() const
+{
+    return m_elementSize;
+}
+
 float Volume::getVoxel(int x, int y, int z) const
 {
+    if (m_pBrickCache)
+        return m_pBrickCache->voxel(x, y, z);
+
     const size_t i = size_t(x + m_dim.x * (y + m_dim.y * z));
     return static_cast<float>(m_data[i]);
 }
 
-std::vector<float> Volume::getData() const
+// The coefficients are a copy of the voxels that is prefiltered in place along x, y and z in turn, in parallel over the
+// lines of an axis. Lines along x are contiguous, along y and z a whole row of x is filtered at once so the recursive
+// filter always steps through contiguous memory. They are kept when switching away from cubic interpolation.
+void Volume::updateInterpolation()
+{
+    if (interpolationMode != InterpolationMode::Cubic || !m_bsplineCoefficients.empty() || m_data.empty())
+        return;
+
+    util::ScopedTimer timer("Volume::updateInterpolation", "load");
+    m_bsplineCoefficients = m_data;
+    float* pCoefficients = m_bsplineCoefficients.data();
+    const size_t rowSize = size_t(m_dim.x);
+    const size_t sliceSize = rowSize * size_t(m_dim.y);
+#pragma omp parallel for
+    for (int row = 0; row < m_dim.y * m_dim.z; row++)
+        prefilterBSplineLines(pCoefficients + size_t(row) * rowSize, m_dim.x, 1, 1);
+#pragma omp parallel for
+    for (int z = 0; z < m_dim.z; z++)
+        prefilterBSplineLines(pCoefficients + size_t(z) * sliceSize, m_dim.y, rowSize, m_dim.x);
+#pragma omp parallel for
+    for (int y = 0; y < m_dim.y; y++)
+        prefilterBSplineLines(pCoefficients + size_t(y) * rowSize, m_dim.z, sliceSize, m_dim.x);
+}
+
+gsl::span<const float> Volume::bsplineCoefficients() const
+{
+    return m_bsplineCoefficients;
+}
+
+gsl::span<const float> Volume::getData() const
 {
     return m_data;
 }
@@ -97,6 +178,16 @@ VolumeType Volume::getVolumeType() const
     return m_dataType;
 }
 
+bool Volume::isOutOfCore() const
+{
+    return m_pBrickCache != nullptr;
+}
+
+std::shared_ptr<BrickCache> Volume::brickCache() const
+{
+    return m_pBrickCache;
+}
+
 // This function returns a value based on the current interpolation mode
 float Volume::getSampleInterpolate(const glm::vec3& coord) const
 {
@@ -116,6 +207,28 @@ float Volume::getSampleInterpolate(const glm::vec3& coord) const
     }
 }
 
+SampleGradient Volume::getSampleGradientInterpolate(const glm::vec3& coord) const
+{
+    switch (interpolationMode) {
+    case InterpolationMode::NearestNeighbour: {
+        if (glm::any(glm::lessThan(coord + 0.5f, glm::vec3(0))) || glm::any(glm::greaterThanEqual(coord + 0.5f, glm::vec3(m_dim))))
+            return { 0.0f, glm::vec3(0.0f) };
+        return getSampleGradientTriLinear(glm::clamp(coord, glm::vec3(0), glm::vec3(m_dim - 1)), true);
+    }
+    case InterpolationMode::Linear: {
+        if (glm::any(glm::lessThan(coord, glm::vec3(0))) || glm::any(glm::greaterThan(coord, glm::vec3(m_dim - 1))))
+            return { 0.0f, glm::vec3(0.0f) };
+        return getSampleGradientTriLinear(coord, false);
+    }
+    case InterpolationMode::Cubic: {
+        return getSampleGradientTriCubic(coord);
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
 // This function returns the nearest neighbour value at the continuous 3D position given by coord.
 // Notice that in this framework we assume that the distance between neighbouring voxels is 1 in all directions
 float Volume::getSampleNearestNeighbourInterpolation(const glm::vec3& coord) const
@@ -133,12 +246,17 @@ float Volume::getSampleNearestNeighbourInterpolation(const glm::vec3& coord) con
     return getVoxel(roundToPositiveInt(coord.x), roundToPositiveInt(coord.y), roundToPositiveInt(coord.z));
 }
 
-// ======= TODO : IMPLEMENT the functions below for tri-linear interpolation ========
-// ======= Consider using the linearInterpolate and biLinearInterpolate functions ===
 // This function returns the trilinear interpolated value at the continuous 3D position given by coord.
 float Volume::getSampleTriLinearInterpolation(const glm::vec3& coord) const
 {
-    return 0.0f;
+    // values are only defined between the outermost voxels
+    if (glm::any(glm::lessThan(coord, glm::vec3(0))) || glm::any(glm::greaterThan(coord, glm::vec3(m_dim - 1))))
+        return 0.0f;
+
+    // the last voxel of an axis is interpolated with itself
+    const int z0 = static_cast<int>(coord.z);
+    const int z1 = std::min(z0 + 1, m_dim.z - 1);
+    return linearInterpolate(biLinearInterpolate(glm::vec2(coord), z0), biLinearInterpolate(glm::vec2(coord), z1), coord.z - float(z0));
 }
 
 // This function linearly interpolates the value at X using incoming values g0 and g1 given a factor (equal to the positon of x in 1D)
@@ -147,42 +265,179 @@ float Volume::getSampleTriLinearInterpolation(const glm::vec3& coord) const
 //   factor
 float Volume::linearInterpolate(float g0, float g1, float factor)
 {
-    return 0.0f;
+    return g0 + factor * (g1 - g0);
 }
 
 // This function bi-linearly interpolates the value at the given continuous 2D XY coordinate for a fixed integer z coordinate.
 float Volume::biLinearInterpolate(const glm::vec2& xyCoord, int z) const
 {
-    return 0.0f;
+    const int x0 = static_cast<int>(xyCoord.x);
+    const int y0 = static_cast<int>(xyCoord.y);
+    const int x1 = std::min(x0 + 1, m_dim.x - 1);
+    const int y1 = std::min(y0 + 1, m_dim.y - 1);
+    const float fx = xyCoord.x - float(x0);
+    const float bottom = linearInterpolate(getVoxel(x0, y0, z), getVoxel(x1, y0, z), fx);
+    const float top = linearInterpolate(getVoxel(x0, y1, z), getVoxel(x1, y1, z), fx);
+    return linearInterpolate(bottom, top, xyCoord.y - float(y0));
 }
 
 
-// ======= OPTIONAL : This functions can be used to implement cubic interpolation ========
+// Cubic interpolation uses the cubic B-spline, which is smooth (C2) unlike the interpolating Catmull-Rom kernel. The
+// B-spline does not pass through the voxels by itself, so it is applied to the prefiltered bsplineCoefficients().
 // This function represents the h(x) function, which returns the weight of the cubic interpolation kernel for a given position x
 float Volume::weight(float x)
 {
+    x = std::abs(x);
+    if (x < 1.0f)
+        return (4.0f - 6.0f * x * x + 3.0f * x * x * x) / 6.0f;
+    if (x < 2.0f)
+        return (2.0f - x) * (2.0f - x) * (2.0f - x) / 6.0f;
     return 0.0f;
 }
 
-// ======= OPTIONAL : This functions can be used to implement cubic interpolation ========
-// This functions returns the results of a cubic interpolation using 4 values and a factor
+// This functions returns the results of a cubic interpolation using 4 values and a factor, the values are the B-spline
+// coefficients at -1, 0, 1 and 2 and factor is the position in [0, 1)
 float Volume::cubicInterpolate(float g0, float g1, float g2, float g3, float factor)
 {
-    return 0.0f;
+    return g0 * weight(factor + 1.0f) + g1 * weight(factor) + g2 * weight(1.0f - factor) + g3 * weight(2.0f - factor);
 }
 
-// ======= OPTIONAL : This functions can be used to implement cubic interpolation ========
-// This function returns the value of a bicubic interpolation
+// This function returns the value of a bicubic interpolation of the B-spline coefficients at the given continuous 2D XY
+// coordinate for a fixed integer z coordinate, coefficients outside of the volume repeat the border.
 float Volume::biCubicInterpolate(const glm::vec2& xyCoord, int z) const
 {
-    return 0.0f;
+    const auto coefficients = bsplineCoefficients();
+    if (coefficients.empty())
+        return biLinearInterpolate(xyCoord, z);
+
+    const int x0 = static_cast<int>(std::floor(xyCoord.x));
+    const int y0 = static_cast<int>(std::floor(xyCoord.y));
+    const size_t slice = size_t(std::clamp(z, 0, m_dim.z - 1)) * size_t(m_dim.y);
+    auto coefficient = [&](int x, int y) {
+        return coefficients[size_t(std::clamp(x, 0, m_dim.x - 1)) + size_t(m_dim.x) * (size_t(std::clamp(y, 0, m_dim.y - 1)) + slice)];
+    };
+
+    std::array<float, 4> rows;
+    for (int i = 0; i < 4; i++) {
+        const int y = y0 - 1 + i;
+        rows[size_t(i)] = cubicInterpolate(coefficient(x0 - 1, y), coefficient(x0, y), coefficient(x0 + 1, y), coefficient(x0 + 2, y), xyCoord.x - float(x0));
+    }
+    return cubicInterpolate(rows[0], rows[1], rows[2], rows[3], xyCoord.y - float(y0));
 }
 
-// ======= OPTIONAL : This functions can be used to implement cubic interpolation ========
-// This function computes the tricubic interpolation at coord
+// This function computes the tricubic interpolation at coord. Instead of weighting the 64 coefficients around coord
+// separately, the two neighbouring coefficients with the weights w0, w1 (and w2, w3) of an axis are fetched with a
+// single linear interpolation at the position between them that weights them w0 : w1. This needs 8 trilinear lookups,
+// the same technique as sampleVolumeCubic() in the GPU shaders.
 float Volume::getSampleTriCubicInterpolation(const glm::vec3& coord) const
 {
-    return 0.0f;
+    // values are only defined between the outermost voxels
+    if (glm::any(glm::lessThan(coord, glm::vec3(0))) || glm::any(glm::greaterThan(coord, glm::vec3(m_dim - 1))))
+        return 0.0f;
+
+    const auto coefficients = bsplineCoefficients();
+    if (coefficients.empty())
+        return getSampleTriLinearInterpolation(coord);
+
+    // per axis the weights of the coefficient pairs (-1, 0) and (1, 2) and the positions of their linear lookups
+    struct AxisLookup {
+        float g0, g1, h0, h1;
+    };
+    auto axisLookup = [](float c) {
+        const float index = std::floor(c);
+        const float f = c - index;
+        const float w0 = (1.0f - f) * (1.0f - f) * (1.0f - f) / 6.0f;
+        const float w1 = (4.0f - 6.0f * f * f + 3.0f * f * f * f) / 6.0f;
+        const float w3 = f * f * f / 6.0f;
+        const float g0 = w0 + w1;
+        const float g1 = 1.0f - g0;
+        return AxisLookup { g0, g1, index - 1.0f + w1 / g0, index + 1.0f + w3 / g1 };
+    };
+    const AxisLookup x = axisLookup(coord.x);
+    const AxisLookup y = axisLookup(coord.y);
+    const AxisLookup z = axisLookup(coord.z);
+
+    auto lookup = [&](float px, float py, float pz) { return sampleCoefficientsLinear(coefficients, m_dim, glm::vec3(px, py, pz)); };
+    auto plane = [&](float pz) {
+        return y.g0 * (x.g0 * lookup(x.h0, y.h0, pz) + x.g1 * lookup(x.h1, y.h0, pz))
+            + y.g1 * (x.g0 * lookup(x.h0, y.h1, pz) + x.g1 * lookup(x.h1, y.h1, pz));
+    };
+    return z.g0 * plane(z.h0) + z.g1 * plane(z.h1);
+}
+
+// Value and gradient of the trilinear interpolant of the 2x2x2 voxels of the cell that contains coord, which lies within
+// the volume. With nearestValue the value is that of the nearest voxel instead.
+SampleGradient Volume::getSampleGradientTriLinear(const glm::vec3& coord, bool nearestValue) const
+{
+    const int x0 = static_cast<int>(coord.x);
+    const int y0 = static_cast<int>(coord.y);
+    const int z0 = static_cast<int>(coord.z);
+    const int x1 = std::min(x0 + 1, m_dim.x - 1);
+    const int y1 = std::min(y0 + 1, m_dim.y - 1);
+    const int z1 = std::min(z0 + 1, m_dim.z - 1);
+    const glm::vec3 f = coord - glm::vec3(x0, y0, z0);
+
+    // the corners along x for the (y, z) edges 00, 10, 01 and 11 of the cell
+    const std::array<float, 4> lower { getVoxel(x0, y0, z0), getVoxel(x0, y1, z0), getVoxel(x0, y0, z1), getVoxel(x0, y1, z1) };
+    const std::array<float, 4> upper { getVoxel(x1, y0, z0), getVoxel(x1, y1, z0), getVoxel(x1, y0, z1), getVoxel(x1, y1, z1) };
+    std::array<float, 4> edge;
+    for (size_t i = 0; i < 4; i++)
+        edge[i] = linearInterpolate(lower[i], upper[i], f.x);
+
+    const float z0Value = linearInterpolate(edge[0], edge[1], f.y);
+    const float z1Value = linearInterpolate(edge[2], edge[3], f.y);
+    const glm::vec3 gradient {
+        linearInterpolate(linearInterpolate(upper[0] - lower[0], upper[1] - lower[1], f.y), linearInterpolate(upper[2] - lower[2], upper[3] - lower[3], f.y), f.z),
+        linearInterpolate(edge[1] - edge[0], edge[3] - edge[2], f.z),
+        z1Value - z0Value
+    };
+    if (!nearestValue)
+        return { linearInterpolate(z0Value, z1Value, f.z), gradient };
+
+    const size_t nearest = (f.y >= 0.5f ? 1u : 0u) + (f.z >= 0.5f ? 2u : 0u);
+    return { f.x >= 0.5f ? upper[nearest] : lower[nearest], gradient };
+}
+
+// Value and gradient of the cubic B-spline from the 4x4x4 coefficients around coord, the separable weights and their
+// derivatives are applied to the same coefficients.
+SampleGradient Volume::getSampleGradientTriCubic(const glm::vec3& coord) const
+{
+    if (glm::any(glm::lessThan(coord, glm::vec3(0))) || glm::any(glm::greaterThan(coord, glm::vec3(m_dim - 1))))
+        return { 0.0f, glm::vec3(0.0f) };
+
+    const auto coefficients = bsplineCoefficients();
+    if (coefficients.empty())
+        return getSampleGradientTriLinear(coord, false);
+
+    const glm::ivec3 index = glm::ivec3(glm::floor(coord));
+    std::array<glm::vec4, 3> weights, derivatives;
+    for (int axis = 0; axis < 3; axis++) {
+        const float f = coord[axis] - float(index[axis]);
+        weights[size_t(axis)] = glm::vec4((1.0f - f) * (1.0f - f) * (1.0f - f), 4.0f - 6.0f * f * f + 3.0f * f * f * f, 1.0f + 3.0f * f + 3.0f * f * f - 3.0f * f * f * f, f * f * f) / 6.0f;
+        derivatives[size_t(axis)] = glm::vec4(-0.5f * (1.0f - f) * (1.0f - f), 1.5f * f * f - 2.0f * f, 0.5f + f - 1.5f * f * f, 0.5f * f * f);
+    }
+
+    std::array<size_t, 4> xOffsets;
+    for (int i = 0; i < 4; i++)
+        xOffsets[size_t(i)] = size_t(std::clamp(index.x - 1 + i, 0, m_dim.x - 1));
+
+    SampleGradient sample { 0.0f, glm::vec3(0.0f) };
+    for (int k = 0; k < 4; k++) {
+        const size_t z = size_t(std::clamp(index.z - 1 + k, 0, m_dim.z - 1));
+        for (int j = 0; j < 4; j++) {
+            const size_t y = size_t(std::clamp(index.y - 1 + j, 0, m_dim.y - 1));
+            const float* pRow = coefficients.data() + size_t(m_dim.x) * (y + size_t(m_dim.y) * z);
+            float row = 0.0f, rowDerivative = 0.0f;
+            for (size_t i = 0; i < 4; i++) {
+                row += weights[0][int(i)] * pRow[xOffsets[i]];
+                rowDerivative += derivatives[0][int(i)] * pRow[xOffsets[i]];
+            }
+            const float wy = weights[1][j], wz = weights[2][k];
+            sample.value += wy * wz * row;
+            sample.gradient += glm::vec3(wy * wz * rowDerivative, derivatives[1][j] * wz * row, wy * derivatives[2][k] * row);
+        }
+    }
+    return sample;
 }
 
 // Load an fld volume data file
@@ -194,23 +449,14 @@ void Volume::loadFile(const std::filesystem::path& file)
     assert(ifs.is_open());
 
 
-    // Normalize file extension to lowercase
-    std::string extension = file.extension().string();
-    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
-
     // Check file type
-    if (extension == ".fld") {
-        m_dataType = VolumeType::Volume;
-        m_fileExtension = FileExtension::FLD;
-    }
-    else if (extension == ".dat") {
-        m_dataType = VolumeType::Volume;
-        m_fileExtension = FileExtension::DAT;
-    }
-    else {
-        std::cerr << "Unsupported file extension: " << extension << "\n";
+    const auto optExtension = parseFileExtension(file);
+    if (!optExtension) {
+        std::cerr << "Unsupported file extension: " << file.extension().string() << "\n";
         return;
     }
+    m_dataType = VolumeType::Volume;
+    m_fileExtension = *optExtension;
 
     const auto header = readHeader(ifs, m_dataType, m_fileExtension);
     m_dim = header.dim;
@@ -247,93 +493,99 @@ void Volume::loadVolumeData(std::ifstream& ifs)
     }
 }
 
-void Volume::loadVectorFieldData()
+// Every slice of the vector field is a separate file of raw floats (name.00000.dat, name.00001.dat, ...). The files are
+// memory mapped and copied straight into m_data by a bounded number of threads, so a few hundred files are read
+// concurrently without flooding the disk with requests. The x and y swap of the hurricane dataset is done while copying.
+// Returns false and leaves no data behind when any of the slices can not be read.
+bool Volume::loadVectorFieldData()
 {
+    util::ScopedTimer timer("Volume::loadVectorFieldData", "load");
     const size_t voxelCount = static_cast<size_t>(m_dim.x * m_dim.y * m_elementSize);
     const size_t byteCount = voxelCount * sizeof(float);
 
-    auto readDataFromFile = [&](const std::filesystem::path& filePath, size_t offset) {
-        assert(std::filesystem::exists(filePath));
+    std::filesystem::path filePath(m_fileName);
+    const std::string fileNameWithoutExt = filePath.stem().string();
+    // The hurricane dataset has flipped x and y components. For simplicity we change these here.
+    const bool flipXY = m_dim.z > 1 && fileNameWithoutExt == "hurricane_p_tc";
 
-        std::ifstream ifs(filePath, std::ios::binary);
-        assert(ifs.is_open());
-
-        std::vector<char> buffer(byteCount);
-        ifs.read(buffer.data(), std::streamsize(byteCount));
-        if (ifs.gcount() != byteCount) {
+    auto readDataFromFile = [&](const std::filesystem::path& slicePath, size_t offset) {
+        const util::MappedFile file(slicePath);
+        if (!file.isOpen()) {
+            std::cerr << "Error: Cannot read " << slicePath.string() << std::endl;
+            return false;
+        }
+        if (file.data().size() < byteCount) {
             std::cerr << "Error: File size mismatch!" << std::endl;
             return false;
         }
-        ifs.close();
 
-        for (size_t i = 0; i < buffer.size(); i += 4) {
-            float value;
-            std::memcpy(&value, &buffer[i], sizeof(float)); // Convert bytes to float
-            m_data[offset++] = value; // Update m_data with the correct index
+        float* pDestination = m_data.data() + offset;
+        if (flipXY) {
+            flipXYVectorField(file.data().data(), pDestination, voxelCount);
+        } else {
+            std::memcpy(pDestination, file.data().data(), byteCount);
         }
-
         return true;
     };
 
+    bool success = true;
     if (m_dim.z == 1) {
         m_data.resize(voxelCount);
-
-        std::filesystem::path filePath(m_fileName);
         filePath.replace_extension(".dat");
-
-        size_t index = 0;
-        // Use the lambda to read the data from the file
-        if (!readDataFromFile(filePath, index)) {
-            return;
-        }
-
+        success = readDataFromFile(filePath, 0);
     } else {
         m_data.resize(voxelCount * m_dim.z);
 
-        std::filesystem::path filePath(m_fileName);
-        std::string fileNameWithoutExt = filePath.stem().string();
-
-        /*#pragma omp parallel for*/
-        for (int i=0;i<m_dim.z;i++) {
-
+        // More reads in flight than this only queue up in the OS. A failed slice can not be returned from within the
+        // parallel loop, so it is flagged and the field is discarded after the loop.
+        constexpr int maxConcurrentReads = 8;
+        std::atomic<bool> failed { false };
+#pragma omp parallel for num_threads(maxConcurrentReads) schedule(dynamic)
+        for (int i = 0; i < m_dim.z; i++) {
             // Create the new filename with number in between
             std::ostringstream newFileName;
-            newFileName << fileNameWithoutExt << "." << std::setw(5) << std::setfill('0') << i; // name
-
-            // Replace the extension with ".dat"
-            filePath.replace_extension(".dat");
-
-            // Combine the new file name with the ".dat" extension
-            filePath.replace_filename(newFileName.str() + ".dat");
-
-            size_t index = i * voxelCount;
-            if (!readDataFromFile(filePath, index)) {
-                continue;
-            }
-        }
-
-        // The hurricane dataset has flipped x and y components. For simplicity we change these here.
-        if(fileNameWithoutExt == "hurricane_p_tc") {
-            flipXYVectorField();
+            newFileName << fileNameWithoutExt << "." << std::setw(5) << std::setfill('0') << i << ".dat";
+            if (!readDataFromFile(filePath.parent_path() / newFileName.str(), size_t(i) * voxelCount))
+                failed = true;
         }
+        success = !failed;
     }
+
+    if (!success)
+        m_data.clear();
+    return success;
 }
 
-void Volume::flipXYVectorField()
+// Copies count floats of vectors with m_elementSize components and swaps the first two components of every vector.
+// The source does not have to be aligned for floats. Chunks are swapped right after copying them while they are still
+// in the L1 cache, so the data only passes through memory once.
+void Volume::flipXYVectorField(const std::byte* pSource, float* pDestination, size_t count) const
 {
-    const size_t voxelCount = static_cast<size_t>(m_dim.x * m_dim.y * m_dim.z* m_elementSize);
-    for(size_t i = 0; i < voxelCount; i += m_elementSize)
-    {
-        float x = m_data[i];
-        float y = m_data[i+1];
-
-        m_data[i]   = y;
-        m_data[i+1] = x;
+    const size_t chunkSize = std::max(size_t(4096) / m_elementSize, size_t(1)) * m_elementSize;
+    for (size_t chunkBegin = 0; chunkBegin < count; chunkBegin += chunkSize) {
+        const size_t chunkEnd = std::min(chunkBegin + chunkSize, count);
+        std::memcpy(pDestination + chunkBegin, pSource + chunkBegin * sizeof(float), (chunkEnd - chunkBegin) * sizeof(float));
+        for (size_t i = chunkBegin; i + 1 < chunkEnd; i += m_elementSize)
+            std::swap(pDestination[i], pDestination[i + 1]);
     }
 }
 
 }
 
+
+static std::optional<volume::FileExtension> parseFileExtension(const std::filesystem::path& file)
+{
+    // Normalize file extension to lowercase
+    std::string extension = file.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    if (extension == ".fld")
+        return volume::FileExtension::FLD;
+    else if (extension == ".dat")
+        return volume::FileExtension::DAT;
+    return {};
+}
+
 static Header readHeader(std::ifstream& ifs, const volume::VolumeType& dataType, const volume::FileExtension& fileExtension)
 {
     if (fileExtension == volume::FileExtension::FLD) return readVolumeHeader_fld(ifs);
@@ -464,3 +716,89 @@ static std::vector<int> computeHistogram(gsl::span<const float> data)
         histogram[v]++;
     return histogram;
 }
+
+// Cubic B-spline prefilter of Unser et al.: a causal followed by an anticausal first order recursive filter with the pole
+// sqrt(3) - 2. It is applied to `lanes` neighbouring lines of `length` samples that are `stride` apart, in place. The
+// lines are mirrored at both ends (without repeating the end sample), the causal initial value sums the mirrored line
+// exactly for short lines and is truncated where the powers of the pole drop below float precision otherwise.
+static void prefilterBSplineLines(float* pFirst, int length, size_t stride, int lanes)
+{
+    if (length < 2)
+        return;
+
+    constexpr float pole = -0.267949192431123f;
+    constexpr float gain = 6.0f; // (1 - pole) * (1 - 1 / pole)
+    constexpr int horizon = 14; // |pole|^14 < 1e-8
+    auto row = [&](int k) { return pFirst + size_t(k) * stride; };
+
+    for (int k = 0; k < length; k++) {
+        float* pRow = row(k);
+        for (int lane = 0; lane < lanes; lane++)
+            pRow[lane] *= gain;
+    }
+
+    float* pRow0 = row(0);
+    if (length > horizon) {
+        float zn = pole;
+        for (int k = 1; k < horizon; k++, zn *= pole) {
+            const float* pRow = row(k);
+            for (int lane = 0; lane < lanes; lane++)
+                pRow0[lane] += zn * pRow[lane];
+        }
+    } else {
+        const float normalization = 1.0f / (1.0f - std::pow(pole, float(2 * length - 2)));
+        for (int lane = 0; lane < lanes; lane++)
+            pRow0[lane] *= normalization;
+        for (int k = 1; k < length; k++) {
+            const float mirrored = k < length - 1 ? std::pow(pole, float(2 * length - 2 - k)) : 0.0f;
+            const float w = (std::pow(pole, float(k)) + mirrored) * normalization;
+            const float* pRow = row(k);
+            for (int lane = 0; lane < lanes; lane++)
+                pRow0[lane] += w * pRow[lane];
+        }
+    }
+
+    for (int k = 1; k < length; k++) {
+        float* pRow = row(k);
+        const float* pPrevious = row(k - 1);
+        for (int lane = 0; lane < lanes; lane++)
+            pRow[lane] += pole * pPrevious[lane];
+    }
+
+    float* pLast = row(length - 1);
+    const float* pBeforeLast = row(length - 2);
+    for (int lane = 0; lane < lanes; lane++)
+        pLast[lane] = pole / (pole * pole - 1.0f) * (pole * pBeforeLast[lane] + pLast[lane]);
+    for (int k = length - 2; k >= 0; k--) {
+        float* pRow = row(k);
+        const float* pNext = row(k + 1);
+        for (int lane = 0; lane < lanes; lane++)
+            pRow[lane] = pole * (pNext[lane] - pRow[lane]);
+    }
+}
+
+// Trilinear interpolation of the B-spline coefficients, positions outside of the volume are clamped to the border like
+// a texture with GL_CLAMP_TO_EDGE.
+static float sampleCoefficientsLinear(gsl::span<const float> coefficients, const glm::ivec3& dim, const glm::vec3& position)
+{
+    const float px = std::clamp(position.x, 0.0f, float(dim.x - 1));
+    const float py = std::clamp(position.y, 0.0f, float(dim.y - 1));
+    const float pz = std::clamp(position.z, 0.0f, float(dim.z - 1));
+    const int x0 = static_cast<int>(px);
+    const int y0 = static_cast<int>(py);
+    const int z0 = static_cast<int>(pz);
+    const size_t dx = x0 + 1 < dim.x ? 1 : 0;
+    const size_t dy = y0 + 1 < dim.y ? size_t(dim.x) : 0;
+    const size_t dz = z0 + 1 < dim.z ? size_t(dim.x) * size_t(dim.y) : 0;
+    const float fx = px - float(x0);
+    const float fy = py - float(y0);
+    const float fz = pz - float(z0);
+
+    const float* p = coefficients.data() + size_t(x0) + size_t(dim.x) * (size_t(y0) + size_t(dim.y) * size_t(z0));
+    auto lerp = [](float a, float b, float t) { return a + t * (b - a); };
+    const float c00 = lerp(p[0], p[dx], fx);
+    const float c10 = lerp(p[dy], p[dy + dx], fx);
+    const float c01 = lerp(p[dz], p[dz + dx], fx);
+    const float c11 = lerp(p[dz + dy], p[dz + dy + dx], fx);
+    return lerp(lerp(c00, c10, fy), lerp(c01, c11, fy), fz);
+}
@@ -1,7 +1,12 @@
 #pragma once
+#include "brick_cache.h"
+#include <cstddef>
 #include <filesystem>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <gsl/span>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -22,27 +27,59 @@ enum class FileExtension {
     DAT = 1
 }; 
 
+// Layout of the voxel data in a volume file, used to stream it without loading it.
+struct VolumeFileInfo {
+    glm::ivec3 dim;
+    size_t elementSize;
+    std::streamoff dataOffset;
+};
+std::optional<VolumeFileInfo> readVolumeFileInfo(const std::filesystem::path& file);
+
+// Interpolated value and the gradient of the interpolant at the same position, the gradient is per voxel.
+struct SampleGradient {
+    float value;
+    glm::vec3 gradient;
+};
+
 class Volume {
 public:
     // DO NOT REMOVE
     InterpolationMode interpolationMode { InterpolationMode::NearestNeighbour };
 
 public:
-    Volume(const std::filesystem::path& file);
+    Volume(const std::filesystem::path& file, const OutOfCoreConfig& outOfCore = {});
     Volume(std::vector<float> data, const glm::ivec3& dim);
 
     float minimum() const;
     float maximum() const;
-    std::vector<int> histogram() const;
+    gsl::span<const int> histogram() const;
     glm::ivec3 dims() const;
     std::string_view fileName() const;
+    // Bytes per voxel in the file, volumes that are not loaded from a file count as 16 bit.
+    size_t elementSize() const;
 
     float getSampleInterpolate(const glm::vec3& coord) const;
+    // Value and gradient from a single fetch of the voxels around coord: the 2x2x2 voxels of the cell, or the 4x4x4 B-spline
+    // coefficients for cubic interpolation. Nearest neighbour takes the value of the nearest of the 8 voxels and the
+    // gradient of their trilinear interpolant. Both are 0 where getSampleInterpolate() is 0.
+    SampleGradient getSampleGradientInterpolate(const glm::vec3& coord) const;
     float getVoxel(int x, int y, int z) const;
-    std::vector<float> getData() const;
+    // Views into the volume, valid as long as the volume exists.
+    gsl::span<const float> getData() const;
+    // Computes what interpolationMode needs before sampling, call it whenever the mode changes: cubic interpolation
+    // needs the B-spline coefficients. Samples are taken in parallel, so they only ever read what was computed here.
+    void updateInterpolation();
+    // Coefficients of the cubic B-spline that interpolates the voxels, cubic samples are taken from these instead of the
+    // voxels. Empty until cubic interpolation is first selected and for out-of-core volumes, cubic samples fall back
+    // to linear interpolation then.
+    gsl::span<const float> bsplineCoefficients() const;
 
     VolumeType getVolumeType() const;
 
+    // Out-of-core volumes keep no voxel data in memory, getData() is empty and voxels are fetched from the brick cache.
+    bool isOutOfCore() const;
+    std::shared_ptr<BrickCache> brickCache() const;
+
 protected:
     float getSampleNearestNeighbourInterpolation(const glm::vec3& coord) const;
 
@@ -55,12 +92,15 @@ protected:
     static float cubicInterpolate(float g0, float g1, float g2, float g3, float factor);
     static float weight(float x);
 
+    SampleGradient getSampleGradientTriLinear(const glm::vec3& coord, bool nearestValue) const;
+    SampleGradient getSampleGradientTriCubic(const glm::vec3& coord) const;
+
 private:
     void loadFile(const std::filesystem::path& file);
 
     void loadVolumeData(std::ifstream& ifs);
-    void loadVectorFieldData();
-    void flipXYVectorField();
+    bool loadVectorFieldData();
+    void flipXYVectorField(const std::byte* pSource, float* pDestination, size_t count) const;
 
 protected:
     VolumeType m_dataType;
@@ -71,8 +111,11 @@ protected:
     glm::ivec3 m_dim;
 
     std::vector<float> m_data; // technically the data is uint16_t but float is easier to work with
+    std::shared_ptr<BrickCache> m_pBrickCache;
 
     float m_minimum, m_maximum;
     std::vector<int> m_histogram;
+
+    std::vector<float> m_bsplineCoefficients;
 };
 }
@@ -0,0 +1,111 @@
+#include "volume_pyramid.h"
+#include "util/trace.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/common.hpp>
+#include <glm/gtx/component_wise.hpp>
+
+namespace volume {
+
+// Average blocks of factor^3 voxels. Blocks at the border of the volume only average the voxels inside it.
+static std::unique_ptr<Volume> downsample(const Volume& source, int factor)
+{
+    const glm::ivec3 sourceDim = source.dims();
+    const glm::ivec3 dim = glm::max((sourceDim + factor - 1) / factor, glm::ivec3(1));
+
+    std::vector<float> data(size_t(dim.x) * size_t(dim.y) * size_t(dim.z));
+#pragma omp parallel for
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++) {
+                const glm::ivec3 begin = glm::ivec3(x, y, z) * factor;
+                const glm::ivec3 end = glm::min(begin + factor, sourceDim);
+
+                float sum = 0.0f;
+                for (int sz = begin.z; sz < end.z; sz++) {
+                    for (int sy = begin.y; sy < end.y; sy++) {
+                        for (int sx = begin.x; sx < end.x; sx++)
+                            sum += source.getVoxel(sx, sy, sz);
+                    }
+                }
+                const glm::ivec3 count = end - begin;
+                data[size_t(x) + size_t(dim.x) * (size_t(y) + size_t(dim.y) * size_t(z))] = sum / float(count.x * count.y * count.z);
+            }
+        }
+    }
+    return std::make_unique<Volume>(std::move(data), dim);
+}
+
+VolumePyramid::VolumePyramid(const Volume& volume, const GradientVolume& gradientVolume, int minLevelDimension)
+    : m_pVolume(&volume)
+    , m_pGradientVolume(&gradientVolume)
+{
+    util::ScopedTimer timer("VolumePyramid::VolumePyramid", "load");
+
+    // A level takes one float for the value and a vec4 for the gradient per voxel.
+    constexpr size_t bytesPerVoxel = sizeof(float) + sizeof(GradientVoxel);
+    const auto pBrickCache = volume.brickCache();
+
+    const Volume* pPrevious = &volume;
+    int previousLevel = 0;
+    for (glm::ivec3 dim = volume.dims(); glm::compMax(dim) / 2 >= minLevelDimension;) {
+        dim = glm::max((dim + 1) / 2, glm::ivec3(1));
+        const int level = int(m_levels.size()) + 1;
+
+        // Levels of an out-of-core volume that do not fit in its memory budget are skipped. The first level that fits
+        // is averaged directly from the bricks.
+        const size_t levelBytes = size_t(dim.x) * size_t(dim.y) * size_t(dim.z) * bytesPerVoxel;
+        if (pBrickCache && levelBytes > pBrickCache->memoryBudget()) {
+            m_levels.emplace_back();
+            m_gradientLevels.emplace_back();
+            continue;
+        }
+
+        m_levels.push_back(downsample(*pPrevious, 1 << (level - previousLevel)));
+        m_gradientLevels.push_back(std::make_unique<GradientVolume>(*m_levels.back()));
+        pPrevious = m_levels.back().get();
+        previousLevel = level;
+    }
+}
+
+int VolumePyramid::numLevels() const
+{
+    return int(m_levels.size()) + 1;
+}
+
+bool VolumePyramid::hasLevel(int level) const
+{
+    return level == 0 || (level > 0 && level < numLevels() && m_levels[size_t(level - 1)]);
+}
+
+const Volume& VolumePyramid::level(int level) const
+{
+    return level == 0 ? *m_pVolume : *m_levels[size_t(level - 1)];
+}
+
+const GradientVolume& VolumePyramid::gradientLevel(int level) const
+{
+    return level == 0 ? *m_pGradientVolume : *m_gradientLevels[size_t(level - 1)];
+}
+
+float VolumePyramid::levelScale(int level)
+{
+    return float(1 << level);
+}
+
+// Voxel i of a level is centered at i * 2^L + (2^L - 1) / 2 in level 0 voxels.
+glm::vec3 VolumePyramid::toLevelCoordinate(const glm::vec3& coord, int level)
+{
+    const float scale = levelScale(level);
+    return (coord - 0.5f * (scale - 1.0f)) / scale;
+}
+
+int VolumePyramid::selectLevel(float pixelSize, float bias) const
+{
+    const float idealLevel = std::floor(std::log2(std::max(pixelSize, 1e-6f)) + bias);
+    int level = std::clamp(int(idealLevel), 0, numLevels() - 1);
+    while (!hasLevel(level))
+        level--;
+    return level;
+}
+}
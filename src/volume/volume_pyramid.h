@@ -0,0 +1,39 @@
+#pragma once
+#include "gradient_volume.h"
+#include "volume.h"
+#include <glm/vec3.hpp>
+#include <memory>
+#include <vector>
+
+namespace volume {
+
+// Mip-mapped pyramid of a volume. Level 0 is the volume itself and every next level halves the resolution by averaging
+// blocks of 2x2x2 voxels, so voxel i of level L covers voxels [i * 2^L, (i + 1) * 2^L) of level 0.
+// Out-of-core volumes only get the levels that fit in the memory budget of their brick cache.
+class VolumePyramid {
+public:
+    VolumePyramid(const Volume& volume, const GradientVolume& gradientVolume, int minLevelDimension = 8);
+
+    int numLevels() const;
+    bool hasLevel(int level) const;
+    const Volume& level(int level) const;
+    const GradientVolume& gradientLevel(int level) const;
+
+    // Size of a voxel of the given level in level 0 voxels.
+    static float levelScale(int level);
+    // Convert a coordinate in the voxel space of level 0 to the voxel space of the given level.
+    static glm::vec3 toLevelCoordinate(const glm::vec3& coord, int level);
+
+    // Pick the level whose voxels are about the size of a pixel. pixelSize is the size of a pixel in level 0 voxels,
+    // a positive bias selects coarser levels. Levels that were not built fall back to the next finer level.
+    int selectLevel(float pixelSize, float bias = 0.0f) const;
+
+private:
+    const Volume* m_pVolume;
+    const GradientVolume* m_pGradientVolume;
+
+    // Levels 1 and up, entries are empty for levels that were skipped.
+    std::vector<std::unique_ptr<Volume>> m_levels;
+    std::vector<std::unique_ptr<GradientVolume>> m_gradientLevels;
+};
+}